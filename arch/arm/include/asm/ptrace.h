@@ -195,6 +195,7 @@ static inline long regs_return_value(struct pt_regs *regs)
 }
 
 #define instruction_pointer(regs)	(regs)->ARM_pc
+#define user_stack_pointer(regs)	(regs)->ARM_sp
 
 #ifdef CONFIG_SMP
 extern unsigned long profile_pc(struct pt_regs *regs);
@@ -404,6 +404,12 @@
 #define __NR_setns			(__NR_SYSCALL_BASE+375)
 #define __NR_process_vm_readv		(__NR_SYSCALL_BASE+376)
 #define __NR_process_vm_writev		(__NR_SYSCALL_BASE+377)
+/*
+ * Not an upstream syscall.  It is numbered well clear of the upstream
+ * range, so that syscalls wired up from newer kernels (kcmp is 378)
+ * keep their numbers.
+ */
+#define __NR_getdents_stat		(__NR_SYSCALL_BASE+500)
 
 /*
  * The following SWIs are ARM private.
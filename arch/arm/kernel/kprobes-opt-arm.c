@@ -0,0 +1,324 @@
+/*
+ * arch/arm/kernel/kprobes-opt-arm.c
+ *
+ * Kprobes jump optimization for ARM.
+ *
+ * An optimized kprobe replaces the probed instruction with a branch to a
+ * detour buffer instead of a breakpoint.  The detour saves the registers
+ * as a struct pt_regs on the stack, calls the pre-handlers, simulates the
+ * probed instruction on the saved registers and returns to wherever the
+ * instruction left the pc.  That costs a few dozen instructions where the
+ * breakpoint costs an undefined instruction exception.
+ *
+ * Only ARM kernels are handled; a Thumb-2 kernel keeps using breakpoints.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/bitops.h>
+#include <asm/cacheflush.h>
+#include <asm/opcodes.h>
+
+#include "kprobes.h"
+#include "insn.h"
+
+/* sizeof(struct pt_regs), which the template below hardcodes */
+#define OPTPROBE_REGS_SIZE	72
+
+/*
+ * The detour buffer.  The 'sub' and 'add' at the labels are rewritten for
+ * each probe with the room needed below sp: the saved registers plus
+ * whatever the probed instruction pushes, see optprobe_stack_space().
+ */
+asm (
+			".global optprobe_template_entry\n"
+			"optprobe_template_entry:\n"
+			".global optprobe_template_sub_sp\n"
+			"optprobe_template_sub_sp:\n"
+			"	sub	sp, sp, #0xff\n"
+			"	stmia	sp, {r0 - r14}\n"
+			".global optprobe_template_add_sp\n"
+			"optprobe_template_add_sp:\n"
+			"	add	r3, sp, #0xff\n"
+			"	str	r3, [sp, #52]\n"
+			"	mrs	r4, cpsr\n"
+			"	str	r4, [sp, #64]\n"
+			"	mov	r1, sp\n"
+			"	ldr	r0, 1f\n"
+			"	ldr	r2, 2f\n"
+			/*
+			 * AEABI requires an 8-bytes alignment stack. If
+			 * SP % 8 != 0 (SP % 4 == 0 should be ensured),
+			 * alloc more bytes here.
+			 */
+			"	and	r4, sp, #4\n"
+			"	sub	sp, sp, r4\n"
+#if __LINUX_ARM_ARCH__ >= 5
+			"	blx	r2\n"
+#else
+			"	mov	lr, pc\n"
+			"	mov	pc, r2\n"
+#endif
+			"	add	sp, sp, r4\n"
+			"	ldr	r1, [sp, #64]\n"
+			"	msr	cpsr_cxsf, r1\n"
+			"	ldmia	sp, {r0 - r15}\n"
+			".global optprobe_template_val\n"
+			"optprobe_template_val:\n"
+			"1:	.long 0\n"
+			".global optprobe_template_call\n"
+			"optprobe_template_call:\n"
+			"2:	.long 0\n"
+			".global optprobe_template_end\n"
+			"optprobe_template_end:\n");
+
+#define TMPL_IDX(label)						\
+	(&optprobe_template_##label - &optprobe_template_entry)
+#define TMPL_SUB_SP	TMPL_IDX(sub_sp)
+#define TMPL_ADD_SP	TMPL_IDX(add_sp)
+#define TMPL_VAL_IDX	TMPL_IDX(val)
+#define TMPL_CALL_IDX	TMPL_IDX(call)
+#define TMPL_END_IDX	TMPL_IDX(end)
+
+/*
+ * How far below sp the probed instruction may store, so that the detour
+ * can keep its saved registers clear of it: 'push {r4, lr}' at a
+ * function entry must not land on top of them.  Returns -1 when that is
+ * not known from the instruction alone.
+ */
+static int __kprobes optprobe_stack_space(kprobe_opcode_t insn)
+{
+	/* only accesses based on sp matter */
+	if (((insn >> 16) & 0xf) != 13)
+		return 0;
+
+	/* LDM/STM		cccc 100P USWL nnnn rrrr rrrr rrrr rrrr */
+	if ((insn & 0x0e000000) == 0x08000000) {
+		if (insn & ((1 << 20) | (1 << 23)))
+			return 0;	/* a load, or upwards */
+		return 4 * hweight16(insn & 0xffff);
+	}
+
+	/* LDR/STR(B)		cccc 01IP UBWL nnnn tttt iiii iiii iiii */
+	if ((insn & 0x0c000000) == 0x04000000) {
+		if (insn & (1 << 20))
+			return 0;
+		if (insn & (1 << 25))
+			return -1;	/* register offset */
+		if (insn & (1 << 23))
+			return 0;
+		return insn & 0xfff;
+	}
+
+	/* LDRH/STRH/LDRD/STRD	cccc 000P UIWL nnnn tttt iiii 1SH1 iiii */
+	if ((insn & 0x0e000090) == 0x00000090 && (insn & 0x60)) {
+		if ((insn & (1 << 20)) || (insn & 0x60) == 0x40)
+			return 0;	/* LDRH/LDRSB/LDRSH, or LDRD */
+		if (!(insn & (1 << 22)))
+			return -1;
+		if (insn & (1 << 23))
+			return 0;
+		return ((insn >> 4) & 0xf0) | (insn & 0xf);
+	}
+
+	/* LDC/STC		cccc 110P UNWL nnnn */
+	if ((insn & 0x0e000000) == 0x0c000000)
+		return (insn & (1 << 20)) ? 0 : -1;
+
+	return 0;
+}
+
+int __kprobes arch_prepared_optinsn(struct arch_optimized_insn *optinsn)
+{
+	return optinsn->insn != NULL;
+}
+
+/*
+ * In ARM ISA, kprobe opt always replace one instruction (4 bytes
+ * aligned and 4 bytes long). It is impossible to encounter another
+ * kprobe in the address range. So always return 0.
+ */
+int __kprobes arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	return 0;
+}
+
+/* Free optimized instruction slot */
+static void __kprobes
+__arch_remove_optimized_kprobe(struct optimized_kprobe *op, int dirty)
+{
+	if (op->optinsn.insn) {
+		free_optinsn_slot(op->optinsn.insn, dirty);
+		op->optinsn.insn = NULL;
+	}
+}
+
+static void __kprobes
+optimized_callback(struct optimized_kprobe *op, struct pt_regs *regs)
+{
+	unsigned long flags;
+	struct kprobe *p = &op->kp;
+	struct kprobe_ctlblk *kcb;
+
+	/* Save skipped registers */
+	regs->ARM_pc = (unsigned long)p->addr;
+	regs->ARM_ORIG_r0 = ~0UL;
+
+	local_irq_save(flags);
+	kcb = get_kprobe_ctlblk();
+
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(p);
+	} else {
+		__this_cpu_write(current_kprobe, p);
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(p, regs);
+		reset_current_kprobe();
+	}
+
+	/*
+	 * In each case, we must singlestep the replaced instruction.  The
+	 * branch here carries its condition, so it has already passed.
+	 */
+	p->ainsn.insn_singlestep(p, regs);
+
+	local_irq_restore(flags);
+}
+
+int __kprobes arch_prepare_optimized_kprobe(struct optimized_kprobe *op)
+{
+	struct kprobe *orig = &op->kp;
+	kprobe_opcode_t *code;
+	unsigned long stack_protect;
+	long offset;
+	int stack_space;
+
+	BUILD_BUG_ON(sizeof(struct pt_regs) != OPTPROBE_REGS_SIZE);
+
+	/*
+	 * 255 is the biggest imm can be used in 'sub sp, sp, #<imm>'
+	 * without a rotation.
+	 */
+	stack_space = optprobe_stack_space(orig->opcode);
+	if (stack_space < 0 || stack_space > 255 - OPTPROBE_REGS_SIZE)
+		return -EILSEQ;
+	stack_protect = OPTPROBE_REGS_SIZE + stack_space;
+
+	code = get_optinsn_slot();
+	if (!code)
+		return -ENOMEM;
+
+	/*
+	 * The probe branches to the detour with a 'b', whose signed 24 bit
+	 * word offset reaches 32MiB either way of pc + 8.
+	 */
+	offset = (long)code - ((long)orig->addr + 8);
+	if (offset < -0x2000000 || offset > 0x1fffffc) {
+		free_optinsn_slot(code, 0);
+		return -ERANGE;
+	}
+
+	/* Copy arch-dep-instance from template. */
+	memcpy(code, &optprobe_template_entry,
+	       TMPL_END_IDX * sizeof(kprobe_opcode_t));
+
+	/* Create a 'sub sp, sp, #<stack_protect>' */
+	code[TMPL_SUB_SP] = __opcode_to_mem_arm(0xe24dd000 | stack_protect);
+	/* Create a 'add r3, sp, #<stack_protect>' */
+	code[TMPL_ADD_SP] = __opcode_to_mem_arm(0xe28d3000 | stack_protect);
+
+	/* Set probe information */
+	code[TMPL_VAL_IDX] = (unsigned long)op;
+
+	/* Set probe function call */
+	code[TMPL_CALL_IDX] = (unsigned long)optimized_callback;
+
+	flush_icache_range((unsigned long)code,
+			   (unsigned long)(&code[TMPL_END_IDX]));
+
+	/* Set op->optinsn.insn means prepared. */
+	op->optinsn.insn = code;
+	return 0;
+}
+
+void __kprobes arch_optimize_kprobes(struct list_head *oplist)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		unsigned long insn, cond;
+
+		WARN_ON(kprobe_disabled(&op->kp));
+
+		/*
+		 * Backup instructions which will be replaced
+		 * by jump address
+		 */
+		memcpy(op->optinsn.copied_insn, op->kp.addr,
+		       RELATIVEJUMP_SIZE);
+
+		insn = arm_gen_branch((unsigned long)op->kp.addr,
+				      (unsigned long)op->optinsn.insn);
+		BUG_ON(insn == 0);
+
+		/*
+		 * Make it a conditional branch if the replaced instruction
+		 * is conditional; the unconditional space has no branch
+		 * to use, but nothing in it is conditional either.
+		 */
+		cond = op->kp.opcode & 0xf0000000;
+		if (cond == 0xf0000000)
+			cond = 0xe0000000;
+		insn = cond | (insn & 0x0fffffff);
+
+		/*
+		 * Similar to arch_disarm_kprobe, operations which
+		 * removing breakpoints must be wrapped by stop_machine
+		 * to avoid racing.
+		 */
+		kprobes_remove_breakpoint(op->kp.addr, insn);
+
+		list_del_init(&op->list);
+	}
+}
+
+void __kprobes arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	arch_arm_kprobe(&op->kp);
+}
+
+/*
+ * Recover original instructions and breakpoints from relative jumps.
+ * Caller must call with locking kprobe_mutex.
+ */
+void __kprobes arch_unoptimize_kprobes(struct list_head *oplist,
+				       struct list_head *done_list)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		arch_unoptimize_kprobe(op);
+		list_move(&op->list, done_list);
+	}
+}
+
+int __kprobes arch_within_optimized_kprobe(struct optimized_kprobe *op,
+					   unsigned long addr)
+{
+	return ((unsigned long)op->kp.addr <= addr &&
+		(unsigned long)op->kp.addr + RELATIVEJUMP_SIZE > addr);
+}
+
+void __kprobes arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	__arch_remove_optimized_kprobe(op, 1);
+}
@@ -155,6 +155,35 @@ void __kprobes arch_disarm_kprobe(struct kprobe *p)
 	stop_machine(__arch_disarm_kprobe, p, cpu_online_mask);
 }
 
+struct patch {
+	void *addr;
+	unsigned int insn;
+};
+
+static int __kprobes __kprobes_remove_breakpoint(void *data)
+{
+	struct patch *p = data;
+
+	__patch_text(p->addr, p->insn);
+
+	return 0;
+}
+
+/*
+ * Replace a breakpoint with another instruction, under stop_machine for
+ * the same reason as arch_disarm_kprobe().  Used to put the branch of an
+ * optimized kprobe in place.
+ */
+void __kprobes kprobes_remove_breakpoint(void *addr, unsigned int insn)
+{
+	struct patch p = {
+		.addr = addr,
+		.insn = insn,
+	};
+
+	stop_machine(__kprobes_remove_breakpoint, &p, cpu_online_mask);
+}
+
 void __kprobes arch_remove_kprobe(struct kprobe *p)
 {
 	if (p->ainsn.insn) {
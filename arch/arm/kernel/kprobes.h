@@ -52,6 +52,8 @@ enum kprobe_insn arm_kprobe_decode_insn(kprobe_opcode_t,
 
 void __init arm_kprobe_decode_init(void);
 
+void kprobes_remove_breakpoint(void *addr, unsigned int insn);
+
 extern kprobe_check_cc * const kprobe_condition_checks[16];
 
 
@@ -127,3 +127,17 @@ void flush_tlb_kernel_range(unsigned long start, unsigned long end)
 		local_flush_tlb_kernel_range(start, end);
 }
 
+
+/*
+ * Flush what reclaim left behind after clearing ptes of possibly many
+ * mms without flushing.  The cpus in @cpumask are interrupted only when
+ * TLB maintenance is not broadcast in hardware; otherwise a single
+ * inner shareable flush reaches them all.
+ */
+void arch_tlbbatch_flush(const struct cpumask *cpumask)
+{
+	if (tlb_ops_need_broadcast())
+		on_each_cpu_mask(cpumask, ipi_flush_tlb_all, NULL, 1);
+	else
+		local_flush_tlb_all();
+}
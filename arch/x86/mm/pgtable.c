@@ -47,25 +47,39 @@ static int __init setup_userpte(char *arg)
 }
 early_param("userpte", setup_userpte);
 
+/*
+ * With HAVE_RCU_TABLE_FREE (speculative page faults), page tables are
+ * freed after a grace period rather than with the pages they mapped.
+ */
+static inline void tlb_remove_pgtable(struct mmu_gather *tlb,
+				      struct page *page)
+{
+#ifdef CONFIG_HAVE_RCU_TABLE_FREE
+	tlb_remove_table(tlb, page);
+#else
+	tlb_remove_page(tlb, page);
+#endif
+}
+
 void ___pte_free_tlb(struct mmu_gather *tlb, struct page *pte)
 {
 	pgtable_page_dtor(pte);
 	paravirt_release_pte(page_to_pfn(pte));
-	tlb_remove_page(tlb, pte);
+	tlb_remove_pgtable(tlb, pte);
 }
 
 #if PAGETABLE_LEVELS > 2
 void ___pmd_free_tlb(struct mmu_gather *tlb, pmd_t *pmd)
 {
 	paravirt_release_pmd(__pa(pmd) >> PAGE_SHIFT);
-	tlb_remove_page(tlb, virt_to_page(pmd));
+	tlb_remove_pgtable(tlb, virt_to_page(pmd));
 }
 
 #if PAGETABLE_LEVELS > 3
 void ___pud_free_tlb(struct mmu_gather *tlb, pud_t *pud)
 {
 	paravirt_release_pud(__pa(pud) >> PAGE_SHIFT);
-	tlb_remove_page(tlb, virt_to_page(pud));
+	tlb_remove_pgtable(tlb, virt_to_page(pud));
 }
 #endif	/* PAGETABLE_LEVELS > 3 */
 #endif	/* PAGETABLE_LEVELS > 2 */
@@ -330,3 +330,24 @@ void flush_tlb_all(void)
 {
 	on_each_cpu(do_flush_tlb_all, NULL, 1);
 }
+
+static void do_flush_tlb_local(void *info)
+{
+	__flush_tlb();
+}
+
+/*
+ * Flush what reclaim left behind after clearing ptes of possibly many
+ * mms without flushing: a full flush of user entries on each cpu in
+ * @cpumask, one IPI per remote cpu for the whole batch.
+ */
+void arch_tlbbatch_flush(const struct cpumask *cpumask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, cpumask))
+		__flush_tlb();
+	if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids)
+		smp_call_function_many(cpumask, do_flush_tlb_local, NULL, 1);
+	put_cpu();
+}
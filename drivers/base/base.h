@@ -67,6 +67,8 @@ struct driver_private {
  * list soon.
  * @device - pointer back to the struct class that this structure is
  * associated with.
+ * @dead - set under the device lock when device_del() starts, so that an
+ *	asynchronous probe still queued for the device does not bind it.
  *
  * Nothing outside of the driver core should ever touch these fields.
  */
@@ -78,6 +80,7 @@ struct device_private {
 	struct list_head deferred_probe;
 	void *driver_data;
 	struct device *device;
+	bool dead;
 };
 #define to_device_private_parent(obj)	\
 	container_of(obj, struct device_private, knode_parent)
@@ -110,6 +113,8 @@ extern int bus_add_driver(struct device_driver *drv);
 extern void bus_remove_driver(struct device_driver *drv);
 
 extern void driver_detach(struct device_driver *drv);
+extern bool driver_allows_async_probing(struct device_driver *drv);
+extern void device_initial_probe(struct device *dev);
 extern int driver_probe_device(struct device_driver *drv, struct device *dev);
 extern void driver_deferred_probe_del(struct device *dev);
 static inline int driver_match_device(struct device_driver *drv,
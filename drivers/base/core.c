@@ -1164,6 +1164,14 @@ void device_del(struct device *dev)
 	struct device *parent = dev->parent;
 	struct class_interface *class_intf;
 
+	/*
+	 * Tell a queued asynchronous probe that the device is going away
+	 * before the bus and sysfs are torn down underneath it.
+	 */
+	device_lock(dev);
+	dev->p->dead = true;
+	device_unlock(dev);
+
 	/* Notify clients of device removal.  This call must come
 	 * before dpm_sysfs_remove().
 	 */
@@ -24,6 +24,7 @@
 #include <linux/wait.h>
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
+#include <linux/ktime.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -335,6 +336,23 @@ void wait_for_device_probe(void)
 }
 EXPORT_SYMBOL_GPL(wait_for_device_probe);
 
+static int really_probe_debug(struct device *dev, struct device_driver *drv)
+{
+	ktime_t calltime, rettime;
+	int ret;
+
+	/* Same format as the initcall lines, for scripts/bootgraph.pl */
+	printk(KERN_DEBUG "probe of %s @ %i\n", dev_name(dev),
+	       task_pid_nr(current));
+	calltime = ktime_get();
+	ret = really_probe(dev, drv);
+	rettime = ktime_get();
+	printk(KERN_DEBUG "probe of %s returned %d after %lld usecs\n",
+	       dev_name(dev), ret,
+	       (long long)ktime_to_us(ktime_sub(rettime, calltime)));
+	return ret;
+}
+
 /**
  * driver_probe_device - attempt to bind device & driver together
  * @drv: driver to bind a device to
@@ -358,37 +376,90 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 
 	pm_runtime_get_noresume(dev);
 	pm_runtime_barrier(dev);
-	ret = really_probe(dev, drv);
+	if (initcall_debug)
+		ret = really_probe_debug(dev, drv);
+	else
+		ret = really_probe(dev, drv);
 	pm_runtime_put_sync(dev);
 
 	return ret;
 }
 
-static int __device_attach(struct device_driver *drv, void *data)
+/**
+ * driver_allows_async_probing - may @drv be probed asynchronously
+ * @drv: driver.
+ *
+ * Only the initial binding after a device or a driver is registered (or a
+ * deferred probe is retried) is done asynchronously; binding requested by
+ * userspace always is synchronous.
+ */
+bool driver_allows_async_probing(struct device_driver *drv)
 {
-	struct device *dev = data;
+	return drv->probe_type == PROBE_PREFER_ASYNCHRONOUS;
+}
+
+struct device_attach_data {
+	struct device *dev;
+	/* if asynchronous drivers are told apart at all */
+	bool check_async;
+	/* if this pass binds the asynchronous drivers or the others */
+	bool want_async;
+	/* set when a matching asynchronous driver was seen */
+	bool have_async;
+};
+
+static int __device_attach_driver(struct device_driver *drv, void *_data)
+{
+	struct device_attach_data *data = _data;
+	struct device *dev = data->dev;
+	bool async_allowed;
 
 	if (!driver_match_device(drv, dev))
 		return 0;
 
+	async_allowed = driver_allows_async_probing(drv);
+	if (async_allowed)
+		data->have_async = true;
+
+	if (data->check_async && async_allowed != data->want_async)
+		return 0;
+
 	return driver_probe_device(drv, dev);
 }
 
-/**
- * device_attach - try to attach device to a driver.
- * @dev: device.
- *
- * Walk the list of drivers that the bus has and call
- * driver_probe_device() for each pair. If a compatible
- * pair is found, break out and return.
- *
- * Returns 1 if the device was bound to a driver;
- * 0 if no matching driver was found;
- * -ENODEV if the device is not registered.
- *
- * When called for a USB interface, @dev->parent lock must be held.
+/*
+ * The second pass of __device_attach(), over the asynchronous drivers only.
+ * It cannot be started for a particular driver right away, as the driver
+ * pointer is only valid while bus_for_each_drv() is at it.
  */
-int device_attach(struct device *dev)
+static void __device_attach_async_helper(void *_dev, async_cookie_t cookie)
+{
+	struct device *dev = _dev;
+	struct device_attach_data data = {
+		.dev		= dev,
+		.check_async	= true,
+		.want_async	= true,
+	};
+
+	if (dev->parent)	/* Needed for USB */
+		device_lock(dev->parent);
+	device_lock(dev);
+	/* device_del() may have started while the probe was queued */
+	if (!dev->p->dead && !dev->driver) {
+		pm_runtime_get_noresume(dev);
+		bus_for_each_drv(dev->bus, NULL, &data,
+				 __device_attach_driver);
+		pm_runtime_put_sync(dev);
+	}
+	device_unlock(dev);
+	if (dev->parent)
+		device_unlock(dev->parent);
+
+	dev_dbg(dev, "async probe completed\n");
+	put_device(dev);
+}
+
+static int __device_attach(struct device *dev, bool allow_async)
 {
 	int ret = 0;
 
@@ -406,16 +477,63 @@ int device_attach(struct device *dev)
 			ret = 0;
 		}
 	} else {
+		struct device_attach_data data = {
+			.dev		= dev,
+			.check_async	= allow_async,
+			.want_async	= false,
+		};
+
 		pm_runtime_get_noresume(dev);
-		ret = bus_for_each_drv(dev->bus, NULL, dev, __device_attach);
+		ret = bus_for_each_drv(dev->bus, NULL, &data,
+				       __device_attach_driver);
+		if (!ret && allow_async && data.have_async) {
+			/*
+			 * No synchronous driver took the device, but an
+			 * asynchronous one may.
+			 */
+			dev_dbg(dev, "scheduling asynchronous probe\n");
+			get_device(dev);
+			async_schedule(__device_attach_async_helper, dev);
+		}
 		pm_runtime_put_sync(dev);
 	}
 out_unlock:
 	device_unlock(dev);
 	return ret;
 }
+
+/**
+ * device_attach - try to attach device to a driver.
+ * @dev: device.
+ *
+ * Walk the list of drivers that the bus has and call
+ * driver_probe_device() for each pair. If a compatible
+ * pair is found, break out and return.
+ *
+ * Returns 1 if the device was bound to a driver;
+ * 0 if no matching driver was found;
+ * -ENODEV if the device is not registered.
+ *
+ * When called for a USB interface, @dev->parent lock must be held.
+ */
+int device_attach(struct device *dev)
+{
+	return __device_attach(dev, false);
+}
 EXPORT_SYMBOL_GPL(device_attach);
 
+/**
+ * device_initial_probe - attach a newly registered device to a driver.
+ * @dev: device.
+ *
+ * Like device_attach(), except that drivers preferring asynchronous probing
+ * are probed from an async thread.
+ */
+void device_initial_probe(struct device *dev)
+{
+	__device_attach(dev, true);
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -525,6 +643,10 @@ void driver_detach(struct device_driver *drv)
 	struct device_private *dev_prv;
 	struct device *dev;
 
+	/* Let probes still in flight finish before unbinding */
+	if (driver_allows_async_probing(drv))
+		async_synchronize_full();
+
 	for (;;) {
 		spin_lock(&drv->p->klist_devices.k_lock);
 		if (list_empty(&drv->p->klist_devices.k_list)) {
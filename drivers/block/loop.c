@@ -76,6 +76,11 @@
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
+#include <linux/mount.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include <asm/uaccess.h>
 
@@ -84,6 +89,7 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static int dio_queue_depth = 16;
 
 /*
  * Transfer functions
@@ -458,6 +464,189 @@ out:
 	return ret;
 }
 
+/*
+ * Direct I/O mode (LOOP_SET_DIRECT_IO): reads and writes go to an O_DIRECT
+ * open of the backing file, so the data is not cached a second time below
+ * the loop device, and loop_thread only hands them out to a workqueue that
+ * runs up to dio_queue_depth of them at once.  Discards, empty flushes and
+ * encrypted devices keep going through do_bio_filebacked().
+ */
+struct loop_dio {
+	struct work_struct	work;
+	struct loop_device	*lo;
+	struct file		*file;
+	struct bio		*bio;
+	struct iovec		iov[];	/* then bio_segments() page pointers */
+};
+
+static struct file *loop_open_dio(struct file *file)
+{
+	if (!file->f_op->aio_read || !file->f_op->aio_write)
+		return ERR_PTR(-EINVAL);
+
+	/* fails with -EINVAL if the backing file can't do O_DIRECT */
+	return dentry_open(dget(file->f_path.dentry), mntget(file->f_path.mnt),
+			   (file->f_flags & ~O_APPEND) | O_DIRECT,
+			   file->f_cred);
+}
+
+/*
+ * Map the bio's pages with vm_map_ram() and pass them down as a kernel
+ * iovec under KERNEL_DS, on a kiocb marked for direct-io.c to pin them
+ * by hand.
+ * Returns -EINVAL or -ENOMEM if the caller should fall back to buffered
+ * I/O: the backing device wants coarser alignment than the bio has, or
+ * there was no room to map it.
+ */
+static int lo_rw_dio(struct loop_device *lo, struct loop_dio *dio)
+{
+	struct bio *bio = dio->bio;
+	unsigned int nr = bio_segments(bio);
+	struct page **pages = (struct page **)(dio->iov + nr);
+	struct file *file = dio->file;
+	struct bio_vec *bvec;
+	struct kiocb kiocb;
+	mm_segment_t old_fs;
+	size_t skip, len = bio->bi_size;
+	loff_t pos;
+	ssize_t ret;
+	void *base;
+	int i, n;
+
+	pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+
+	n = 0;
+	bio_for_each_segment(bvec, bio, i)
+		pages[n++] = bvec->bv_page;
+	base = vm_map_ram(pages, nr, -1, PAGE_KERNEL);
+	if (!base)
+		return -ENOMEM;
+
+	n = 0;
+	bio_for_each_segment(bvec, bio, i) {
+		dio->iov[n].iov_base = base + n * PAGE_SIZE + bvec->bv_offset;
+		dio->iov[n].iov_len = bvec->bv_len;
+		n++;
+	}
+
+	init_sync_kiocb(&kiocb, file);
+	kiocbSetKernelPages(&kiocb);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = len;
+	kiocb.ki_nbytes = len;
+
+	old_fs = get_fs();
+	set_fs(get_ds());
+	if (bio_rw(bio) == WRITE) {
+		invalidate_kernel_vmap_range(base, nr << PAGE_SHIFT);
+		ret = file->f_op->aio_write(&kiocb, dio->iov, nr, pos);
+	} else {
+		ret = file->f_op->aio_read(&kiocb, dio->iov, nr, pos);
+	}
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	set_fs(old_fs);
+
+	if (bio_rw(bio) != WRITE) {
+		/* reads past the end of the backing file see zeroes */
+		if (ret >= 0 && ret < len) {
+			for (skip = ret, n = 0; n < nr; n++) {
+				if (skip < dio->iov[n].iov_len) {
+					memset(dio->iov[n].iov_base + skip, 0,
+					       dio->iov[n].iov_len - skip);
+					skip = 0;
+				} else {
+					skip -= dio->iov[n].iov_len;
+				}
+			}
+			ret = len;
+		}
+		flush_kernel_vmap_range(base, nr << PAGE_SHIFT);
+	}
+	vm_unmap_ram(base, nr);
+
+	if (ret == len)
+		return 0;
+	if (ret == -EINVAL)
+		return ret;
+	printk(KERN_ERR "loop: Direct %s error at byte offset %llu, length %zu.\n",
+			bio_rw(bio) == WRITE ? "write" : "read",
+			(unsigned long long)pos, len);
+	return ret < 0 ? ret : -EIO;
+}
+
+static int do_bio_dio(struct loop_device *lo, struct loop_dio *dio)
+{
+	struct bio *bio = dio->bio;
+	int ret;
+
+	if (bio->bi_rw & REQ_FLUSH) {
+		ret = vfs_fsync(dio->file, 0);
+		if (unlikely(ret && ret != -EINVAL))
+			return -EIO;
+	}
+
+	ret = lo_rw_dio(lo, dio);
+	if (ret == -EINVAL || ret == -ENOMEM)
+		return do_bio_filebacked(lo, bio);
+
+	if ((bio->bi_rw & REQ_FUA) && !ret) {
+		ret = vfs_fsync(dio->file, 0);
+		if (unlikely(ret && ret != -EINVAL))
+			ret = -EIO;
+		else
+			ret = 0;
+	}
+	return ret;
+}
+
+static void loop_dio_work(struct work_struct *work)
+{
+	struct loop_dio *dio = container_of(work, struct loop_dio, work);
+	struct bio *bio = dio->bio;
+	unsigned int noio_flags;
+	int ret;
+
+	/*
+	 * vm_map_ram(), direct-io.c and the backing filesystem allocate
+	 * with GFP_KERNEL: reclaim must not write back through this loop
+	 * device while it is busy with the bio.
+	 */
+	noio_flags = memalloc_noio_save();
+	ret = do_bio_dio(dio->lo, dio);
+	memalloc_noio_restore(noio_flags);
+	kfree(dio);
+	bio_endio(bio, ret);
+}
+
+/*
+ * Called from loop_thread: hand the bio to the direct I/O workqueue if it
+ * can go there.  Returns false if loop_thread should do it itself.
+ */
+static bool loop_queue_dio(struct loop_device *lo, struct bio *bio)
+{
+	struct file *file = ACCESS_ONCE(lo->lo_dio_file);
+	unsigned int nr = bio_segments(bio);
+	struct loop_dio *dio;
+
+	if (!file || lo->transfer != transfer_none || !nr ||
+	    (bio->bi_rw & REQ_DISCARD))
+		return false;
+	smp_rmb();	/* lo_dio_wq is set before lo_dio_file */
+
+	dio = kmalloc(sizeof(*dio) + nr * (sizeof(struct iovec) +
+					   sizeof(struct page *)), GFP_NOIO);
+	if (!dio)
+		return false;
+
+	INIT_WORK(&dio->work, loop_dio_work);
+	dio->lo = lo;
+	dio->file = file;
+	dio->bio = bio;
+	queue_work(lo->lo_dio_wq, &dio->work);
+	return true;
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -509,9 +698,12 @@ static void do_loop_switch(struct loop_device *, struct switch_request *);
 static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	if (unlikely(!bio->bi_bdev)) {
+		/* the switch also waits for direct I/O handed out before it */
+		if (lo->lo_dio_wq)
+			flush_workqueue(lo->lo_dio_wq);
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
-	} else {
+	} else if (!loop_queue_dio(lo, bio)) {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
 	}
@@ -607,6 +799,18 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 		mapping->host->i_bdev->bd_block_size : PAGE_SIZE;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
+
+	if (lo->lo_dio_file) {
+		struct file *dio_file = loop_open_dio(file);
+
+		fput(lo->lo_dio_file);
+		if (IS_ERR(dio_file)) {
+			lo->lo_dio_file = NULL;
+			lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		} else {
+			lo->lo_dio_file = dio_file;
+		}
+	}
 out:
 	complete(&p->wait);
 }
@@ -743,11 +947,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -755,6 +967,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -970,6 +1183,7 @@ loop_init_xfer(struct loop_device *lo, struct loop_func_table *xfer,
 static int loop_clr_fd(struct loop_device *lo)
 {
 	struct file *filp = lo->lo_backing_file;
+	struct file *dio_file = lo->lo_dio_file;
 	gfp_t gfp = lo->old_gfp_mask;
 	struct block_device *bdev = lo->lo_device;
 
@@ -988,8 +1202,15 @@ static int loop_clr_fd(struct loop_device *lo)
 
 	kthread_stop(lo->lo_thread);
 
+	/* waits for the direct I/O loop_thread handed out */
+	if (lo->lo_dio_wq) {
+		destroy_workqueue(lo->lo_dio_wq);
+		lo->lo_dio_wq = NULL;
+	}
+
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
+	lo->lo_dio_file = NULL;
 	spin_unlock_irq(&lo->lo_lock);
 
 	loop_release_xfer(lo);
@@ -1030,6 +1251,8 @@ static int loop_clr_fd(struct loop_device *lo)
 	 * bd_mutex which is usually taken before lo_ctl_mutex.
 	 */
 	fput(filp);
+	if (dio_file)
+		fput(dio_file);
 	return 0;
 }
 
@@ -1273,6 +1496,43 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	return err;
 }
 
+static int loop_set_dio(struct loop_device *lo, unsigned long arg)
+{
+	struct file *dio_file;
+
+	if (lo->lo_state != Lo_bound)
+		return -ENXIO;
+	if (!arg == !lo->lo_dio_file)
+		return 0;
+
+	if (!arg) {
+		dio_file = lo->lo_dio_file;
+		lo->lo_dio_file = NULL;
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		/* wait for the bios that are still using it */
+		loop_flush(lo);
+		fput(dio_file);
+		return 0;
+	}
+
+	if (!lo->lo_dio_wq) {
+		lo->lo_dio_wq = alloc_workqueue("loop%d-dio",
+						WQ_UNBOUND | WQ_MEM_RECLAIM,
+						dio_queue_depth, lo->lo_number);
+		if (!lo->lo_dio_wq)
+			return -ENOMEM;
+	}
+
+	dio_file = loop_open_dio(lo->lo_backing_file);
+	if (IS_ERR(dio_file))
+		return PTR_ERR(dio_file);
+
+	smp_wmb();	/* see loop_queue_dio() */
+	lo->lo_dio_file = dio_file;
+	lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	return 0;
+}
+
 static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 	unsigned int cmd, unsigned long arg)
 {
@@ -1316,6 +1576,11 @@ static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
 			err = loop_set_capacity(lo, bdev);
 		break;
+	case LOOP_SET_DIRECT_IO:
+		err = -EPERM;
+		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
+			err = loop_set_dio(lo, arg);
+		break;
 	default:
 		err = lo->ioctl ? lo->ioctl(lo, cmd, arg) : -EINVAL;
 	}
@@ -1470,6 +1735,7 @@ static int lo_compat_ioctl(struct block_device *bdev, fmode_t mode,
 		arg = (unsigned long) compat_ptr(arg);
 	case LOOP_SET_FD:
 	case LOOP_CHANGE_FD:
+	case LOOP_SET_DIRECT_IO:
 		err = lo_ioctl(bdev, mode, cmd, arg);
 		break;
 	default:
@@ -1550,6 +1816,8 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(dio_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(dio_queue_depth, "Direct I/O requests in flight per loop device");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
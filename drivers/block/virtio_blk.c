@@ -19,19 +19,56 @@ static DEFINE_IDA(vd_index_ida);
 
 struct workqueue_struct *virtblk_wq;
 
+/*
+ * Hand plain reads and writes to a virtqueue straight from
+ * ->make_request_fn, without going through the request queue, its
+ * elevator and q->queue_lock.  Flushes, SCSI commands and the id request
+ * still take the request queue.  Off by default: bios sent this way do
+ * not show up in the disk's I/O statistics.
+ */
+static bool use_bio;
+module_param(use_bio, bool, S_IRUGO);
+
+/* Number of request virtqueues to use; 0 means one per online cpu. */
+static unsigned int num_queues;
+module_param(num_queues, uint, S_IRUGO);
+
+struct virtio_blk_vq
+{
+	struct virtqueue *vq;
+
+	/* Protects vq and sg. */
+	spinlock_t lock;
+
+	/* Bio submitters waiting for room in vq. */
+	wait_queue_head_t wait;
+
+	/* Set, under lock, while vq is gone for suspend. */
+	bool frozen;
+
+	/* Buffers added to vq and not yet collected, under lock. */
+	unsigned int inflight;
+
+	char name[16];
+
+	/* Scatterlist: can be too big for stack. */
+	struct scatterlist *sg;
+};
+
 struct virtio_blk
 {
+	/* The request queue's lock; the virtqueues have their own. */
 	spinlock_t lock;
 
 	struct virtio_device *vdev;
-	struct virtqueue *vq;
+
+	/* Request virtqueues, one per cpu unless the host has fewer. */
+	struct virtio_blk_vq *vqs;
+	unsigned int nvqs;
 
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
 
-	/* Request tracking. */
-	struct list_head reqs;
-
 	mempool_t *pool;
 
 	/* Process context for config space updates */
@@ -48,67 +85,122 @@ struct virtio_blk
 
 	/* Ida index - used to track minor number allocations. */
 	int index;
-
-	/* Scatterlist: can be too big for stack. */
-	struct scatterlist sg[/*sg_elems*/];
 };
 
 struct virtblk_req
 {
 	struct list_head list;
+	/* One of these is set, depending on the path it was submitted on. */
 	struct request *req;
+	struct bio *bio;
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
 };
 
+static struct virtio_blk_vq *vq_to_bvq(struct virtio_blk *vblk,
+				       struct virtqueue *vq)
+{
+	unsigned int i;
+
+	for (i = 0; i < vblk->nvqs; i++)
+		if (vblk->vqs[i].vq == vq)
+			return &vblk->vqs[i];
+	BUG();
+	return NULL;
+}
+
+/*
+ * The virtqueue to submit on from this cpu.  Queue i has its interrupt
+ * hinted to cpu i, so with a queue per cpu requests complete where they
+ * were issued.
+ */
+static struct virtio_blk_vq *virtblk_this_vq(struct virtio_blk *vblk)
+{
+	return &vblk->vqs[raw_smp_processor_id() % vblk->nvqs];
+}
+
+static int virtblk_status_to_errno(u8 status)
+{
+	switch (status) {
+	case VIRTIO_BLK_S_OK:
+		return 0;
+	case VIRTIO_BLK_S_UNSUPP:
+		return -ENOTTY;
+	default:
+		return -EIO;
+	}
+}
+
 static void blk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
-	struct virtblk_req *vbr;
+	struct virtio_blk_vq *bvq = vq_to_bvq(vblk, vq);
+	struct request_queue *q = vblk->disk->queue;
+	struct virtblk_req *vbr, *tmp;
 	unsigned int len;
 	unsigned long flags;
+	bool reqs = false, frozen;
+	LIST_HEAD(done);
 
-	spin_lock_irqsave(&vblk->lock, flags);
-	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
-		int error;
-
-		switch (vbr->status) {
-		case VIRTIO_BLK_S_OK:
-			error = 0;
-			break;
-		case VIRTIO_BLK_S_UNSUPP:
-			error = -ENOTTY;
-			break;
-		default:
-			error = -EIO;
-			break;
-		}
-
-		switch (vbr->req->cmd_type) {
-		case REQ_TYPE_BLOCK_PC:
-			vbr->req->resid_len = vbr->in_hdr.residual;
-			vbr->req->sense_len = vbr->in_hdr.sense_len;
-			vbr->req->errors = vbr->in_hdr.errors;
-			break;
-		case REQ_TYPE_SPECIAL:
-			vbr->req->errors = (error != 0);
-			break;
-		default:
-			break;
-		}
+	/*
+	 * Only collect the buffers under the virtqueue lock: ending a request
+	 * takes q->queue_lock, which do_virtblk_request() holds when it takes
+	 * the virtqueue lock.
+	 */
+	spin_lock_irqsave(&bvq->lock, flags);
+	while ((vbr = virtqueue_get_buf(vq, &len)) != NULL) {
+		list_add_tail(&vbr->list, &done);
+		if (vbr->req)
+			reqs = true;
+		bvq->inflight--;
+	}
+	frozen = bvq->frozen;
+	spin_unlock_irqrestore(&bvq->lock, flags);
 
-		__blk_end_request_all(vbr->req, error);
+	list_for_each_entry_safe(vbr, tmp, &done, list) {
+		if (!vbr->bio)
+			continue;
 		list_del(&vbr->list);
+		bio_endio(vbr->bio, virtblk_status_to_errno(vbr->status));
 		mempool_free(vbr, vblk->pool);
 	}
-	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
-	spin_unlock_irqrestore(&vblk->lock, flags);
+
+	if (reqs || blk_queue_stopped(q)) {
+		spin_lock_irqsave(&vblk->lock, flags);
+		list_for_each_entry_safe(vbr, tmp, &done, list) {
+			int error = virtblk_status_to_errno(vbr->status);
+
+			switch (vbr->req->cmd_type) {
+			case REQ_TYPE_BLOCK_PC:
+				vbr->req->resid_len = vbr->in_hdr.residual;
+				vbr->req->sense_len = vbr->in_hdr.sense_len;
+				vbr->req->errors = vbr->in_hdr.errors;
+				break;
+			case REQ_TYPE_SPECIAL:
+				vbr->req->errors = (error != 0);
+				break;
+			default:
+				break;
+			}
+
+			__blk_end_request_all(vbr->req, error);
+			mempool_free(vbr, vblk->pool);
+		}
+		/* In case queue is stopped waiting for more buffers. */
+		if (!frozen)
+			blk_start_queue(q);
+		spin_unlock_irqrestore(&vblk->lock, flags);
+	}
+
+	/* Pairs with the prepare_to_wait() under bvq->lock, and wakes
+	   virtblk_freeze() draining the virtqueue. */
+	if (waitqueue_active(&bvq->wait))
+		wake_up(&bvq->wait);
 }
 
 static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+		   struct virtio_blk_vq *bvq, struct request *req)
 {
 	unsigned long num, out = 0, in = 0;
 	struct virtblk_req *vbr;
@@ -119,6 +211,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		return false;
 
 	vbr->req = req;
+	vbr->bio = NULL;
 
 	if (req->cmd_flags & REQ_FLUSH) {
 		vbr->out_hdr.type = VIRTIO_BLK_T_FLUSH;
@@ -147,7 +240,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	sg_set_buf(&vblk->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	sg_set_buf(&bvq->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
 
 	/*
 	 * If this is a packet command we need a couple of additional headers.
@@ -156,17 +249,17 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 	 * inhdr with additional status information before the normal inhdr.
 	 */
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC)
-		sg_set_buf(&vblk->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
+		sg_set_buf(&bvq->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
 
-	num = blk_rq_map_sg(q, vbr->req, vblk->sg + out);
+	num = blk_rq_map_sg(q, vbr->req, bvq->sg + out);
 
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC) {
-		sg_set_buf(&vblk->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
-		sg_set_buf(&vblk->sg[num + out + in++], &vbr->in_hdr,
+		sg_set_buf(&bvq->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
+		sg_set_buf(&bvq->sg[num + out + in++], &vbr->in_hdr,
 			   sizeof(vbr->in_hdr));
 	}
 
-	sg_set_buf(&vblk->sg[num + out + in++], &vbr->status,
+	sg_set_buf(&bvq->sg[num + out + in++], &vbr->status,
 		   sizeof(vbr->status));
 
 	if (num) {
@@ -179,27 +272,31 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr, GFP_ATOMIC)<0) {
+	if (virtqueue_add_buf(bvq->vq, bvq->sg, out, in, vbr, GFP_ATOMIC)<0) {
 		mempool_free(vbr, vblk->pool);
 		return false;
 	}
 
-	list_add_tail(&vbr->list, &vblk->reqs);
+	bvq->inflight++;
 	return true;
 }
 
 static void do_virtblk_request(struct request_queue *q)
 {
 	struct virtio_blk *vblk = q->queuedata;
+	struct virtio_blk_vq *bvq = virtblk_this_vq(vblk);
 	struct request *req;
 	unsigned int issued = 0;
 
+	spin_lock(&bvq->lock);
 	while ((req = blk_peek_request(q)) != NULL) {
 		BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
 
 		/* If this request fails, stop queue and wait for something to
-		   finish to restart it. */
-		if (!do_req(q, vblk, req)) {
+		   finish to restart it.  Stopping it under bvq->lock makes
+		   sure blk_done() on this virtqueue sees it stopped.  While
+		   frozen, it stays stopped until virtblk_restore(). */
+		if (bvq->frozen || !do_req(q, vblk, bvq, req)) {
 			blk_stop_queue(q);
 			break;
 		}
@@ -207,8 +304,114 @@ static void do_virtblk_request(struct request_queue *q)
 		issued++;
 	}
 
+	/* Under the lock, so virtblk_freeze() cannot delete vq under us */
 	if (issued)
-		virtqueue_kick(vblk->vq);
+		virtqueue_kick(bvq->vq);
+	spin_unlock(&bvq->lock);
+}
+
+/*
+ * blk_rq_map_sg() for a lone bio: merge the segments the way
+ * bio_add_page() counted them against the queue limits.
+ */
+static unsigned int virtblk_map_bio(struct request_queue *q, struct bio *bio,
+				    struct scatterlist *sglist)
+{
+	struct bio_vec *bvec, *bvprv = NULL;
+	struct scatterlist *sg = NULL;
+	unsigned int nsegs = 0;
+	int i;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvprv && blk_queue_cluster(q) &&
+		    sg->length + bvec->bv_len <= queue_max_segment_size(q) &&
+		    BIOVEC_PHYS_MERGEABLE(bvprv, bvec) &&
+		    BIOVEC_SEG_BOUNDARY(q, bvprv, bvec)) {
+			sg->length += bvec->bv_len;
+		} else {
+			sg = sg ? sg + 1 : sglist;
+			sg_set_page(sg, bvec->bv_page, bvec->bv_len,
+				    bvec->bv_offset);
+			nsegs++;
+		}
+		bvprv = bvec;
+	}
+
+	return nsegs;
+}
+
+static bool virtblk_add_bio(struct virtio_blk *vblk, struct virtio_blk_vq *bvq,
+			    struct virtblk_req *vbr)
+{
+	unsigned int num, out = 0, in = 0;
+
+	sg_set_buf(&bvq->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	num = virtblk_map_bio(vblk->disk->queue, vbr->bio, bvq->sg + out);
+	sg_set_buf(&bvq->sg[num + out + in++], &vbr->status,
+		   sizeof(vbr->status));
+
+	if (vbr->out_hdr.type & VIRTIO_BLK_T_OUT)
+		out += num;
+	else
+		in += num;
+
+	if (virtqueue_add_buf(bvq->vq, bvq->sg, out, in, vbr, GFP_ATOMIC) < 0)
+		return false;
+
+	bvq->inflight++;
+	return true;
+}
+
+static void virtblk_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct virtio_blk *vblk = q->queuedata;
+	struct virtio_blk_vq *bvq;
+	struct virtblk_req *vbr;
+	DEFINE_WAIT(wait);
+
+	/*
+	 * Flushes and FUA writes need the request queue's flush sequencing.
+	 * While the queue is stopped, for suspend or because a virtqueue
+	 * filled up, let everything wait there too.
+	 */
+	if (unlikely((bio->bi_rw & (REQ_FLUSH | REQ_FUA)) ||
+		     blk_queue_stopped(q))) {
+		blk_queue_bio(q, bio);
+		return;
+	}
+
+	vbr = mempool_alloc(vblk->pool, GFP_NOIO);
+	vbr->req = NULL;
+	vbr->bio = bio;
+	vbr->out_hdr.type = bio_data_dir(bio) == WRITE ?
+			    VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	vbr->out_hdr.sector = bio->bi_sector;
+	vbr->out_hdr.ioprio = bio_prio(bio);
+
+	bvq = virtblk_this_vq(vblk);
+	spin_lock_irq(&bvq->lock);
+	while (!bvq->frozen && !virtblk_add_bio(vblk, bvq, vbr)) {
+		/* Full: sleep until blk_done() makes room. */
+		prepare_to_wait(&bvq->wait, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock_irq(&bvq->lock);
+		io_schedule();
+		spin_lock_irq(&bvq->lock);
+	}
+	if (unlikely(bvq->frozen)) {
+		/*
+		 * Suspended since the check above: the virtqueue may be
+		 * gone, wait on the stopped request queue instead.
+		 */
+		spin_unlock_irq(&bvq->lock);
+		finish_wait(&bvq->wait, &wait);
+		mempool_free(vbr, vblk->pool);
+		blk_queue_bio(q, bio);
+		return;
+	}
+	/* Under the lock, so virtblk_freeze() cannot delete vq under us */
+	virtqueue_kick(bvq->vq);
+	spin_unlock_irq(&bvq->lock);
+	finish_wait(&bvq->wait, &wait);
 }
 
 /* return id (s/n) string for *disk to *id_str
@@ -363,18 +566,112 @@ static void virtblk_config_changed(struct virtio_device *vdev)
 	queue_work(virtblk_wq, &vblk->config_work);
 }
 
+/*
+ * Hint the interrupt of queue i to cpu i, the cpu that submits on it, or
+ * drop the hints.  With a single queue, leave it to irqbalance.
+ */
+static void virtblk_set_affinity(struct virtio_blk *vblk, bool set)
+{
+	unsigned int i;
+
+	if (vblk->nvqs == 1)
+		return;
+
+	for (i = 0; i < vblk->nvqs; i++)
+		virtqueue_set_affinity(vblk->vqs[i].vq,
+				       set && cpu_online(i) ? i : -1);
+}
+
 static int init_vq(struct virtio_blk *vblk)
 {
-	int err = 0;
+	struct virtqueue **vqs;
+	vq_callback_t **callbacks;
+	const char **names;
+	unsigned int i;
+	int err = -ENOMEM;
+
+	vqs = kmalloc(vblk->nvqs * sizeof(*vqs), GFP_KERNEL);
+	callbacks = kmalloc(vblk->nvqs * sizeof(*callbacks), GFP_KERNEL);
+	names = kmalloc(vblk->nvqs * sizeof(*names), GFP_KERNEL);
+	if (!vqs || !callbacks || !names)
+		goto out;
+
+	for (i = 0; i < vblk->nvqs; i++) {
+		callbacks[i] = blk_done;
+		names[i] = vblk->vqs[i].name;
+	}
 
-	/* We expect one virtqueue, for output. */
-	vblk->vq = virtio_find_single_vq(vblk->vdev, blk_done, "requests");
-	if (IS_ERR(vblk->vq))
-		err = PTR_ERR(vblk->vq);
+	err = vblk->vdev->config->find_vqs(vblk->vdev, vblk->nvqs, vqs,
+					   callbacks, names);
+	if (err)
+		goto out;
 
+	for (i = 0; i < vblk->nvqs; i++)
+		vblk->vqs[i].vq = vqs[i];
+	virtblk_set_affinity(vblk, true);
+
+out:
+	kfree(names);
+	kfree(callbacks);
+	kfree(vqs);
 	return err;
 }
 
+static void virtblk_free_vqs(struct virtio_blk *vblk)
+{
+	unsigned int i;
+
+	for (i = 0; i < vblk->nvqs; i++)
+		kfree(vblk->vqs[i].sg);
+	kfree(vblk->vqs);
+}
+
+static int virtblk_alloc_vqs(struct virtio_blk *vblk)
+{
+	struct virtio_blk_vq *bvq;
+	unsigned int i;
+
+	vblk->vqs = kcalloc(vblk->nvqs, sizeof(*vblk->vqs), GFP_KERNEL);
+	if (!vblk->vqs)
+		return -ENOMEM;
+
+	for (i = 0; i < vblk->nvqs; i++) {
+		bvq = &vblk->vqs[i];
+		spin_lock_init(&bvq->lock);
+		init_waitqueue_head(&bvq->wait);
+		if (vblk->nvqs == 1)
+			strcpy(bvq->name, "requests");
+		else
+			sprintf(bvq->name, "req.%u", i);
+		bvq->sg = kmalloc(vblk->sg_elems * sizeof(*bvq->sg),
+				  GFP_KERNEL);
+		if (!bvq->sg) {
+			virtblk_free_vqs(vblk);
+			return -ENOMEM;
+		}
+		sg_init_table(bvq->sg, vblk->sg_elems);
+	}
+
+	return 0;
+}
+
+/* One queue per cpu, if the host has that many and we were not told less. */
+static unsigned int virtblk_nvqs(struct virtio_device *vdev)
+{
+	unsigned int nvqs = num_queues ? num_queues : num_online_cpus();
+	u16 host_vqs;
+	int err;
+
+	err = virtio_config_val(vdev, VIRTIO_BLK_F_MQ,
+				offsetof(struct virtio_blk_config, num_queues),
+				&host_vqs);
+	if (err || host_vqs < 1)
+		return 1;
+
+	return clamp_t(unsigned int, nvqs, 1, min_t(unsigned int, host_vqs,
+						   nr_cpu_ids));
+}
+
 /*
  * Legacy naming scheme used for virtio devices.  We are stuck with it for
  * virtio blk but don't ever use it for any new driver.
@@ -430,26 +727,28 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	/* We need an extra sg elements at head and tail. */
 	sg_elems += 2;
-	vdev->priv = vblk = kmalloc(sizeof(*vblk) +
-				    sizeof(vblk->sg[0]) * sg_elems, GFP_KERNEL);
+	vdev->priv = vblk = kzalloc(sizeof(*vblk), GFP_KERNEL);
 	if (!vblk) {
 		err = -ENOMEM;
 		goto out_free_index;
 	}
 
-	INIT_LIST_HEAD(&vblk->reqs);
 	spin_lock_init(&vblk->lock);
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
-	sg_init_table(vblk->sg, vblk->sg_elems);
+	vblk->nvqs = virtblk_nvqs(vdev);
 	mutex_init(&vblk->config_lock);
 	INIT_WORK(&vblk->config_work, virtblk_config_changed_work);
 	vblk->config_enable = true;
 
-	err = init_vq(vblk);
+	err = virtblk_alloc_vqs(vblk);
 	if (err)
 		goto out_free_vblk;
 
+	err = init_vq(vblk);
+	if (err)
+		goto out_free_vqs;
+
 	vblk->pool = mempool_create_kmalloc_pool(1,sizeof(struct virtblk_req));
 	if (!vblk->pool) {
 		err = -ENOMEM;
@@ -470,6 +769,8 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 	}
 
 	q->queuedata = vblk;
+	if (use_bio)
+		blk_queue_make_request(q, virtblk_make_request);
 
 	virtblk_name_format("vd", index, vblk->disk->disk_name, DISK_NAME_LEN);
 
@@ -570,7 +871,10 @@ out_put_disk:
 out_mempool:
 	mempool_destroy(vblk->pool);
 out_free_vq:
+	virtblk_set_affinity(vblk, false);
 	vdev->config->del_vqs(vdev);
+out_free_vqs:
+	virtblk_free_vqs(vblk);
 out_free_vblk:
 	kfree(vblk);
 out_free_index:
@@ -589,9 +893,6 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 	vblk->config_enable = false;
 	mutex_unlock(&vblk->config_lock);
 
-	/* Nothing should be pending. */
-	BUG_ON(!list_empty(&vblk->reqs));
-
 	/* Stop all the virtqueues. */
 	vdev->config->reset(vdev);
 
@@ -601,15 +902,61 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 	blk_cleanup_queue(vblk->disk->queue);
 	put_disk(vblk->disk);
 	mempool_destroy(vblk->pool);
+	virtblk_set_affinity(vblk, false);
 	vdev->config->del_vqs(vdev);
+	virtblk_free_vqs(vblk);
 	kfree(vblk);
 	ida_simple_remove(&vd_index_ida, index);
 }
 
 #ifdef CONFIG_PM
+/*
+ * Keep bio submitters off the virtqueues while they are deleted for
+ * suspend, or let them back on.  Those waiting for room are woken to
+ * notice.
+ */
+static void virtblk_freeze_vqs(struct virtio_blk *vblk, bool frozen)
+{
+	struct virtio_blk_vq *bvq;
+	unsigned int i;
+
+	for (i = 0; i < vblk->nvqs; i++) {
+		bvq = &vblk->vqs[i];
+		spin_lock_irq(&bvq->lock);
+		bvq->frozen = frozen;
+		spin_unlock_irq(&bvq->lock);
+		wake_up(&bvq->wait);
+	}
+}
+
+static bool virtblk_vq_idle(struct virtio_blk_vq *bvq)
+{
+	bool idle;
+
+	spin_lock_irq(&bvq->lock);
+	idle = !bvq->inflight;
+	spin_unlock_irq(&bvq->lock);
+	return idle;
+}
+
 static int virtblk_freeze(struct virtio_device *vdev)
 {
 	struct virtio_blk *vblk = vdev->priv;
+	unsigned int i;
+
+	/*
+	 * Send new requests and bios to the stopped request queue.  The vqs
+	 * are frozen first: do_virtblk_request() stops the queue again if a
+	 * blk_done() that ran just before restarted it.
+	 */
+	virtblk_freeze_vqs(vblk, true);
+	spin_lock_irq(vblk->disk->queue->queue_lock);
+	blk_stop_queue(vblk->disk->queue);
+	spin_unlock_irq(vblk->disk->queue->queue_lock);
+
+	/* Let what the device already has complete before resetting it */
+	for (i = 0; i < vblk->nvqs; i++)
+		wait_event(vblk->vqs[i].wait, virtblk_vq_idle(&vblk->vqs[i]));
 
 	/* Ensure we don't receive any more interrupts */
 	vdev->config->reset(vdev);
@@ -621,11 +968,9 @@ static int virtblk_freeze(struct virtio_device *vdev)
 
 	flush_work(&vblk->config_work);
 
-	spin_lock_irq(vblk->disk->queue->queue_lock);
-	blk_stop_queue(vblk->disk->queue);
-	spin_unlock_irq(vblk->disk->queue->queue_lock);
 	blk_sync_queue(vblk->disk->queue);
 
+	virtblk_set_affinity(vblk, false);
 	vdev->config->del_vqs(vdev);
 	return 0;
 }
@@ -638,6 +983,7 @@ static int virtblk_restore(struct virtio_device *vdev)
 	vblk->config_enable = true;
 	ret = init_vq(vdev->priv);
 	if (!ret) {
+		virtblk_freeze_vqs(vblk, false);
 		spin_lock_irq(vblk->disk->queue->queue_lock);
 		blk_start_queue(vblk->disk->queue);
 		spin_unlock_irq(vblk->disk->queue->queue_lock);
@@ -654,7 +1000,7 @@ static const struct virtio_device_id id_table[] = {
 static unsigned int features[] = {
 	VIRTIO_BLK_F_SEG_MAX, VIRTIO_BLK_F_SIZE_MAX, VIRTIO_BLK_F_GEOMETRY,
 	VIRTIO_BLK_F_RO, VIRTIO_BLK_F_BLK_SIZE, VIRTIO_BLK_F_SCSI,
-	VIRTIO_BLK_F_FLUSH, VIRTIO_BLK_F_TOPOLOGY
+	VIRTIO_BLK_F_FLUSH, VIRTIO_BLK_F_TOPOLOGY, VIRTIO_BLK_F_MQ
 };
 
 /*
@@ -14,6 +14,7 @@
 #define EVDEV_MINORS		32
 #define EVDEV_MIN_BUFFER_SIZE	64U
 #define EVDEV_BUF_PACKETS	8
+#define EVDEV_READ_BATCH	16
 
 #include <linux/poll.h>
 #include <linux/sched.h>
@@ -26,6 +27,13 @@
 #include <linux/wakelock.h>
 #include "input-compat.h"
 
+enum evdev_clock_type {
+	EV_CLK_REAL = 0,
+	EV_CLK_MONO,
+	EV_CLK_BOOT,
+	EV_CLK_MAX
+};
+
 struct evdev {
 	int open;
 	int minor;
@@ -50,7 +58,7 @@ struct evdev_client {
 	struct fasync_struct *fasync;
 	struct evdev *evdev;
 	struct list_head node;
-	int clkid;
+	unsigned int clk_type;
 	unsigned int bufsize;
 	struct input_event buffer[];
 };
@@ -58,16 +66,10 @@ struct evdev_client {
 static struct evdev *evdev_table[EVDEV_MINORS];
 static DEFINE_MUTEX(evdev_table_mutex);
 
-static void evdev_pass_event(struct evdev_client *client,
-			     struct input_event *event,
-			     ktime_t mono, ktime_t real)
+/* Called with client->buffer_lock held and interrupts disabled. */
+static void __pass_event(struct evdev_client *client,
+			 const struct input_event *event)
 {
-	event->time = ktime_to_timeval(client->clkid == CLOCK_MONOTONIC ?
-					mono : real);
-
-	/* Interrupts are disabled, just acquire the lock. */
-	spin_lock(&client->buffer_lock);
-
 	client->buffer[client->head++] = *event;
 	client->head &= client->bufsize - 1;
 
@@ -94,44 +96,78 @@ static void evdev_pass_event(struct evdev_client *client,
 			wake_lock(&client->wake_lock);
 		kill_fasync(&client->fasync, SIGIO, POLL_IN);
 	}
+}
+
+static void evdev_pass_values(struct evdev_client *client,
+			      const struct input_value *vals, unsigned int count,
+			      ktime_t *ev_time)
+{
+	const struct input_value *v;
+	struct input_event event;
+
+	event.time = ktime_to_timeval(ev_time[client->clk_type]);
+
+	/* Interrupts are disabled, just acquire the lock. */
+	spin_lock(&client->buffer_lock);
+
+	for (v = vals; v != vals + count; v++) {
+		event.type = v->type;
+		event.code = v->code;
+		event.value = v->value;
+		__pass_event(client, &event);
+	}
 
 	spin_unlock(&client->buffer_lock);
 }
 
 /*
- * Pass incoming event to all connected clients.
+ * Pass incoming events to all connected clients. The input core hands
+ * us a whole frame at a time, so every event of it gets the same
+ * timestamp and readers are woken up once, at its end.
  */
-static void evdev_event(struct input_handle *handle,
-			unsigned int type, unsigned int code, int value)
+static void evdev_events(struct input_handle *handle,
+			 const struct input_value *vals, unsigned int count)
 {
 	struct evdev *evdev = handle->private;
 	struct evdev_client *client;
-	struct input_event event;
-	ktime_t time_mono, time_real;
+	ktime_t ev_time[EV_CLK_MAX];
 
-	time_mono = ktime_get();
-	time_real = ktime_sub(time_mono, ktime_get_monotonic_offset());
-
-	event.type = type;
-	event.code = code;
-	event.value = value;
+	ev_time[EV_CLK_MONO] = input_get_timestamp(handle->dev);
+	ev_time[EV_CLK_REAL] = ktime_sub(ev_time[EV_CLK_MONO],
+					 ktime_get_monotonic_offset());
+	ev_time[EV_CLK_BOOT] = ktime_add(ev_time[EV_CLK_MONO],
+					 ktime_sub(ktime_get_boottime(),
+						   ktime_get()));
 
 	rcu_read_lock();
 
 	client = rcu_dereference(evdev->grab);
 
 	if (client)
-		evdev_pass_event(client, &event, time_mono, time_real);
+		evdev_pass_values(client, vals, count, ev_time);
 	else
 		list_for_each_entry_rcu(client, &evdev->client_list, node)
-			evdev_pass_event(client, &event, time_mono, time_real);
+			evdev_pass_values(client, vals, count, ev_time);
 
 	rcu_read_unlock();
 
-	if (type == EV_SYN && code == SYN_REPORT)
+	/* SYN_REPORT, if there is one, ends the frame */
+	if (vals[count - 1].type == EV_SYN &&
+	    vals[count - 1].code == SYN_REPORT)
 		wake_up_interruptible(&evdev->wait);
 }
 
+/*
+ * Pass incoming event to all connected clients.
+ */
+static void evdev_event(struct input_handle *handle,
+			unsigned int type, unsigned int code, int value)
+{
+	struct input_value vals[] = { { type, code, value } };
+
+	evdev_events(handle, vals, ARRAY_SIZE(vals));
+}
+
 static int evdev_fasync(int fd, struct file *file, int on)
 {
 	struct evdev_client *client = file->private_data;
@@ -323,7 +359,7 @@ static int evdev_open(struct inode *inode, struct file *file)
 		goto err_put_evdev;
 	}
 
-	client->clkid = CLOCK_MONOTONIC;
+	client->clk_type = EV_CLK_MONO;
 	client->bufsize = bufsize;
 	spin_lock_init(&client->buffer_lock);
 	snprintf(client->name, sizeof(client->name), "%s-%d",
@@ -384,25 +420,30 @@ static ssize_t evdev_write(struct file *file, const char __user *buffer,
 	return retval;
 }
 
-static int evdev_fetch_next_event(struct evdev_client *client,
-				  struct input_event *event)
+/*
+ * Take up to @max complete-frame events off the client's queue at once,
+ * so that a reader pulling a whole frame does not bounce the buffer lock
+ * against the interrupt adding the next one for every single event.
+ */
+static unsigned int evdev_fetch_events(struct evdev_client *client,
+				       struct input_event *events,
+				       unsigned int max)
 {
-	int have_event;
+	unsigned int n = 0;
 
 	spin_lock_irq(&client->buffer_lock);
 
-	have_event = client->packet_head != client->tail;
-	if (have_event) {
-		*event = client->buffer[client->tail++];
+	while (n < max && client->packet_head != client->tail) {
+		events[n++] = client->buffer[client->tail++];
 		client->tail &= client->bufsize - 1;
-		if (client->use_wake_lock &&
-		    client->packet_head == client->tail)
-			wake_unlock(&client->wake_lock);
 	}
 
+	if (n && client->use_wake_lock && client->packet_head == client->tail)
+		wake_unlock(&client->wake_lock);
+
 	spin_unlock_irq(&client->buffer_lock);
 
-	return have_event;
+	return n;
 }
 
 static ssize_t evdev_read(struct file *file, char __user *buffer,
@@ -410,7 +451,8 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 {
 	struct evdev_client *client = file->private_data;
 	struct evdev *evdev = client->evdev;
-	struct input_event event;
+	struct input_event events[EVDEV_READ_BATCH];
+	unsigned int i, n;
 	int retval = 0;
 
 	if (count < input_event_size())
@@ -427,13 +469,19 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 	if (!evdev->exist)
 		return -ENODEV;
 
-	while (retval + input_event_size() <= count &&
-	       evdev_fetch_next_event(client, &event)) {
+	while (retval + input_event_size() <= count) {
+		n = min_t(size_t, (count - retval) / input_event_size(),
+			  EVDEV_READ_BATCH);
+		n = evdev_fetch_events(client, events, n);
+		if (!n)
+			break;
 
-		if (input_event_to_user(buffer + retval, &event))
-			return -EFAULT;
+		for (i = 0; i < n; i++) {
+			if (input_event_to_user(buffer + retval, &events[i]))
+				return -EFAULT;
 
-		retval += input_event_size();
+			retval += input_event_size();
+		}
 	}
 
 	if (retval == 0 && (file->f_flags & O_NONBLOCK))
@@ -764,9 +812,19 @@ static long evdev_do_ioctl(struct file *file, unsigned int cmd,
 	case EVIOCSCLOCKID:
 		if (copy_from_user(&i, p, sizeof(unsigned int)))
 			return -EFAULT;
-		if (i != CLOCK_MONOTONIC && i != CLOCK_REALTIME)
+		switch (i) {
+		case CLOCK_REALTIME:
+			client->clk_type = EV_CLK_REAL;
+			break;
+		case CLOCK_MONOTONIC:
+			client->clk_type = EV_CLK_MONO;
+			break;
+		case CLOCK_BOOTTIME:
+			client->clk_type = EV_CLK_BOOT;
+			break;
+		default:
 			return -EINVAL;
-		client->clkid = i;
+		}
 		return 0;
 
 	case EVIOCGKEYCODE:
@@ -1085,6 +1143,7 @@ MODULE_DEVICE_TABLE(input, evdev_ids);
 
 static struct input_handler evdev_handler = {
 	.event		= evdev_event,
+	.events		= evdev_events,
 	.connect	= evdev_connect,
 	.disconnect	= evdev_disconnect,
 	.fops		= &evdev_fops,
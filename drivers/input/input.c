@@ -70,43 +70,107 @@ static int input_defuzz_abs_event(int value, int old_val, int fuzz)
 }
 
 /*
- * Pass event first through all filters and then, if event has not been
+ * Pass values first through the handler's filter, if it has one, and
+ * then the ones left to its events() or event() method. Filtered values
+ * are squeezed out of the array, so that handlers further down the list
+ * do not see them either. Returns the number of values left.
+ */
+static unsigned int input_to_handler(struct input_handle *handle,
+			struct input_value *vals, unsigned int count)
+{
+	struct input_handler *handler = handle->handler;
+	struct input_value *end = vals;
+	struct input_value *v;
+
+	if (handler->filter) {
+		for (v = vals; v != vals + count; v++) {
+			if (handler->filter(handle, v->type, v->code, v->value))
+				continue;
+			if (end != v)
+				*end = *v;
+			end++;
+		}
+		count = end - vals;
+	}
+
+	if (!count)
+		return 0;
+
+	if (handler->events)
+		handler->events(handle, vals, count);
+	else if (handler->event)
+		for (v = vals; v != vals + count; v++)
+			handler->event(handle, v->type, v->code, v->value);
+
+	return count;
+}
+
+/*
+ * Pass values first through all filters and then, if they have not been
  * filtered out, through all open handles. This function is called with
  * dev->event_lock held and interrupts disabled.
  */
-static void input_pass_event(struct input_dev *dev,
-			     unsigned int type, unsigned int code, int value)
+static void input_pass_values(struct input_dev *dev,
+			      struct input_value *vals, unsigned int count)
 {
-	struct input_handler *handler;
 	struct input_handle *handle;
 
+	if (!count)
+		return;
+
 	rcu_read_lock();
 
 	handle = rcu_dereference(dev->grab);
 	if (handle)
-		handle->handler->event(handle, type, code, value);
+		input_to_handler(handle, vals, count);
 	else {
-		bool filtered = false;
-
 		list_for_each_entry_rcu(handle, &dev->h_list, d_node) {
 			if (!handle->open)
 				continue;
 
-			handler = handle->handler;
-			if (!handler->filter) {
-				if (filtered)
-					break;
-
-				handler->event(handle, type, code, value);
-
-			} else if (handler->filter(handle, type, code, value))
-				filtered = true;
+			count = input_to_handler(handle, vals, count);
+			if (!count)
+				break;
 		}
 	}
 
 	rcu_read_unlock();
 }
 
+static void input_pass_event(struct input_dev *dev,
+			     unsigned int type, unsigned int code, int value)
+{
+	struct input_value vals[] = { { type, code, value } };
+
+	input_pass_values(dev, vals, ARRAY_SIZE(vals));
+}
+
+/*
+ * Add a value to the frame being collected for the handlers. The frame
+ * is timestamped when its first value comes in, unless the driver has
+ * already done it at interrupt time with input_set_timestamp().
+ */
+static void input_queue_value(struct input_dev *dev,
+			      unsigned int type, unsigned int code, int value)
+{
+	struct input_value *v;
+
+	if (!dev->num_vals && !dev->timestamp.tv64)
+		dev->timestamp = ktime_get();
+
+	v = &dev->vals[dev->num_vals++];
+	v->type = type;
+	v->code = code;
+	v->value = value;
+}
+
+static void input_flush_values(struct input_dev *dev)
+{
+	input_pass_values(dev, dev->vals, dev->num_vals);
+	dev->num_vals = 0;
+	dev->timestamp.tv64 = 0;
+}
+
 /*
  * Generate software autorepeat event. Note that we take
  * dev->event_lock here to avoid racing with input_event
@@ -207,7 +271,8 @@ static int input_handle_abs_event(struct input_dev *dev,
 	/* Flush pending "slot" event */
 	if (is_mt_event && dev->slot != input_abs_get_val(dev, ABS_MT_SLOT)) {
 		input_abs_set_val(dev, ABS_MT_SLOT, dev->slot);
-		input_pass_event(dev, EV_ABS, ABS_MT_SLOT, dev->slot);
+		if (dev->vals)
+			input_queue_value(dev, EV_ABS, ABS_MT_SLOT, dev->slot);
 	}
 
 	return INPUT_PASS_TO_HANDLERS;
@@ -323,8 +388,22 @@ static void input_handle_event(struct input_dev *dev,
 	if ((disposition & INPUT_PASS_TO_DEVICE) && dev->event)
 		dev->event(dev, type, code, value);
 
-	if (disposition & INPUT_PASS_TO_HANDLERS)
-		input_pass_event(dev, type, code, value);
+	/* not registered yet: nobody to pass the event to */
+	if (!dev->vals || !(disposition & INPUT_PASS_TO_HANDLERS))
+		return;
+
+	/*
+	 * Handlers get a whole frame at once, on SYN_REPORT. Should a
+	 * device send more values than fit in between, end the frame
+	 * early rather than lose them.
+	 */
+	input_queue_value(dev, type, code, value);
+	if (type == EV_SYN && code == SYN_REPORT) {
+		input_flush_values(dev);
+	} else if (dev->num_vals >= dev->max_vals - 2) {
+		input_queue_value(dev, EV_SYN, SYN_REPORT, 1);
+		input_flush_values(dev);
+	}
 }
 
 /**
@@ -359,6 +438,38 @@ void input_event(struct input_dev *dev,
 }
 EXPORT_SYMBOL(input_event);
 
+/**
+ * input_set_timestamp() - set the time the current frame was generated at
+ * @dev: device that is about to report the frame
+ * @timestamp: CLOCK_MONOTONIC time of the hardware event
+ *
+ * Drivers that report events from a thread or a work item should take
+ * the time in their hard interrupt handler and pass it here, before
+ * reporting the events of the frame, so that handlers timestamp the
+ * frame with the time the interrupt came in rather than the time the
+ * events made it to the input core. The timestamp applies to the frame
+ * up to the next EV_SYN/SYN_REPORT.
+ */
+void input_set_timestamp(struct input_dev *dev, ktime_t timestamp)
+{
+	dev->timestamp = timestamp;
+}
+EXPORT_SYMBOL(input_set_timestamp);
+
+/**
+ * input_get_timestamp() - get the time of the frame being passed
+ * @dev: device the frame comes from
+ *
+ * For use by input handlers from their events() method. Returns the
+ * CLOCK_MONOTONIC time set with input_set_timestamp(), or the time the
+ * first value of the frame was reported at.
+ */
+ktime_t input_get_timestamp(struct input_dev *dev)
+{
+	return dev->timestamp.tv64 ? dev->timestamp : ktime_get();
+}
+EXPORT_SYMBOL(input_get_timestamp);
+
 /**
  * input_inject_event() - send input event from input handler
  * @handle: input handle to send event through
@@ -1416,6 +1527,7 @@ static void input_dev_release(struct device *device)
 	input_ff_destroy(dev);
 	input_mt_destroy_slots(dev);
 	kfree(dev->absinfo);
+	kfree(dev->vals);
 	kfree(dev);
 
 	module_put(THIS_MODULE);
@@ -1816,6 +1928,7 @@ int input_register_device(struct input_dev *dev)
 {
 	static atomic_t input_no = ATOMIC_INIT(0);
 	struct input_handler *handler;
+	unsigned int packet_size;
 	const char *path;
 	int error;
 
@@ -1828,9 +1941,15 @@ int input_register_device(struct input_dev *dev)
 	/* Make sure that bitmasks not mentioned in dev->evbit are clean. */
 	input_cleanse_bitmasks(dev);
 
+	packet_size = input_estimate_events_per_packet(dev);
 	if (!dev->hint_events_per_packet)
-		dev->hint_events_per_packet =
-				input_estimate_events_per_packet(dev);
+		dev->hint_events_per_packet = packet_size;
+
+	/* room for a whole frame, plus a pending slot change and SYN_REPORT */
+	dev->max_vals = max(dev->hint_events_per_packet, packet_size) + 2;
+	dev->vals = kcalloc(dev->max_vals, sizeof(*dev->vals), GFP_KERNEL);
+	if (!dev->vals)
+		return -ENOMEM;
 
 	/*
 	 * If delay and period are pre-set by the driver, then autorepeating
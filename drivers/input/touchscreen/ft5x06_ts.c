@@ -219,6 +219,16 @@ static int ft5x06_handle_touchdata(struct ft5x06_ts_data *data)
 	return 0;
 }
 
+/* Timestamp the touch when it happens, not when the i2c read is done */
+static irqreturn_t ft5x06_ts_hardirq(int irq, void *dev_id)
+{
+	struct ft5x06_ts_data *data = dev_id;
+
+	input_set_timestamp(data->input_dev, ktime_get());
+
+	return IRQ_WAKE_THREAD;
+}
+
 static irqreturn_t ft5x06_ts_interrupt(int irq, void *dev_id)
 {
 	struct ft5x06_ts_data *data = dev_id;
@@ -544,7 +554,7 @@ static int ft5x06_ts_probe(struct i2c_client *client,
 		dev_err(&client->dev, "threshold read failed");
 	dev_dbg(&client->dev, "[FTS] touch threshold is %d.\n", reg_value * 4);
 
-	err = request_threaded_irq(client->irq, NULL,
+	err = request_threaded_irq(client->irq, ft5x06_ts_hardirq,
 				   ft5x06_ts_interrupt, pdata->irqflags,
 				   client->dev.driver->name, data);
 	if (err) {
@@ -16,6 +16,9 @@
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
 
 #include <media/videobuf2-core.h>
 #include <media/videobuf2-memops.h>
@@ -29,6 +32,8 @@ struct vb2_vmalloc_buf {
 	unsigned int			n_pages;
 	atomic_t			refcount;
 	struct vb2_vmarea_handler	handler;
+	struct dma_buf			*dbuf;
+	void				**kaddrs;
 };
 
 static void vb2_vmalloc_put(void *buf_priv);
@@ -206,11 +211,280 @@ static int vb2_vmalloc_mmap(void *buf_priv, struct vm_area_struct *vma)
 	return 0;
 }
 
+/*********************************************/
+/*         DMABUF ops for exporters          */
+/*********************************************/
+
+struct vb2_vmalloc_attachment {
+	struct sg_table sgt;
+	enum dma_data_direction dir;
+};
+
+static int vb2_vmalloc_dmabuf_ops_attach(struct dma_buf *dbuf,
+	struct device *dev, struct dma_buf_attachment *dbuf_attach)
+{
+	struct vb2_vmalloc_attachment *attach;
+	struct vb2_vmalloc_buf *buf = dbuf->priv;
+	int num_pages = PAGE_ALIGN(buf->size) >> PAGE_SHIFT;
+	struct scatterlist *sg;
+	void *vaddr = buf->vaddr;
+	int ret, i;
+
+	attach = kzalloc(sizeof(*attach), GFP_KERNEL);
+	if (!attach)
+		return -ENOMEM;
+
+	ret = sg_alloc_table(&attach->sgt, num_pages, GFP_KERNEL);
+	if (ret) {
+		kfree(attach);
+		return ret;
+	}
+
+	for_each_sg(attach->sgt.sgl, sg, attach->sgt.nents, i) {
+		struct page *page = vmalloc_to_page(vaddr);
+
+		if (!page) {
+			sg_free_table(&attach->sgt);
+			kfree(attach);
+			return -ENOMEM;
+		}
+		sg_set_page(sg, page, PAGE_SIZE, 0);
+		vaddr += PAGE_SIZE;
+	}
+
+	attach->dir = DMA_NONE;
+	dbuf_attach->priv = attach;
+	return 0;
+}
+
+static void vb2_vmalloc_dmabuf_ops_detach(struct dma_buf *dbuf,
+	struct dma_buf_attachment *db_attach)
+{
+	struct vb2_vmalloc_attachment *attach = db_attach->priv;
+
+	if (!attach)
+		return;
+
+	/* release the scatterlist cache */
+	if (attach->dir != DMA_NONE)
+		dma_unmap_sg(db_attach->dev, attach->sgt.sgl,
+			     attach->sgt.orig_nents, attach->dir);
+	sg_free_table(&attach->sgt);
+	kfree(attach);
+	db_attach->priv = NULL;
+}
+
+static struct sg_table *vb2_vmalloc_dmabuf_ops_map(
+	struct dma_buf_attachment *db_attach, enum dma_data_direction dir)
+{
+	struct vb2_vmalloc_attachment *attach = db_attach->priv;
+	struct mutex *lock = &db_attach->dmabuf->lock;
+	struct sg_table *sgt = &attach->sgt;
+
+	mutex_lock(lock);
+
+	/* return previously mapped sg table */
+	if (attach->dir == dir) {
+		mutex_unlock(lock);
+		return sgt;
+	}
+
+	/* release any previous cache */
+	if (attach->dir != DMA_NONE) {
+		dma_unmap_sg(db_attach->dev, sgt->sgl, sgt->orig_nents,
+			     attach->dir);
+		attach->dir = DMA_NONE;
+	}
+
+	/* mapping to the client with new direction */
+	sgt->nents = dma_map_sg(db_attach->dev, sgt->sgl, sgt->orig_nents,
+				dir);
+	if (!sgt->nents) {
+		pr_err("failed to map scatterlist\n");
+		mutex_unlock(lock);
+		return ERR_PTR(-EIO);
+	}
+
+	attach->dir = dir;
+
+	mutex_unlock(lock);
+	return sgt;
+}
+
+static void vb2_vmalloc_dmabuf_ops_unmap(struct dma_buf_attachment *db_attach,
+	struct sg_table *sgt, enum dma_data_direction dir)
+{
+	/* nothing to be done here, the mapping is cached until detach */
+}
+
+static void vb2_vmalloc_dmabuf_ops_release(struct dma_buf *dbuf)
+{
+	/* drop reference obtained in vb2_vmalloc_get_dmabuf */
+	vb2_vmalloc_put(dbuf->priv);
+}
+
+static void *vb2_vmalloc_dmabuf_ops_kmap(struct dma_buf *dbuf, unsigned long pgnum)
+{
+	struct vb2_vmalloc_buf *buf = dbuf->priv;
+
+	return buf->vaddr + pgnum * PAGE_SIZE;
+}
+
+static int vb2_vmalloc_dmabuf_ops_mmap(struct dma_buf *dbuf,
+	struct vm_area_struct *vma)
+{
+	return vb2_vmalloc_mmap(dbuf->priv, vma);
+}
+
+static struct dma_buf_ops vb2_vmalloc_dmabuf_ops = {
+	.attach = vb2_vmalloc_dmabuf_ops_attach,
+	.detach = vb2_vmalloc_dmabuf_ops_detach,
+	.map_dma_buf = vb2_vmalloc_dmabuf_ops_map,
+	.unmap_dma_buf = vb2_vmalloc_dmabuf_ops_unmap,
+	.kmap = vb2_vmalloc_dmabuf_ops_kmap,
+	.kmap_atomic = vb2_vmalloc_dmabuf_ops_kmap,
+	.mmap = vb2_vmalloc_dmabuf_ops_mmap,
+	.release = vb2_vmalloc_dmabuf_ops_release,
+};
+
+static struct dma_buf *vb2_vmalloc_get_dmabuf(void *buf_priv)
+{
+	struct vb2_vmalloc_buf *buf = buf_priv;
+	struct dma_buf *dbuf;
+
+	if (WARN_ON(!buf->vaddr))
+		return NULL;
+
+	dbuf = dma_buf_export(buf, &vb2_vmalloc_dmabuf_ops, buf->size, O_RDWR);
+	if (IS_ERR(dbuf))
+		return dbuf;
+
+	/* dmabuf keeps reference to vb2 buffer */
+	atomic_inc(&buf->refcount);
+
+	return dbuf;
+}
+
+/*********************************************/
+/*       callbacks for DMABUF buffers        */
+/*********************************************/
+
+/*
+ * There is no dma_buf_vmap() to map a whole imported buffer, so map it a
+ * page at a time with dma_buf_kmap() and put the pages behind those
+ * addresses together again with vm_map_ram().  That works for exporters
+ * whose kmap hands out lowmem or vmalloc addresses, which covers the vb2
+ * allocators; anything else is refused at qbuf time.
+ */
+static int vb2_vmalloc_map_dmabuf(void *mem_priv)
+{
+	struct vb2_vmalloc_buf *buf = mem_priv;
+	enum dma_data_direction dir;
+	unsigned int i;
+	int ret;
+
+	dir = buf->write ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	ret = dma_buf_begin_cpu_access(buf->dbuf, 0, buf->size, dir);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < buf->n_pages; i++) {
+		void *kaddr = dma_buf_kmap(buf->dbuf, i);
+
+		if (!kaddr)
+			goto fail;
+		buf->kaddrs[i] = kaddr;
+
+		if (is_vmalloc_addr(kaddr))
+			buf->pages[i] = vmalloc_to_page(kaddr);
+		else if (virt_addr_valid(kaddr))
+			buf->pages[i] = virt_to_page(kaddr);
+		else
+			buf->pages[i] = NULL;
+		if (!buf->pages[i]) {
+			i++;
+			goto fail;
+		}
+	}
+
+	buf->vaddr = vm_map_ram(buf->pages, buf->n_pages, -1, PAGE_KERNEL);
+	if (!buf->vaddr)
+		goto fail;
+
+	return 0;
+
+fail:
+	while (i--)
+		dma_buf_kunmap(buf->dbuf, i, buf->kaddrs[i]);
+	dma_buf_end_cpu_access(buf->dbuf, 0, buf->size, dir);
+	return -EINVAL;
+}
+
+static void vb2_vmalloc_unmap_dmabuf(void *mem_priv)
+{
+	struct vb2_vmalloc_buf *buf = mem_priv;
+	unsigned int i;
+
+	vm_unmap_ram(buf->vaddr, buf->n_pages);
+	buf->vaddr = NULL;
+
+	for (i = 0; i < buf->n_pages; i++)
+		dma_buf_kunmap(buf->dbuf, i, buf->kaddrs[i]);
+	dma_buf_end_cpu_access(buf->dbuf, 0, buf->size,
+			       buf->write ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+}
+
+static void vb2_vmalloc_detach_dmabuf(void *mem_priv)
+{
+	struct vb2_vmalloc_buf *buf = mem_priv;
+
+	if (buf->vaddr)
+		vb2_vmalloc_unmap_dmabuf(buf);
+
+	kfree(buf->kaddrs);
+	kfree(buf->pages);
+	kfree(buf);
+}
+
+static void *vb2_vmalloc_attach_dmabuf(void *alloc_ctx, struct dma_buf *dbuf,
+	unsigned long size, int write)
+{
+	struct vb2_vmalloc_buf *buf;
+
+	if (dbuf->size < size)
+		return ERR_PTR(-EFAULT);
+
+	buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return ERR_PTR(-ENOMEM);
+
+	buf->n_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	buf->pages = kcalloc(buf->n_pages, sizeof(*buf->pages), GFP_KERNEL);
+	buf->kaddrs = kcalloc(buf->n_pages, sizeof(*buf->kaddrs), GFP_KERNEL);
+	if (!buf->pages || !buf->kaddrs) {
+		kfree(buf->pages);
+		kfree(buf->kaddrs);
+		kfree(buf);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	buf->dbuf = dbuf;
+	buf->write = write;
+	buf->size = size;
+
+	return buf;
+}
+
 const struct vb2_mem_ops vb2_vmalloc_memops = {
 	.alloc		= vb2_vmalloc_alloc,
 	.put		= vb2_vmalloc_put,
 	.get_userptr	= vb2_vmalloc_get_userptr,
 	.put_userptr	= vb2_vmalloc_put_userptr,
+	.get_dmabuf	= vb2_vmalloc_get_dmabuf,
+	.map_dmabuf	= vb2_vmalloc_map_dmabuf,
+	.unmap_dmabuf	= vb2_vmalloc_unmap_dmabuf,
+	.attach_dmabuf	= vb2_vmalloc_attach_dmabuf,
+	.detach_dmabuf	= vb2_vmalloc_detach_dmabuf,
 	.vaddr		= vb2_vmalloc_vaddr,
 	.mmap		= vb2_vmalloc_mmap,
 	.num_users	= vb2_vmalloc_num_users,
@@ -575,20 +575,22 @@ static void free_internal_volumes(struct ubi_device *ubi)
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  *
- * Note, currently this is the only method to attach UBI devices. Hopefully in
- * the future we'll have more scalable attaching methods and avoid full media
- * scanning. But even in this case scanning will be needed as a fall-back
- * attaching method if there are some on-flash table corruptions.
+ * Note, if there is a fastmap on the media, only the PEBs it does not cover
+ * are actually scanned (see 'ubi_scan()'). Full media scanning is the
+ * fall-back attaching method if there is no fastmap or it is corrupted.
  */
 static int attach_by_scanning(struct ubi_device *ubi)
 {
 	int err;
+	unsigned long start = jiffies;
 	struct ubi_scan_info *si;
 
 	si = ubi_scan(ubi);
 	if (IS_ERR(si))
 		return PTR_ERR(si);
 
+	ubi_msg("scanning took %u ms", jiffies_to_msecs(jiffies - start));
+
 	ubi->bad_peb_count = si->bad_peb_count;
 	ubi->good_peb_count = ubi->peb_count - ubi->bad_peb_count;
 	ubi->corr_peb_count = si->corr_peb_count;
@@ -1048,6 +1050,7 @@ out_free:
  */
 int ubi_detach_mtd_dev(int ubi_num, int anyway)
 {
+	int err;
 	struct ubi_device *ubi;
 
 	if (ubi_num < 0 || ubi_num >= UBI_MAX_DEVICES)
@@ -1083,6 +1086,17 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	if (ubi->bgt_thread)
 		kthread_stop(ubi->bgt_thread);
 
+	/*
+	 * Leave a fastmap behind, so that the next attach does not have to
+	 * scan. Nothing may wake the background thread up any more.
+	 */
+	spin_lock(&ubi->wl_lock);
+	ubi->thread_enabled = 0;
+	spin_unlock(&ubi->wl_lock);
+	err = ubi_update_fastmap(ubi);
+	if (err)
+		ubi_warn("cannot write fastmap, error %d", err);
+
 	/*
 	 * Get a reference to the device in order to prevent 'dev_release()'
 	 * from freeing the @ubi object.
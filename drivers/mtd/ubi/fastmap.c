@@ -0,0 +1,654 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ */
+
+/*
+ * This file contains the fastmap code. Attaching an MTD device normally means
+ * reading the EC and VID headers of every physical eraseblock, which takes
+ * time linear in the flash size. The fastmap is an on-flash snapshot of what
+ * that scan would find: which PEBs are free, which have to be erased, the
+ * EBA tables of all volumes and all erase counters. With it, attach only has
+ * to read the fastmap and scan the few PEBs which may have changed since it
+ * was written.
+ *
+ * Those are the PEBs of the pool. When a fastmap is written, a number of free
+ * PEBs is moved to the pool (@ubi->fm_pool), and from then on UBI takes free
+ * PEBs only from there. PEBs the fastmap records as free are thus left alone,
+ * and the pool PEBs are not recorded at all, so attach scans them. PEBs the
+ * fastmap records as mapped are not erased either until a new fastmap is
+ * written (see 'erase_worker()'). Whenever the pool runs low, the background
+ * thread writes a new fastmap with a fresh pool.
+ *
+ * The fastmap consists of the anchor PEB, which has to be among the first
+ * %UBI_FM_MAX_START PEBs, and possibly more data PEBs. The data PEBs are
+ * written first and the anchor last, so an anchor is only there if the whole
+ * fastmap is. A fastmap is invalidated by erasing its anchor, which happens
+ * before writing a new one, on attach, and whenever the pool is used up before
+ * the background thread got to write a new fastmap. Without a valid fastmap,
+ * attach falls back to scanning the whole MTD device.
+ */
+
+#include <linux/crc32.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include "ubi.h"
+
+/**
+ * check_fastmap - check that a fastmap makes sense.
+ * @ubi: UBI device description object
+ * @fm: the fastmap
+ * @size: size of @fm in bytes
+ *
+ * Checks all the records of the fastmap, so that it can be used without
+ * further checking. Returns zero if the fastmap is all right, %1 if not, and
+ * a negative error code in case of failure.
+ */
+static int check_fastmap(const struct ubi_device *ubi, void *fm, int size)
+{
+	int i, j, pnum, vol_id, count, err = 1, off;
+	struct ubi_fm_sb *sb = fm;
+	struct ubi_fm_hdr *fmhdr = fm + sizeof(struct ubi_fm_sb);
+	struct ubi_fm_volhdr *fmvhdr;
+	struct ubi_fm_ec *fmec;
+	unsigned long *claimed;
+	DECLARE_BITMAP(vols, UBI_MAX_VOLUMES + 1);
+
+	if (be32_to_cpu(fmhdr->magic) != UBI_FM_HDR_MAGIC) {
+		ubi_err("bad fastmap header magic %#08x",
+			be32_to_cpu(fmhdr->magic));
+		return 1;
+	}
+
+	if (be32_to_cpu(fmhdr->peb_count) != ubi->peb_count) {
+		ubi_err("fastmap is for %d PEBs, but there are %d",
+			be32_to_cpu(fmhdr->peb_count), ubi->peb_count);
+		return 1;
+	}
+
+	claimed = kcalloc(BITS_TO_LONGS(ubi->peb_count), sizeof(unsigned long),
+			  GFP_KERNEL);
+	if (!claimed)
+		return -ENOMEM;
+	bitmap_zero(vols, UBI_MAX_VOLUMES + 1);
+
+	off = 0;
+	for (i = 0; i < be32_to_cpu(sb->used_blocks); i++) {
+		pnum = be32_to_cpu(sb->block_loc[i]);
+		if (be32_to_cpu(sb->block_ec[i]) > UBI_MAX_ERASECOUNTER ||
+		    test_and_set_bit(pnum, claimed))
+			goto out;
+	}
+
+	off = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr);
+	count = be32_to_cpu(fmhdr->free_peb_count);
+	if (count < 0 || count > ubi->peb_count)
+		goto out;
+	i = be32_to_cpu(fmhdr->erase_peb_count);
+	if (i < 0 || i > ubi->peb_count - count)
+		goto out;
+	count += i;
+
+	if (off + count * sizeof(struct ubi_fm_ec) > size)
+		goto out;
+	fmec = fm + off;
+	for (i = 0; i < count; i++, fmec++) {
+		pnum = be32_to_cpu(fmec->pnum);
+		if (pnum < 0 || pnum >= ubi->peb_count ||
+		    be32_to_cpu(fmec->ec) > UBI_MAX_ERASECOUNTER)
+			goto out;
+		if (test_and_set_bit(pnum, claimed))
+			goto out;
+	}
+	off += count * sizeof(struct ubi_fm_ec);
+
+	count = be32_to_cpu(fmhdr->vol_count);
+	if (count < 0 || count > UBI_MAX_VOLUMES + 1)
+		goto out;
+	for (i = 0; i < count; i++) {
+		int reserved_pebs, used_ebs, data_pad, last_eb_bytes;
+
+		if (off + sizeof(struct ubi_fm_volhdr) > size)
+			goto out;
+		fmvhdr = fm + off;
+		off += sizeof(struct ubi_fm_volhdr);
+
+		vol_id = be32_to_cpu(fmvhdr->vol_id);
+		reserved_pebs = be32_to_cpu(fmvhdr->reserved_pebs);
+		used_ebs = be32_to_cpu(fmvhdr->used_ebs);
+		data_pad = be32_to_cpu(fmvhdr->data_pad);
+		last_eb_bytes = be32_to_cpu(fmvhdr->last_eb_bytes);
+
+		if (be32_to_cpu(fmvhdr->magic) != UBI_FM_VHDR_MAGIC)
+			goto out;
+		if (vol_id == UBI_LAYOUT_VOLUME_ID)
+			j = UBI_MAX_VOLUMES;
+		else if (vol_id >= 0 && vol_id < UBI_MAX_VOLUMES)
+			j = vol_id;
+		else
+			goto out;
+		if (test_and_set_bit(j, vols))
+			goto out;
+
+		if (fmvhdr->vol_type != UBI_VID_DYNAMIC &&
+		    fmvhdr->vol_type != UBI_VID_STATIC)
+			goto out;
+		if (data_pad < 0 || data_pad > ubi->leb_size / 2)
+			goto out;
+		if (reserved_pebs < 0 || reserved_pebs > ubi->peb_count)
+			goto out;
+		if (fmvhdr->vol_type == UBI_VID_STATIC &&
+		    (used_ebs < 0 || used_ebs > reserved_pebs ||
+		     last_eb_bytes < 0 ||
+		     last_eb_bytes > ubi->leb_size - data_pad))
+			goto out;
+
+		if (off + reserved_pebs * sizeof(struct ubi_fm_ec) > size)
+			goto out;
+		fmec = fm + off;
+		for (j = 0; j < reserved_pebs; j++, fmec++) {
+			pnum = be32_to_cpu(fmec->pnum);
+			if (pnum == UBI_LEB_UNMAPPED)
+				continue;
+			if (pnum < 0 || pnum >= ubi->peb_count ||
+			    be32_to_cpu(fmec->ec) > UBI_MAX_ERASECOUNTER)
+				goto out;
+			if (test_and_set_bit(pnum, claimed))
+				goto out;
+		}
+		off += reserved_pebs * sizeof(struct ubi_fm_ec);
+	}
+
+	if (off != size)
+		goto out;
+
+	err = 0;
+
+out:
+	if (err)
+		ubi_err("bad fastmap record at offset %d", off);
+	kfree(claimed);
+	return err;
+}
+
+/**
+ * read_fastmap - read and check the fastmap starting at an anchor PEB.
+ * @ubi: UBI device description object
+ * @anchor: the anchor PEB
+ * @sqnum: sequence number of the VID header of @anchor
+ * @vh: VID header buffer to use
+ *
+ * Returns the fastmap, %NULL if it is not usable, or an error pointer in case
+ * of failure.
+ */
+static void *read_fastmap(struct ubi_device *ubi, int anchor,
+			  unsigned long long sqnum, struct ubi_vid_hdr *vh)
+{
+	int i, err, pnum, used_blocks, size, len;
+	struct ubi_fm_sb *sb;
+	void *fm = NULL;
+	uint32_t crc;
+
+	sb = kmalloc(sizeof(struct ubi_fm_sb), GFP_KERNEL);
+	if (!sb)
+		return ERR_PTR(-ENOMEM);
+
+	err = ubi_io_read_data(ubi, sb, anchor, 0, sizeof(struct ubi_fm_sb));
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_err("cannot read fastmap super block from PEB %d, error %d",
+			anchor, err);
+		goto out_corrupted;
+	}
+
+	used_blocks = be32_to_cpu(sb->used_blocks);
+	size = be32_to_cpu(sb->data_size);
+	if (be32_to_cpu(sb->magic) != UBI_FM_SB_MAGIC ||
+	    sb->version != UBI_FM_FMT_VERSION ||
+	    be64_to_cpu(sb->sqnum) != sqnum ||
+	    used_blocks < 1 || used_blocks > UBI_FM_MAX_BLOCKS ||
+	    be32_to_cpu(sb->block_loc[0]) != anchor ||
+	    size < sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) ||
+	    size > used_blocks * ubi->leb_size ||
+	    size <= (used_blocks - 1) * ubi->leb_size) {
+		ubi_err("bad fastmap super block at PEB %d", anchor);
+		goto out_corrupted;
+	}
+
+	fm = vmalloc(size);
+	if (!fm) {
+		kfree(sb);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (i = 0; i < used_blocks; i++) {
+		pnum = be32_to_cpu(sb->block_loc[i]);
+		if (pnum < 0 || pnum >= ubi->peb_count)
+			goto out_corrupted;
+
+		if (i > 0) {
+			err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+			if (err && err != UBI_IO_BITFLIPS) {
+				ubi_err("cannot read fastmap VID header from "
+					"PEB %d, error %d", pnum, err);
+				goto out_corrupted;
+			}
+			if (be32_to_cpu(vh->vol_id) != UBI_FM_DATA_VOLUME_ID ||
+			    be32_to_cpu(vh->lnum) != i ||
+			    be64_to_cpu(vh->sqnum) != sqnum) {
+				ubi_err("PEB %d does not belong to the fastmap",
+					pnum);
+				goto out_corrupted;
+			}
+		}
+
+		len = min_t(int, size - i * ubi->leb_size, ubi->leb_size);
+		err = ubi_io_read_data(ubi, fm + i * ubi->leb_size, pnum, 0,
+				       len);
+		if (err && err != UBI_IO_BITFLIPS) {
+			ubi_err("cannot read fastmap from PEB %d, error %d",
+				pnum, err);
+			goto out_corrupted;
+		}
+	}
+
+	((struct ubi_fm_sb *)fm)->data_crc = 0;
+	crc = crc32(UBI_CRC32_INIT, fm, size);
+	if (crc != be32_to_cpu(sb->data_crc)) {
+		ubi_err("fastmap CRC error: calculated %#08x, must be %#08x",
+			crc, be32_to_cpu(sb->data_crc));
+		goto out_corrupted;
+	}
+
+	err = check_fastmap(ubi, fm, size);
+	if (err < 0) {
+		vfree(fm);
+		kfree(sb);
+		return ERR_PTR(err);
+	}
+	if (err)
+		goto out_corrupted;
+
+	kfree(sb);
+	return fm;
+
+out_corrupted:
+	vfree(fm);
+	kfree(sb);
+	return NULL;
+}
+
+/**
+ * ubi_read_fastmap - find and read the fastmap.
+ * @ubi: UBI device description object
+ * @anchors: PEB numbers of all fastmap anchors found are returned here
+ * @count: the number of anchors found is returned here
+ *
+ * Looks for fastmap anchors among the first %UBI_FM_MAX_START PEBs. There may
+ * be more than one if an older anchor could not be erased before an unclean
+ * reboot; the one with the highest sequence number is used. @anchors has to
+ * have room for %UBI_FM_MAX_START entries.
+ *
+ * Returns the fastmap - a vmalloc()'ed buffer with all the records already
+ * checked against the MTD device, so that the caller can use them as they
+ * are. Returns %NULL if there is no usable fastmap and an error pointer in
+ * case of failure.
+ */
+void *ubi_read_fastmap(struct ubi_device *ubi, int *anchors, int *count)
+{
+	int pnum, err, anchor = -1;
+	unsigned long long sqnum, anchor_sqnum = 0;
+	struct ubi_vid_hdr *vh;
+	void *fm;
+
+	*count = 0;
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		return ERR_PTR(-ENOMEM);
+
+	for (pnum = 0; pnum < ubi->peb_count && pnum < UBI_FM_MAX_START;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0) {
+			fm = ERR_PTR(err);
+			goto out;
+		} else if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+		if (err < 0) {
+			fm = ERR_PTR(err);
+			goto out;
+		} else if (err && err != UBI_IO_BITFLIPS)
+			continue;
+
+		if (be32_to_cpu(vh->vol_id) != UBI_FM_SB_VOLUME_ID)
+			continue;
+
+		anchors[*count] = pnum;
+		*count += 1;
+		sqnum = be64_to_cpu(vh->sqnum);
+		dbg_bld("fastmap anchor at PEB %d, sqnum %llu", pnum, sqnum);
+		if (anchor < 0 || sqnum > anchor_sqnum) {
+			anchor = pnum;
+			anchor_sqnum = sqnum;
+		}
+	}
+
+	if (anchor < 0) {
+		dbg_bld("no fastmap found");
+		fm = NULL;
+		goto out;
+	}
+
+	fm = read_fastmap(ubi, anchor, anchor_sqnum, vh);
+	if (!fm)
+		ubi_warn("fastmap at PEB %d is not usable", anchor);
+
+out:
+	ubi_free_vid_hdr(ubi, vh);
+	return fm;
+}
+
+/**
+ * fastmap_size - the maximum fastmap size.
+ * @ubi: UBI device description object
+ *
+ * Every PEB is either free, to be erased, or mapped, or not recorded at all,
+ * so the fastmap is never larger than the records for all PEBs plus the
+ * volume records. The volumes cannot change while @ubi->device_mutex is held.
+ */
+static int fastmap_size(struct ubi_device *ubi)
+{
+	int i, size;
+
+	size = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) +
+	       ubi->peb_count * sizeof(struct ubi_fm_ec);
+
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		if (!ubi->volumes[i])
+			continue;
+		size += sizeof(struct ubi_fm_volhdr) +
+			ubi->volumes[i]->reserved_pebs *
+			sizeof(struct ubi_fm_ec);
+	}
+	spin_unlock(&ubi->volumes_lock);
+
+	return size;
+}
+
+/**
+ * take_snapshot - fill the fastmap records in.
+ * @ubi: UBI device description object
+ * @fm: the buffer to fill in, large enough for 'fastmap_size()' bytes
+ * @new: the new fastmap, with @new->used to be filled in
+ * @sqnum: sequence number of the fastmap
+ *
+ * This function refills the pool, records the state of all PEBs except the
+ * pool ones, and makes @new the current fastmap, all atomically with respect
+ * to the EBA tables and the WL sub-system. From then on, only the pool PEBs
+ * are written to. Returns the size of the fastmap in bytes.
+ */
+static int take_snapshot(struct ubi_device *ubi, void *fm,
+			 struct ubi_fastmap *new, unsigned long long sqnum)
+{
+	int i, j, pnum, off, free_count = 0, erase_count = 0, vol_count = 0;
+	struct ubi_fm_hdr *fmhdr = fm + sizeof(struct ubi_fm_sb);
+	struct ubi_fm_volhdr *fmvhdr;
+	struct ubi_fm_ec *fmec;
+	struct ubi_wl_entry *e;
+	struct ubi_volume *vol;
+	struct ubi_work *wrk;
+	struct rb_node *rb;
+
+	off = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr);
+
+	down_write(&ubi->fm_eba_sem);
+	spin_lock(&ubi->volumes_lock);
+	spin_lock(&ubi->wl_lock);
+
+	ubi_wl_refill_pool(ubi);
+
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb) {
+		fmec = fm + off;
+		fmec->pnum = cpu_to_be32(e->pnum);
+		fmec->ec = cpu_to_be32(e->ec);
+		off += sizeof(struct ubi_fm_ec);
+		free_count += 1;
+	}
+
+	list_for_each_entry(wrk, &ubi->works, list) {
+		if (!ubi_is_erase_work(wrk))
+			continue;
+		fmec = fm + off;
+		fmec->pnum = cpu_to_be32(wrk->e->pnum);
+		fmec->ec = cpu_to_be32(wrk->e->ec);
+		off += sizeof(struct ubi_fm_ec);
+		erase_count += 1;
+	}
+
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		vol = ubi->volumes[i];
+		if (!vol)
+			continue;
+
+		fmvhdr = fm + off;
+		fmvhdr->magic = cpu_to_be32(UBI_FM_VHDR_MAGIC);
+		fmvhdr->vol_id = cpu_to_be32(vol->vol_id);
+		if (vol->vol_type == UBI_DYNAMIC_VOLUME)
+			fmvhdr->vol_type = UBI_VID_DYNAMIC;
+		else
+			fmvhdr->vol_type = UBI_VID_STATIC;
+		fmvhdr->data_pad = cpu_to_be32(vol->data_pad);
+		fmvhdr->used_ebs = cpu_to_be32(vol->used_ebs);
+		fmvhdr->last_eb_bytes = cpu_to_be32(vol->last_eb_bytes);
+		fmvhdr->reserved_pebs = cpu_to_be32(vol->reserved_pebs);
+		off += sizeof(struct ubi_fm_volhdr);
+
+		for (j = 0; j < vol->reserved_pebs; j++) {
+			pnum = vol->eba_tbl[j];
+			fmec = fm + off;
+			fmec->pnum = cpu_to_be32(pnum);
+			if (pnum >= 0) {
+				fmec->ec = cpu_to_be32(ubi->lookuptbl[pnum]->ec);
+				set_bit(pnum, new->used);
+			} else
+				fmec->ec = 0;
+			off += sizeof(struct ubi_fm_ec);
+		}
+		vol_count += 1;
+	}
+
+	fmhdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	fmhdr->peb_count = cpu_to_be32(ubi->peb_count);
+	fmhdr->free_peb_count = cpu_to_be32(free_count);
+	fmhdr->erase_peb_count = cpu_to_be32(erase_count);
+	fmhdr->vol_count = cpu_to_be32(vol_count);
+	fmhdr->max_sqnum = cpu_to_be64(sqnum);
+
+	ubi->fm = new;
+
+	spin_unlock(&ubi->wl_lock);
+	spin_unlock(&ubi->volumes_lock);
+	up_write(&ubi->fm_eba_sem);
+
+	return off;
+}
+
+/**
+ * ubi_update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function invalidates the current fastmap, takes a new snapshot and
+ * writes it to flash, with a fresh pool. It is called by the background
+ * thread when asked to, and on detach. Returns zero in case of success and a
+ * negative error code in case of failure; the device is then left without a
+ * fastmap, and the next attach does a full scan.
+ */
+int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	int i, err, size, used_blocks, len;
+	unsigned long long sqnum;
+	struct ubi_fastmap *new;
+	struct ubi_vid_hdr *vh;
+	struct ubi_fm_sb *sb;
+	void *fm;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->fm_wanted = 0;
+	spin_unlock(&ubi->wl_lock);
+
+	if (ubi->ro_mode)
+		return 0;
+
+	mutex_lock(&ubi->device_mutex);
+
+	size = fastmap_size(ubi);
+	used_blocks = DIV_ROUND_UP(size, ubi->leb_size);
+	if (used_blocks > UBI_FM_MAX_BLOCKS) {
+		ubi_err("fastmap would take %d PEBs, only %d are allowed",
+			used_blocks, UBI_FM_MAX_BLOCKS);
+		err = -ENOSPC;
+		goto out_unlock_dev;
+	}
+
+	err = -ENOMEM;
+	fm = vzalloc(used_blocks * ubi->leb_size);
+	if (!fm)
+		goto out_unlock_dev;
+
+	new = kzalloc(sizeof(struct ubi_fastmap), GFP_KERNEL);
+	if (!new)
+		goto out_free_fm;
+
+	new->used = kcalloc(BITS_TO_LONGS(ubi->peb_count),
+			    sizeof(unsigned long), GFP_KERNEL);
+	if (!new->used)
+		goto out_free_new;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		goto out_free_new;
+
+	mutex_lock(&ubi->fm_mutex);
+	down_write(&ubi->work_sem);
+
+	err = ubi_wl_release_fastmap(ubi);
+	if (err)
+		goto out_unlock;
+
+	for (i = 0; i < used_blocks; i++) {
+		new->e[i] = ubi_wl_get_fm_peb(ubi, i == 0);
+		if (!new->e[i]) {
+			ubi_warn("no free PEB for the fastmap%s",
+				 i == 0 ? " anchor" : "");
+			err = -ENOSPC;
+			while (i--)
+				ubi_wl_put_fm_peb(ubi, new->e[i]);
+			goto out_unlock;
+		}
+	}
+	new->used_blocks = used_blocks;
+
+	sqnum = ubi_next_sqnum(ubi);
+	size = take_snapshot(ubi, fm, new, sqnum);
+
+	sb = fm;
+	sb->magic = cpu_to_be32(UBI_FM_SB_MAGIC);
+	sb->version = UBI_FM_FMT_VERSION;
+	sb->used_blocks = cpu_to_be32(used_blocks);
+	for (i = 0; i < used_blocks; i++) {
+		sb->block_loc[i] = cpu_to_be32(new->e[i]->pnum);
+		sb->block_ec[i] = cpu_to_be32(new->e[i]->ec);
+	}
+	sb->sqnum = cpu_to_be64(sqnum);
+	sb->data_size = cpu_to_be32(size);
+	sb->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, fm, size));
+
+	vh->vol_type = UBI_VID_DYNAMIC;
+	vh->compat = UBI_FM_VOLUME_COMPAT;
+	vh->sqnum = cpu_to_be64(sqnum);
+
+	/* The anchor goes last, it makes the fastmap valid */
+	for (i = used_blocks - 1; i >= 0; i--) {
+		int pnum = new->e[i]->pnum;
+
+		vh->vol_id = cpu_to_be32(i ? UBI_FM_DATA_VOLUME_ID :
+					     UBI_FM_SB_VOLUME_ID);
+		vh->lnum = cpu_to_be32(i);
+		err = ubi_io_write_vid_hdr(ubi, pnum, vh);
+		if (err) {
+			ubi_err("cannot write fastmap VID header to PEB %d",
+				pnum);
+			goto out_release;
+		}
+
+		len = min_t(int, size - i * ubi->leb_size, ubi->leb_size);
+		len = ALIGN(len, ubi->min_io_size);
+		err = ubi_io_write_data(ubi, fm + i * ubi->leb_size, pnum, 0,
+					len);
+		if (err) {
+			ubi_err("cannot write fastmap to PEB %d", pnum);
+			goto out_release;
+		}
+	}
+
+	dbg_gen("fastmap written to PEB %d: %d bytes in %d PEBs, pool of %d",
+		new->e[0]->pnum, size, used_blocks, ubi->fm_pool_count);
+
+	up_write(&ubi->work_sem);
+	mutex_unlock(&ubi->fm_mutex);
+	mutex_unlock(&ubi->device_mutex);
+	ubi_free_vid_hdr(ubi, vh);
+	vfree(fm);
+	return 0;
+
+out_release:
+	/* The fastmap is published already, take it back */
+	ubi_wl_release_fastmap(ubi);
+	new = NULL;
+out_unlock:
+	up_write(&ubi->work_sem);
+	mutex_unlock(&ubi->fm_mutex);
+	ubi_free_vid_hdr(ubi, vh);
+out_free_new:
+	if (new) {
+		kfree(new->used);
+		kfree(new);
+	}
+out_free_fm:
+	vfree(fm);
+out_unlock_dev:
+	mutex_unlock(&ubi->device_mutex);
+	return err;
+}
+
+/**
+ * ubi_invalidate_fastmap - drop the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function is used when UBI cannot keep to the limits the fastmap on
+ * flash sets, e.g., when the pool is used up. The fastmap anchor is erased, so
+ * the next attach scans the whole device, unless the background thread writes
+ * a new fastmap before that, which it is asked to. Returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+int ubi_invalidate_fastmap(struct ubi_device *ubi)
+{
+	int err;
+
+	mutex_lock(&ubi->fm_mutex);
+	err = ubi_wl_release_fastmap(ubi);
+	spin_lock(&ubi->wl_lock);
+	ubi_wl_request_fastmap(ubi);
+	spin_unlock(&ubi->wl_lock);
+	mutex_unlock(&ubi->fm_mutex);
+
+	return err;
+}
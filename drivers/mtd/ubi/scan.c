@@ -98,6 +98,9 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si);
 static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
 
+/* Returned by 'scan_fastmap()' if the whole MTD device has to be scanned */
+#define UBI_NO_FASTMAP 1
+
 /**
  * add_to_list - add physical eraseblock to a list.
  * @si: scanning information
@@ -1140,12 +1143,229 @@ static int check_what_we_have(struct ubi_device *ubi, struct ubi_scan_info *si)
 	return 0;
 }
 
+/**
+ * count_ec - account an erase counter taken from the fastmap.
+ * @si: scanning information
+ * @ec: the erase counter
+ */
+static void count_ec(struct ubi_scan_info *si, int ec)
+{
+	si->ec_sum += ec;
+	si->ec_count += 1;
+	if (ec > si->max_ec)
+		si->max_ec = ec;
+	if (ec < si->min_ec)
+		si->min_ec = ec;
+}
+
+/**
+ * add_fm_peb - add a PEB the fastmap records as free or to be erased.
+ * @si: scanning information
+ * @claimed: bitmap of the PEBs taken from the fastmap
+ * @fmec: the fastmap record of the PEB
+ * @list: the list to add to
+ *
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+static int add_fm_peb(struct ubi_scan_info *si, unsigned long *claimed,
+		      const struct ubi_fm_ec *fmec, struct list_head *list)
+{
+	int pnum = be32_to_cpu(fmec->pnum), ec = be32_to_cpu(fmec->ec);
+
+	set_bit(pnum, claimed);
+	count_ec(si, ec);
+	return add_to_list(si, pnum, ec, 0, list);
+}
+
+/**
+ * add_fm_volume - add the LEBs of a volume the fastmap records.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @claimed: bitmap of the PEBs taken from the fastmap
+ * @fmvhdr: the fastmap volume record, followed by the EBA table records
+ *
+ * The fastmap does not store VID headers, so one is made up for each mapped
+ * LEB. Its sequence number is zero, so if a pool PEB turns out to hold the
+ * same LEB, that one is newer, which it is. Returns zero in case of success
+ * and a negative error code in case of failure.
+ */
+static int add_fm_volume(struct ubi_device *ubi, struct ubi_scan_info *si,
+			 unsigned long *claimed,
+			 const struct ubi_fm_volhdr *fmvhdr)
+{
+	int lnum, pnum, ec, err, vol_id = be32_to_cpu(fmvhdr->vol_id);
+	int reserved_pebs = be32_to_cpu(fmvhdr->reserved_pebs);
+	int used_ebs = be32_to_cpu(fmvhdr->used_ebs);
+	int data_pad = be32_to_cpu(fmvhdr->data_pad);
+	const struct ubi_fm_ec *fmec = (const void *)(fmvhdr + 1);
+
+	memset(vidh, 0, sizeof(struct ubi_vid_hdr));
+	vidh->vol_type = fmvhdr->vol_type;
+	vidh->vol_id = fmvhdr->vol_id;
+	vidh->data_pad = fmvhdr->data_pad;
+	if (vol_id == UBI_LAYOUT_VOLUME_ID)
+		vidh->compat = UBI_LAYOUT_VOLUME_COMPAT;
+	if (fmvhdr->vol_type == UBI_VID_STATIC)
+		vidh->used_ebs = fmvhdr->used_ebs;
+
+	for (lnum = 0; lnum < reserved_pebs; lnum++, fmec++) {
+		pnum = be32_to_cpu(fmec->pnum);
+		if (pnum == UBI_LEB_UNMAPPED)
+			continue;
+
+		vidh->lnum = cpu_to_be32(lnum);
+		if (fmvhdr->vol_type == UBI_VID_STATIC) {
+			if (lnum == used_ebs - 1)
+				vidh->data_size = fmvhdr->last_eb_bytes;
+			else
+				vidh->data_size =
+					cpu_to_be32(ubi->leb_size - data_pad);
+		}
+
+		ec = be32_to_cpu(fmec->ec);
+		err = ubi_scan_add_used(ubi, si, pnum, ec, vidh, 0);
+		if (err)
+			return err;
+		set_bit(pnum, claimed);
+		count_ec(si, ec);
+	}
+
+	return 0;
+}
+
+/**
+ * scan_fastmap - build scanning information from the fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information, still empty
+ *
+ * This function takes all the PEBs the fastmap records from it and scans only
+ * the others, which are the fastmap pool, bad PEBs and PEBs which were in use
+ * but not mapped when the fastmap was written. All fastmap anchors found are
+ * erased afterwards, as anything written from now on makes them stale.
+ *
+ * Returns zero in case of success, %UBI_NO_FASTMAP if there is no usable
+ * fastmap (@si is untouched then), and a negative error code in case of
+ * failure.
+ */
+static int scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int i, err, pnum, count, anchor_count, scanned = 0;
+	int anchors[UBI_FM_MAX_START];
+	unsigned long *claimed = NULL;
+	const struct ubi_fm_sb *sb;
+	const struct ubi_fm_hdr *fmhdr;
+	const struct ubi_fm_ec *fmec;
+	const struct ubi_fm_volhdr *fmvhdr;
+	void *fm;
+
+	fm = ubi_read_fastmap(ubi, anchors, &anchor_count);
+	if (IS_ERR(fm))
+		return PTR_ERR(fm);
+	if (!fm) {
+		err = UBI_NO_FASTMAP;
+		goto out_erase;
+	}
+
+	err = -ENOMEM;
+	claimed = kcalloc(BITS_TO_LONGS(ubi->peb_count), sizeof(unsigned long),
+			  GFP_KERNEL);
+	if (!claimed)
+		goto out_free;
+
+	sb = fm;
+	fmhdr = fm + sizeof(struct ubi_fm_sb);
+	fmec = fm + sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr);
+
+	err = ubi_io_read_ec_hdr(ubi, be32_to_cpu(sb->block_loc[0]), ech, 0);
+	if (err < 0)
+		goto out_free;
+	if ((!err || err == UBI_IO_BITFLIPS) && !ubi->image_seq)
+		ubi->image_seq = be32_to_cpu(ech->image_seq);
+
+	/* The fastmap itself is stale as soon as anything is written */
+	for (i = 0; i < be32_to_cpu(sb->used_blocks); i++) {
+		struct ubi_fm_ec rec;
+
+		rec.pnum = sb->block_loc[i];
+		rec.ec = sb->block_ec[i];
+		err = add_fm_peb(si, claimed, &rec, &si->erase);
+		if (err)
+			goto out_free;
+	}
+
+	count = be32_to_cpu(fmhdr->free_peb_count);
+	for (i = 0; i < count; i++, fmec++) {
+		err = add_fm_peb(si, claimed, fmec, &si->free);
+		if (err)
+			goto out_free;
+	}
+
+	count = be32_to_cpu(fmhdr->erase_peb_count);
+	for (i = 0; i < count; i++, fmec++) {
+		err = add_fm_peb(si, claimed, fmec, &si->erase);
+		if (err)
+			goto out_free;
+	}
+
+	count = be32_to_cpu(fmhdr->vol_count);
+	for (i = 0; i < count; i++) {
+		fmvhdr = (const void *)fmec;
+		err = add_fm_volume(ubi, si, claimed, fmvhdr);
+		if (err)
+			goto out_free;
+		fmec = (const void *)(fmvhdr + 1);
+		fmec += be32_to_cpu(fmvhdr->reserved_pebs);
+	}
+
+	if (si->max_sqnum < be64_to_cpu(fmhdr->max_sqnum))
+		si->max_sqnum = be64_to_cpu(fmhdr->max_sqnum);
+	si->is_fastmap = 1;
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (test_bit(pnum, claimed))
+			continue;
+
+		cond_resched();
+
+		dbg_gen("process PEB %d", pnum);
+		err = process_eb(ubi, si, pnum);
+		if (err < 0)
+			goto out_free;
+		scanned += 1;
+	}
+
+	ubi_msg("attached by fastmap from PEB %d, scanned %d PEBs",
+		be32_to_cpu(sb->block_loc[0]), scanned);
+	err = 0;
+
+out_free:
+	kfree(claimed);
+	vfree(fm);
+out_erase:
+	if (err >= 0 && !ubi->ro_mode) {
+		for (i = 0; i < anchor_count; i++) {
+			int err1 = ubi_io_sync_erase(ubi, anchors[i], 0);
+
+			if (err1 < 0) {
+				ubi_err("cannot erase fastmap anchor PEB %d",
+					anchors[i]);
+				ubi_ro_mode(ubi);
+				break;
+			}
+		}
+	}
+	return err;
+}
+
 /**
  * ubi_scan - scan an MTD device.
  * @ubi: UBI device description object
  *
  * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * information about it. If there is a fastmap, it is used instead, and only
+ * the PEBs it does not know about are scanned. In case of failure, an error
+ * code is returned.
  */
 struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 {
@@ -1180,13 +1400,19 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	if (!vidh)
 		goto out_ech;
 
-	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
-		cond_resched();
+	err = scan_fastmap(ubi, si);
+	if (err < 0)
+		goto out_vidh;
 
-		dbg_gen("process PEB %d", pnum);
-		err = process_eb(ubi, si, pnum);
-		if (err < 0)
-			goto out_vidh;
+	if (err == UBI_NO_FASTMAP) {
+		for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+			cond_resched();
+
+			dbg_gen("process PEB %d", pnum);
+			err = process_eb(ubi, si, pnum);
+			if (err < 0)
+				goto out_vidh;
+		}
 	}
 
 	dbg_msg("scanning is finished");
@@ -1466,8 +1692,15 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si)
 		goto out;
 	}
 
-	/* Check that scanning information is correct */
+	/*
+	 * Check that scanning information is correct. The VID headers of LEBs
+	 * taken from the fastmap are made up, there is nothing to check them
+	 * against.
+	 */
 	ubi_rb_for_each_entry(rb1, sv, &si->volumes, rb) {
+		if (si->is_fastmap)
+			break;
+
 		last_seb = NULL;
 		ubi_rb_for_each_entry(rb2, seb, &sv->root, u.rb) {
 			int vol_type;
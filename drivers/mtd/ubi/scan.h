@@ -103,6 +103,7 @@ struct ubi_scan_volume {
  * @vols_found: number of volumes found during scanning
  * @highest_vol_id: highest volume ID
  * @is_empty: flag indicating whether the MTD device is empty or not
+ * @is_fastmap: flag indicating whether the information comes from a fastmap
  * @min_ec: lowest erase counter value
  * @max_ec: highest erase counter value
  * @max_sqnum: highest sequence number value
@@ -129,6 +130,7 @@ struct ubi_scan_info {
 	int vols_found;
 	int highest_vol_id;
 	int is_empty;
+	int is_fastmap;
 	int min_ec;
 	int max_ec;
 	unsigned long long max_sqnum;
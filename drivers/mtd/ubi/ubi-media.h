@@ -312,6 +312,16 @@ struct ubi_vid_hdr {
 #define UBI_LAYOUT_VOLUME_NAME   "layout volume"
 #define UBI_LAYOUT_VOLUME_COMPAT UBI_COMPAT_REJECT
 
+/*
+ * The fastmap is stored in two internal volumes: the super block (anchor)
+ * volume, which has one LEB, and the data volume. Both are "delete"
+ * compatible, so UBI implementations which do not know about fastmap just
+ * drop them.
+ */
+#define UBI_FM_SB_VOLUME_ID      (UBI_LAYOUT_VOLUME_ID + 1)
+#define UBI_FM_DATA_VOLUME_ID    (UBI_LAYOUT_VOLUME_ID + 2)
+#define UBI_FM_VOLUME_COMPAT     UBI_COMPAT_DELETE
+
 /* The maximum number of volumes per one UBI device */
 #define UBI_MAX_VOLUMES 128
 
@@ -375,4 +385,109 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __packed;
 
+/* Fastmap format version */
+#define UBI_FM_FMT_VERSION 1
+
+/* Fastmap magic numbers */
+#define UBI_FM_SB_MAGIC   0x7B11D69F
+#define UBI_FM_HDR_MAGIC  0xD4B82EF7
+#define UBI_FM_VHDR_MAGIC 0xFA370ED1
+
+/* The fastmap anchor has to be among the first @UBI_FM_MAX_START PEBs */
+#define UBI_FM_MAX_START 64
+
+/* Maximum number of PEBs the fastmap may span, the anchor included */
+#define UBI_FM_MAX_BLOCKS 32
+
+/**
+ * struct ubi_fm_sb - fastmap super block.
+ * @magic: fastmap super block magic number (%UBI_FM_SB_MAGIC)
+ * @version: format version of this fastmap
+ * @data_crc: CRC checksum of the whole fastmap, computed with this field
+ *            set to zero
+ * @used_blocks: number of PEBs used by this fastmap
+ * @block_loc: PEB numbers of the fastmap blocks, the anchor first
+ * @block_ec: erase counters of the fastmap blocks
+ * @sqnum: sequence number of the VID headers of all fastmap blocks
+ * @data_size: size of the fastmap in bytes, this super block included
+ *
+ * The super block starts the data area of the anchor PEB, which is the only
+ * LEB of the %UBI_FM_SB_VOLUME_ID volume. The rest of the fastmap follows it
+ * and continues in the PEBs of the %UBI_FM_DATA_VOLUME_ID volume, in the
+ * order given by @block_loc. Their VID headers carry the same @sqnum as the
+ * anchor, which tells them apart from leftovers of older fastmaps.
+ *
+ * The fastmap is a snapshot of the PEB states: &struct ubi_fm_hdr, then
+ * @free_peb_count and @erase_peb_count &struct ubi_fm_ec records, then for
+ * each volume a &struct ubi_fm_volhdr followed by one &struct ubi_fm_ec per
+ * reserved LEB (the EBA table, with %0xFFFFFFFF for unmapped LEBs). PEBs
+ * the fastmap does not mention at all - the pool of PEBs UBI was allowed to
+ * write to after the snapshot, bad PEBs, and so on - are scanned on attach.
+ */
+struct ubi_fm_sb {
+	__be32 magic;
+	__u8   version;
+	__u8   padding1[3];
+	__be32 data_crc;
+	__be32 used_blocks;
+	__be32 block_loc[UBI_FM_MAX_BLOCKS];
+	__be32 block_ec[UBI_FM_MAX_BLOCKS];
+	__be64 sqnum;
+	__be32 data_size;
+	__u8   padding2[28];
+} __packed;
+
+/**
+ * struct ubi_fm_hdr - fastmap header.
+ * @magic: fastmap header magic number (%UBI_FM_HDR_MAGIC)
+ * @peb_count: number of PEBs of the device the fastmap was written for
+ * @free_peb_count: number of free PEB records
+ * @erase_peb_count: number of records of PEBs which have to be erased
+ * @vol_count: number of volume records
+ * @max_sqnum: highest sequence number in use when the fastmap was written
+ */
+struct ubi_fm_hdr {
+	__be32 magic;
+	__be32 peb_count;
+	__be32 free_peb_count;
+	__be32 erase_peb_count;
+	__be32 vol_count;
+	__u8   padding1[4];
+	__be64 max_sqnum;
+	__u8   padding2[32];
+} __packed;
+
+/**
+ * struct ubi_fm_ec - a PEB and its erase counter.
+ * @pnum: PEB number
+ * @ec: erase counter
+ */
+struct ubi_fm_ec {
+	__be32 pnum;
+	__be32 ec;
+} __packed;
+
+/**
+ * struct ubi_fm_volhdr - fastmap volume record.
+ * @magic: volume record magic number (%UBI_FM_VHDR_MAGIC)
+ * @vol_id: volume ID
+ * @vol_type: type of the volume (%UBI_VID_DYNAMIC or %UBI_VID_STATIC)
+ * @data_pad: how many bytes at the end of LEBs are not used
+ * @used_ebs: number of used LEBs (static volumes only)
+ * @last_eb_bytes: data bytes in the last used LEB (static volumes only)
+ * @reserved_pebs: number of LEBs of the volume, which is also the number of
+ *                 &struct ubi_fm_ec records following this one
+ */
+struct ubi_fm_volhdr {
+	__be32 magic;
+	__be32 vol_id;
+	__u8   vol_type;
+	__u8   padding1[3];
+	__be32 data_pad;
+	__be32 used_ebs;
+	__be32 last_eb_bytes;
+	__be32 reserved_pebs;
+	__u8   padding2[8];
+} __packed;
+
 #endif /* !__UBI_MEDIA_H__ */
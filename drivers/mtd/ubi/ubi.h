@@ -107,6 +107,14 @@ enum {
 	UBI_IO_BITFLIPS,
 };
 
+
+/*
+ * Limits of the fastmap pool size. The pool is what attach has to scan, and
+ * how many PEBs may be written to before the fastmap has to be rewritten.
+ */
+#define UBI_FM_MIN_POOL_SIZE 8
+#define UBI_FM_MAX_POOL_SIZE 256
+
 /*
  * Return codes of the 'ubi_eba_copy_leb()' function.
  *
@@ -151,6 +159,44 @@ struct ubi_wl_entry {
 	int pnum;
 };
 
+struct ubi_device;
+
+/**
+ * struct ubi_work - UBI work description data structure.
+ * @list: a link in the list of pending works
+ * @func: worker function
+ * @e: physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * The @func pointer points to the worker function. If the @cancel argument is
+ * not zero, the worker has to free the resources and exit immediately. The
+ * worker has to return zero in case of success and a negative error code in
+ * case of failure.
+ */
+struct ubi_work {
+	struct list_head list;
+	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
+	/* The below fields are only relevant to erasure works */
+	struct ubi_wl_entry *e;
+	int torture;
+};
+
+/**
+ * struct ubi_fastmap - the fastmap currently on flash.
+ * @used_blocks: number of PEBs the fastmap takes
+ * @e: WL entries of these PEBs, the anchor first
+ * @used: bitmap of the PEBs the fastmap records as mapped to a LEB
+ *
+ * While a fastmap is on flash, PEBs it records as mapped are not erased, and
+ * only PEBs from the pool (@ubi->fm_pool) are written to. Everything else
+ * UBI does is found again on attach by scanning the pool.
+ */
+struct ubi_fastmap {
+	int used_blocks;
+	struct ubi_wl_entry *e[UBI_FM_MAX_BLOCKS];
+	unsigned long *used;
+};
+
 /**
  * struct ubi_ltree_entry - an entry in the lock tree.
  * @rb: links RB-tree nodes
@@ -343,7 +389,8 @@ struct ubi_wl_entry;
  * @pq_head: protection queue head
  * @wl_lock: protects the @used, @free, @pq, @pq_head, @lookuptbl, @move_from,
  *	     @move_to, @move_to_put @erase_pending, @wl_scheduled, @works,
- *	     @erroneous, and @erroneous_peb_count fields
+ *	     @erroneous, @erroneous_peb_count, @fm, @fm_pool, @fm_pool_count,
+ *	     @fm_erase and @fm_erase_count fields
  * @move_mutex: serializes eraseblock moves
  * @work_sem: synchronizes the WL worker with use tasks
  * @wl_scheduled: non-zero if the wear-leveling was scheduled
@@ -358,6 +405,19 @@ struct ubi_wl_entry;
  * @thread_enabled: if the background thread is enabled
  * @bgt_name: background thread name
  *
+ * @fm: the fastmap currently on flash, %NULL if there is none
+ * @fm_pool: RB-tree of free PEBs which may be written while @fm is on flash
+ * @fm_pool_count: count of PEBs in @fm_pool
+ * @fm_pool_size: how many PEBs a fresh @fm_pool gets
+ * @fm_erase: erase works of PEBs @fm records as mapped, held back until @fm
+ *            is replaced
+ * @fm_erase_count: count of works in @fm_erase
+ * @fm_wanted: a new fastmap should be written by the background thread
+ * @fm_mutex: serializes writing and invalidating the fastmap
+ * @fm_eba_sem: held for reading while an EBA table entry is changed together
+ *              with putting the PEB it pointed to, and for writing while the
+ *              fastmap takes its snapshot of the EBA tables
+ *
  * @flash_size: underlying MTD device size (in bytes)
  * @peb_count: count of physical eraseblocks on the MTD device
  * @peb_size: physical eraseblock size
@@ -446,6 +506,17 @@ struct ubi_device {
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
 
+	/* Fastmap stuff */
+	struct ubi_fastmap *fm;
+	struct rb_root fm_pool;
+	int fm_pool_count;
+	int fm_pool_size;
+	struct list_head fm_erase;
+	int fm_erase_count;
+	int fm_wanted;
+	struct mutex fm_mutex;
+	struct rw_semaphore fm_eba_sem;
+
 	/* I/O sub-system's stuff */
 	long long flash_size;
 	int peb_count;
@@ -534,6 +605,7 @@ int ubi_eba_atomic_leb_change(struct ubi_device *ubi, struct ubi_volume *vol,
 int ubi_eba_copy_leb(struct ubi_device *ubi, int from, int to,
 		     struct ubi_vid_hdr *vid_hdr);
 int ubi_eba_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 
 /* wl.c */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype);
@@ -543,6 +615,29 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+int ubi_is_erase_work(struct ubi_work *wrk);
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor);
+void ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e);
+void ubi_wl_refill_pool(struct ubi_device *ubi);
+int ubi_wl_release_fastmap(struct ubi_device *ubi);
+void ubi_wl_request_fastmap(struct ubi_device *ubi);
+int ubi_wl_in_fastmap(struct ubi_device *ubi, int pnum);
+
+/* fastmap.c */
+#ifdef CONFIG_MTD_UBI_FASTMAP
+void *ubi_read_fastmap(struct ubi_device *ubi, int *anchors, int *count);
+int ubi_update_fastmap(struct ubi_device *ubi);
+int ubi_invalidate_fastmap(struct ubi_device *ubi);
+#else
+static inline void *ubi_read_fastmap(struct ubi_device *ubi, int *anchors,
+				     int *count)
+{
+	*count = 0;
+	return NULL;
+}
+static inline int ubi_update_fastmap(struct ubi_device *ubi) { return 0; }
+static inline int ubi_invalidate_fastmap(struct ubi_device *ubi) { return 0; }
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
@@ -142,26 +142,6 @@
  */
 #define WL_MAX_FAILURES 32
 
-/**
- * struct ubi_work - UBI work description data structure.
- * @list: a link in the list of pending works
- * @func: worker function
- * @e: physical eraseblock to erase
- * @torture: if the physical eraseblock has to be tortured
- *
- * The @func pointer points to the worker function. If the @cancel argument is
- * not zero, the worker has to free the resources and exit immediately. The
- * worker has to return zero in case of success and a negative error code in
- * case of failure.
- */
-struct ubi_work {
-	struct list_head list;
-	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
-	/* The below fields are only relevant to erasure works */
-	struct ubi_wl_entry *e;
-	int torture;
-};
-
 #ifdef CONFIG_MTD_UBI_DEBUG
 static int paranoid_check_ec(struct ubi_device *ubi, int pnum, int ec);
 static int paranoid_check_in_wl_tree(const struct ubi_device *ubi,
@@ -272,7 +252,7 @@ static int produce_free_peb(struct ubi_device *ubi)
 	int err;
 
 	spin_lock(&ubi->wl_lock);
-	while (!ubi->free.rb_node) {
+	while (!ubi->free.rb_node && !ubi->fm_pool.rb_node) {
 		spin_unlock(&ubi->wl_lock);
 
 		dbg_wl("do one work synchronously");
@@ -380,6 +360,43 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int diff)
 	return e;
 }
 
+/**
+ * free_tree - the tree free physical eraseblocks may be taken from.
+ * @ubi: UBI device description object
+ *
+ * While a fastmap is on flash, the PEBs it records as free must stay
+ * untouched: an attach from that fastmap would not look at them. Writes then
+ * go to the PEBs of the pool, which the attach does scan. Note, @ubi->wl_lock
+ * has to be locked.
+ */
+static struct rb_root *free_tree(struct ubi_device *ubi)
+{
+	if (ubi->fm)
+		return &ubi->fm_pool;
+	return &ubi->free;
+}
+
+/**
+ * take_free_peb - take a PEB out of the tree returned by 'free_tree()'.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock to take
+ * @root: the tree @e is in
+ *
+ * When the pool runs low, the background thread is asked to write a new
+ * fastmap with a fresh pool. Note, @ubi->wl_lock has to be locked.
+ */
+static void take_free_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+			  struct rb_root *root)
+{
+	paranoid_check_in_wl_tree(ubi, e, root);
+	rb_erase(&e->u.rb, root);
+	if (root == &ubi->fm_pool) {
+		ubi->fm_pool_count -= 1;
+		if (ubi->fm_pool_count < ubi->fm_pool_size / 4)
+			ubi_wl_request_fastmap(ubi);
+	}
+}
+
 /**
  * ubi_wl_get_peb - get a physical eraseblock.
  * @ubi: UBI device description object
@@ -392,13 +409,28 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 {
 	int err;
 	struct ubi_wl_entry *e, *first, *last;
+	struct rb_root *root;
 
 	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
 		   dtype == UBI_UNKNOWN);
 
 retry:
 	spin_lock(&ubi->wl_lock);
-	if (!ubi->free.rb_node) {
+	root = free_tree(ubi);
+	if (!root->rb_node && root == &ubi->fm_pool) {
+		/*
+		 * The pool is used up before a new fastmap could be written.
+		 * Drop the fastmap, then any free PEB may be used.
+		 */
+		spin_unlock(&ubi->wl_lock);
+
+		err = ubi_invalidate_fastmap(ubi);
+		if (err)
+			return err;
+		goto retry;
+	}
+
+	if (!root->rb_node) {
 		if (ubi->works_count == 0) {
 			ubi_assert(list_empty(&ubi->works));
 			ubi_err("no free eraseblocks");
@@ -421,7 +453,7 @@ retry:
 		 * bounded by the the lowest erase counter plus
 		 * %WL_FREE_MAX_DIFF.
 		 */
-		e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e = find_wl_entry(root, WL_FREE_MAX_DIFF);
 		break;
 	case UBI_UNKNOWN:
 		/*
@@ -430,34 +462,30 @@ retry:
 		 * eraseblock with erase counter greater or equivalent than the
 		 * lowest erase counter plus %WL_FREE_MAX_DIFF/2.
 		 */
-		first = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry,
-					u.rb);
-		last = rb_entry(rb_last(&ubi->free), struct ubi_wl_entry, u.rb);
+		first = rb_entry(rb_first(root), struct ubi_wl_entry, u.rb);
+		last = rb_entry(rb_last(root), struct ubi_wl_entry, u.rb);
 
 		if (last->ec - first->ec < WL_FREE_MAX_DIFF)
-			e = rb_entry(ubi->free.rb_node,
-					struct ubi_wl_entry, u.rb);
+			e = rb_entry(root->rb_node, struct ubi_wl_entry, u.rb);
 		else
-			e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF/2);
+			e = find_wl_entry(root, WL_FREE_MAX_DIFF/2);
 		break;
 	case UBI_SHORTTERM:
 		/*
 		 * For short term data we pick a physical eraseblock with the
 		 * lowest erase counter as we expect it will be erased soon.
 		 */
-		e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry, u.rb);
+		e = rb_entry(rb_first(root), struct ubi_wl_entry, u.rb);
 		break;
 	default:
 		BUG();
 	}
 
-	paranoid_check_in_wl_tree(ubi, e, &ubi->free);
-
 	/*
 	 * Move the physical eraseblock to the protection queue where it will
 	 * be protected from being moved for some time.
 	 */
-	rb_erase(&e->u.rb, &ubi->free);
+	take_free_peb(ubi, e, root);
 	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
 	prot_queue_add(ubi, e);
 	spin_unlock(&ubi->wl_lock);
@@ -669,6 +697,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	int vol_id = -1, uninitialized_var(lnum);
 	struct ubi_wl_entry *e1, *e2;
 	struct ubi_vid_hdr *vid_hdr;
+	struct rb_root *root;
 
 	kfree(wrk);
 	if (cancel)
@@ -683,12 +712,15 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi_assert(!ubi->move_from && !ubi->move_to);
 	ubi_assert(!ubi->move_to_put);
 
-	if (!ubi->free.rb_node ||
+	root = free_tree(ubi);
+	if (!root->rb_node ||
 	    (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
 		/*
 		 * No free physical eraseblocks? Well, they must be waiting in
-		 * the queue to be erased. Cancel movement - it will be
-		 * triggered again when a free physical eraseblock appears.
+		 * the queue to be erased, or the fastmap pool is used up and
+		 * a new fastmap is about to bring a fresh one. Cancel
+		 * movement - it will be triggered again when a free physical
+		 * eraseblock appears.
 		 *
 		 * No used physical eraseblocks? They must be temporarily
 		 * protected from being moved. They will be moved to the
@@ -696,7 +728,9 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * triggered again.
 		 */
 		dbg_wl("cancel WL, a list is empty: free %d, used %d",
-		       !ubi->free.rb_node, !ubi->used.rb_node);
+		       !root->rb_node, !ubi->used.rb_node);
+		if (!root->rb_node && root == &ubi->fm_pool)
+			ubi_wl_request_fastmap(ubi);
 		goto out_cancel;
 	}
 
@@ -707,7 +741,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * counters differ much enough, start wear-leveling.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD)) {
 			dbg_wl("no WL needed: min used EC %d, max free EC %d",
@@ -722,14 +756,13 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		/* Perform scrubbing */
 		scrubbing = 1;
 		e1 = rb_entry(rb_first(&ubi->scrub), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 		paranoid_check_in_wl_tree(ubi, e1, &ubi->scrub);
 		rb_erase(&e1->u.rb, &ubi->scrub);
 		dbg_wl("scrub PEB %d to PEB %d", e1->pnum, e2->pnum);
 	}
 
-	paranoid_check_in_wl_tree(ubi, e2, &ubi->free);
-	rb_erase(&e2->u.rb, &ubi->free);
+	take_free_peb(ubi, e2, root);
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -963,7 +996,9 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	 * the WL worker has to be scheduled anyway.
 	 */
 	if (!ubi->scrub.rb_node) {
-		if (!ubi->used.rb_node || !ubi->free.rb_node)
+		struct rb_root *root = free_tree(ubi);
+
+		if (!ubi->used.rb_node || !root->rb_node)
 			/* No physical eraseblocks - no deal */
 			goto out_unlock;
 
@@ -974,7 +1009,7 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		 * %UBI_WL_THRESHOLD.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD))
 			goto out_unlock;
@@ -1027,6 +1062,22 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 		return 0;
 	}
 
+	spin_lock(&ubi->wl_lock);
+	if (ubi->fm && test_bit(pnum, ubi->fm->used)) {
+		/*
+		 * The fastmap on flash still maps a LEB to this PEB. Erase it
+		 * only once a new fastmap has been written.
+		 */
+		dbg_wl("PEB %d is in the fastmap, hold back its erasure", pnum);
+		list_add_tail(&wl_wrk->list, &ubi->fm_erase);
+		ubi->fm_erase_count += 1;
+		if (ubi->fm_erase_count > ubi->fm_pool_size)
+			ubi_wl_request_fastmap(ubi);
+		spin_unlock(&ubi->wl_lock);
+		return 0;
+	}
+	spin_unlock(&ubi->wl_lock);
+
 	dbg_wl("erase PEB %d EC %d", pnum, e->ec);
 
 	err = sync_erase(ubi, e, wl_wrk->torture);
@@ -1301,6 +1352,16 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	down_write(&ubi->work_sem);
 	up_write(&ubi->work_sem);
 
+	/*
+	 * Erasures held back for the fastmap are pending as well, and the
+	 * callers rely on them being done. Drop the fastmap to let them go.
+	 */
+	if (ubi->fm_erase_count) {
+		err = ubi_invalidate_fastmap(ubi);
+		if (err)
+			return err;
+	}
+
 	/*
 	 * And in case last was the WL worker and it canceled the LEB
 	 * movement, flush again.
@@ -1315,6 +1376,192 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	return 0;
 }
 
+/**
+ * ubi_is_erase_work - check if a work is an erase work.
+ * @wrk: the work to check
+ */
+int ubi_is_erase_work(struct ubi_work *wrk)
+{
+	return wrk->func == erase_worker;
+}
+
+/**
+ * ubi_wl_get_fm_peb - get a free physical eraseblock for the fastmap itself.
+ * @ubi: UBI device description object
+ * @anchor: if the PEB is going to be the fastmap anchor
+ *
+ * The anchor has to be among the first %UBI_FM_MAX_START PEBs, so that attach
+ * finds it quickly. Other fastmap PEBs are taken from beyond that area, if
+ * possible, to leave room for future anchors. Fastmap PEBs are rewritten
+ * often, so the lowest erase counters are preferred. Returns %NULL if there is
+ * no suitable free PEB.
+ */
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor)
+{
+	struct rb_node *rb;
+	struct ubi_wl_entry *e, *found = NULL;
+
+	spin_lock(&ubi->wl_lock);
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb) {
+		if (anchor) {
+			if (e->pnum < UBI_FM_MAX_START) {
+				found = e;
+				break;
+			}
+		} else {
+			if (!found)
+				found = e;
+			if (e->pnum >= UBI_FM_MAX_START) {
+				found = e;
+				break;
+			}
+		}
+	}
+	if (found) {
+		paranoid_check_in_wl_tree(ubi, found, &ubi->free);
+		rb_erase(&found->u.rb, &ubi->free);
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	return found;
+}
+
+/**
+ * ubi_wl_put_fm_peb - return an unused fastmap PEB.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock, as returned by 'ubi_wl_get_fm_peb()'
+ *
+ * This function is used when a fastmap PEB was not written to after all.
+ */
+void ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	spin_lock(&ubi->wl_lock);
+	wl_tree_add(e, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ubi_wl_refill_pool - fill the fastmap pool up from the free tree.
+ * @ubi: UBI device description object
+ *
+ * The pool gets PEBs with both low and high erase counters, so that
+ * 'ubi_wl_get_peb()' and the WL worker still have a choice. Note,
+ * @ubi->wl_lock has to be locked.
+ */
+void ubi_wl_refill_pool(struct ubi_device *ubi)
+{
+	struct ubi_wl_entry *e;
+
+	while (ubi->fm_pool_count < ubi->fm_pool_size && ubi->free.rb_node) {
+		if (ubi->fm_pool_count & 1)
+			e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		else
+			e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry,
+				     u.rb);
+		rb_erase(&e->u.rb, &ubi->free);
+		wl_tree_add(e, &ubi->fm_pool);
+		ubi->fm_pool_count += 1;
+	}
+}
+
+/**
+ * ubi_wl_release_fastmap - invalidate the fastmap and release its PEBs.
+ * @ubi: UBI device description object
+ *
+ * This function erases the fastmap anchor, so that the next attach scans the
+ * MTD device, returns the pool to the free tree and lets the held back
+ * erasures go ahead. The caller has to hold @ubi->fm_mutex. Returns zero in
+ * case of success and a negative error code in case of failure.
+ */
+int ubi_wl_release_fastmap(struct ubi_device *ubi)
+{
+	int i, err;
+	struct rb_node *rb;
+	struct ubi_fastmap *fm;
+	struct ubi_wl_entry *e;
+
+	spin_lock(&ubi->wl_lock);
+	fm = ubi->fm;
+	ubi->fm = NULL;
+	while ((rb = rb_first(&ubi->fm_pool))) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		rb_erase(rb, &ubi->fm_pool);
+		wl_tree_add(e, &ubi->free);
+	}
+	ubi->fm_pool_count = 0;
+	if (ubi->fm_erase_count) {
+		list_splice_tail_init(&ubi->fm_erase, &ubi->works);
+		ubi->works_count += ubi->fm_erase_count;
+		ubi->fm_erase_count = 0;
+		if (ubi->thread_enabled && !ubi_dbg_is_bgt_disabled(ubi))
+			wake_up_process(ubi->bgt_thread);
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	if (!fm)
+		return 0;
+
+	dbg_wl("invalidate fastmap at PEB %d", fm->e[0]->pnum);
+	err = sync_erase(ubi, fm->e[0], 0);
+	if (err) {
+		/*
+		 * The old fastmap is still on flash, and it stays valid only
+		 * as long as nothing changes.
+		 */
+		ubi_err("cannot erase fastmap anchor PEB %d, error %d",
+			fm->e[0]->pnum, err);
+		ubi_ro_mode(ubi);
+		if (schedule_erase(ubi, fm->e[0], 1))
+			kmem_cache_free(ubi_wl_entry_slab, fm->e[0]);
+	} else
+		ubi_wl_put_fm_peb(ubi, fm->e[0]);
+
+	for (i = 1; i < fm->used_blocks; i++) {
+		if (schedule_erase(ubi, fm->e[i], 0)) {
+			kmem_cache_free(ubi_wl_entry_slab, fm->e[i]);
+			ubi_ro_mode(ubi);
+			err = -ENOMEM;
+		}
+	}
+
+	kfree(fm->used);
+	kfree(fm);
+	return err;
+}
+
+/**
+ * ubi_wl_request_fastmap - ask the background thread for a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+void ubi_wl_request_fastmap(struct ubi_device *ubi)
+{
+	if (ubi->fm_wanted)
+		return;
+	ubi->fm_wanted = 1;
+	if (ubi->thread_enabled && !ubi_dbg_is_bgt_disabled(ubi))
+		wake_up_process(ubi->bgt_thread);
+}
+
+/**
+ * ubi_wl_in_fastmap - check if the fastmap maps a LEB to a PEB.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock to check
+ *
+ * This function returns non-zero if the fastmap on flash records @pnum as
+ * mapped, so that an attach from it would map a LEB to @pnum again.
+ */
+int ubi_wl_in_fastmap(struct ubi_device *ubi, int pnum)
+{
+	int ret;
+
+	spin_lock(&ubi->wl_lock);
+	ret = ubi->fm && test_bit(pnum, ubi->fm->used);
+	spin_unlock(&ubi->wl_lock);
+	return ret;
+}
+
 /**
  * tree_destroy - destroy an RB-tree.
  * @root: the root of the tree to destroy
@@ -1369,8 +1616,9 @@ int ubi_thread(void *u)
 			continue;
 
 		spin_lock(&ubi->wl_lock);
-		if (list_empty(&ubi->works) || ubi->ro_mode ||
-		    !ubi->thread_enabled || ubi_dbg_is_bgt_disabled(ubi)) {
+		if ((list_empty(&ubi->works) && !ubi->fm_wanted) ||
+		    ubi->ro_mode || !ubi->thread_enabled ||
+		    ubi_dbg_is_bgt_disabled(ubi)) {
 			set_current_state(TASK_INTERRUPTIBLE);
 			spin_unlock(&ubi->wl_lock);
 			schedule();
@@ -1378,6 +1626,15 @@ int ubi_thread(void *u)
 		}
 		spin_unlock(&ubi->wl_lock);
 
+		if (ubi->fm_wanted) {
+			err = ubi_update_fastmap(ubi);
+			if (err)
+				ubi_warn("%s: cannot write fastmap, error %d",
+					 ubi->bgt_name, err);
+			cond_resched();
+			continue;
+		}
+
 		err = do_work(ubi);
 		if (err) {
 			ubi_err("%s: work failed with error code %d",
@@ -1443,6 +1700,20 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	ubi->max_ec = si->max_ec;
 	INIT_LIST_HEAD(&ubi->works);
 
+	ubi->fm = NULL;
+	ubi->fm_pool = RB_ROOT;
+	ubi->fm_pool_count = 0;
+	ubi->fm_pool_size = clamp(ubi->peb_count / 20, UBI_FM_MIN_POOL_SIZE,
+				  UBI_FM_MAX_POOL_SIZE);
+	INIT_LIST_HEAD(&ubi->fm_erase);
+	ubi->fm_erase_count = 0;
+	mutex_init(&ubi->fm_mutex);
+	init_rwsem(&ubi->fm_eba_sem);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* Write a fastmap for the next attach once we are up */
+	ubi->fm_wanted = !ubi->ro_mode;
+#endif
+
 	sprintf(ubi->bgt_name, UBI_BGT_NAME_PATTERN, ubi->ubi_num);
 
 	err = -ENOMEM;
@@ -1551,6 +1822,35 @@ static void protection_queue_destroy(struct ubi_device *ubi)
 	}
 }
 
+/**
+ * fastmap_destroy - free the in-RAM fastmap state.
+ * @ubi: UBI device description object
+ *
+ * The fastmap itself stays on flash, for the next attach.
+ */
+static void fastmap_destroy(struct ubi_device *ubi)
+{
+	int i;
+
+	while (!list_empty(&ubi->fm_erase)) {
+		struct ubi_work *wrk;
+
+		wrk = list_entry(ubi->fm_erase.next, struct ubi_work, list);
+		list_del(&wrk->list);
+		wrk->func(ubi, wrk, 1);
+	}
+	ubi->fm_erase_count = 0;
+	tree_destroy(&ubi->fm_pool);
+
+	if (ubi->fm) {
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, ubi->fm->e[i]);
+		kfree(ubi->fm->used);
+		kfree(ubi->fm);
+		ubi->fm = NULL;
+	}
+}
+
 /**
  * ubi_wl_close - close the wear-leveling sub-system.
  * @ubi: UBI device description object
@@ -1559,6 +1859,7 @@ void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
+	fastmap_destroy(ubi);
 	protection_queue_destroy(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->erroneous);
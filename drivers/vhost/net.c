@@ -30,9 +30,12 @@
 
 #include "vhost.h"
 
-static int experimental_zcopytx;
-module_param(experimental_zcopytx, int, 0444);
-MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
+static int zcopytx = 1;
+module_param(zcopytx, int, 0444);
+MODULE_PARM_DESC(zcopytx, "Enable Zero Copy TX");
+/* the old name, for existing modprobe.conf lines */
+module_param_named(experimental_zcopytx, zcopytx, int, 0444);
+MODULE_PARM_DESC(experimental_zcopytx, "Same as zcopytx (deprecated)");
 
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
@@ -40,8 +43,14 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
 
 /* MAX number of TX used buffers for outstanding zerocopy */
 #define VHOST_MAX_PEND 128
+/* Packets shorter than this are copied even with zerocopy: pinning the
+ * pages and waiting for the DMA costs more than copying them. */
 #define VHOST_GOODCOPY_LEN 256
 
+/* Used buffers are returned to the guest, and the guest signalled, this
+ * many at a time, or when the queue runs dry. */
+#define VHOST_NET_BATCH 64
+
 enum {
 	VHOST_NET_VQ_RX = 0,
 	VHOST_NET_VQ_TX = 1,
@@ -66,8 +75,29 @@ struct vhost_net {
 
 static bool vhost_sock_zcopy(struct socket *sock)
 {
-	return unlikely(experimental_zcopytx) &&
-		sock_flag(sock->sk, SOCK_ZEROCOPY);
+	return zcopytx && sock_flag(sock->sk, SOCK_ZEROCOPY);
+}
+
+/* Number of zerocopy buffers still waiting for their DMA */
+static int vhost_zerocopy_pends(struct vhost_virtqueue *vq)
+{
+	/* Handle upend_idx wrap around */
+	return likely(vq->upend_idx >= vq->done_idx) ?
+	       (vq->upend_idx - vq->done_idx) :
+	       (vq->upend_idx + UIO_MAXIOV - vq->done_idx);
+}
+
+/*
+ * Whether to send a packet of @len bytes zerocopy.  Small packets are
+ * cheaper to copy, and a packet is copied rather than held up when many
+ * DMAs are pending already (a slow or stuck lower device, or packets
+ * sitting in a local socket's queue): then the guest gets its buffer
+ * back right away and the pending ring does not fill.
+ */
+static bool vhost_net_tx_select_zcopy(struct vhost_virtqueue *vq, size_t len)
+{
+	return len >= VHOST_GOODCOPY_LEN &&
+	       vhost_zerocopy_pends(vq) < VHOST_MAX_PEND;
 }
 
 /* Pop first len bytes from iovec. Return number of segments used. */
@@ -147,6 +177,7 @@ static void handle_tx(struct vhost_net *net)
 	struct socket *sock;
 	struct vhost_ubuf_ref *uninitialized_var(ubufs);
 	bool zcopy;
+	int nheads = 0;
 
 	/* TODO: check that we are running from vhost_worker? */
 	sock = rcu_dereference_check(vq->private_data, 1);
@@ -170,8 +201,8 @@ static void handle_tx(struct vhost_net *net)
 	zcopy = vhost_sock_zcopy(sock);
 
 	for (;;) {
-		/* Release DMAs done buffers first */
-		if (zcopy)
+		/* Release DMAs done buffers first, a batch at a time */
+		if (zcopy && vhost_zerocopy_pends(vq) >= VHOST_NET_BATCH)
 			vhost_zerocopy_signal_used(vq);
 
 		head = vhost_get_vq_desc(&net->dev, vq, vq->iov,
@@ -183,7 +214,14 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		/* Nothing new?  Wait for eventfd to tell us they refilled. */
 		if (head == vq->num) {
-			int num_pends;
+			/* Give back what we have before going to sleep. */
+			if (zcopy)
+				vhost_zerocopy_signal_used(vq);
+			else if (nheads) {
+				vhost_add_used_and_signal_n(&net->dev, vq,
+							    vq->heads, nheads);
+				nheads = 0;
+			}
 
 			wmem = atomic_read(&sock->sk->sk_wmem_alloc);
 			if (wmem >= sock->sk->sk_sndbuf * 3 / 4) {
@@ -191,13 +229,8 @@ static void handle_tx(struct vhost_net *net)
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
-			/* If more outstanding DMAs, queue the work.
-			 * Handle upend_idx wrap around
-			 */
-			num_pends = likely(vq->upend_idx >= vq->done_idx) ?
-				    (vq->upend_idx - vq->done_idx) :
-				    (vq->upend_idx + UIO_MAXIOV - vq->done_idx);
-			if (unlikely(num_pends > VHOST_MAX_PEND)) {
+			/* If more outstanding DMAs, queue the work. */
+			if (unlikely(vhost_zerocopy_pends(vq) > VHOST_MAX_PEND)) {
 				tx_poll_start(net, sock);
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
@@ -227,7 +260,7 @@ static void handle_tx(struct vhost_net *net)
 		/* use msg_control to pass vhost zerocopy ubuf info to skb */
 		if (zcopy) {
 			vq->heads[vq->upend_idx].id = head;
-			if (len < VHOST_GOODCOPY_LEN) {
+			if (!vhost_net_tx_select_zcopy(vq, len)) {
 				/* copy don't need to wait for DMA done */
 				vq->heads[vq->upend_idx].len =
 							VHOST_DMA_DONE_LEN;
@@ -264,8 +297,15 @@ static void handle_tx(struct vhost_net *net)
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		if (!zcopy) {
+			vq->heads[nheads].id = head;
+			vq->heads[nheads].len = 0;
+			if (++nheads == VHOST_NET_BATCH) {
+				vhost_add_used_and_signal_n(&net->dev, vq,
+							    vq->heads, nheads);
+				nheads = 0;
+			}
+		}
 		total_len += len;
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
@@ -273,6 +313,11 @@ static void handle_tx(struct vhost_net *net)
 		}
 	}
 
+	if (zcopy)
+		vhost_zerocopy_signal_used(vq);
+	else if (nheads)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads, nheads);
+
 	mutex_unlock(&vq->mutex);
 }
 
@@ -377,6 +422,7 @@ static void handle_rx(struct vhost_net *net)
 	};
 	size_t total_len = 0;
 	int err, headcount, mergeable;
+	int nheads = 0;
 	size_t vhost_hlen, sock_hlen;
 	size_t vhost_len, sock_len;
 	/* TODO: check that we are running from vhost_worker? */
@@ -397,14 +443,21 @@ static void handle_rx(struct vhost_net *net)
 	while ((sock_len = peek_head_len(sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
-		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
+		headcount = get_rx_bufs(vq, vq->heads + nheads, vhost_len,
 					&in, vq_log, &log,
-					likely(mergeable) ? UIO_MAXIOV : 1);
+					likely(mergeable) ?
+					UIO_MAXIOV - nheads : 1);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(headcount < 0))
 			break;
 		/* OK, now we need to know about added descriptors. */
 		if (!headcount) {
+			/* Give back what we have before going to sleep. */
+			if (nheads) {
+				vhost_add_used_and_signal_n(&net->dev, vq,
+							    vq->heads, nheads);
+				nheads = 0;
+			}
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
 				/* They have slipped one in as we were
 				 * doing that: check again. */
@@ -451,8 +504,12 @@ static void handle_rx(struct vhost_net *net)
 			vhost_discard_vq_desc(vq, headcount);
 			break;
 		}
-		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
-					    headcount);
+		nheads += headcount;
+		if (nheads >= VHOST_NET_BATCH) {
+			vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
+						    nheads);
+			nheads = 0;
+		}
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len);
 		total_len += vhost_len;
@@ -462,6 +519,9 @@ static void handle_rx(struct vhost_net *net)
 		}
 	}
 
+	if (nheads)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads, nheads);
+
 	mutex_unlock(&vq->mutex);
 }
 
@@ -515,8 +575,10 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		return r;
 	}
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT,
+			n->vqs + VHOST_NET_VQ_TX);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN,
+			n->vqs + VHOST_NET_VQ_RX);
 	n->tx_poll_state = VHOST_NET_POLL_DISABLED;
 
 	f->private_data = n;
@@ -729,10 +791,12 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 		mutex_unlock(&vq->mutex);
 	}
 
-	if (oldsock) {
+	/* The old buffers' completions may have queued work on this vq:
+	 * flush after waiting for them, not before. */
+	if (oldubufs || oldsock)
 		vhost_net_flush_vq(n, index);
+	if (oldsock)
 		fput(oldsock->file);
-	}
 
 	mutex_unlock(&n->dev.mutex);
 	return 0;
@@ -868,7 +932,7 @@ static struct miscdevice vhost_net_misc = {
 
 static int vhost_net_init(void)
 {
-	if (experimental_zcopytx)
+	if (zcopytx)
 		vhost_enable_zcopy(VHOST_NET_VQ_TX);
 	return misc_register(&vhost_net_misc);
 }
@@ -24,6 +24,9 @@
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_TEST_WEIGHT 0x80000
 
+/* Used buffers are returned to the guest this many at a time, as in net.c */
+#define VHOST_TEST_BATCH 64
+
 enum {
 	VHOST_TEST_VQ = 0,
 	VHOST_TEST_VQ_MAX = 1,
@@ -43,6 +46,7 @@ static void handle_vq(struct vhost_test *n)
 	int head;
 	size_t len, total_len = 0;
 	void *private;
+	int nheads = 0;
 
 	private = rcu_dereference_check(vq->private_data, 1);
 	if (!private)
@@ -61,6 +65,11 @@ static void handle_vq(struct vhost_test *n)
 			break;
 		/* Nothing new?  Wait for eventfd to tell us they refilled. */
 		if (head == vq->num) {
+			if (nheads) {
+				vhost_add_used_and_signal_n(&n->dev, vq,
+							    vq->heads, nheads);
+				nheads = 0;
+			}
 			if (unlikely(vhost_enable_notify(&n->dev, vq))) {
 				vhost_disable_notify(&n->dev, vq);
 				continue;
@@ -78,7 +87,13 @@ static void handle_vq(struct vhost_test *n)
 			vq_err(vq, "Unexpected 0 len for TX\n");
 			break;
 		}
-		vhost_add_used_and_signal(&n->dev, vq, head, 0);
+		vq->heads[nheads].id = head;
+		vq->heads[nheads].len = 0;
+		if (++nheads == VHOST_TEST_BATCH) {
+			vhost_add_used_and_signal_n(&n->dev, vq, vq->heads,
+						    nheads);
+			nheads = 0;
+		}
 		total_len += len;
 		if (unlikely(total_len >= VHOST_TEST_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
@@ -86,6 +101,9 @@ static void handle_vq(struct vhost_test *n)
 		}
 	}
 
+	if (nheads)
+		vhost_add_used_and_signal_n(&n->dev, vq, vq->heads, nheads);
+
 	mutex_unlock(&vq->mutex);
 }
 
@@ -39,6 +39,11 @@ enum {
 
 static unsigned vhost_zcopy_mask __read_mostly;
 
+static bool vq_workers = true;
+module_param(vq_workers, bool, 0444);
+MODULE_PARM_DESC(vq_workers,
+		 "One worker thread per virtqueue rather than per device");
+
 #define vhost_used_event(vq) ((u16 __user *)&vq->avail->ring[vq->num])
 #define vhost_avail_event(vq) ((u16 __user *)&vq->used->ring[vq->num])
 
@@ -73,14 +78,15 @@ static void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 	work->queue_seq = work->done_seq = 0;
 }
 
-/* Init poll structure */
+/* Init poll structure: its work runs on the worker of @vq */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev)
+		     unsigned long mask, struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
-	poll->dev = dev;
+	poll->dev = vq->dev;
+	poll->vq = vq;
 
 	vhost_work_init(&poll->work, fn);
 }
@@ -103,30 +109,35 @@ void vhost_poll_stop(struct vhost_poll *poll)
 	remove_wait_queue(poll->wqh, &poll->wait);
 }
 
-static bool vhost_work_seq_done(struct vhost_dev *dev, struct vhost_work *work,
-				unsigned seq)
+static bool vhost_work_seq_done(struct vhost_worker *worker,
+				struct vhost_work *work, unsigned seq)
 {
 	int left;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	left = seq - work->done_seq;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	return left <= 0;
 }
 
-static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_work_flush(struct vhost_worker *worker,
+			     struct vhost_work *work)
 {
 	unsigned seq;
 	int flushing;
 
-	spin_lock_irq(&dev->work_lock);
+	/* No owner: nothing can have been queued. */
+	if (!worker)
+		return;
+
+	spin_lock_irq(&worker->work_lock);
 	seq = work->queue_seq;
 	work->flushing++;
-	spin_unlock_irq(&dev->work_lock);
-	wait_event(work->done, vhost_work_seq_done(dev, work, seq));
-	spin_lock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
+	wait_event(work->done, vhost_work_seq_done(worker, work, seq));
+	spin_lock_irq(&worker->work_lock);
 	flushing = --work->flushing;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	BUG_ON(flushing < 0);
 }
 
@@ -134,26 +145,26 @@ static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	vhost_work_flush(poll->vq->worker, &poll->work);
 }
 
-static inline void vhost_work_queue(struct vhost_dev *dev,
+static inline void vhost_work_queue(struct vhost_worker *worker,
 				    struct vhost_work *work)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->work_lock, flags);
+	spin_lock_irqsave(&worker->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		wake_up_process(dev->worker);
+		wake_up_process(worker->task);
 	}
-	spin_unlock_irqrestore(&dev->work_lock, flags);
+	spin_unlock_irqrestore(&worker->work_lock, flags);
 }
 
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	vhost_work_queue(poll->vq->worker, &poll->work);
 }
 
 static void vhost_vq_reset(struct vhost_dev *dev,
@@ -188,7 +199,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 
@@ -198,7 +210,7 @@ static int vhost_worker(void *data)
 		/* mb paired w/ kthread_stop */
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		spin_lock_irq(&dev->work_lock);
+		spin_lock_irq(&worker->work_lock);
 		if (work) {
 			work->done_seq = seq;
 			if (work->flushing)
@@ -206,18 +218,18 @@ static int vhost_worker(void *data)
 		}
 
 		if (kthread_should_stop()) {
-			spin_unlock_irq(&dev->work_lock);
+			spin_unlock_irq(&worker->work_lock);
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
 		} else
 			work = NULL;
-		spin_unlock_irq(&dev->work_lock);
+		spin_unlock_irq(&worker->work_lock);
 
 		if (work) {
 			__set_current_state(TASK_RUNNING);
@@ -300,9 +312,8 @@ long vhost_dev_init(struct vhost_dev *dev,
 	dev->log_file = NULL;
 	dev->memory = NULL;
 	dev->mm = NULL;
-	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
-	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 0;
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		dev->vqs[i].log = NULL;
@@ -310,11 +321,13 @@ long vhost_dev_init(struct vhost_dev *dev,
 		dev->vqs[i].heads = NULL;
 		dev->vqs[i].ubuf_info = NULL;
 		dev->vqs[i].dev = dev;
+		dev->vqs[i].worker = NULL;
 		mutex_init(&dev->vqs[i].mutex);
 		vhost_vq_reset(dev, dev->vqs + i);
 		if (dev->vqs[i].handle_kick)
 			vhost_poll_init(&dev->vqs[i].poll,
-					dev->vqs[i].handle_kick, POLLIN, dev);
+					dev->vqs[i].handle_kick, POLLIN,
+					dev->vqs + i);
 	}
 
 	return 0;
@@ -341,21 +354,90 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_work_queue(worker, &attach.work);
+	vhost_work_flush(worker, &attach.work);
 	return attach.ret;
 }
 
+static void vhost_dev_stop_workers(struct vhost_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i].worker = NULL;
+	for (i = 0; i < dev->nworkers; ++i) {
+		if (!dev->workers[i].task)
+			continue;
+		WARN_ON(!list_empty(&dev->workers[i].work_list));
+		kthread_stop(dev->workers[i].task);
+	}
+	kfree(dev->workers);
+	dev->workers = NULL;
+	dev->nworkers = 0;
+}
+
+/*
+ * Start the owner's worker threads: one per virtqueue, so that the
+ * virtqueues of one device (the rx and tx queues of a guest nic) are
+ * handled on as many cpus, or with vq_workers=0 one for the device, as
+ * it used to be.  Each thread runs in the owner's mm and cgroups.
+ * Caller should have device mutex.
+ */
+static long vhost_dev_start_workers(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int i, err;
+
+	dev->nworkers = vq_workers ? dev->nvqs : 1;
+	dev->workers = kcalloc(dev->nworkers, sizeof *dev->workers,
+			       GFP_KERNEL);
+	if (!dev->workers) {
+		dev->nworkers = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < dev->nworkers; ++i) {
+		worker = &dev->workers[i];
+		spin_lock_init(&worker->work_lock);
+		INIT_LIST_HEAD(&worker->work_list);
+		worker->dev = dev;
+		if (i)
+			task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+					      current->pid, i);
+		else
+			task = kthread_create(vhost_worker, worker, "vhost-%d",
+					      current->pid);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			goto err;
+		}
+		worker->task = task;
+		wake_up_process(task);	/* avoid contributing to loadavg */
+
+		err = vhost_attach_cgroups(worker);
+		if (err)
+			goto err;
+	}
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i].worker = &dev->workers[i % dev->nworkers];
+	return 0;
+
+err:
+	vhost_dev_stop_workers(dev);
+	return err;
+}
+
 /* Caller should have device mutex */
 static long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -366,27 +448,17 @@ static long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
-		goto err_worker;
-	}
-
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
+	err = vhost_dev_start_workers(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_worker;
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_iovecs;
 
 	return 0;
-err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+err_iovecs:
+	vhost_dev_stop_workers(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -415,24 +487,30 @@ long vhost_dev_reset_owner(struct vhost_dev *dev)
 /* In case of DMA done not in order in lower device driver for some reason.
  * upend_idx is used to track end of used idx, done_idx is used to track head
  * of used idx. Once lower device DMA done contiguously, we will signal KVM
- * guest used idx.
+ * guest used idx: all the buffers done so far in one update of the used
+ * ring (two if they wrap around heads[]) and one signal.
  */
 int vhost_zerocopy_signal_used(struct vhost_virtqueue *vq)
 {
-	int i;
+	int i, add;
 	int j = 0;
 
 	for (i = vq->done_idx; i != vq->upend_idx; i = (i + 1) % UIO_MAXIOV) {
 		if ((vq->heads[i].len == VHOST_DMA_DONE_LEN)) {
 			vq->heads[i].len = VHOST_DMA_CLEAR_LEN;
-			vhost_add_used_and_signal(vq->dev, vq,
-						  vq->heads[i].id, 0);
 			++j;
 		} else
 			break;
 	}
-	if (j)
-		vq->done_idx = i;
+	if (!j)
+		return 0;
+
+	for (i = j; i; i -= add) {
+		add = min(UIO_MAXIOV - vq->done_idx, i);
+		vhost_add_used_n(vq, &vq->heads[vq->done_idx], add);
+		vq->done_idx = (vq->done_idx + add) % UIO_MAXIOV;
+	}
+	vhost_signal(vq->dev, vq);
 	return j;
 }
 
@@ -447,8 +525,12 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 			vhost_poll_flush(&dev->vqs[i].poll);
 		}
 		/* Wait for all lower device DMAs done. */
-		if (dev->vqs[i].ubufs)
+		if (dev->vqs[i].ubufs) {
 			vhost_ubuf_put_and_wait(dev->vqs[i].ubufs);
+			/* Their completions queue the vq's work: flush it
+			 * before the workers go away. */
+			vhost_poll_flush(&dev->vqs[i].poll);
+		}
 
 		/* Signal guest as appropriate. */
 		vhost_zerocopy_signal_used(&dev->vqs[i]);
@@ -477,11 +559,7 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 					locked ==
 						lockdep_is_held(&dev->mutex)));
 	RCU_INIT_POINTER(dev->memory, NULL);
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	vhost_dev_stop_workers(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -1605,5 +1683,9 @@ void vhost_zerocopy_callback(struct ubuf_info *ubuf)
 
 	/* set len = 1 to mark this desc buffers done DMA */
 	vq->heads[ubuf->desc].len = VHOST_DMA_DONE_LEN;
+	/* Have the worker return it to the guest now rather than on the
+	 * next kick, which may be a long time coming if the guest is
+	 * waiting for this very buffer. */
+	vhost_poll_queue(&vq->poll);
 	kref_put(&ubufs->kref, vhost_zerocopy_done_signal);
 }
@@ -19,6 +19,7 @@
 #define VHOST_DMA_CLEAR_LEN	0
 
 struct vhost_device;
+struct vhost_virtqueue;
 
 struct vhost_work;
 typedef void (*vhost_work_fn_t)(struct vhost_work *work);
@@ -32,6 +33,14 @@ struct vhost_work {
 	unsigned		  done_seq;
 };
 
+/* A thread running the work of some of a device's virtqueues */
+struct vhost_worker {
+	spinlock_t		  work_lock;
+	struct list_head	  work_list;
+	struct task_struct	 *task;
+	struct vhost_dev	 *dev;
+};
+
 /* Poll a file (eventfd or socket) */
 /* Note: there's nothing vhost specific about this structure. */
 struct vhost_poll {
@@ -41,10 +50,12 @@ struct vhost_poll {
 	struct vhost_work	  work;
 	unsigned long		  mask;
 	struct vhost_dev	 *dev;
+	/* the work runs on this virtqueue's worker */
+	struct vhost_virtqueue	 *vq;
 };
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev);
+		     unsigned long mask, struct vhost_virtqueue *vq);
 void vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_flush(struct vhost_poll *poll);
@@ -55,8 +66,6 @@ struct vhost_log {
 	u64 len;
 };
 
-struct vhost_virtqueue;
-
 struct vhost_ubuf_ref {
 	struct kref kref;
 	wait_queue_head_t wait;
@@ -70,6 +79,8 @@ void vhost_ubuf_put_and_wait(struct vhost_ubuf_ref *);
 /* The virtqueue structure describes a queue attached to a device. */
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
+	/* Runs handle_kick and the backend's polls, set while owned. */
+	struct vhost_worker *worker;
 
 	/* The actual ring of buffers. */
 	struct mutex mutex;
@@ -155,9 +166,8 @@ struct vhost_dev {
 	int nvqs;
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
-	spinlock_t work_lock;
-	struct list_head work_list;
-	struct task_struct *worker;
+	struct vhost_worker *workers;
+	int nworkers;
 };
 
 long vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue *vqs, int nvqs);
@@ -90,6 +90,9 @@ struct virtio_pci_vq_info
 
 	/* MSI-X vector (or none) */
 	unsigned msix_vector;
+
+	/* cpus the vector is hinted to, see vp_set_vq_affinity() */
+	cpumask_var_t affinity;
 };
 
 /* Qumranet donated their vendor ID for devices 0x1000 thru 0x10FF. */
@@ -401,6 +404,10 @@ static struct virtqueue *setup_vq(struct virtio_device *vdev, unsigned index,
 	info = kmalloc(sizeof(struct virtio_pci_vq_info), GFP_KERNEL);
 	if (!info)
 		return ERR_PTR(-ENOMEM);
+	if (!zalloc_cpumask_var(&info->affinity, GFP_KERNEL)) {
+		kfree(info);
+		return ERR_PTR(-ENOMEM);
+	}
 
 	info->queue_index = index;
 	info->num = num;
@@ -453,6 +460,7 @@ out_activate_queue:
 	iowrite32(0, vp_dev->ioaddr + VIRTIO_PCI_QUEUE_PFN);
 	free_pages_exact(info->queue, size);
 out_info:
+	free_cpumask_var(info->affinity);
 	kfree(info);
 	return ERR_PTR(err);
 }
@@ -483,6 +491,7 @@ static void vp_del_vq(struct virtqueue *vq)
 
 	size = PAGE_ALIGN(vring_size(info->num, VIRTIO_PCI_VRING_ALIGN));
 	free_pages_exact(info->queue, size);
+	free_cpumask_var(info->affinity);
 	kfree(info);
 }
 
@@ -496,9 +505,12 @@ static void vp_del_vqs(struct virtio_device *vdev)
 	list_for_each_entry_safe(vq, n, &vdev->vqs, list) {
 		info = vq->priv;
 		if (vp_dev->per_vq_vectors &&
-			info->msix_vector != VIRTIO_MSI_NO_VECTOR)
-			free_irq(vp_dev->msix_entries[info->msix_vector].vector,
-				 vq);
+			info->msix_vector != VIRTIO_MSI_NO_VECTOR) {
+			unsigned irq = vp_dev->msix_entries[info->msix_vector].vector;
+
+			irq_set_affinity_hint(irq, NULL);
+			free_irq(irq, vq);
+		}
 		vp_del_vq(vq);
 	}
 	vp_dev->per_vq_vectors = false;
@@ -602,6 +614,34 @@ static int vp_find_vqs(struct virtio_device *vdev, unsigned nvqs,
 				  false, false);
 }
 
+/*
+ * the config->set_vq_affinity() implementation: hint the queue's interrupt
+ * to @cpu, or drop the hint if @cpu is -1.  Only a queue with a vector of
+ * its own can follow a cpu; with a shared vector this does nothing.
+ */
+static int vp_set_vq_affinity(struct virtqueue *vq, int cpu)
+{
+	struct virtio_pci_device *vp_dev = to_vp_device(vq->vdev);
+	struct virtio_pci_vq_info *info = vq->priv;
+	unsigned irq;
+
+	if (!vq->callback)
+		return -EINVAL;
+	if (!vp_dev->per_vq_vectors ||
+	    info->msix_vector == VIRTIO_MSI_NO_VECTOR)
+		return 0;
+
+	irq = vp_dev->msix_entries[info->msix_vector].vector;
+	if (cpu == -1) {
+		irq_set_affinity_hint(irq, NULL);
+	} else {
+		cpumask_clear(info->affinity);
+		cpumask_set_cpu(cpu, info->affinity);
+		irq_set_affinity_hint(irq, info->affinity);
+	}
+	return 0;
+}
+
 static const char *vp_bus_name(struct virtio_device *vdev)
 {
 	struct virtio_pci_device *vp_dev = to_vp_device(vdev);
@@ -620,6 +660,7 @@ static struct virtio_config_ops virtio_pci_config_ops = {
 	.get_features	= vp_get_features,
 	.finalize_features = vp_finalize_features,
 	.bus_name	= vp_bus_name,
+	.set_vq_affinity = vp_set_vq_affinity,
 };
 
 static void virtio_pci_release_dev(struct device *_d)
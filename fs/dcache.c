@@ -48,8 +48,8 @@
  *   - the dcache hash table
  * s_anon bl list spinlock protects:
  *   - the s_anon list (see __d_drop)
- * dcache_lru_lock protects:
- *   - the dcache lru lists and counters
+ * the sb->s_dentry_lru list locks protect:
+ *   - the dcache lru lists
  * d_lock protects:
  *   - d_flags
  *   - d_name
@@ -63,7 +63,7 @@
  * Ordering:
  * dentry->d_inode->i_lock
  *   dentry->d_lock
- *     dcache_lru_lock
+ *     sb->s_dentry_lru list lock
  *     dcache_hash_bucket lock
  *     s_anon lock
  *
@@ -81,7 +81,6 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
-static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lru_lock);
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -118,6 +117,7 @@ struct dentry_stat_t dentry_stat = {
 };
 
 static DEFINE_PER_CPU(unsigned int, nr_dentry);
+static DEFINE_PER_CPU(unsigned int, nr_dentry_unused);
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 static int get_nr_dentry(void)
@@ -129,10 +129,20 @@ static int get_nr_dentry(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static int get_nr_dentry_unused(void)
+{
+	int i;
+	int sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_unused, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
+	dentry_stat.nr_unused = get_nr_dentry_unused();
 	return proc_dointvec(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -289,42 +299,61 @@ static void dentry_unlink_inode(struct dentry * dentry)
 
 /*
  * dentry_lru_(add|del|prune|move_tail) must be called with d_lock held.
+ *
+ * d_lru is either empty, or on the superblock's LRU, or, with
+ * DCACHE_SHRINK_LIST set, on a private list of dentries being shrunk.
+ * Moving between these takes d_lock, so holding it keeps d_lru where
+ * it is.  Dentries on either list count as unused.
+ *
+ * A shrink list belongs to the task that built it, and only that task
+ * links or unlinks its entries: the d_lock of one entry does not keep
+ * its neighbours still.  Everybody else leaves a dentry that has
+ * DCACHE_SHRINK_LIST set where it is, even when they kill it, and the
+ * owner frees it; see d_kill() and shrink_dentry_list().
  */
+static void d_shrink_add(struct dentry *dentry, struct list_head *list)
+{
+	list_move_tail(&dentry->d_lru, list);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
+}
+
+static void d_shrink_del(struct dentry *dentry)
+{
+	list_del_init(&dentry->d_lru);
+	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
+	this_cpu_dec(nr_dentry_unused);
+}
+
 static void dentry_lru_add(struct dentry *dentry)
 {
 	if (list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
-		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-		spin_unlock(&dcache_lru_lock);
+		list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru);
+		this_cpu_inc(nr_dentry_unused);
 	}
 }
 
 static void __dentry_lru_del(struct dentry *dentry)
 {
-	list_del_init(&dentry->d_lru);
-	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
-	dentry->d_sb->s_nr_dentry_unused--;
-	dentry_stat.nr_unused--;
+	list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru);
+	this_cpu_dec(nr_dentry_unused);
 }
 
 /*
- * Remove a dentry with references from the LRU.
+ * Remove a dentry with references from the LRU.  One on a shrink list
+ * stays there; the owner drops it when it finds it in use.
  */
 static void dentry_lru_del(struct dentry *dentry)
 {
-	if (!list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
+	if (!list_empty(&dentry->d_lru) &&
+	    !(dentry->d_flags & DCACHE_SHRINK_LIST))
 		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
-	}
 }
 
 /*
  * Remove a dentry that is unreferenced and about to be pruned
  * (unhashed and destroyed) from the LRU, and inform the file system.
  * This wrapper should be called _prior_ to unhashing a victim dentry.
+ * One on a shrink list stays there for the owner to free.
  */
 static void dentry_lru_prune(struct dentry *dentry)
 {
@@ -332,23 +361,24 @@ static void dentry_lru_prune(struct dentry *dentry)
 		if (dentry->d_flags & DCACHE_OP_PRUNE)
 			dentry->d_op->d_prune(dentry);
 
-		spin_lock(&dcache_lru_lock);
-		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
+		if (!(dentry->d_flags & DCACHE_SHRINK_LIST))
+			__dentry_lru_del(dentry);
 	}
 }
 
+/*
+ * Move a dentry that is not on a shrink list yet to the tail of @list,
+ * which becomes its shrink list.
+ */
 static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
 {
-	spin_lock(&dcache_lru_lock);
-	if (list_empty(&dentry->d_lru)) {
-		list_add_tail(&dentry->d_lru, list);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-	} else {
-		list_move_tail(&dentry->d_lru, list);
-	}
-	spin_unlock(&dcache_lru_lock);
+	BUG_ON(dentry->d_flags & DCACHE_SHRINK_LIST);
+
+	if (list_empty(&dentry->d_lru))
+		this_cpu_inc(nr_dentry_unused);
+	else
+		list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru);
+	d_shrink_add(dentry, list);
 }
 
 /**
@@ -356,7 +386,8 @@ static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
  * @dentry: dentry to kill
  * @parent: parent dentry
  *
- * The dentry must already be unhashed and removed from the LRU.
+ * The dentry must already be unhashed and removed from the LRU, unless it
+ * is on a shrink list: then it is left there, and the list's owner frees it.
  *
  * If this is the root of the dentry tree, return NULL.
  *
@@ -368,19 +399,34 @@ static struct dentry *d_kill(struct dentry *dentry, struct dentry *parent)
 	__releases(parent->d_lock)
 	__releases(dentry->d_inode->i_lock)
 {
+	int on_shrink_list = dentry->d_flags & DCACHE_SHRINK_LIST;
+
 	list_del(&dentry->d_u.d_child);
 	/*
 	 * Inform try_to_ascend() that we are no longer attached to the
 	 * dentry tree
 	 */
-	dentry->d_flags |= DCACHE_DISCONNECTED;
+	dentry->d_flags |= DCACHE_DISCONNECTED | DCACHE_DENTRY_KILLED;
 	if (parent)
 		spin_unlock(&parent->d_lock);
 	dentry_iput(dentry);
 	/*
 	 * dentry_iput drops the locks, at which point nobody (except
-	 * transient RCU lookups) can reach this dentry.
+	 * transient RCU lookups and the owner of a shrink list it is on)
+	 * can reach this dentry.  If it is still on a shrink list, tell
+	 * the owner that we are done with it.  Nothing can put it on one
+	 * any more, so without DCACHE_SHRINK_LIST now there is no need to
+	 * look again.
 	 */
+	if (on_shrink_list) {
+		spin_lock(&dentry->d_lock);
+		if (dentry->d_flags & DCACHE_SHRINK_LIST) {
+			dentry->d_flags |= DCACHE_MAY_FREE;
+			spin_unlock(&dentry->d_lock);
+			return parent;
+		}
+		spin_unlock(&dentry->d_lock);
+	}
 	d_free(dentry);
 	return parent;
 }
@@ -796,18 +842,32 @@ static void try_prune_one_dentry(struct dentry *dentry)
 	}
 }
 
+/*
+ * Nobody but us takes dentries off @list, or frees them while they are on
+ * it, so the last entry stays put while we lock it.
+ */
 static void shrink_dentry_list(struct list_head *list)
 {
 	struct dentry *dentry;
 
-	rcu_read_lock();
-	for (;;) {
-		dentry = list_entry_rcu(list->prev, struct dentry, d_lru);
-		if (&dentry->d_lru == list)
-			break; /* empty */
+	while (!list_empty(list)) {
+		dentry = list_entry(list->prev, struct dentry, d_lru);
 		spin_lock(&dentry->d_lock);
-		if (dentry != list_entry(list->prev, struct dentry, d_lru)) {
+
+		/*
+		 * Killed while on the list, by a dput() elsewhere or by
+		 * us pruning it or one of its children, and left for us
+		 * to free.  Without DCACHE_MAY_FREE the killer is not
+		 * done with it yet, and frees it itself once it sees that
+		 * it is off the list.
+		 */
+		if (dentry->d_flags & DCACHE_DENTRY_KILLED) {
+			int can_free = dentry->d_flags & DCACHE_MAY_FREE;
+
+			d_shrink_del(dentry);
 			spin_unlock(&dentry->d_lock);
+			if (can_free)
+				d_free(dentry);
 			continue;
 		}
 
@@ -817,69 +877,78 @@ static void shrink_dentry_list(struct list_head *list)
 		 * it - just keep it off the LRU list.
 		 */
 		if (dentry->d_count) {
-			dentry_lru_del(dentry);
+			d_shrink_del(dentry);
 			spin_unlock(&dentry->d_lock);
 			continue;
 		}
 
-		rcu_read_unlock();
-
+		/*
+		 * Killing it leaves it on the list, for the next pass to
+		 * free; if a trylock fails it is still there to retry.
+		 */
 		try_prune_one_dentry(dentry);
+	}
+}
 
-		rcu_read_lock();
+static enum lru_status dentry_lru_isolate(struct list_head *item,
+					  spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry *dentry = container_of(item, struct dentry, d_lru);
+
+	/*
+	 * we are inverting the lru lock/dentry->d_lock here, so use a
+	 * trylock.  If we fail to get the lock, just skip the dentry.
+	 */
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
 	}
-	rcu_read_unlock();
+
+	d_shrink_add(dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+	return LRU_REMOVED;
 }
 
 /**
  * prune_dcache_sb - shrink the dcache
  * @sb: superblock
- * @count: number of entries to try to free
+ * @count: number of entries to scan
  *
- * Attempt to shrink the superblock dcache LRU by @count entries. This is
- * done when we need more memory an called from the superblock shrinker
- * function.
+ * Attempt to shrink the superblock dcache LRU by scanning @count entries.
+ * This is done when we need more memory an called from the superblock
+ * shrinker function.
  *
  * This function may fail to free any resources if all the dentries are in
  * use.
  */
 void prune_dcache_sb(struct super_block *sb, int count)
 {
-	struct dentry *dentry;
-	LIST_HEAD(referenced);
-	LIST_HEAD(tmp);
+	LIST_HEAD(dispose);
 
-relock:
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		dentry = list_entry(sb->s_dentry_lru.prev,
-				struct dentry, d_lru);
-		BUG_ON(dentry->d_sb != sb);
-
-		if (!spin_trylock(&dentry->d_lock)) {
-			spin_unlock(&dcache_lru_lock);
-			cpu_relax();
-			goto relock;
-		}
+	if (count <= 0)
+		return;
+	list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate, &dispose, count);
+	shrink_dentry_list(&dispose);
+}
 
-		if (dentry->d_flags & DCACHE_REFERENCED) {
-			dentry->d_flags &= ~DCACHE_REFERENCED;
-			list_move(&dentry->d_lru, &referenced);
-			spin_unlock(&dentry->d_lock);
-		} else {
-			list_move_tail(&dentry->d_lru, &tmp);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
-			spin_unlock(&dentry->d_lock);
-			if (!--count)
-				break;
-		}
-		cond_resched_lock(&dcache_lru_lock);
-	}
-	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
-	spin_unlock(&dcache_lru_lock);
+static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
+						 spinlock_t *lru_lock,
+						 void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry *dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
 
-	shrink_dentry_list(&tmp);
+	d_shrink_add(dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+	return LRU_REMOVED;
 }
 
 /**
@@ -891,16 +960,14 @@ relock:
  */
 void shrink_dcache_sb(struct super_block *sb)
 {
-	LIST_HEAD(tmp);
+	do {
+		LIST_HEAD(dispose);
 
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		list_splice_init(&sb->s_dentry_lru, &tmp);
-		spin_unlock(&dcache_lru_lock);
-		shrink_dentry_list(&tmp);
-		spin_lock(&dcache_lru_lock);
-	}
-	spin_unlock(&dcache_lru_lock);
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_shrink,
+			      &dispose, 1024);
+		shrink_dentry_list(&dispose);
+		cond_resched();
+	} while (list_lru_count(&sb->s_dentry_lru) > 0);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
@@ -1170,7 +1237,6 @@ resume:
 			dentry_lru_del(dentry);
 		} else if (!(dentry->d_flags & DCACHE_SHRINK_LIST)) {
 			dentry_lru_move_list(dentry, dispose);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
 			found++;
 		}
 		/*
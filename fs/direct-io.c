@@ -126,6 +126,7 @@ struct dio {
 	spinlock_t bio_lock;		/* protects BIO fields below */
 	int page_errors;		/* errno from get_user_pages() */
 	int is_async;			/* is IO async ? */
+	int kernel_pages;		/* buffers are kernel memory */
 	int io_error;			/* IO error in completion path */
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
@@ -197,6 +198,33 @@ static inline unsigned dio_pages_present(struct dio_submit *sdio)
 	return sdio->tail - sdio->head;
 }
 
+/*
+ * O_DIRECT from the kernel, on a kiocb marked with kiocbSetKernelPages():
+ * the loop driver hands us buffers that are lowmem or vm_map_ram()ed
+ * pages.  They are not in any mm, so look the pages up by hand.
+ */
+static int dio_get_kernel_pages(unsigned long start, int nr_pages,
+				struct page **pages)
+{
+	struct page *page;
+	int i;
+
+	start &= PAGE_MASK;
+	for (i = 0; i < nr_pages; i++, start += PAGE_SIZE) {
+		if (is_vmalloc_addr((void *)start))
+			page = vmalloc_to_page((void *)start);
+		else if (virt_addr_valid(start))
+			page = virt_to_page(start);
+		else
+			page = NULL;
+		if (!page)
+			return i ? i : -EFAULT;
+		page_cache_get(page);
+		pages[i] = page;
+	}
+	return nr_pages;
+}
+
 /*
  * Go grab and pin some userspace pages.   Typically we'll get 64 at a time.
  */
@@ -206,11 +234,15 @@ static inline int dio_refill_pages(struct dio *dio, struct dio_submit *sdio)
 	int nr_pages;
 
 	nr_pages = min(sdio->total_pages - sdio->curr_page, DIO_PAGES);
-	ret = get_user_pages_fast(
-		sdio->curr_user_address,		/* Where from? */
-		nr_pages,			/* How many pages? */
-		dio->rw == READ,		/* Write to memory? */
-		&dio->pages[0]);		/* Put results here */
+	if (dio->kernel_pages)
+		ret = dio_get_kernel_pages(sdio->curr_user_address,
+					   nr_pages, &dio->pages[0]);
+	else
+		ret = get_user_pages_fast(
+			sdio->curr_user_address,	/* Where from? */
+			nr_pages,			/* How many pages? */
+			dio->rw == READ,		/* Write to memory? */
+			&dio->pages[0]);		/* Put results here */
 
 	if (ret < 0 && sdio->blocks_available && (dio->rw & WRITE)) {
 		struct page *page = ZERO_PAGE(0);
@@ -491,13 +523,19 @@ static int dio_bio_complete(struct dio *dio, struct bio *bio)
 	if (!uptodate)
 		dio->io_error = -EIO;
 
-	if (dio->is_async && dio->rw == READ) {
+	/*
+	 * Kernel buffers are not dirtied: the loop driver reads into page
+	 * cache pages of the filesystem above it, which are locked for the
+	 * read and which that filesystem marks uptodate itself.
+	 */
+	if (dio->is_async && dio->rw == READ && !dio->kernel_pages) {
 		bio_check_pages_dirty(bio);	/* transfers ownership */
 	} else {
 		for (page_no = 0; page_no < bio->bi_vcnt; page_no++) {
 			struct page *page = bvec[page_no].bv_page;
 
-			if (dio->rw == READ && !PageCompound(page))
+			if (dio->rw == READ && !dio->kernel_pages &&
+			    !PageCompound(page))
 				set_page_dirty_lock(page);
 			page_cache_release(page);
 		}
@@ -1191,6 +1229,7 @@ do_blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 
 	dio->inode = inode;
 	dio->rw = rw;
+	dio->kernel_pages = kiocbIsKernelPages(iocb);
 	sdio.blkbits = blkbits;
 	sdio.blkfactor = inode->i_blkbits - blkbits;
 	sdio.block_in_file = offset >> blkbits;
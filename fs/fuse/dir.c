@@ -1109,6 +1109,139 @@ static int parse_dirfile(char *buf, size_t nbytes, struct file *file,
 	return 0;
 }
 
+/*
+ * Instantiate (or refresh) the dentry and inode of an entry returned by
+ * READDIRPLUS, as a LOOKUP reply would.  The lookup count the filesystem
+ * took for the entry passes to the inode; on error the caller forgets it.
+ */
+static int fuse_direntplus_link(struct file *file,
+				struct fuse_direntplus *direntplus,
+				u64 attr_version)
+{
+	struct fuse_entry_out *o = &direntplus->entry_out;
+	struct fuse_dirent *dirent = &direntplus->dirent;
+	struct dentry *parent = file->f_path.dentry;
+	struct inode *dir = parent->d_inode;
+	struct fuse_conn *fc = get_fuse_conn(dir);
+	struct dentry *dentry, *alias;
+	struct inode *inode;
+	struct qstr name;
+
+	/* no nodeid: the filesystem did not look this one up */
+	if (!o->nodeid)
+		return 0;
+
+	name.name = dirent->name;
+	name.len = dirent->namelen;
+	/* not children: nothing to instantiate */
+	if (name.name[0] == '.' &&
+	    (name.len == 1 || (name.len == 2 && name.name[1] == '.')))
+		return 0;
+
+	if (invalid_nodeid(o->nodeid) || !fuse_valid_type(o->attr.mode))
+		return -EIO;
+
+	name.hash = full_name_hash(name.name, name.len);
+	dentry = d_lookup(parent, &name);
+	if (dentry) {
+		inode = dentry->d_inode;
+		if (inode && get_node_id(inode) == o->nodeid &&
+		    !((o->attr.mode ^ inode->i_mode) & S_IFMT) &&
+		    !is_bad_inode(inode)) {
+			struct fuse_inode *fi = get_fuse_inode(inode);
+
+			spin_lock(&fc->lock);
+			fi->nlookup++;
+			spin_unlock(&fc->lock);
+
+			fuse_change_attributes(inode, &o->attr,
+					       entry_attr_timeout(o),
+					       attr_version);
+			goto found;
+		}
+		if (inode) {
+			/* stale: leave it for the next lookup to sort out */
+			dput(dentry);
+			return -ESTALE;
+		}
+		d_drop(dentry);
+		dput(dentry);
+	}
+
+	dentry = d_alloc(parent, &name);
+	if (!dentry)
+		return -ENOMEM;
+
+	inode = fuse_iget(dir->i_sb, o->nodeid, o->generation,
+			  &o->attr, entry_attr_timeout(o), attr_version);
+	if (!inode) {
+		dput(dentry);
+		return -ENOMEM;
+	}
+
+	/* from here on the inode holds the lookup count */
+	alias = d_materialise_unique(dentry, inode);
+	if (IS_ERR(alias)) {
+		dput(dentry);
+		return 0;
+	}
+	if (alias) {
+		dput(dentry);
+		dentry = alias;
+	}
+
+found:
+	fuse_change_entry_timeout(dentry, o);
+	dput(dentry);
+	return 0;
+}
+
+/*
+ * Like parse_dirfile(), but link each entry into the dcache before
+ * passing it on, so that a filldir looking it up finds it there.
+ * Entries that do not fit are still linked, or forgotten, so that no
+ * lookup count taken by the filesystem is leaked.
+ */
+static int parse_dirplusfile(char *buf, size_t nbytes, struct file *file,
+			     void *dstbuf, filldir_t filldir, u64 attr_version)
+{
+	struct fuse_conn *fc = get_fuse_conn(file->f_path.dentry->d_inode);
+	int over = 0;
+
+	while (nbytes >= FUSE_NAME_OFFSET_DIRENTPLUS) {
+		struct fuse_direntplus *direntplus =
+			(struct fuse_direntplus *) buf;
+		struct fuse_dirent *dirent = &direntplus->dirent;
+		size_t reclen = FUSE_DIRENTPLUS_SIZE(direntplus);
+
+		if (!dirent->namelen || dirent->namelen > FUSE_NAME_MAX)
+			return -EIO;
+		if (reclen > nbytes)
+			break;
+
+		if (fuse_direntplus_link(file, direntplus, attr_version)) {
+			struct fuse_forget_link *forget = fuse_alloc_forget();
+
+			if (forget)
+				fuse_queue_forget(fc, forget,
+						  direntplus->entry_out.nodeid,
+						  1);
+		}
+
+		if (!over) {
+			over = filldir(dstbuf, dirent->name, dirent->namelen,
+				       file->f_pos, dirent->ino, dirent->type);
+			if (!over)
+				file->f_pos = dirent->off;
+		}
+
+		buf += reclen;
+		nbytes -= reclen;
+	}
+
+	return 0;
+}
+
 static int fuse_readdir(struct file *file, void *dstbuf, filldir_t filldir)
 {
 	int err;
@@ -1117,6 +1250,8 @@ static int fuse_readdir(struct file *file, void *dstbuf, filldir_t filldir)
 	struct inode *inode = file->f_path.dentry->d_inode;
 	struct fuse_conn *fc = get_fuse_conn(inode);
 	struct fuse_req *req;
+	u64 attr_version = 0;
+	int plus = fc->do_readdirplus;
 
 	if (is_bad_inode(inode))
 		return -EIO;
@@ -1133,12 +1268,22 @@ static int fuse_readdir(struct file *file, void *dstbuf, filldir_t filldir)
 	req->out.argpages = 1;
 	req->num_pages = 1;
 	req->pages[0] = page;
-	fuse_read_fill(req, file, file->f_pos, PAGE_SIZE, FUSE_READDIR);
+	if (plus) {
+		attr_version = fuse_get_attr_version(fc);
+		fuse_read_fill(req, file, file->f_pos, PAGE_SIZE,
+			       FUSE_READDIRPLUS);
+	} else {
+		fuse_read_fill(req, file, file->f_pos, PAGE_SIZE,
+			       FUSE_READDIR);
+	}
 	fuse_request_send(fc, req);
 	nbytes = req->out.args[0].size;
 	err = req->out.h.error;
 	fuse_put_request(fc, req);
-	if (!err)
+	if (!err && plus)
+		err = parse_dirplusfile(page_address(page), nbytes, file,
+					dstbuf, filldir, attr_version);
+	else if (!err)
 		err = parse_dirfile(page_address(page), nbytes, file, dstbuf,
 				    filldir);
 
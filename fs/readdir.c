@@ -14,6 +14,8 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/dirent.h>
+#include <linux/dirent_stat.h>
+#include <linux/namei.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
@@ -309,3 +311,156 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 out:
 	return error;
 }
+
+/*
+ * getdents_stat(): entries together with their lstat() attributes, for
+ * programs that would otherwise stat every entry they read.  Where the
+ * filesystem allows it the entry is looked up right from its filldir,
+ * with the directory still locked by vfs_readdir(), which is a hash
+ * lookup for entries the filesystem instantiated while reading the
+ * directory (fuse with READDIRPLUS) and one directory search otherwise.
+ */
+struct getdents_stat_callback {
+	struct linux_dirent_stat __user *current_dir;
+	struct linux_dirent_stat __user *previous;
+	struct file *file;
+	bool lookup;
+	int count;
+	int error;
+};
+
+static bool dirent_getattr(struct file *file, const char *name, int namlen,
+			   struct kstat *stat)
+{
+	struct dentry *parent = file->f_path.dentry;
+	struct dentry *dentry;
+	bool ok = false;
+
+	if (namlen == 1 && name[0] == '.')
+		dentry = dget(parent);
+	else if (namlen == 2 && name[0] == '.' && name[1] == '.')
+		return false;	/* may be across a mount */
+	else
+		dentry = lookup_one_len(name, parent, namlen);
+	if (IS_ERR(dentry))
+		return false;
+
+	/* lstat() of a mount point would give the mounted root */
+	if (dentry->d_inode && !d_mountpoint(dentry))
+		ok = !vfs_getattr(file->f_path.mnt, dentry, stat);
+	dput(dentry);
+	return ok;
+}
+
+static int filldir_stat(void *__buf, const char *name, int namlen,
+			loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct getdents_stat_callback *buf = __buf;
+	struct linux_dirent_stat __user *dirent;
+	struct linux_dirent_stat d;
+	struct kstat stat;
+	int reclen = ALIGN(offsetof(struct linux_dirent_stat, d_name) +
+			   namlen + 1, sizeof(u64));
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+
+	memset(&d, 0, offsetof(struct linux_dirent_stat, d_name));
+	d.d_ino = ino;
+	d.d_reclen = reclen;
+	d.d_type = d_type;
+	if (buf->lookup && dirent_getattr(buf->file, name, namlen, &stat)) {
+		d.d_stat_valid = 1;
+		d.st_mode = stat.mode;
+		d.st_nlink = stat.nlink;
+		d.st_uid = stat.uid;
+		d.st_gid = stat.gid;
+		d.st_blksize = stat.blksize;
+		d.st_dev = huge_encode_dev(stat.dev);
+		d.st_rdev = huge_encode_dev(stat.rdev);
+		d.st_size = stat.size;
+		d.st_blocks = stat.blocks;
+		d.st_atime_sec = stat.atime.tv_sec;
+		d.st_atime_nsec = stat.atime.tv_nsec;
+		d.st_mtime_sec = stat.mtime.tv_sec;
+		d.st_mtime_nsec = stat.mtime.tv_nsec;
+		d.st_ctime_sec = stat.ctime.tv_sec;
+		d.st_ctime_nsec = stat.ctime.tv_nsec;
+	}
+
+	dirent = buf->previous;
+	if (dirent) {
+		if (__put_user(offset, &dirent->d_off))
+			goto efault;
+	}
+	dirent = buf->current_dir;
+	if (__copy_to_user(dirent, &d,
+			   offsetof(struct linux_dirent_stat, d_name)))
+		goto efault;
+	if (copy_to_user(dirent->d_name, name, namlen))
+		goto efault;
+	if (__put_user(0, dirent->d_name + namlen))
+		goto efault;
+	buf->previous = dirent;
+	dirent = (void __user *)dirent + reclen;
+	buf->current_dir = dirent;
+	buf->count -= reclen;
+	return 0;
+efault:
+	buf->error = -EFAULT;
+	return -EFAULT;
+}
+
+SYSCALL_DEFINE4(getdents_stat, unsigned int, fd,
+		struct linux_dirent_stat __user *, dirent, unsigned int, count,
+		unsigned int, flags)
+{
+	struct file * file;
+	struct linux_dirent_stat __user * lastdirent;
+	struct getdents_stat_callback buf;
+	int error;
+
+	/* Same layout for every ABI: no holes, nothing after d_name */
+	BUILD_BUG_ON(offsetof(struct linux_dirent_stat, st_blksize) != 36);
+	BUILD_BUG_ON(offsetof(struct linux_dirent_stat, st_dev) != 40);
+	BUILD_BUG_ON(offsetof(struct linux_dirent_stat, st_ctime_nsec) != 104);
+	BUILD_BUG_ON(offsetof(struct linux_dirent_stat, d_name) != 112);
+	BUILD_BUG_ON(sizeof(struct linux_dirent_stat) != 112);
+
+	error = -EINVAL;
+	if (flags)
+		goto out;
+
+	error = -EFAULT;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		goto out;
+
+	error = -EBADF;
+	file = fget(fd);
+	if (!file)
+		goto out;
+
+	buf.current_dir = dirent;
+	buf.previous = NULL;
+	buf.file = file;
+	buf.lookup = file->f_path.dentry->d_sb->s_type->fs_flags &
+		     FS_READDIR_LOOKUP;
+	buf.count = count;
+	buf.error = 0;
+
+	error = vfs_readdir(file, filldir_stat, &buf);
+	if (error >= 0)
+		error = buf.error;
+	lastdirent = buf.previous;
+	if (lastdirent) {
+		typeof(lastdirent->d_off) d_off = file->f_pos;
+		if (__put_user(d_off, &lastdirent->d_off))
+			error = -EFAULT;
+		else
+			error = count - buf.count;
+	}
+	fput(file);
+out:
+	return error;
+}
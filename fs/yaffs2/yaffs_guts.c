@@ -132,6 +132,7 @@ static int yaffs_init_tmp_buffers(struct yaffs_dev *dev)
 	u8 *buf = (u8 *) 1;
 
 	memset(dev->temp_buffer, 0, sizeof(dev->temp_buffer));
+	spin_lock_init(&dev->temp_lock);
 
 	for (i = 0; buf && i < YAFFS_N_TEMP_BUFFERS; i++) {
 		dev->temp_buffer[i].line = 0;	/* not in use */
@@ -146,6 +147,9 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 {
 	int i, j;
 
+	/* Readers holding the gross lock shared get buffers concurrently */
+	spin_lock(&dev->temp_lock);
+
 	dev->temp_in_use++;
 	if (dev->temp_in_use > dev->max_temp)
 		dev->max_temp = dev->temp_in_use;
@@ -160,6 +164,7 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 					    dev->temp_buffer[j].line;
 			}
 
+			spin_unlock(&dev->temp_lock);
 			return dev->temp_buffer[i].buffer;
 		}
 	}
@@ -176,6 +181,7 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 	 */
 
 	dev->unmanaged_buffer_allocs++;
+	spin_unlock(&dev->temp_lock);
 	return kmalloc(dev->data_bytes_per_chunk, GFP_NOFS);
 
 }
@@ -184,22 +190,28 @@ void yaffs_release_temp_buffer(struct yaffs_dev *dev, u8 * buffer, int line_no)
 {
 	int i;
 
+	spin_lock(&dev->temp_lock);
+
 	dev->temp_in_use--;
 
 	for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++) {
 		if (dev->temp_buffer[i].buffer == buffer) {
 			dev->temp_buffer[i].line = 0;
+			spin_unlock(&dev->temp_lock);
 			return;
 		}
 	}
 
+	if (buffer)
+		dev->unmanaged_buffer_deallocs++;
+	spin_unlock(&dev->temp_lock);
+
 	if (buffer) {
 		/* assume it is an unmanaged one. */
 		yaffs_trace(YAFFS_TRACE_BUFFERS,
 		  "Releasing unmanaged temp buffer in line %d",
 		   line_no);
 		kfree(buffer);
-		dev->unmanaged_buffer_deallocs++;
 	}
 
 }
@@ -255,6 +267,8 @@ static void yaffs_handle_chunk_update(struct yaffs_dev *dev, int nand_chunk,
 void yaffs_handle_chunk_error(struct yaffs_dev *dev,
 			      struct yaffs_block_info *bi)
 {
+	/* Read errors are also reported under the shared gross lock */
+	spin_lock(&dev->temp_lock);
 	if (!bi->gc_prioritise) {
 		bi->gc_prioritise = 1;
 		dev->has_pending_prioritised_gc = 1;
@@ -266,6 +280,7 @@ void yaffs_handle_chunk_error(struct yaffs_dev *dev,
 
 		}
 	}
+	spin_unlock(&dev->temp_lock);
 }
 
 static void yaffs_handle_chunk_wr_error(struct yaffs_dev *dev, int nand_chunk,
@@ -1562,6 +1577,28 @@ static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
         }
 }
 
+/* Grab a cache chunk without flushing anything out.
+ * Used by reads, which hold the gross lock shared and so must not write:
+ * only a free chunk, or the least recently used clean one, will do.
+ */
+static struct yaffs_cache *yaffs_grab_clean_chunk_cache(struct yaffs_dev *dev)
+{
+	struct yaffs_cache *cache;
+	int i;
+
+	cache = yaffs_grab_chunk_worker(dev);
+	if (cache)
+		return cache;
+
+	for (i = 0; i < dev->param.n_caches; i++) {
+		if (!dev->cache[i].dirty && !dev->cache[i].locked &&
+		    (!cache || dev->cache[i].last_use < cache->last_use))
+			cache = &dev->cache[i];
+	}
+
+	return cache;
+}
+
 /* Find a cached chunk */
 static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
 						  int chunk_id)
@@ -2389,6 +2426,11 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
 	}
+	if (block_no == dev->gc_cb_best) {
+		dev->gc_cb_best = 0;
+		dev->gc_cb_best_pages = 0;
+		dev->gc_cb_best_score = 0;
+	}
 
 	if (!bi->needs_retiring) {
 		yaffs2_checkpt_invalidate(dev);
@@ -2715,9 +2757,35 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	return ret_val;
 }
 
+/*
+ * Cost-benefit score of collecting a block, as in log-structured file
+ * systems: the space it frees, weighted by its age, over the cost of
+ * reading it and writing out its live chunks. With u the fraction of the
+ * block in use that is age * (1 - u) / (1 + u).
+ *
+ * Old blocks are worth collecting at a lower dirtiness than young ones:
+ * what is still live in them has stayed live and is likely to stay so,
+ * while young blocks keep getting dirtier by themselves if left alone.
+ */
+#define YAFFS_GC_MAX_AGE 0xffff
+
+static unsigned yaffs_gc_score(struct yaffs_dev *dev,
+			       struct yaffs_block_info *bi, int pages_used)
+{
+	unsigned age = dev->seq_number - bi->seq_number;
+
+	if (age > YAFFS_GC_MAX_AGE)
+		age = YAFFS_GC_MAX_AGE;
+
+	return (age + 1) * (dev->param.chunks_per_block - pages_used) /
+	    (dev->param.chunks_per_block + pages_used);
+}
+
 /*
  * FindBlockForgarbageCollection is used to select the dirtiest block (or close enough)
  * for garbage collection.
+ * Background gc on yaffs2 picks the block with the best cost-benefit
+ * score instead, since it is not in a hurry to get a block back.
  */
 
 static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
@@ -2730,10 +2798,12 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 	int prioritised_exist = 0;
 	struct yaffs_block_info *bi;
 	int threshold;
+	int selected_pages = 0;
 
 	/* First let's see if we need to grab a prioritised block */
 	if (dev->has_pending_prioritised_gc && !aggressive) {
 		dev->gc_dirtiest = 0;
+		dev->gc_cb_best = 0;
 		bi = dev->block_info;
 		for (i = dev->internal_start_block;
 		     i <= dev->internal_end_block && !selected; i++) {
@@ -2773,6 +2843,10 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 		int pages_used;
 		int n_blocks =
 		    dev->internal_end_block - dev->internal_start_block + 1;
+		int cost_benefit = background && !aggressive &&
+		    dev->param.is_yaffs2;
+		unsigned score;
+
 		if (aggressive) {
 			threshold = dev->param.chunks_per_block;
 			iterations = n_blocks;
@@ -2800,7 +2874,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 		for (i = 0;
 		     i < iterations &&
-		     (dev->gc_dirtiest < 1 ||
+		     (cost_benefit || dev->gc_dirtiest < 1 ||
 		      dev->gc_pages_in_use > YAFFS_GC_GOOD_ENOUGH); i++) {
 			dev->gc_block_finder++;
 			if (dev->gc_block_finder < dev->internal_start_block ||
@@ -2812,18 +2886,51 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 			pages_used = bi->pages_in_use - bi->soft_del_pages;
 
-			if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
-			    pages_used < dev->param.chunks_per_block &&
-			    (dev->gc_dirtiest < 1
-			     || pages_used < dev->gc_pages_in_use)
-			    && yaffs_block_ok_for_gc(dev, bi)) {
+			if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+			    pages_used >= dev->param.chunks_per_block)
+				continue;
+
+			/*
+			 * The two searches keep their own best candidate:
+			 * a block with the best score is not the one with
+			 * the fewest pages in use, and comparing one
+			 * search's pick by the other's measure would let
+			 * each undo the other's work.
+			 */
+			if (cost_benefit) {
+				score = yaffs_gc_score(dev, bi, pages_used);
+				if ((dev->gc_cb_best > 0 &&
+				     score <= dev->gc_cb_best_score) ||
+				    !yaffs_block_ok_for_gc(dev, bi))
+					continue;
+
+				dev->gc_cb_best = dev->gc_block_finder;
+				dev->gc_cb_best_pages = pages_used;
+				dev->gc_cb_best_score = score;
+			} else {
+				if ((dev->gc_dirtiest > 0 &&
+				     pages_used >= dev->gc_pages_in_use) ||
+				    !yaffs_block_ok_for_gc(dev, bi))
+					continue;
+
 				dev->gc_dirtiest = dev->gc_block_finder;
 				dev->gc_pages_in_use = pages_used;
 			}
 		}
 
-		if (dev->gc_dirtiest > 0 && dev->gc_pages_in_use <= threshold)
+		if (cost_benefit) {
+			if (dev->gc_cb_best > 0 &&
+			    dev->gc_cb_best_pages <= threshold) {
+				selected = dev->gc_cb_best;
+				selected_pages = dev->gc_cb_best_pages;
+				dev->cb_gc_picks++;
+			}
+		} else if (dev->gc_dirtiest > 0 &&
+			   dev->gc_pages_in_use <= threshold) {
 			selected = dev->gc_dirtiest;
+			selected_pages = dev->gc_pages_in_use;
+			dev->dirtiest_gc_picks++;
+		}
 	}
 
 	/*
@@ -2836,10 +2943,9 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 		yaffs2_find_oldest_dirty_seq(dev);
 		if (dev->oldest_dirty_block > 0) {
 			selected = dev->oldest_dirty_block;
-			dev->gc_dirtiest = selected;
 			dev->oldest_dirty_gc_count++;
 			bi = yaffs_get_block_info(dev, selected);
-			dev->gc_pages_in_use =
+			selected_pages =
 			    bi->pages_in_use - bi->soft_del_pages;
 		} else {
 			dev->gc_not_done = 0;
@@ -2850,24 +2956,29 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 		yaffs_trace(YAFFS_TRACE_GC,
 			"GC Selected block %d with %d free, prioritised:%d",
 			selected,
-			dev->param.chunks_per_block - dev->gc_pages_in_use,
+			dev->param.chunks_per_block - selected_pages,
 			prioritised);
 
 		dev->n_gc_blocks++;
 		if (background)
 			dev->bg_gcs++;
 
+		/* Both candidates may be the block now being collected */
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
+		dev->gc_cb_best = 0;
+		dev->gc_cb_best_pages = 0;
+		dev->gc_cb_best_score = 0;
 		dev->gc_not_done = 0;
 		if (dev->refresh_skip > 0)
 			dev->refresh_skip--;
 	} else {
 		dev->gc_not_done++;
 		yaffs_trace(YAFFS_TRACE_GC,
-			"GC none: finder %d skip %d threshold %d dirtiest %d using %d oldest %d%s",
+			"GC none: finder %d skip %d threshold %d dirtiest %d using %d best score %d using %d oldest %d%s",
 			dev->gc_block_finder, dev->gc_not_done, threshold,
 			dev->gc_dirtiest, dev->gc_pages_in_use,
+			dev->gc_cb_best, dev->gc_cb_best_pages,
 			dev->oldest_dirty_block, background ? " bg" : "");
 	}
 
@@ -2886,11 +2997,13 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 {
 	int aggressive = 0;
+	int whole_block;
 	int gc_ok = YAFFS_OK;
 	int max_tries = 0;
 	int min_erased;
 	int erased_chunks;
 	int checkpt_block_adjust;
+	u32 copies_before = dev->n_gc_copies;
 
 	if (dev->param.gc_control && (dev->param.gc_control(dev) & 1) == 0)
 		return YAFFS_OK;
@@ -2918,8 +3031,12 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 		if (dev->n_erased_blocks < min_erased)
 			aggressive = 1;
 		else {
-			if (!background
-			    && erased_chunks > (dev->n_free_chunks / 4))
+			/* Leasurely gc is the background thread's job if
+			 * there is one, so that writes don't stall on it.
+			 */
+			if (!background &&
+			    (dev->gc_bg_active ||
+			     erased_chunks > (dev->n_free_chunks / 4)))
 				break;
 
 			if (dev->gc_skip > 20)
@@ -2954,11 +3071,29 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 			if (!aggressive)
 				dev->passive_gc_count++;
 
+			/*
+			 * A write that needs a block soon collects a few
+			 * chunks of one at a time, as leasurely gc does, so
+			 * that no single write copies a whole block. Only
+			 * once into the reserved blocks does it have to get
+			 * a whole block back right now.
+			 */
+			whole_block = aggressive;
+			if (!background) {
+				if (dev->n_erased_blocks >
+				    dev->param.n_reserved_blocks)
+					whole_block = 0;
+				if (whole_block)
+					dev->fg_gc_whole_blocks++;
+				else
+					dev->fg_gc_steps++;
+			}
+
 			yaffs_trace(YAFFS_TRACE_GC,
-				"yaffs: GC n_erased_blocks %d aggressive %d",
-				dev->n_erased_blocks, aggressive);
+				"yaffs: GC n_erased_blocks %d aggressive %d whole %d",
+				dev->n_erased_blocks, aggressive, whole_block);
 
-			gc_ok = yaffs_gc_block(dev, dev->gc_block, aggressive);
+			gc_ok = yaffs_gc_block(dev, dev->gc_block, whole_block);
 		}
 
 		if (dev->n_erased_blocks < (dev->param.n_reserved_blocks)
@@ -2971,6 +3106,11 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 	} while ((dev->n_erased_blocks < dev->param.n_reserved_blocks) &&
 		 (dev->gc_block > 0) && (max_tries < 2));
 
+	if (background)
+		dev->bg_gc_copies += dev->n_gc_copies - copies_before;
+	else
+		dev->fg_gc_copies += dev->n_gc_copies - copies_before;
+
 	return aggressive ? gc_ok : YAFFS_OK;
 }
 
@@ -3270,8 +3410,18 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 
 	dev = in->my_dev;
 
+	/*
+	 * Lookups and readdir hold the device lock shared, so several can
+	 * find the same object lazy loaded: one loads it under lazy_lock,
+	 * and lazy_loaded is only cleared once its details are complete.
+	 */
+	if (!in->lazy_loaded) {
+		smp_rmb();
+		return;
+	}
+
+	mutex_lock(&dev->lazy_lock);
 	if (in->lazy_loaded && in->hdr_chunk > 0) {
-		in->lazy_loaded = 0;
 		chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
 
 		result =
@@ -3291,7 +3441,11 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 		}
 
 		yaffs_release_temp_buffer(dev, chunk_data, __LINE__);
+
+		smp_wmb();
+		in->lazy_loaded = 0;
 	}
+	mutex_unlock(&dev->lazy_lock);
 }
 
 static void yaffs_load_name_from_oh(struct yaffs_dev *dev, YCHAR * name,
@@ -3538,6 +3692,9 @@ int yaffs_update_oh(struct yaffs_obj *in, const YCHAR * name, int force,
  * Curve-balls: the first chunk might also be the last chunk.
  */
 
+/* Reads only need the gross lock held shared, so several can run at once:
+ * they share the short op cache under cache_lock and never write to flash.
+ */
 int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 {
 
@@ -3566,21 +3723,23 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 		else
 			n_copy = dev->data_bytes_per_chunk - start;
 
-		cache = yaffs_find_chunk_cache(in, chunk);
-
-		/* If the chunk is already in the cache or it is less than a whole chunk
-		 * or we're using inband tags then use the cache (if there is caching)
-		 * else bypass the cache.
+		/* The gross lock is only held shared here, so the short op
+		 * cache is used under cache_lock, and never flushed: a miss
+		 * that finds no clean chunk to load into reads around it.
 		 */
-		if (cache || n_copy != dev->data_bytes_per_chunk
-		    || dev->param.inband_tags) {
-			if (dev->param.n_caches > 0) {
+		cache = NULL;
+		if (dev->param.n_caches > 0) {
+			mutex_lock(&dev->cache_lock);
 
-				/* If we can't find the data in the cache, then load it up. */
+			cache = yaffs_find_chunk_cache(in, chunk);
 
-				if (!cache) {
-					cache =
-					    yaffs_grab_chunk_cache(in->my_dev);
+			/* Load partial chunks, and inband tagged ones, into
+			 * the cache. Whole chunks are read straight through.
+			 */
+			if (!cache && (n_copy != dev->data_bytes_per_chunk ||
+				       dev->param.inband_tags)) {
+				cache = yaffs_grab_clean_chunk_cache(dev);
+				if (cache) {
 					cache->object = in;
 					cache->chunk_id = chunk;
 					cache->dirty = 0;
@@ -3589,27 +3748,30 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 							  cache->data);
 					cache->n_bytes = 0;
 				}
+			}
 
+			if (cache) {
 				yaffs_use_cache(dev, cache, 0);
-
-				cache->locked = 1;
-
 				memcpy(buffer, &cache->data[start], n_copy);
+			}
 
-				cache->locked = 0;
-			} else {
-				/* Read into the local buffer then copy.. */
+			mutex_unlock(&dev->cache_lock);
+		}
 
-				u8 *local_buffer =
-				    yaffs_get_temp_buffer(dev, __LINE__);
-				yaffs_rd_data_obj(in, chunk, local_buffer);
+		if (cache)
+			;	/* Served from the cache */
+		else if (n_copy != dev->data_bytes_per_chunk
+			 || dev->param.inband_tags) {
+			/* Read into the local buffer then copy.. */
 
-				memcpy(buffer, &local_buffer[start], n_copy);
+			u8 *local_buffer =
+			    yaffs_get_temp_buffer(dev, __LINE__);
+			yaffs_rd_data_obj(in, chunk, local_buffer);
 
-				yaffs_release_temp_buffer(dev, local_buffer,
-							  __LINE__);
-			}
+			memcpy(buffer, &local_buffer[start], n_copy);
 
+			yaffs_release_temp_buffer(dev, local_buffer,
+						  __LINE__);
 		} else {
 
 			/* A full chunk. Read directly into the supplied buffer. */
@@ -4916,6 +5078,16 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->bg_gc_copies = 0;
+	dev->bg_idle_gcs = 0;
+	dev->fg_gc_copies = 0;
+	dev->fg_gc_steps = 0;
+	dev->fg_gc_whole_blocks = 0;
+	dev->cb_gc_picks = 0;
+	dev->dirtiest_gc_picks = 0;
+	dev->gc_cb_best = 0;
+	dev->gc_cb_best_pages = 0;
+	dev->gc_cb_best_score = 0;
 	dev->gc_block_finder = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
@@ -4939,6 +5111,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		init_failed = 1;
 
 	dev->cache = NULL;
+	mutex_init(&dev->cache_lock);
+	mutex_init(&dev->lazy_lock);
 	dev->gc_cleanup_list = NULL;
 
 	if (!init_failed && dev->param.n_caches > 0) {
@@ -671,6 +671,10 @@ struct yaffs_dev {
 	unsigned gc_block;
 	unsigned gc_chunk;
 	unsigned gc_skip;
+	unsigned gc_cb_best;	/* Best candidate by cost-benefit score */
+	unsigned gc_cb_best_pages;	/* Its pages in use */
+	unsigned gc_cb_best_score;	/* Its score */
+	int gc_bg_active;	/* A background thread is keeping blocks erased */
 
 	/* Special directories */
 	struct yaffs_obj *root_dir;
@@ -686,6 +690,10 @@ struct yaffs_dev {
 
 	struct yaffs_cache *cache;
 	int cache_last_use;
+	/* Serialises cache use by readers holding the device lock shared */
+	struct mutex cache_lock;
+	/* Serialises lazy loading of object details by those readers */
+	struct mutex lazy_lock;
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted files live. */
@@ -697,6 +705,8 @@ struct yaffs_dev {
 
 	/* Temporary buffer management */
 	struct yaffs_buffer temp_buffer[YAFFS_N_TEMP_BUFFERS];
+	/* Protects temp buffers and chunk error state against shared readers */
+	spinlock_t temp_lock;
 	int max_temp;
 	int temp_in_use;
 	int unmanaged_buffer_allocs;
@@ -724,6 +734,13 @@ struct yaffs_dev {
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
 	u32 bg_gcs;
+	u32 bg_gc_copies;	/* Chunks copied by background gc */
+	u32 bg_idle_gcs;	/* Background gc passes run because writes went idle */
+	u32 fg_gc_copies;	/* Chunks copied by gc inline in writes */
+	u32 fg_gc_steps;	/* Incremental gc steps run inline in writes */
+	u32 fg_gc_whole_blocks;	/* Writes that had to collect a whole block */
+	u32 cb_gc_picks;	/* Blocks picked by cost-benefit selection */
+	u32 dirtiest_gc_picks;	/* Blocks picked as the dirtiest */
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
 	u32 n_ecc_fixed;
@@ -24,14 +24,16 @@ struct yaffs_linux_context {
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
-	struct mutex gross_lock;	/* Gross locking mutex*/
-	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
-				 * at compile time so we have to allocate it.
-				 */
+	unsigned long last_write;	/* jiffies of the last file write */
+	/* Gross lock: held for writing by anything that modifies the
+	 * device and for reading by operations that only read it.
+	 */
+	struct rw_semaphore gross_lock;
+	/* Readdirs in progress, added and removed under search_lock */
 	struct list_head search_contexts;
+	spinlock_t search_lock;
 	void (*put_super_fn) (struct super_block * sb);
 
-	struct task_struct *readdir_process;
 	unsigned mount_id;
 };
 
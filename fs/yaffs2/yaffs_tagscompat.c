@@ -268,9 +268,11 @@ static void yaffs_handle_rd_data_error(struct yaffs_dev *dev, int nand_chunk)
 	int flash_block = nand_chunk / dev->param.chunks_per_block;
 
 	/* Mark the block for retirement */
+	spin_lock(&dev->temp_lock);
 	yaffs_get_block_info(dev,
 			     flash_block + dev->block_offset)->needs_retiring =
 	    1;
+	spin_unlock(&dev->temp_lock);
 	yaffs_trace(YAFFS_TRACE_ERROR | YAFFS_TRACE_BAD_BLOCKS,
 		"**>>Block %d marked for retirement",
 		flash_block);
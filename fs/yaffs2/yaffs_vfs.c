@@ -124,14 +124,38 @@ static unsigned yaffs_gc_control_callback(struct yaffs_dev *dev)
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
-	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	down_write(&(yaffs_dev_to_lc(dev)->gross_lock));
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
 }
 
 static void yaffs_gross_unlock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
-	mutex_unlock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	up_write(&(yaffs_dev_to_lc(dev)->gross_lock));
+}
+
+/*
+ * Operations that only read the device take the gross lock shared, so
+ * that reads of different files, or of different parts of one file, no
+ * longer queue behind each other. They still wait for writers: a write
+ * can run garbage collection, which moves any object's chunks and
+ * rewrites its tnodes, so writes keep the device to themselves.
+ *
+ * What shared readers do update is protected underneath: the short op
+ * cache by dev->cache_lock, the temp buffers and block error state by
+ * dev->temp_lock.
+ */
+static void yaffs_gross_lock_shared(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking shared %p", current);
+	down_read(&(yaffs_dev_to_lc(dev)->gross_lock));
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked shared %p", current);
+}
+
+static void yaffs_gross_unlock_shared(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking shared %p", current);
+	up_read(&(yaffs_dev_to_lc(dev)->gross_lock));
 }
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
@@ -373,8 +397,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry,
 
 	struct yaffs_dev *dev = yaffs_inode_to_obj(dir)->my_dev;
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_lookup for %d:%s",
@@ -385,8 +408,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry,
 	obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
 
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (obj) {
 		yaffs_trace(YAFFS_TRACE_OS,
@@ -600,9 +622,9 @@ static ssize_t yaffs_getxattr(struct dentry * dentry, const char *name, void *bu
 
 	if (error == 0) {
 		dev = obj->my_dev;
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		error = yaffs_get_xattrib(obj, name, buff, size);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 
 	}
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_getxattr done returning %d", error);
@@ -650,9 +672,9 @@ static ssize_t yaffs_listxattr(struct dentry * dentry, char *buff, size_t size)
 
 	if (error == 0) {
 		dev = obj->my_dev;
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		error = yaffs_list_xattrib(obj, buff, size);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 
 	}
 	yaffs_trace(YAFFS_TRACE_OS,
@@ -697,7 +719,10 @@ static const struct inode_operations yaffs_dir_inode_operations = {
  *
  * A seach context lives for the duration of a readdir.
  *
- * All these functions must be called while yaffs is locked.
+ * All these functions must be called while yaffs is locked. Readdir
+ * only holds the lock shared, so the list of search contexts has its
+ * own search_lock; yaffs_remove_obj_callback() runs with yaffs locked
+ * exclusively, when no readdir can be using its context.
  */
 
 struct yaffs_search_context {
@@ -728,7 +753,9 @@ static struct yaffs_search_context *yaffs_new_search(struct yaffs_obj *dir)
 			    list_entry(dir->variant.dir_variant.children.next,
 				       struct yaffs_obj, siblings);
 		INIT_LIST_HEAD(&sc->others);
+		spin_lock(&yaffs_dev_to_lc(dev)->search_lock);
 		list_add(&sc->others, &(yaffs_dev_to_lc(dev)->search_contexts));
+		spin_unlock(&yaffs_dev_to_lc(dev)->search_lock);
 	}
 	return sc;
 }
@@ -739,7 +766,9 @@ static struct yaffs_search_context *yaffs_new_search(struct yaffs_obj *dir)
 static void yaffs_search_end(struct yaffs_search_context *sc)
 {
 	if (sc) {
+		spin_lock(&yaffs_dev_to_lc(sc->dev)->search_lock);
 		list_del(&sc->others);
+		spin_unlock(&yaffs_dev_to_lc(sc->dev)->search_lock);
 		kfree(sc);
 	}
 }
@@ -810,9 +839,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
-
-	yaffs_dev_to_lc(dev)->readdir_process = current;
+	yaffs_gross_lock_shared(dev);
 
 	offset = f->f_pos;
 
@@ -829,12 +856,12 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry . ino %d",
 			(int)inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 		if (filldir(dirent, ".", 1, offset, inode->i_ino, DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -842,14 +869,14 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry .. ino %d",
 			(int)f->f_dentry->d_parent->d_inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 		if (filldir(dirent, "..", 2, offset,
 			    f->f_dentry->d_parent->d_inode->i_ino,
 			    DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -876,17 +903,17 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 				"yaffs_readdir: %s inode %d",
 				name, yaffs_get_obj_inode(l));
 
-			yaffs_gross_unlock(dev);
+			yaffs_gross_unlock_shared(dev);
 
 			if (filldir(dirent,
 				    name,
 				    strlen(name),
 				    offset, this_inode, this_type) < 0) {
-				yaffs_gross_lock(dev);
+				yaffs_gross_lock_shared(dev);
 				goto out;
 			}
 
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 
 			offset++;
 			f->f_pos++;
@@ -896,8 +923,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 out:
 	yaffs_search_end(sc);
-	yaffs_dev_to_lc(dev)->readdir_process = NULL;
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	return ret_val;
 }
@@ -1021,11 +1047,11 @@ static int yaffs_readlink(struct dentry *dentry, char __user * buffer,
 
 	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (!alias)
 		return -ENOMEM;
@@ -1041,10 +1067,10 @@ static void *yaffs_follow_link(struct dentry *dentry, struct nameidata *nd)
 	void *ret;
 	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (!alias) {
 		ret = ERR_PTR(-ENOMEM);
@@ -1153,12 +1179,12 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	ret = yaffs_file_rd(obj, pg_buf,
 			    pg->index << PAGE_CACHE_SHIFT, PAGE_CACHE_SIZE);
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (ret >= 0)
 		ret = 0;
@@ -1263,6 +1289,7 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 				  page->index << PAGE_CACHE_SHIFT, n_bytes, 0);
 
 	yaffs_touch_super(dev);
+	yaffs_dev_to_lc(dev)->last_write = jiffies;
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"writepag1: obj = %05x, ino = %05x",
@@ -1297,11 +1324,11 @@ static ssize_t yaffs_hold_space(struct file *f)
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	n_free_chunks = yaffs_get_n_free_chunks(dev);
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	return (n_free_chunks > 20) ? 1 : 0;
 }
@@ -1315,9 +1342,9 @@ static void yaffs_release_space(struct file *f)
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 }
 
 static int yaffs_write_begin(struct file *filp, struct address_space *mapping,
@@ -1407,6 +1434,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 	n_written = yaffs_wr_file(obj, buf, ipos, n, 0);
 
 	yaffs_touch_super(dev);
+	yaffs_dev_to_lc(dev)->last_write = jiffies;
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_file_write: %d(%x) bytes written",
@@ -1468,7 +1496,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_statfs");
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
@@ -1520,7 +1548,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 	return 0;
 }
 
@@ -1574,6 +1602,29 @@ static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev)
 		return 2;
 }
 
+/*
+ * Once writes have gone quiet, the background thread keeps collecting
+ * past the point where it would otherwise stop, so that the next burst
+ * of writes finds erased blocks instead of having to collect them.
+ */
+#define YAFFS_BG_IDLE_TIME	(HZ / 2)
+
+static int yaffs_bg_gc_idle(struct yaffs_dev *dev)
+{
+	unsigned erased_chunks =
+	    dev->n_erased_blocks * dev->param.chunks_per_block;
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+
+	if (!time_after(jiffies, context->last_write + YAFFS_BG_IDLE_TIME))
+		return 0;
+
+	/* Something to gain: a block's worth of free chunks not erased */
+	if (erased_chunks + dev->param.chunks_per_block > dev->n_free_chunks)
+		return 0;
+
+	return erased_chunks < dev->n_free_chunks / 4 * 3;
+}
+
 static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint)
 {
 
@@ -1616,6 +1667,9 @@ static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint)
  * The thread should not do any writing while the fs is in read only.
  */
 
+/* gc steps per background pass, by urgency */
+static const int yaffs_bg_gc_steps[] = { 1, 4, 16 };
+
 void yaffs_background_waker(unsigned long data)
 {
 	wake_up_process((struct task_struct *)data);
@@ -1630,6 +1684,8 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long next_gc = now;
 	unsigned long expires;
 	unsigned int urgency;
+	int idle;
+	int steps;
 
 	int gc_result;
 	struct timer_list timer;
@@ -1656,10 +1712,36 @@ static int yaffs_bg_thread_fn(void *data)
 			next_dir_update = now + HZ;
 		}
 
+		dev->gc_bg_active = yaffs_bg_enable;
+
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
 				urgency = yaffs_bg_gc_urgency(dev);
-				gc_result = yaffs_bg_gc(dev, urgency);
+				idle = !urgency && yaffs_bg_gc_idle(dev);
+				if (idle) {
+					dev->bg_idle_gcs++;
+					urgency = 1;
+				}
+
+				/*
+				 * Each gc step copies a few chunks. Take
+				 * more of them the more urgent it is, but
+				 * let other users have the device in
+				 * between.
+				 */
+				steps = yaffs_bg_gc_steps[urgency];
+				do {
+					gc_result = yaffs_bg_gc(dev, urgency);
+					if (--steps <= 0)
+						break;
+					yaffs_gross_unlock(dev);
+					cond_resched();
+					yaffs_gross_lock(dev);
+				} while (context->bg_running &&
+					 !kthread_should_stop() &&
+					 !dev->is_checkpointed);
+
+				now = jiffies;
 				if (urgency > 1)
 					next_gc = now + HZ / 20 + 1;
 				else if (urgency > 0)
@@ -1726,6 +1808,7 @@ static void yaffs_bg_stop(struct yaffs_dev *dev)
 		kthread_stop(ctxt->bg_thread);
 		ctxt->bg_thread = NULL;
 	}
+	dev->gc_bg_active = 0;
 }
 
 static void yaffs_write_super(struct super_block *sb)
@@ -1985,11 +2068,6 @@ static void yaffs_put_super(struct super_block *sb)
 	list_del_init(&(yaffs_dev_to_lc(dev)->context_list));
 	mutex_unlock(&yaffs_context_lock);
 
-	if (yaffs_dev_to_lc(dev)->spare_buffer) {
-		kfree(yaffs_dev_to_lc(dev)->spare_buffer);
-		yaffs_dev_to_lc(dev)->spare_buffer = NULL;
-	}
-
 	kfree(dev);
 }
 
@@ -2200,6 +2278,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	INIT_LIST_HEAD(&(context->context_list));
 	context->dev = dev;
 	context->super = sb;
+	context->last_write = jiffies;
 
 	dev->read_only = read_only;
 
@@ -2266,8 +2345,6 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
-		yaffs_dev_to_lc(dev)->spare_buffer = 
-		                kmalloc(mtd->oobsize, GFP_NOFS);
 		param->is_yaffs2 = 1;
 		param->total_bytes_per_chunk = mtd->writesize;
 		param->chunks_per_block = mtd->erasesize / mtd->writesize;
@@ -2322,9 +2399,10 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	/* Directory search handling... */
 	INIT_LIST_HEAD(&(yaffs_dev_to_lc(dev)->search_contexts));
+	spin_lock_init(&(yaffs_dev_to_lc(dev)->search_lock));
 	param->remove_obj_fn = yaffs_remove_obj_callback;
 
-	mutex_init(&(yaffs_dev_to_lc(dev)->gross_lock));
+	init_rwsem(&(yaffs_dev_to_lc(dev)->gross_lock));
 
 	yaffs_gross_lock(dev);
 
@@ -2476,6 +2554,17 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf += sprintf(buf, "bg_gc_copies.......... %u\n", dev->bg_gc_copies);
+	buf += sprintf(buf, "bg_idle_gcs........... %u\n", dev->bg_idle_gcs);
+	buf += sprintf(buf, "cb_gc_picks........... %u\n", dev->cb_gc_picks);
+	buf +=
+	    sprintf(buf, "dirtiest_gc_picks..... %u\n",
+		    dev->dirtiest_gc_picks);
+	buf += sprintf(buf, "fg_gc_copies.......... %u\n", dev->fg_gc_copies);
+	buf += sprintf(buf, "fg_gc_steps........... %u\n", dev->fg_gc_steps);
+	buf +=
+	    sprintf(buf, "fg_gc_whole_blocks.... %u\n",
+		    dev->fg_gc_whole_blocks);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
@@ -30,6 +30,9 @@
 #include <linux/stat.h>
 #include <linux/sort.h>
 #include <linux/bitops.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
 
 #define YCHAR char
 #define YUCHAR unsigned char
@@ -188,6 +188,8 @@ struct dentry_operations {
 #define DCACHE_NEED_AUTOMOUNT	0x20000	/* handle automount on this dir */
 #define DCACHE_MANAGE_TRANSIT	0x40000	/* manage transit from this dirent */
 #define DCACHE_NEED_LOOKUP	0x80000 /* dentry requires i_op->lookup */
+#define DCACHE_DENTRY_KILLED	0x100000 /* killed, maybe still on a shrink list */
+#define DCACHE_MAY_FREE		0x200000 /* killer done, shrink list owner frees */
 #define DCACHE_MANAGED_DENTRY \
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
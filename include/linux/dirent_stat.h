@@ -0,0 +1,44 @@
+#ifndef _LINUX_DIRENT_STAT_H
+#define _LINUX_DIRENT_STAT_H
+
+#include <linux/types.h>
+
+/*
+ * Directory entries as returned by getdents_stat(): a linux_dirent64
+ * followed by what lstat() would return for the entry, if d_stat_valid.
+ * Records are d_reclen bytes long and 8 byte aligned; d_name is NUL
+ * terminated.  The layout has no implicit padding, so it is the same
+ * for 32 and 64 bit userspace: the 64 bit fields start at offset 40,
+ * d_name at 112.  fs/readdir.c checks this at build time.
+ *
+ * The attributes are left out (d_stat_valid is 0) where they could not
+ * be had as cheaply as the entry itself: on filesystems that do not
+ * support it, for "..", for mount points, and for entries that could not
+ * be looked up.  The caller should lstat() those as before.
+ */
+struct linux_dirent_stat {
+	__u64		d_ino;
+	__s64		d_off;
+	__u16		d_reclen;
+	__u8		d_type;
+	__u8		d_stat_valid;
+	__u32		st_mode;
+	__u32		st_nlink;
+	__u32		st_uid;
+	__u32		st_gid;
+	__u32		st_blksize;
+	__u64		st_dev;
+	__u64		st_rdev;
+	__s64		st_size;
+	__u64		st_blocks;	/* in 512 byte units */
+	__s64		st_atime_sec;
+	__s64		st_mtime_sec;
+	__s64		st_ctime_sec;
+	__u32		st_atime_nsec;
+	__u32		st_mtime_nsec;
+	__u32		st_ctime_nsec;
+	__u32		__pad;
+	char		d_name[0];
+};
+
+#endif /* _LINUX_DIRENT_STAT_H */
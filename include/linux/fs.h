@@ -185,6 +185,9 @@ struct inodes_stat_t {
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
 					 */
+#define FS_READDIR_LOOKUP	65536	/* filldir may look up the entry
+					 * it is passed, see getdents_stat()
+					 */
 
 /*
  * These are the fs-independent mount-flags: up to 32 flags are supported
@@ -403,6 +406,7 @@ struct inodes_stat_t {
 #include <linux/atomic.h>
 #include <linux/shrinker.h>
 #include <linux/migrate_mode.h>
+#include <linux/list_lru.h>
 
 #include <asm/byteorder.h>
 
@@ -1448,14 +1452,8 @@ struct super_block {
 	struct list_head	s_files;
 #endif
 	struct list_head	s_mounts;	/* list of mounts; _not_ for fs use */
-	/* s_dentry_lru, s_nr_dentry_unused protected by dcache.c lru locks */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
-
-	/* s_inode_lru_lock protects s_inode_lru and s_nr_inodes_unused */
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		/* unused inode lru */
-	int			s_nr_inodes_unused;	/* # of inodes on lru */
+	struct list_lru		s_dentry_lru;	/* unused dentry lru */
+	struct list_lru		s_inode_lru;	/* unused inode lru */
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
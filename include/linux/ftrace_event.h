@@ -180,6 +180,7 @@ enum {
 	TRACE_EVENT_FL_CAP_ANY_BIT,
 	TRACE_EVENT_FL_NO_SET_FILTER_BIT,
 	TRACE_EVENT_FL_IGNORE_ENABLE_BIT,
+	TRACE_EVENT_FL_HIST_BIT,
 };
 
 enum {
@@ -189,8 +190,11 @@ enum {
 	TRACE_EVENT_FL_CAP_ANY		= (1 << TRACE_EVENT_FL_CAP_ANY_BIT),
 	TRACE_EVENT_FL_NO_SET_FILTER	= (1 << TRACE_EVENT_FL_NO_SET_FILTER_BIT),
 	TRACE_EVENT_FL_IGNORE_ENABLE	= (1 << TRACE_EVENT_FL_IGNORE_ENABLE_BIT),
+	TRACE_EVENT_FL_HIST		= (1 << TRACE_EVENT_FL_HIST_BIT),
 };
 
+struct event_hist;
+
 struct ftrace_event_call {
 	struct list_head	list;
 	struct ftrace_event_class *class;
@@ -207,6 +211,7 @@ struct ftrace_event_call {
 	 *   bit 1:		enabled
 	 *   bit 2:		filter_active
 	 *   bit 3:		enabled cmd record
+	 *   bit 7:		hist attached (probe registered for it)
 	 *
 	 * Changes to flags must hold the event_mutex.
 	 *
@@ -223,6 +228,9 @@ struct ftrace_event_call {
 	int				perf_refcount;
 	struct hlist_head __percpu	*perf_events;
 #endif
+#ifdef CONFIG_EVENT_HIST
+	struct event_hist __rcu		*hist;
+#endif
 };
 
 #define __TRACE_EVENT_FLAGS(name, value)				\
@@ -244,6 +252,23 @@ extern int filter_current_check_discard(struct ring_buffer *buffer,
 					void *rec,
 					struct ring_buffer_event *event);
 
+#ifdef CONFIG_EVENT_HIST
+extern void *trace_event_hist_buffer(unsigned long len);
+extern void trace_event_hist_commit(struct ftrace_event_call *call,
+				    void *rec, unsigned long len,
+				    unsigned long flags, int pc);
+#else
+static inline void *trace_event_hist_buffer(unsigned long len)
+{
+	return NULL;
+}
+static inline void trace_event_hist_commit(struct ftrace_event_call *call,
+					   void *rec, unsigned long len,
+					   unsigned long flags, int pc)
+{
+}
+#endif
+
 enum {
 	FILTER_OTHER = 0,
 	FILTER_STATIC_STRING,
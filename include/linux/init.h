@@ -155,6 +155,13 @@ extern unsigned int reset_devices;
 void setup_arch(char **);
 void prepare_namespace(void);
 
+/* Defined in init/initramfs.c */
+#ifdef CONFIG_BLK_DEV_INITRD
+extern void wait_for_initramfs(void);
+#else
+static inline void wait_for_initramfs(void) { }
+#endif
+
 extern void (*late_time_init)(void);
 
 extern bool initcall_debug;
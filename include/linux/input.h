@@ -1169,8 +1169,21 @@ struct ff_effect {
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #include <linux/mod_devicetable.h>
 
+/**
+ * struct input_value - input value representation
+ * @type: type of value (EV_KEY, EV_ABS, etc)
+ * @code: the value code
+ * @value: the value
+ */
+struct input_value {
+	__u16 type;
+	__u16 code;
+	__s32 value;
+};
+
 /**
  * struct input_dev - represents an input device
  * @name: name of the device
@@ -1252,6 +1265,12 @@ struct ff_effect {
  * @h_list: list of input handles associated with the device. When
  *	accessing the list dev->mutex must be held
  * @node: used to place the device onto input_dev_list
+ * @num_vals: number of values queued in the current frame
+ * @max_vals: maximum number of values queued in a frame
+ * @vals: array of values queued in the current frame
+ * @timestamp: CLOCK_MONOTONIC time the current frame was generated at,
+ *	set by the driver with input_set_timestamp() or, failing that, by
+ *	input core when the first value of the frame is reported
  */
 struct input_dev {
 	const char *name;
@@ -1321,6 +1340,12 @@ struct input_dev {
 
 	struct list_head	h_list;
 	struct list_head	node;
+
+	unsigned int num_vals;
+	unsigned int max_vals;
+	struct input_value *vals;
+
+	ktime_t timestamp;
 };
 #define to_input_dev(d) container_of(d, struct input_dev, dev)
 
@@ -1381,6 +1406,11 @@ struct input_handle;
  * @event: event handler. This method is being called by input core with
  *	interrupts disabled and dev->event_lock spinlock held and so
  *	it may not sleep
+ * @events: event sequence handler. This method is being called by
+ *	input core with interrupts disabled and dev->event_lock
+ *	spinlock held and so it may not sleep. It gets all the events
+ *	of a frame, up to and including its EV_SYN/SYN_REPORT, at once;
+ *	if it is not provided, @event is called for each of them
  * @filter: similar to @event; separates normal event handlers from
  *	"filters".
  * @match: called after comparing device's id with handler's id_table
@@ -1417,6 +1447,8 @@ struct input_handler {
 	void *private;
 
 	void (*event)(struct input_handle *handle, unsigned int type, unsigned int code, int value);
+	void (*events)(struct input_handle *handle,
+		       const struct input_value *vals, unsigned int count);
 	bool (*filter)(struct input_handle *handle, unsigned int type, unsigned int code, int value);
 	bool (*match)(struct input_handler *handler, struct input_dev *dev);
 	int (*connect)(struct input_handler *handler, struct input_dev *dev, const struct input_device_id *id);
@@ -1508,6 +1540,9 @@ int input_flush_device(struct input_handle *handle, struct file *file);
 void input_event(struct input_dev *dev, unsigned int type, unsigned int code, int value);
 void input_inject_event(struct input_handle *handle, unsigned int type, unsigned int code, int value);
 
+void input_set_timestamp(struct input_dev *dev, ktime_t timestamp);
+ktime_t input_get_timestamp(struct input_dev *dev);
+
 static inline void input_report_key(struct input_dev *dev, unsigned int code, int value)
 {
 	input_event(dev, EV_KEY, code, !!value);
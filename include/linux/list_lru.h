@@ -0,0 +1,78 @@
+#ifndef _LINUX_LIST_LRU_H
+#define _LINUX_LIST_LRU_H
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+
+/*
+ * LRU lists of reclaimable objects, split so that adding and removing
+ * objects from different cpus, and walking the lists to reclaim them,
+ * do not all serialize on one lock.
+ *
+ * With NUMA there is one list per memory node, and an object goes on the
+ * list of the node its memory is on.  Otherwise objects are spread over
+ * one list per possible cpu, chosen by address.  Either way the list an
+ * object belongs on never changes, so it needs no field to find it by.
+ *
+ * Each list is kept in LRU order on its own: objects are added at the
+ * tail and walked from the head.
+ */
+
+/* What the isolate callback of list_lru_walk() did with an item */
+enum lru_status {
+	LRU_REMOVED,		/* item removed from the list */
+	LRU_ROTATE,		/* item referenced, give it another pass */
+	LRU_SKIP,		/* item cannot be locked, skip it */
+	LRU_RETRY,		/* item not freeable, lock was dropped */
+};
+
+struct list_lru_one {
+	spinlock_t		lock;
+	struct list_head	list;
+	long			nr_items;	/* protected by lock */
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_one	*lists;
+	unsigned int		nr_lists;
+	unsigned int		shift;		/* log2(nr_lists) */
+	unsigned int		cursor;		/* first list of the next walk */
+};
+
+int list_lru_init(struct list_lru *lru);
+void list_lru_destroy(struct list_lru *lru);
+
+/*
+ * Add an item at the tail of its list, if it is on no list.  Returns true
+ * if it was added.  The item's list_head must be initialised empty.
+ */
+bool list_lru_add(struct list_lru *lru, struct list_head *item);
+
+/*
+ * Remove an item from its list, if it is on it.  Returns true if it was
+ * removed.  The caller must make sure that the item is not on some other
+ * list by now, e.g. moved to a private one by an isolate callback.
+ */
+bool list_lru_del(struct list_lru *lru, struct list_head *item);
+
+/* Number of items on all the lists: only a snapshot. */
+unsigned long list_lru_count(struct list_lru *lru);
+
+/*
+ * Called by list_lru_walk() with the lock of the item's list held.  If
+ * it drops that lock, it must take it again and return LRU_RETRY.  On
+ * LRU_REMOVED it must have taken the item off the list itself, e.g. with
+ * list_move() to a private list.
+ */
+typedef enum lru_status (*list_lru_walk_cb)(struct list_head *item,
+					    spinlock_t *lock, void *cb_arg);
+
+/*
+ * Call isolate on up to nr_to_walk items, oldest first, shared out over
+ * the lists.  Returns the number of items removed.
+ */
+unsigned long list_lru_walk(struct list_lru *lru, list_lru_walk_cb isolate,
+			    void *cb_arg, unsigned long nr_to_walk);
+
+#endif /* _LINUX_LIST_LRU_H */
@@ -33,6 +33,7 @@ struct modversion_info
 };
 
 struct module;
+struct module_export;
 
 struct module_kobject {
 	struct kobject kobj;
@@ -265,6 +266,10 @@ struct module
 	const unsigned long *gpl_future_crcs;
 	unsigned int num_gpl_future_syms;
 
+	/* All of the above, hashed by name for find_symbol(). */
+	struct module_export *exports;
+	unsigned int num_exports;
+
 	/* Exception table */
 	unsigned int num_exentries;
 	struct exception_table_entry *extable;
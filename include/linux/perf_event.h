@@ -130,8 +130,10 @@ enum perf_event_sample_format {
 	PERF_SAMPLE_STREAM_ID			= 1U << 9,
 	PERF_SAMPLE_RAW				= 1U << 10,
 	PERF_SAMPLE_BRANCH_STACK		= 1U << 11,
+	PERF_SAMPLE_REGS_USER			= 1U << 12,
+	PERF_SAMPLE_STACK_USER			= 1U << 13,
 
-	PERF_SAMPLE_MAX = 1U << 12,		/* non-ABI */
+	PERF_SAMPLE_MAX = 1U << 14,		/* non-ABI */
 };
 
 /*
@@ -162,6 +164,15 @@ enum perf_branch_sample_type {
 	 PERF_SAMPLE_BRANCH_KERNEL|\
 	 PERF_SAMPLE_BRANCH_HV)
 
+/*
+ * Values to determine ABI of the registers dump.
+ */
+enum perf_sample_regs_abi {
+	PERF_SAMPLE_REGS_ABI_NONE	= 0,
+	PERF_SAMPLE_REGS_ABI_32		= 1,
+	PERF_SAMPLE_REGS_ABI_64		= 2,
+};
+
 /*
  * The format of the data returned by read() on a perf event fd,
  * as specified by attr.read_format:
@@ -194,6 +205,8 @@ enum perf_event_read_format {
 #define PERF_ATTR_SIZE_VER0	64	/* sizeof first published struct */
 #define PERF_ATTR_SIZE_VER1	72	/* add: config2 */
 #define PERF_ATTR_SIZE_VER2	80	/* add: branch_sample_type */
+#define PERF_ATTR_SIZE_VER3	96	/* add: sample_regs_user */
+					/* add: sample_stack_user */
 
 /*
  * Hardware event_id to monitor via a performance monitoring event:
@@ -255,7 +268,16 @@ struct perf_event_attr {
 				exclude_host   :  1, /* don't count in host   */
 				exclude_guest  :  1, /* don't count in guest  */
 
-				__reserved_1   : 43;
+				exclude_callchain_kernel : 1, /* exclude kernel callchains */
+				exclude_callchain_user   : 1, /* exclude user callchains */
+
+				__reserved_1   : 40,
+
+				/*
+				 * Not upstream: kept at the far end, clear
+				 * of the bits upstream assigns next.
+				 */
+				callchain_id   :  1; /* callchain ids, not callchains */
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -272,6 +294,20 @@ struct perf_event_attr {
 		__u64		config2; /* extension of config1 */
 	};
 	__u64	branch_sample_type; /* enum branch_sample_type */
+
+	/*
+	 * Defines set of user regs to dump on samples.
+	 * See asm/perf_regs.h for details.
+	 */
+	__u64	sample_regs_user;
+
+	/*
+	 * Defines size of the user stack to dump on samples.
+	 */
+	__u32	sample_stack_user;
+
+	/* Align to u64. */
+	__u32	__reserved_2;
 };
 
 /*
@@ -532,6 +568,9 @@ enum perf_event_type {
 	 *
 	 *	{ u64			nr,
 	 *	  u64			ips[nr];  } && PERF_SAMPLE_CALLCHAIN
+	 *					     && !callchain_id
+	 *	{ u64			callchain_id; } && PERF_SAMPLE_CALLCHAIN
+	 *						 && callchain_id
 	 *
 	 *	#
 	 *	# The RAW record below is opaque data wrt the ABI
@@ -548,11 +587,43 @@ enum perf_event_type {
 	 *	  char                  data[size];}&& PERF_SAMPLE_RAW
 	 *
 	 *	{ u64 from, to, flags } lbr[nr];} && PERF_SAMPLE_BRANCH_STACK
+	 *
+	 *	{ u64			abi; # enum perf_sample_regs_abi
+	 *	  u64			regs[weight(mask)]; } && PERF_SAMPLE_REGS_USER
+	 *
+	 *	{ u64			size;
+	 *	  char			data[size];
+	 *	  u64			dyn_size; } && PERF_SAMPLE_STACK_USER
 	 * };
 	 */
 	PERF_RECORD_SAMPLE			= 9,
 
 	PERF_RECORD_MAX,			/* non-ABI */
+
+	/*
+	 * Not upstream, so numbered well clear of the kernel's record
+	 * types and of the perf tool's own, which start at 64.
+	 *
+	 * With attr.callchain_id set, samples carry an id in place of
+	 * their callchain.  The callchain behind an id is written once,
+	 * the first time the event (or, for inherited events, the
+	 * process) samples it, and again only after it has been evicted
+	 * from the cache.  An id is a hash of the callchain, so equal ids
+	 * from different events name the same callchain.  Samples taken
+	 * on other cpus may refer to an id ahead of this record, so ids
+	 * are best resolved once the buffer has been read.  The buffer
+	 * has to be mapped writable: an overwrite buffer would drop these
+	 * records while samples still refer to them.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *	u64				id;
+	 *	u64				nr;
+	 *	u64				ips[nr];
+	 *	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_CALLCHAIN			= 0x8000,
 };
 
 enum perf_callchain_context {
@@ -621,6 +692,13 @@ struct perf_raw_record {
 	void				*data;
 };
 
+struct perf_regs_user {
+	__u64				abi;
+	struct pt_regs			*regs;
+};
+
+struct perf_callchain_cache;
+
 /*
  * single taken branch record layout:
  *
@@ -955,6 +1033,9 @@ struct perf_event {
 	struct ring_buffer		*rb;
 	struct list_head		rb_entry;
 
+	/* callchain ids already written to rb, see PERF_RECORD_CALLCHAIN */
+	struct perf_callchain_cache	*callchain_cache;
+
 	/* poll related */
 	wait_queue_head_t		waitq;
 	struct fasync_struct		*fasync;
@@ -1130,6 +1211,9 @@ struct perf_sample_data {
 	struct perf_callchain_entry	*callchain;
 	struct perf_raw_record		*raw;
 	struct perf_branch_stack	*br_stack;
+	u64				callchain_id;
+	struct perf_regs_user		regs_user;
+	u64				stack_user_size;
 };
 
 static inline void perf_sample_data_init(struct perf_sample_data *data, u64 addr)
@@ -1137,6 +1221,9 @@ static inline void perf_sample_data_init(struct perf_sample_data *data, u64 addr
 	data->addr = addr;
 	data->raw  = NULL;
 	data->br_stack = NULL;
+	data->regs_user.abi = PERF_SAMPLE_REGS_ABI_NONE;
+	data->regs_user.regs = NULL;
+	data->stack_user_size = 0;
 }
 
 extern void perf_output_sample(struct perf_output_handle *handle,
@@ -1280,6 +1367,12 @@ static inline bool has_branch_stack(struct perf_event *event)
 	return event->attr.sample_type & PERF_SAMPLE_BRANCH_STACK;
 }
 
+#ifdef CONFIG_HAVE_PERF_USER_STACK_DUMP
+# define perf_user_stack_pointer(regs)	user_stack_pointer(regs)
+#else
+# define perf_user_stack_pointer(regs)	0
+#endif
+
 extern int perf_output_begin(struct perf_output_handle *handle,
 			     struct perf_event *event, unsigned int size);
 extern void perf_output_end(struct perf_output_handle *handle);
@@ -179,6 +179,21 @@ void ring_buffer_free_read_page(struct ring_buffer *buffer, void *data);
 int ring_buffer_read_page(struct ring_buffer *buffer, void **data_page,
 			  size_t len, int cpu, int full);
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+int ring_buffer_set_compress(struct ring_buffer *buffer, unsigned long size);
+unsigned long ring_buffer_compress_size(struct ring_buffer *buffer);
+unsigned long
+ring_buffer_compressed_pages_cpu(struct ring_buffer *buffer, int cpu);
+unsigned long
+ring_buffer_compressed_bytes_cpu(struct ring_buffer *buffer, int cpu);
+#else
+static inline int
+ring_buffer_set_compress(struct ring_buffer *buffer, unsigned long size)
+{
+	return size ? -ENODEV : 0;
+}
+#endif
+
 struct trace_seq;
 
 int ring_buffer_print_entry_header(struct trace_seq *s);
@@ -170,6 +170,8 @@ enum ttu_flags {
 	TTU_IGNORE_MLOCK = (1 << 8),	/* ignore mlock */
 	TTU_IGNORE_ACCESS = (1 << 9),	/* don't age */
 	TTU_IGNORE_HWPOISON = (1 << 10),/* corrupted page is recoverable */
+	TTU_LAZYFREE = (1 << 11),	/* discard clean MADV_FREE pages */
+	TTU_BATCH_FLUSH = (1 << 12),	/* defer TLB flushes to the caller */
 };
 #define TTU_ACTION(x) ((x) & TTU_ACTION_MASK)
 
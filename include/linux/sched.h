@@ -1254,6 +1254,19 @@ struct sched_rt_entity {
 
 struct rcu_node;
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * TLB flushes that reclaim owes for ptes it cleared without flushing,
+ * issued by try_to_unmap_flush() once per batch of pages.
+ */
+struct tlbflush_unmap_batch {
+	struct cpumask cpumask;		/* cpus that may hold the entries */
+	unsigned int nr_pending;	/* ptes cleared without a flush */
+	bool flush_required;
+	bool writable;			/* some entry was dirty */
+};
+#endif
+
 enum perf_event_task_context {
 	perf_invalid_context = -1,
 	perf_hw_context = 0,
@@ -1513,6 +1526,9 @@ struct task_struct {
 
 /* VM state */
 	struct reclaim_state *reclaim_state;
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	struct tlbflush_unmap_batch tlb_ubc;
+#endif
 
 	struct backing_dev_info *backing_dev_info;
 
@@ -1826,6 +1842,7 @@ extern int task_free_unregister(struct notifier_block *n);
 #define PF_FROZEN	0x00010000	/* frozen for system suspend */
 #define PF_FSTRANS	0x00020000	/* inside a filesystem transaction */
 #define PF_KSWAPD	0x00040000	/* I am kswapd */
+#define PF_MEMALLOC_NOIO 0x00080000	/* Allocating memory without IO involved */
 #define PF_LESS_THROTTLE 0x00100000	/* Throttle me less: I clean memory */
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
@@ -1863,6 +1880,23 @@ extern int task_free_unregister(struct notifier_block *n);
 #define tsk_used_math(p) ((p)->flags & PF_USED_MATH)
 #define used_math() tsk_used_math(current)
 
+/*
+ * Allocations made between these may not start I/O to reclaim memory,
+ * whatever gfp mask they pass: for code issuing block I/O that calls
+ * into paths which allocate with GFP_KERNEL.
+ */
+static inline unsigned int memalloc_noio_save(void)
+{
+	unsigned int flags = current->flags & PF_MEMALLOC_NOIO;
+	current->flags |= PF_MEMALLOC_NOIO;
+	return flags;
+}
+
+static inline void memalloc_noio_restore(unsigned int flags)
+{
+	current->flags = (current->flags & ~PF_MEMALLOC_NOIO) | flags;
+}
+
 /*
  * task->jobctl flags
  */
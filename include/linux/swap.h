@@ -174,6 +174,23 @@ enum {
 #define COUNT_CONTINUED	0x80	/* See swap_map continuation for full count */
 #define SWAP_MAP_SHMEM	0xbf	/* Owned by shmem/tmpfs, in first swap_map */
 
+/*
+ * On solid state swap, slots are handed out by SWAPFILE_CLUSTER sized
+ * clusters: each cpu allocates sequentially from a cluster of its own,
+ * and clusters that are empty or have free slots are kept on lists so
+ * that finding one never means scanning swap_map.
+ */
+struct swap_cluster_info {
+	struct list_head list;	/* on free or nonfull list, unless full/owned */
+	unsigned int count;	/* slots in use, bad or beyond the end */
+	unsigned int state;	/* CLUSTER_FREE etc, see mm/swapfile.c */
+};
+
+struct percpu_cluster {
+	struct swap_cluster_info *cluster; /* cluster being allocated from */
+	unsigned int next;		/* likely next free offset in it */
+};
+
 /*
  * The in-memory structure used to track swap areas.
  */
@@ -192,6 +209,10 @@ struct swap_info_struct {
 	unsigned int cluster_nr;	/* countdown to next cluster search */
 	unsigned int lowest_alloc;	/* while preparing discard cluster */
 	unsigned int highest_alloc;	/* while preparing discard cluster */
+	struct swap_cluster_info *cluster_info; /* per cluster state, or NULL */
+	struct list_head free_clusters;	/* clusters with no slot in use */
+	struct list_head nonfull_clusters; /* clusters with some slots free */
+	struct percpu_cluster __percpu *percpu_cluster;
 	struct swap_extent *curr_swap_extent;
 	struct swap_extent first_swap_extent;
 	struct block_device *bdev;	/* swap device or bdev of swap file */
@@ -230,6 +251,7 @@ extern void lru_add_drain_cpu(int cpu);
 extern int lru_add_drain_all(void);
 extern void rotate_reclaimable_page(struct page *page);
 extern void deactivate_page(struct page *page);
+extern void mark_page_lazyfree(struct page *page);
 extern void swap_setup(void);
 
 extern void add_page_to_unevictable_list(struct page *page);
@@ -338,8 +360,10 @@ extern struct page *swapin_readahead(swp_entry_t, gfp_t,
 extern long nr_swap_pages;
 extern long total_swap_pages;
 extern void si_swapinfo(struct sysinfo *);
-extern swp_entry_t get_swap_page(void);
+extern int get_swap_pages(int n, swp_entry_t swp_entries[]);
 extern swp_entry_t get_swap_page_of_type(int);
+extern void swapcache_free_entries(swp_entry_t *entries, int n);
+extern int __swp_swapcount(swp_entry_t entry);
 extern int add_swap_count_continuation(swp_entry_t, gfp_t);
 extern void swap_shmem_alloc(swp_entry_t);
 extern int swap_duplicate(swp_entry_t);
@@ -355,6 +379,15 @@ extern int reuse_swap_page(struct page *);
 extern int try_to_free_swap(struct page *);
 struct backing_dev_info;
 
+/* linux/mm/swap_slots.c */
+#define SWAP_SLOTS_CACHE_SIZE	64
+extern bool swap_slot_cache_enabled;
+extern swp_entry_t get_swap_page(void);
+extern void free_swap_slot(swp_entry_t entry);
+extern void enable_swap_slots_cache(void);
+extern void disable_swap_slots_cache_lock(void);
+extern void reenable_swap_slots_cache_unlock(void);
+
 /* linux/mm/thrash.c */
 extern struct mm_struct *swap_token_mm;
 extern void grab_swap_token(struct mm_struct *);
@@ -19,6 +19,7 @@
 
 struct vb2_alloc_ctx;
 struct vb2_fileio_data;
+struct dma_buf;
 
 /**
  * struct vb2_mem_ops - memory handling/memory allocator operations
@@ -41,6 +42,19 @@ struct vb2_fileio_data;
  *		 argument to other ops in this structure
  * @put_userptr: inform the allocator that a USERPTR buffer will no longer
  *		 be used
+ * @get_dmabuf: export the buffer described by buf_priv as a dma_buf, for
+ *		VIDIOC_EXPBUF; the dma_buf holds its own reference to the
+ *		buffer, which is dropped when its last file is closed
+ * @attach_dmabuf: attach a dma_buf imported by userspace for a hardware
+ *		   operation; used for DMABUF memory types; size is the
+ *		   minimum size the plane needs; returns an allocator private
+ *		   per-buffer structure on success, ERR_PTR on failure
+ * @detach_dmabuf: inform the exporter that a DMABUF buffer will no longer be
+ *		   used; buf_priv is what attach_dmabuf returned
+ * @map_dmabuf: map the attached dma_buf for the device, before the buffer
+ *		is handed to the driver
+ * @unmap_dmabuf: release the mapping set up by map_dmabuf, once the driver
+ *		  is done with the buffer
  * @vaddr:	return a kernel virtual address to a given memory buffer
  *		associated with the passed private structure or NULL if no
  *		such mapping exists
@@ -55,6 +69,9 @@ struct vb2_fileio_data;
  *
  * Required ops for USERPTR types: get_userptr, put_userptr.
  * Required ops for MMAP types: alloc, put, num_users, mmap.
+ * Required ops for DMABUF types: attach_dmabuf, detach_dmabuf, map_dmabuf,
+ *				  unmap_dmabuf.
+ * Required ops for DMABUF export (VIDIOC_EXPBUF): get_dmabuf.
  * Required ops for read/write access types: alloc, put, num_users, vaddr
  */
 struct vb2_mem_ops {
@@ -65,6 +82,14 @@ struct vb2_mem_ops {
 					unsigned long size, int write);
 	void		(*put_userptr)(void *buf_priv);
 
+	struct dma_buf	*(*get_dmabuf)(void *buf_priv);
+
+	void		*(*attach_dmabuf)(void *alloc_ctx, struct dma_buf *dbuf,
+					  unsigned long size, int write);
+	void		(*detach_dmabuf)(void *buf_priv);
+	int		(*map_dmabuf)(void *buf_priv);
+	void		(*unmap_dmabuf)(void *buf_priv);
+
 	void		*(*vaddr)(void *buf_priv);
 	void		*(*cookie)(void *buf_priv);
 
@@ -75,6 +100,8 @@ struct vb2_mem_ops {
 
 struct vb2_plane {
 	void			*mem_priv;
+	struct dma_buf		*dbuf;
+	unsigned int		dbuf_mapped;
 };
 
 /**
@@ -83,12 +110,14 @@ struct vb2_plane {
  * @VB2_USERPTR:	driver supports USERPTR with streaming API
  * @VB2_READ:		driver supports read() style access
  * @VB2_WRITE:		driver supports write() style access
+ * @VB2_DMABUF:		driver supports DMABUF with streaming API
  */
 enum vb2_io_modes {
 	VB2_MMAP	= (1 << 0),
 	VB2_USERPTR	= (1 << 1),
 	VB2_READ	= (1 << 2),
 	VB2_WRITE	= (1 << 3),
+	VB2_DMABUF	= (1 << 4),
 };
 
 /**
@@ -317,6 +346,7 @@ void vb2_queue_release(struct vb2_queue *q);
 
 int vb2_qbuf(struct vb2_queue *q, struct v4l2_buffer *b);
 int vb2_dqbuf(struct vb2_queue *q, struct v4l2_buffer *b, bool nonblocking);
+int vb2_expbuf(struct vb2_queue *q, struct v4l2_exportbuffer *eb);
 
 int vb2_streamon(struct vb2_queue *q, enum v4l2_buf_type type);
 int vb2_streamoff(struct vb2_queue *q, enum v4l2_buf_type type);
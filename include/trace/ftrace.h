@@ -532,18 +532,32 @@ ftrace_raw_event_##call(void *__data, proto)				\
 									\
 	__data_size = ftrace_get_offsets_##call(&__data_offsets, args); \
 									\
-	event = trace_current_buffer_lock_reserve(&buffer,		\
+	/* with a histogram, build the entry aside, see trace_events_hist.c */ \
+	event = NULL;							\
+	entry = NULL;							\
+	if (unlikely(event_call->flags & TRACE_EVENT_FL_HIST))		\
+		entry = trace_event_hist_buffer(sizeof(*entry) + __data_size); \
+	if (!entry) {							\
+		event = trace_current_buffer_lock_reserve(&buffer,	\
 				 event_call->event.type,		\
 				 sizeof(*entry) + __data_size,		\
 				 irq_flags, pc);			\
-	if (!event)							\
-		return;							\
-	entry	= ring_buffer_event_data(event);			\
+		if (!event)						\
+			return;						\
+		entry	= ring_buffer_event_data(event);		\
+	}								\
 									\
 	tstruct								\
 									\
 	{ assign; }							\
 									\
+	if (!event) {							\
+		trace_event_hist_commit(event_call, entry,		\
+					sizeof(*entry) + __data_size,	\
+					irq_flags, pc);			\
+		return;							\
+	}								\
+									\
 	if (!filter_current_check_discard(buffer, event_call, entry, event)) \
 		trace_nowake_buffer_unlock_commit(buffer,		\
 						  event, irq_flags, pc); \
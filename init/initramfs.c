@@ -8,6 +8,8 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
 
 static __initdata char *message;
 static void __init error(char *x)
@@ -569,20 +571,60 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+static char * __init unpack_to_rootfs_timed(const char *what, char *buf,
+					   unsigned len)
+{
+	ktime_t calltime;
+	char *err;
+
+	if (!initcall_debug)
+		return unpack_to_rootfs(buf, len);
+
+	calltime = ktime_get();
+	err = unpack_to_rootfs(buf, len);
+	printk(KERN_DEBUG "initramfs: %s (%u bytes) unpacked after %lld usecs\n",
+	       what, len,
+	       (long long)ktime_to_ns(ktime_sub(ktime_get(), calltime)) >> 10);
+	return err;
+}
+
+static int __initdata initramfs_async = 1;
+
+static int __init initramfs_async_setup(char *str)
+{
+	initramfs_async = simple_strtoul(str, NULL, 0) != 0;
+	return 1;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+/*
+ * Unpacking runs in its own async domain: anything that needs the files,
+ * which is mostly anything that execs, waits for it with
+ * wait_for_initramfs().
+ */
+static LIST_HEAD(initramfs_domain);
+
+void wait_for_initramfs(void)
 {
-	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
+	async_synchronize_full_domain(&initramfs_domain);
+}
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
+{
+	char *err = unpack_to_rootfs_timed("built-in archive",
+					   __initramfs_start,
+					   __initramfs_size);
 	if (err)
 		panic(err);	/* Failed to decompress INTERNAL initramfs */
 	if (initrd_start) {
 #ifdef CONFIG_BLK_DEV_RAM
 		int fd;
 		printk(KERN_INFO "Trying to unpack rootfs image as initramfs...\n");
-		err = unpack_to_rootfs((char *)initrd_start,
+		err = unpack_to_rootfs_timed("initrd", (char *)initrd_start,
 			initrd_end - initrd_start);
 		if (!err) {
 			free_initrd();
-			return 0;
+			return;
 		} else {
 			clean_rootfs();
 			unpack_to_rootfs(__initramfs_start, __initramfs_size);
@@ -599,13 +641,27 @@ static int __init populate_rootfs(void)
 		}
 #else
 		printk(KERN_INFO "Unpacking initramfs...\n");
-		err = unpack_to_rootfs((char *)initrd_start,
+		err = unpack_to_rootfs_timed("initrd", (char *)initrd_start,
 			initrd_end - initrd_start);
 		if (err)
 			printk(KERN_EMERG "Initramfs unpacking failed: %s\n", err);
 		free_initrd();
 #endif
 	}
+}
+
+/*
+ * Decompressing and unpacking the archives takes long enough to show up in
+ * boot time, and nothing but the first exec depends on it, so it runs in
+ * parallel with the remaining initcalls unless "initramfs_async=0" is given.
+ */
+static int __init populate_rootfs(void)
+{
+	if (initramfs_async)
+		async_schedule_domain(do_populate_rootfs, NULL,
+				      &initramfs_domain);
+	else
+		do_populate_rootfs(NULL, 0);
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
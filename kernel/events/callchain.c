@@ -11,6 +11,7 @@
 
 #include <linux/perf_event.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
 #include "internal.h"
 
 struct callchain_cpus_entries {
@@ -153,7 +154,8 @@ put_callchain_entry(int rctx)
 	put_recursion_context(__get_cpu_var(callchain_recursion), rctx);
 }
 
-struct perf_callchain_entry *perf_callchain(struct pt_regs *regs)
+struct perf_callchain_entry *
+perf_callchain(struct perf_event *event, struct pt_regs *regs)
 {
 	int rctx;
 	struct perf_callchain_entry *entry;
@@ -169,15 +171,21 @@ struct perf_callchain_entry *perf_callchain(struct pt_regs *regs)
 	entry->nr = 0;
 
 	if (!user_mode(regs)) {
-		perf_callchain_store(entry, PERF_CONTEXT_KERNEL);
-		perf_callchain_kernel(entry, regs);
+		if (!event->attr.exclude_callchain_kernel) {
+			perf_callchain_store(entry, PERF_CONTEXT_KERNEL);
+			perf_callchain_kernel(entry, regs);
+		}
 		if (current->mm)
 			regs = task_pt_regs(current);
 		else
 			regs = NULL;
 	}
 
-	if (regs) {
+	/*
+	 * Unwinding user stacks is the expensive part on some machines;
+	 * with PERF_SAMPLE_STACK_USER that can be done offline instead.
+	 */
+	if (regs && !event->attr.exclude_callchain_user) {
 		perf_callchain_store(entry, PERF_CONTEXT_USER);
 		perf_callchain_user(entry, regs);
 	}
@@ -187,3 +195,106 @@ exit_put:
 
 	return entry;
 }
+
+/*
+ * Callchain ids: with attr.callchain_id a sample carries a hash of its
+ * callchain, and the callchain itself is written once, in a
+ * PERF_RECORD_CALLCHAIN, the first time it comes up.  The cache below
+ * remembers which ids are in the buffer.  It belongs to the event the
+ * user opened and is shared with the events inherited from it, so it
+ * covers the whole process; slots are claimed with cmpxchg, which makes
+ * it safe to use from NMI on every cpu at once.  When a probe sequence
+ * is full the first slot is taken over, which only costs the evicted
+ * callchain being written again.
+ */
+#define CALLCHAIN_CACHE_BITS	10
+#define CALLCHAIN_CACHE_SIZE	(1 << CALLCHAIN_CACHE_BITS)
+#define CALLCHAIN_CACHE_MASK	(CALLCHAIN_CACHE_SIZE - 1)
+#define CALLCHAIN_CACHE_PROBES	8
+
+struct perf_callchain_cache {
+	atomic64_t			ids[CALLCHAIN_CACHE_SIZE];
+};
+
+int alloc_callchain_cache(struct perf_event *event)
+{
+	event->callchain_cache = kzalloc(sizeof(struct perf_callchain_cache),
+					 GFP_KERNEL);
+	if (!event->callchain_cache)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void free_callchain_cache(struct perf_event *event)
+{
+	kfree(event->callchain_cache);
+	event->callchain_cache = NULL;
+}
+
+/*
+ * Called when the event gets a new buffer: nothing written to the old
+ * one is of use to whoever reads the new one.
+ */
+void reset_callchain_cache(struct perf_event *event)
+{
+	struct perf_callchain_cache *cache = event->callchain_cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < CALLCHAIN_CACHE_SIZE; i++)
+		atomic64_set(&cache->ids[i], 0);
+}
+
+u64 perf_callchain_id(struct perf_callchain_entry *entry)
+{
+	u32 words = entry->nr * (sizeof(u64) / sizeof(u32));
+	const u32 *ip = (const u32 *)entry->ip;
+	u64 id;
+
+	id = (u64)jhash2(ip, words, 0) << 32 | jhash2(ip, words, JHASH_INITVAL);
+
+	/* 0 marks a free slot */
+	return id ?: 1;
+}
+
+/*
+ * Returns the slot that now holds @id if the callchain has to be written
+ * out, or NULL if it already was.  A caller that then fails to write it
+ * hands the slot back with forget_callchain_id().
+ */
+atomic64_t *perf_callchain_cache_add(struct perf_event *event, u64 id)
+{
+	struct perf_callchain_cache *cache;
+	unsigned int idx = id & CALLCHAIN_CACHE_MASK;
+	atomic64_t *slot;
+	u64 old;
+	int i;
+
+	if (event->parent)
+		event = event->parent;
+	cache = event->callchain_cache;
+
+	for (i = 0; i < CALLCHAIN_CACHE_PROBES; i++) {
+		slot = &cache->ids[(idx + i) & CALLCHAIN_CACHE_MASK];
+		old = atomic64_read(slot);
+		if (!old)
+			old = atomic64_cmpxchg(slot, 0, id);
+		if (!old)
+			return slot;
+		if (old == id)
+			return NULL;
+	}
+
+	slot = &cache->ids[idx];
+	atomic64_set(slot, id);
+
+	return slot;
+}
+
+void forget_callchain_id(atomic64_t *slot, u64 id)
+{
+	atomic64_cmpxchg(slot, id, 0);
+}
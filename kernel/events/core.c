@@ -34,6 +34,7 @@
 #include <linux/anon_inodes.h>
 #include <linux/kernel_stat.h>
 #include <linux/perf_event.h>
+#include <linux/perf_regs.h>
 #include <linux/ftrace_event.h>
 #include <linux/hw_breakpoint.h>
 
@@ -2845,6 +2846,7 @@ static void free_event_rcu(struct rcu_head *head)
 	if (event->ns)
 		put_pid_ns(event->ns);
 	perf_event_free_filter(event);
+	free_callchain_cache(event);
 	kfree(event);
 }
 
@@ -3603,6 +3605,13 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 	if (vma->vm_pgoff != 0)
 		return -EINVAL;
 
+	/*
+	 * Callchain ids need each PERF_RECORD_CALLCHAIN to stay until it
+	 * has been read, which an overwrite (read-only) buffer won't do.
+	 */
+	if (event->attr.callchain_id && !(vma->vm_flags & VM_WRITE))
+		return -EINVAL;
+
 	WARN_ON_ONCE(event->ctx->parent_ctx);
 	mutex_lock(&event->mmap_mutex);
 	if (event->rb) {
@@ -3650,6 +3659,7 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 		ret = -ENOMEM;
 		goto unlock;
 	}
+	reset_callchain_cache(event);
 	rcu_assign_pointer(event->rb, rb);
 
 	atomic_long_add(user_extra, &user->locked_vm);
@@ -3818,6 +3828,125 @@ void perf_event__output_id_sample(struct perf_event *event,
 		__perf_event__output_id_sample(handle, sample);
 }
 
+static void
+perf_output_sample_regs(struct perf_output_handle *handle,
+			struct pt_regs *regs, u64 mask)
+{
+	int bit;
+
+	for_each_set_bit(bit, (const unsigned long *) &mask,
+			 sizeof(mask) * BITS_PER_BYTE) {
+		u64 val;
+
+		val = perf_reg_value(regs, bit);
+		perf_output_put(handle, val);
+	}
+}
+
+static void perf_sample_regs_user(struct perf_regs_user *regs_user,
+				  struct pt_regs *regs)
+{
+	if (!user_mode(regs)) {
+		if (current->mm)
+			regs = task_pt_regs(current);
+		else
+			regs = NULL;
+	}
+
+	if (regs) {
+		regs_user->regs = regs;
+		regs_user->abi  = perf_reg_abi(current);
+	}
+}
+
+static u64 perf_ustack_task_size(struct pt_regs *regs)
+{
+	unsigned long addr = perf_user_stack_pointer(regs);
+
+	if (!addr || addr >= TASK_SIZE)
+		return 0;
+
+	return TASK_SIZE - addr;
+}
+
+static u16
+perf_sample_ustack_size(u16 stack_size, u16 header_size,
+			struct pt_regs *regs)
+{
+	u64 task_size;
+
+	/* No regs, no stack pointer, no dump. */
+	if (!regs)
+		return 0;
+
+	/*
+	 * Check if we fit in with the requested stack size into the:
+	 * - TASK_SIZE
+	 *   If we don't, we limit the size to the TASK_SIZE.
+	 *
+	 * - remaining sample size
+	 *   If we don't, we customize the stack size to
+	 *   fit in to the remaining sample size.
+	 */
+
+	task_size  = min((u64) USHRT_MAX, perf_ustack_task_size(regs));
+	stack_size = min(stack_size, (u16) task_size);
+
+	/* Current header size plus static size and dynamic size. */
+	header_size += 2 * sizeof(u64);
+
+	/* Do we fit in with the current stack dump size? */
+	if ((u16) (header_size + stack_size) < header_size) {
+		/*
+		 * If we overflow the maximum size for the sample,
+		 * we customize the stack dump size to fit in.
+		 */
+		stack_size = USHRT_MAX - header_size - sizeof(u64);
+		stack_size = round_up(stack_size, sizeof(u64));
+	}
+
+	return stack_size;
+}
+
+static void
+perf_output_sample_ustack(struct perf_output_handle *handle, u64 dump_size,
+			  struct pt_regs *regs)
+{
+	/* Case of a kernel thread, nothing to dump */
+	if (!regs) {
+		u64 size = 0;
+		perf_output_put(handle, size);
+	} else {
+		unsigned long sp;
+		unsigned int rem;
+		u64 dyn_size;
+
+		/*
+		 * We dump:
+		 * static size
+		 *   - the size requested by user or the best one we can fit
+		 *     in to the sample max size
+		 * data
+		 *   - user stack dump data
+		 * dynamic size
+		 *   - the actual dumped size
+		 */
+
+		/* Static size. */
+		perf_output_put(handle, dump_size);
+
+		/* Data. */
+		sp = perf_user_stack_pointer(regs);
+		rem = __output_copy_user(handle, (void __user *) sp, dump_size);
+		dyn_size = dump_size - rem;
+
+		__output_skip(handle, rem);
+
+		/* Dynamic size. */
+		perf_output_put(handle, dyn_size);
+	}
+}
+
 static void perf_output_read_one(struct perf_output_handle *handle,
 				 struct perf_event *event,
 				 u64 enabled, u64 running)
@@ -3948,7 +4077,9 @@ void perf_output_sample(struct perf_output_handle *handle,
 		perf_output_read(handle, event);
 
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
-		if (data->callchain) {
+		if (event->attr.callchain_id) {
+			perf_output_put(handle, data->callchain_id);
+		} else if (data->callchain) {
 			int size = 1;
 
 			if (data->callchain)
@@ -4011,6 +4142,74 @@ void perf_output_sample(struct perf_output_handle *handle,
 			perf_output_put(handle, nr);
 		}
 	}
+
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		u64 abi = data->regs_user.abi;
+
+		/*
+		 * If there are no regs to dump, notice it through
+		 * first u64 being zero (PERF_SAMPLE_REGS_ABI_NONE).
+		 */
+		perf_output_put(handle, abi);
+
+		if (abi) {
+			u64 mask = event->attr.sample_regs_user;
+			perf_output_sample_regs(handle,
+						data->regs_user.regs,
+						mask);
+		}
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER)
+		perf_output_sample_ustack(handle,
+					  data->stack_user_size,
+					  data->regs_user.regs);
+}
+
+/*
+ * With attr.callchain_id the sample only carries the id; the callchain
+ * itself goes out ahead of the sample the first time it is seen.
+ */
+static void perf_output_callchain_id(struct perf_event *event,
+				     struct perf_sample_data *data)
+{
+	struct perf_callchain_entry *entry = data->callchain;
+	struct perf_output_handle handle;
+	struct perf_event_header header;
+	atomic64_t *slot;
+	u64 id;
+
+	if (!entry || !entry->nr) {
+		data->callchain_id = 0;
+		return;
+	}
+
+	id = perf_callchain_id(entry);
+	data->callchain_id = id;
+
+	slot = perf_callchain_cache_add(event, id);
+	if (!slot)
+		return;
+
+	header.type = PERF_RECORD_CALLCHAIN;
+	header.misc = 0;
+	header.size = sizeof(header) + sizeof(id) +
+		      (1 + entry->nr) * sizeof(u64);
+
+	perf_event_header__init_id(&header, data, event);
+
+	if (perf_output_begin(&handle, event, header.size)) {
+		/* not in the buffer, so write it again next time */
+		forget_callchain_id(slot, id);
+		return;
+	}
+
+	perf_output_put(&handle, header);
+	perf_output_put(&handle, id);
+	__output_copy(&handle, entry, (1 + entry->nr) * sizeof(u64));
+	perf_event__output_id_sample(event, &handle, data);
+
+	perf_output_end(&handle);
 }
 
 void perf_prepare_sample(struct perf_event_header *header,
@@ -4034,9 +4233,11 @@ void perf_prepare_sample(struct perf_event_header *header,
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
 		int size = 1;
 
-		data->callchain = perf_callchain(regs);
+		data->callchain = perf_callchain(event, regs);
 
-		if (data->callchain)
+		if (event->attr.callchain_id)
+			perf_output_callchain_id(event, data);
+		else if (data->callchain)
 			size += data->callchain->nr;
 
 		header->size += size * sizeof(u64);
@@ -4062,6 +4263,49 @@ void perf_prepare_sample(struct perf_event_header *header,
 		}
 		header->size += size;
 	}
+
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		/* regs dump ABI info */
+		int size = sizeof(u64);
+
+		perf_sample_regs_user(&data->regs_user, regs);
+
+		if (data->regs_user.regs) {
+			u64 mask = event->attr.sample_regs_user;
+			size += hweight64(mask) * sizeof(u64);
+		}
+
+		header->size += size;
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER) {
+		/*
+		 * Either we need PERF_SAMPLE_STACK_USER bit to be allways
+		 * processed as the last one or have additional check added
+		 * in case new sample type is added, because we could eat
+		 * up the rest of the sample size.
+		 */
+		struct perf_regs_user *uregs = &data->regs_user;
+		u16 stack_size = event->attr.sample_stack_user;
+		u16 size = sizeof(u64);
+
+		if (!uregs->abi)
+			perf_sample_regs_user(uregs, regs);
+
+		stack_size = perf_sample_ustack_size(stack_size, header->size,
+						     uregs->regs);
+
+		/*
+		 * If there is something to dump, add space for the dump
+		 * itself and for the field that tells the dynamic size,
+		 * which is how many have been actually dumped.
+		 */
+		if (stack_size)
+			size += sizeof(u64) + stack_size;
+
+		data->stack_user_size = stack_size;
+		header->size += size;
+	}
 }
 
 static void perf_event_output(struct perf_event *event,
@@ -6003,6 +6247,13 @@ done:
 				return ERR_PTR(err);
 			}
 		}
+		if (event->attr.callchain_id) {
+			err = alloc_callchain_cache(event);
+			if (err) {
+				free_event(event);
+				return ERR_PTR(err);
+			}
+		}
 		if (has_branch_stack(event)) {
 			static_key_slow_inc(&perf_sched_events.key);
 			if (!(event->attach_state & PERF_ATTACH_TASK))
@@ -6112,6 +6363,32 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 			attr->branch_sample_type = mask;
 		}
 	}
+
+	if (attr->callchain_id &&
+	    !(attr->sample_type & PERF_SAMPLE_CALLCHAIN))
+		return -EINVAL;
+
+	if (attr->sample_type & PERF_SAMPLE_REGS_USER) {
+		ret = perf_reg_validate(attr->sample_regs_user);
+		if (ret)
+			return ret;
+	}
+
+	if (attr->sample_type & PERF_SAMPLE_STACK_USER) {
+#ifndef CONFIG_HAVE_PERF_USER_STACK_DUMP
+		return -ENOSYS;
+#endif
+		/*
+		 * We have __u32 type for the size, but so far
+		 * we can only use __u16 as maximum due to the
+		 * __u16 sample size limit.
+		 */
+		if (attr->sample_stack_user >= USHRT_MAX)
+			ret = -EINVAL;
+		else if (!IS_ALIGNED(attr->sample_stack_user, sizeof(u64)))
+			ret = -EINVAL;
+	}
+
 out:
 	return ret;
 
@@ -6157,9 +6434,15 @@ set:
 		rb = ring_buffer_get(output_event);
 		if (!rb)
 			goto unlock;
+		/* as in perf_mmap(): no callchain ids in an overwrite rb */
+		if (event->attr.callchain_id && !rb->writable) {
+			ring_buffer_put(rb);
+			goto unlock;
+		}
 	}
 
 	old_rb = event->rb;
+	reset_callchain_cache(event);
 	rcu_assign_pointer(event->rb, rb);
 	if (old_rb)
 		ring_buffer_detach(event, old_rb);
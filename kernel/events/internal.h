@@ -2,6 +2,7 @@
 #define _KERNEL_EVENTS_INTERNAL_H
 
 #include <linux/hardirq.h>
+#include <linux/uaccess.h>
 
 /* Buffer handling */
 
@@ -76,6 +77,21 @@ static inline unsigned long perf_data_size(struct ring_buffer *rb)
 	return rb->nr_pages << (PAGE_SHIFT + page_order(rb));
 }
 
+static inline void
+__output_advance(struct perf_output_handle *handle, unsigned long size)
+{
+	handle->addr += size;
+	handle->size -= size;
+	if (!handle->size) {
+		struct ring_buffer *rb = handle->rb;
+
+		handle->page++;
+		handle->page &= rb->nr_pages - 1;
+		handle->addr = rb->data_pages[handle->page];
+		handle->size = PAGE_SIZE << page_order(rb);
+	}
+}
+
 static inline void
 __output_copy(struct perf_output_handle *handle,
 		   const void *buf, unsigned int len)
@@ -86,24 +102,60 @@ __output_copy(struct perf_output_handle *handle,
 		memcpy(handle->addr, buf, size);
 
 		len -= size;
-		handle->addr += size;
 		buf += size;
-		handle->size -= size;
-		if (!handle->size) {
-			struct ring_buffer *rb = handle->rb;
-
-			handle->page++;
-			handle->page &= rb->nr_pages - 1;
-			handle->addr = rb->data_pages[handle->page];
-			handle->size = PAGE_SIZE << page_order(rb);
-		}
+		__output_advance(handle, size);
 	} while (len);
 }
 
+/*
+ * Copy from user memory without faulting pages in; returns the number
+ * of bytes that could not be copied.
+ */
+static inline unsigned int
+__output_copy_user(struct perf_output_handle *handle,
+		   const void __user *buf, unsigned int len)
+{
+	unsigned long size, rem;
+
+	pagefault_disable();
+	while (len) {
+		size = min_t(unsigned long, handle->size, len);
+		rem = __copy_from_user_inatomic(handle->addr, buf, size);
+		size -= rem;
+
+		len -= size;
+		buf += size;
+		__output_advance(handle, size);
+		if (rem)
+			break;
+	}
+	pagefault_enable();
+
+	return len;
+}
+
+static inline void
+__output_skip(struct perf_output_handle *handle, unsigned int len)
+{
+	while (len) {
+		unsigned long size = min_t(unsigned long, handle->size, len);
+
+		len -= size;
+		__output_advance(handle, size);
+	}
+}
+
 /* Callchain handling */
-extern struct perf_callchain_entry *perf_callchain(struct pt_regs *regs);
+extern struct perf_callchain_entry *
+perf_callchain(struct perf_event *event, struct pt_regs *regs);
 extern int get_callchain_buffers(void);
 extern void put_callchain_buffers(void);
+extern int alloc_callchain_cache(struct perf_event *event);
+extern void free_callchain_cache(struct perf_event *event);
+extern void reset_callchain_cache(struct perf_event *event);
+extern u64 perf_callchain_id(struct perf_callchain_entry *entry);
+extern atomic64_t *perf_callchain_cache_add(struct perf_event *event, u64 id);
+extern void forget_callchain_id(atomic64_t *slot, u64 id);
 
 static inline int get_recursion_context(int *recursion)
 {
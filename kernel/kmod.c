@@ -211,6 +211,9 @@ static int ____call_usermodehelper(void *data)
 
 	commit_creds(new);
 
+	/* The helper may well live in the initramfs, still being unpacked */
+	wait_for_initramfs();
+
 	retval = kernel_execve(sub_info->path,
 			       (const char *const *)sub_info->argv,
 			       (const char *const *)sub_info->envp);
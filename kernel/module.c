@@ -58,6 +58,7 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/module.h>
@@ -248,6 +249,26 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
+/* The kernel's own exports: these never change, so need no locking. */
+static const struct symsearch core_syms[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
 /* Returns true as soon as fn returns true, otherwise false. */
 bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 				    struct module *owner,
@@ -255,26 +276,9 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(core_syms, ARRAY_SIZE(core_syms), NULL,
+				   fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
@@ -382,6 +386,132 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * The exports of loaded modules, hashed by name.  Searching the table of
+ * every module in turn made each lookup cost a bsearch per module, and
+ * loading a module looks up every symbol it uses and every symbol it
+ * exports.  Entries go in and out with the module's list entry, under
+ * module_mutex, and are looked up under the same rules as the list.
+ */
+#define MODULE_EXPORT_HASH_BITS	10
+
+struct module_export {
+	struct hlist_node node;
+	struct module *owner;
+	struct symsearch syms;	/* just this symbol */
+};
+
+static struct hlist_head module_export_hash[1 << MODULE_EXPORT_HASH_BITS];
+
+static struct hlist_head *module_export_head(const char *name)
+{
+	u32 hash = jhash(name, strlen(name), 0);
+
+	return &module_export_hash[hash & ((1 << MODULE_EXPORT_HASH_BITS) - 1)];
+}
+
+static bool find_symbol_in_modules(struct find_symbol_arg *fsa)
+{
+	struct module_export *exp;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(exp, pos, module_export_head(fsa->name),
+				 node) {
+		if (strcmp(exp->syms.start->name, fsa->name) == 0)
+			return check_symbol(&exp->syms, exp->owner, 0, fsa);
+	}
+	return false;
+}
+
+/* Set up the hash entries for a module's exports, before taking the mutex. */
+static int alloc_module_exports(struct module *mod)
+{
+	struct symsearch arr[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
+		  NOT_GPL_ONLY, false },
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
+		  GPL_ONLY, false },
+		{ mod->gpl_future_syms,
+		  mod->gpl_future_syms + mod->num_gpl_future_syms,
+		  mod->gpl_future_crcs,
+		  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+		{ mod->unused_syms,
+		  mod->unused_syms + mod->num_unused_syms,
+		  mod->unused_crcs,
+		  NOT_GPL_ONLY, true },
+		{ mod->unused_gpl_syms,
+		  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		  mod->unused_gpl_crcs,
+		  GPL_ONLY, true },
+#endif
+	};
+	const struct kernel_symbol *sym;
+	struct module_export *exp;
+	unsigned int i, num = 0;
+
+	for (i = 0; i < ARRAY_SIZE(arr); i++)
+		num += arr[i].stop - arr[i].start;
+	if (!num)
+		return 0;
+
+	exp = kcalloc(num, sizeof(*exp), GFP_KERNEL);
+	if (!exp)
+		return -ENOMEM;
+	mod->exports = exp;
+	mod->num_exports = num;
+
+	for (i = 0; i < ARRAY_SIZE(arr); i++) {
+		for (sym = arr[i].start; sym < arr[i].stop; sym++, exp++) {
+			exp->owner = mod;
+			exp->syms = arr[i];
+			exp->syms.start = sym;
+			exp->syms.stop = sym + 1;
+			exp->syms.crcs = symversion(arr[i].crcs,
+						    sym - arr[i].start);
+		}
+	}
+	return 0;
+}
+
+/* Caller holds module_mutex. */
+static void hash_module_exports(struct module *mod)
+{
+	struct module_export *exp;
+
+	for (exp = mod->exports; exp < mod->exports + mod->num_exports; exp++)
+		hlist_add_head_rcu(&exp->node,
+				   module_export_head(exp->syms.start->name));
+}
+
+/* Caller holds module_mutex, and waits for readers before freeing. */
+static void unhash_module_exports(struct module *mod)
+{
+	struct module_export *exp;
+
+	for (exp = mod->exports; exp < mod->exports + mod->num_exports; exp++)
+		hlist_del_rcu(&exp->node);
+}
+
+/* Look a symbol up among the kernel's own exports only: needs no lock. */
+static const struct kernel_symbol *find_core_symbol(const char *name,
+						    const unsigned long **crc,
+						    bool gplok)
+{
+	struct find_symbol_arg fsa;
+
+	fsa.name = name;
+	fsa.gplok = gplok;
+	fsa.warn = true;
+
+	if (!each_symbol_in_section(core_syms, ARRAY_SIZE(core_syms), NULL,
+				    find_symbol_in_section, &fsa))
+		return NULL;
+	*crc = fsa.crc;
+	return fsa.sym;
+}
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -396,7 +526,9 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (each_symbol_in_section(core_syms, ARRAY_SIZE(core_syms), NULL,
+				   find_symbol_in_section, &fsa) ||
+	    find_symbol_in_modules(&fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1203,11 +1335,25 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	struct module *owner;
 	const struct kernel_symbol *sym;
 	const unsigned long *crc;
+	bool gplok = !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE));
 	int err;
 
+	/*
+	 * The kernel's own exports never go away and need no reference
+	 * taken, so most symbols of most modules resolve without the mutex,
+	 * and modules loading in parallel do not queue on it for each one.
+	 */
+	sym = find_core_symbol(name, &crc, gplok);
+	if (sym) {
+		if (!check_version(info->sechdrs, info->index.vers, name, mod,
+				   crc, NULL))
+			sym = ERR_PTR(-EINVAL);
+		strncpy(ownername, module_name(NULL), MODULE_NAME_LEN);
+		return sym;
+	}
+
 	mutex_lock(&module_mutex);
-	sym = find_symbol(name, &owner, &crc,
-			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
+	sym = find_symbol(name, &owner, &crc, gplok, true);
 	if (!sym)
 		goto unlock;
 
@@ -1671,6 +1817,7 @@ static int __unlink_module(void *_mod)
 {
 	struct module *mod = _mod;
 	list_del(&mod->list);
+	unhash_module_exports(mod);
 	module_bug_cleanup(mod);
 	return 0;
 }
@@ -1818,6 +1965,8 @@ static void free_module(struct module *mod)
 	/* Free any allocated parameters. */
 	destroy_params(mod->kp, mod->num_kp);
 
+	kfree(mod->exports);
+
 	/* This may be NULL, but that's OK */
 	unset_module_init_ro_nx(mod);
 	module_free(mod, mod->module_init);
@@ -2923,6 +3072,10 @@ static struct module *load_module(void __user *umod,
 		goto free_arch_cleanup;
 	}
 
+	err = alloc_module_exports(mod);
+	if (err)
+		goto free_exports;
+
 	/* Mark state as coming so strong_try_module_get() ignores us. */
 	mod->state = MODULE_STATE_COMING;
 
@@ -2948,6 +3101,7 @@ static struct module *load_module(void __user *umod,
 		goto ddebug;
 
 	module_bug_finalize(info.hdr, info.sechdrs, mod);
+	hash_module_exports(mod);
 	list_add_rcu(&mod->list, &modules);
 	mutex_unlock(&module_mutex);
 
@@ -2973,6 +3127,7 @@ static struct module *load_module(void __user *umod,
 	mutex_lock(&module_mutex);
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
+	unhash_module_exports(mod);
 	module_bug_cleanup(mod);
 
  ddebug:
@@ -2980,6 +3135,8 @@ static struct module *load_module(void __user *umod,
  unlock:
 	mutex_unlock(&module_mutex);
 	synchronize_sched();
+ free_exports:
+	kfree(mod->exports);
 	kfree(mod->args);
  free_arch_cleanup:
 	module_arch_cleanup(mod);
@@ -3010,6 +3167,7 @@ SYSCALL_DEFINE3(init_module, void __user *, umod,
 		unsigned long, len, const char __user *, uargs)
 {
 	struct module *mod;
+	ktime_t calltime;
 	int ret = 0;
 
 	/* Must have permission */
@@ -3017,10 +3175,15 @@ SYSCALL_DEFINE3(init_module, void __user *, umod,
 		return -EPERM;
 
 	/* Do all the hard work */
+	calltime = ktime_get();
 	mod = load_module(umod, len, uargs);
 	if (IS_ERR(mod))
 		return PTR_ERR(mod);
 
+	if (initcall_debug)
+		printk(KERN_DEBUG "module %s loaded in %lld usecs\n", mod->name,
+		       (long long)ktime_to_us(ktime_sub(ktime_get(), calltime)));
+
 	blocking_notifier_call_chain(&module_notify_list,
 			MODULE_STATE_COMING, mod);
 
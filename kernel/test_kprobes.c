@@ -17,6 +17,8 @@
 #include <linux/kernel.h>
 #include <linux/kprobes.h>
 #include <linux/random.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
 
 #define div_factor 3
 
@@ -357,6 +359,115 @@ static int test_kretprobes(void)
 }
 #endif /* CONFIG_KRETPROBES */
 
+#ifdef CONFIG_OPTPROBES
+#define OPT_LOOPS	100000
+
+static u32 opth_hits;
+
+static int opt_pre_handler_test(struct kprobe *p, struct pt_regs *regs)
+{
+	opth_hits++;
+	return 0;
+}
+
+static struct kprobe optkp = {
+	.symbol_name = "kprobe_target",
+	.pre_handler = opt_pre_handler_test
+};
+
+/* the optimizer runs from a delayed work, give it a second at most */
+static bool wait_for_optimization(void *addr)
+{
+	struct kprobe *p;
+	bool optimized = false;
+	int i;
+
+	for (i = 0; i < 100 && !optimized; i++) {
+		msleep(10);
+		preempt_disable();
+		p = get_kprobe(addr);
+		optimized = p && kprobe_optimized(p);
+		preempt_enable();
+	}
+	return optimized;
+}
+
+static u64 time_target(u32 *ret)
+{
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < OPT_LOOPS; i++)
+		*ret = target(rand1);
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/*
+ * Checks that a probe without a post_handler is optimized and still
+ * produces the right result, and reports what a call to a probed
+ * function costs with no probe, a breakpoint probe and an optimized one.
+ */
+static int test_optprobe(void)
+{
+	u64 bare, brk, opt;
+	u32 ret;
+	int err;
+
+	bare = time_target(&ret);
+
+	/* kp has a post_handler, which keeps it on the breakpoint */
+	kp.addr = NULL;
+	kp.flags = 0;
+	err = register_kprobe(&kp);
+	if (err < 0) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"register_kprobe returned %d\n", err);
+		return err;
+	}
+	brk = time_target(&ret);
+	unregister_kprobe(&kp);
+
+	optkp.addr = NULL;
+	optkp.flags = 0;
+	err = register_kprobe(&optkp);
+	if (err < 0) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"register_kprobe returned %d\n", err);
+		return err;
+	}
+
+	if (!wait_for_optimization(optkp.addr)) {
+		unregister_kprobe(&optkp);
+		printk(KERN_INFO "Kprobe smoke test: kprobe_target "
+				"not optimized, skipping optprobe test\n");
+		return 0;
+	}
+
+	opth_hits = 0;
+	opt = time_target(&ret);
+	unregister_kprobe(&optkp);
+
+	if (opth_hits != OPT_LOOPS) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"optprobe pre_handler called %u times, "
+				"expected %u\n", opth_hits, OPT_LOOPS);
+		handler_errors++;
+	}
+	if (ret != rand1 / div_factor) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"incorrect value from optimized target\n");
+		handler_errors++;
+	}
+
+	printk(KERN_INFO "Kprobe smoke test: %llu ns per call without "
+			"a probe, %llu with a breakpoint, %llu optimized\n",
+			div_u64(bare, OPT_LOOPS), div_u64(brk, OPT_LOOPS),
+			div_u64(opt, OPT_LOOPS));
+	return 0;
+}
+#endif /* CONFIG_OPTPROBES */
+
 int init_test_probes(void)
 {
 	int ret;
@@ -401,6 +512,13 @@ int init_test_probes(void)
 		errors++;
 #endif /* CONFIG_KRETPROBES */
 
+#ifdef CONFIG_OPTPROBES
+	num_tests++;
+	ret = test_optprobe();
+	if (ret < 0)
+		errors++;
+#endif /* CONFIG_OPTPROBES */
+
 	if (errors)
 		printk(KERN_ERR "BUG: Kprobe smoke test: %d out of "
 				"%d tests failed\n", errors, num_tests);
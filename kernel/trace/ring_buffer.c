@@ -14,6 +14,9 @@
 #include <linux/percpu.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/lzo.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
 #include <linux/init.h>
 #include <linux/hash.h>
 #include <linux/list.h>
@@ -466,6 +469,16 @@ struct ring_buffer_per_cpu {
 	unsigned long			read_bytes;
 	u64				write_stamp;
 	u64				read_stamp;
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	/* full pages packed away by the compressor, see rb_pack_page() */
+	struct mutex			zmutex;		/* orders page reads */
+	struct list_head		zpages;		/* oldest first */
+	unsigned long			zbytes;		/* compressed size */
+	unsigned long			znr;
+	unsigned long			zoverrun;	/* entries dropped */
+	bool				zmissed;	/* since last unpack */
+	unsigned long			zentries;	/* written at last pass */
+#endif
 };
 
 struct ring_buffer {
@@ -485,6 +498,16 @@ struct ring_buffer {
 	struct notifier_block		cpu_notify;
 #endif
 	u64				(*clock)(void);
+
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	unsigned long			zsize;		/* pool per cpu, 0: off */
+	struct delayed_work		zwork;
+	struct irq_work			zkick;		/* restarts zwork */
+	bool				zidle;		/* zwork not queued */
+	void				*zwrkmem;
+	void				*zdst;
+	void				*zspare;
+#endif
 };
 
 struct ring_buffer_iter {
@@ -496,6 +519,64 @@ struct ring_buffer_iter {
 	u64				read_stamp;
 };
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+/* A full page, LZO compressed (or not, if that did not make it smaller) */
+struct rb_zpage {
+	struct list_head	list;
+	unsigned long		entries;
+	unsigned int		size;		/* of the page data */
+	unsigned int		len;		/* of the compressed data */
+	unsigned char		data[];
+};
+
+/* Called with the reader_lock held */
+static void rb_free_zpages(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct rb_zpage *zpage, *tmp;
+
+	list_for_each_entry_safe(zpage, tmp, &cpu_buffer->zpages, list) {
+		list_del(&zpage->list);
+		kfree(zpage);
+	}
+	cpu_buffer->zbytes = 0;
+	cpu_buffer->znr = 0;
+	cpu_buffer->zoverrun = 0;
+	cpu_buffer->zmissed = false;
+}
+
+static inline unsigned long rb_zoverrun(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	return cpu_buffer->zoverrun;
+}
+
+/*
+ * The writer has filled a page.  If the compressor stopped for lack of
+ * work, start it again.  This can be any context, NMI included, so the
+ * work is queued from an irq_work.  Without a barrier a writer may miss
+ * that the compressor just went idle; the next full page restarts it.
+ */
+static inline void rb_compress_kick(struct ring_buffer *buffer)
+{
+	if (unlikely(buffer->zidle)) {
+		buffer->zidle = false;
+		irq_work_queue(&buffer->zkick);
+	}
+}
+#else
+static inline void rb_free_zpages(struct ring_buffer_per_cpu *cpu_buffer)
+{
+}
+
+static inline unsigned long rb_zoverrun(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	return 0;
+}
+
+static inline void rb_compress_kick(struct ring_buffer *buffer)
+{
+}
+#endif
+
 /* buffer may be either ring_buffer or ring_buffer_per_cpu */
 #define RB_WARN_ON(b, cond)						\
 	({								\
@@ -1035,6 +1116,10 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, int cpu)
 	raw_spin_lock_init(&cpu_buffer->reader_lock);
 	lockdep_set_class(&cpu_buffer->reader_lock, buffer->reader_lock_key);
 	cpu_buffer->lock = (arch_spinlock_t)__ARCH_SPIN_LOCK_UNLOCKED;
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	mutex_init(&cpu_buffer->zmutex);
+	INIT_LIST_HEAD(&cpu_buffer->zpages);
+#endif
 
 	bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 			    GFP_KERNEL, cpu_to_node(cpu));
@@ -1090,6 +1175,7 @@ static void rb_free_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 		free_buffer_page(bpage);
 	}
 
+	rb_free_zpages(cpu_buffer);
 	kfree(cpu_buffer);
 }
 
@@ -1098,6 +1184,11 @@ static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu);
 #endif
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+static void rb_compress_work(struct work_struct *work);
+static void rb_compress_kick_func(struct irq_work *work);
+#endif
+
 /**
  * ring_buffer_alloc - allocate a new ring_buffer
  * @size: the size in bytes per cpu that is needed.
@@ -1167,6 +1258,10 @@ struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
 
 	put_online_cpus();
 	mutex_init(&buffer->mutex);
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	INIT_DELAYED_WORK(&buffer->zwork, rb_compress_work);
+	init_irq_work(&buffer->zkick, rb_compress_kick_func);
+#endif
 
 	return buffer;
 
@@ -1196,6 +1291,8 @@ ring_buffer_free(struct ring_buffer *buffer)
 {
 	int cpu;
 
+	ring_buffer_set_compress(buffer, 0);
+
 	get_online_cpus();
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -1890,6 +1987,8 @@ rb_move_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	struct buffer_page *next_page;
 	int ret;
 
+	rb_compress_kick(buffer);
+
 	next_page = tail_page;
 
 	rb_inc_page(cpu_buffer, &next_page);
@@ -2695,7 +2794,8 @@ static inline unsigned long
 rb_num_of_entries(struct ring_buffer_per_cpu *cpu_buffer)
 {
 	return local_read(&cpu_buffer->entries) -
-		(local_read(&cpu_buffer->overrun) + cpu_buffer->read);
+		(local_read(&cpu_buffer->overrun) + rb_zoverrun(cpu_buffer) +
+		 cpu_buffer->read);
 }
 
 /**
@@ -2782,7 +2882,7 @@ unsigned long ring_buffer_overrun_cpu(struct ring_buffer *buffer, int cpu)
 		return 0;
 
 	cpu_buffer = buffer->buffers[cpu];
-	ret = local_read(&cpu_buffer->overrun);
+	ret = local_read(&cpu_buffer->overrun) + rb_zoverrun(cpu_buffer);
 
 	return ret;
 }
@@ -2848,7 +2948,8 @@ unsigned long ring_buffer_overruns(struct ring_buffer *buffer)
 	/* if you care about this being correct, lock the buffer */
 	for_each_buffer_cpu(buffer, cpu) {
 		cpu_buffer = buffer->buffers[cpu];
-		overruns += local_read(&cpu_buffer->overrun);
+		overruns += local_read(&cpu_buffer->overrun) +
+			    rb_zoverrun(cpu_buffer);
 	}
 
 	return overruns;
@@ -3631,6 +3732,8 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	cpu_buffer->lost_events = 0;
 	cpu_buffer->last_overrun = 0;
 
+	rb_free_zpages(cpu_buffer);
+
 	rb_head_page_activate(cpu_buffer);
 }
 
@@ -3867,45 +3970,18 @@ void ring_buffer_free_read_page(struct ring_buffer *buffer, void *data)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
 
-/**
- * ring_buffer_read_page - extract a page from the ring buffer
- * @buffer: buffer to extract from
- * @data_page: the page to use allocated from ring_buffer_alloc_read_page
- * @len: amount to extract
- * @cpu: the cpu of the buffer to extract
- * @full: should the extraction only happen when the page is full.
- *
- * This function will pull out a page from the ring buffer and consume it.
- * @data_page must be the address of the variable that was returned
- * from ring_buffer_alloc_read_page. This is because the page might be used
- * to swap with a page in the ring buffer.
- *
- * for example:
- *	rpage = ring_buffer_alloc_read_page(buffer);
- *	if (!rpage)
- *		return error;
- *	ret = ring_buffer_read_page(buffer, &rpage, len, cpu, 0);
- *	if (ret >= 0)
- *		process_page(rpage, ret);
- *
- * When @full is set, the function will not return true unless
- * the writer is off the reader page.
- *
- * Note: it is up to the calling functions to handle sleeps and wakeups.
- *  The ring buffer can be used anywhere in the kernel and can not
- *  blindly call wake_up. The layer that uses the ring buffer must be
- *  responsible for that.
- *
- * Returns:
- *  >=0 if data has been transferred, returns the offset of consumed data.
- *  <0 if no data has been transferred.
+/*
+ * Consume a page, or what is there of it, into *data_page: the body of
+ * ring_buffer_read_page().  The compressor passes @entries (and @full):
+ * the entries of the page it takes are returned there rather than
+ * counted as read, as they only move to the compressed pool.
  */
-int ring_buffer_read_page(struct ring_buffer *buffer,
-			  void **data_page, size_t len, int cpu, int full)
+static int rb_read_page(struct ring_buffer_per_cpu *cpu_buffer,
+			void **data_page, size_t len, int full,
+			unsigned long *entries)
 {
-	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+	struct buffer_data_page *bpage = *data_page;
 	struct ring_buffer_event *event;
-	struct buffer_data_page *bpage;
 	struct buffer_page *reader;
 	unsigned long missed_events;
 	unsigned long flags;
@@ -3914,25 +3990,6 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 	u64 save_timestamp;
 	int ret = -1;
 
-	if (!cpumask_test_cpu(cpu, buffer->cpumask))
-		goto out;
-
-	/*
-	 * If len is not big enough to hold the page header, then
-	 * we can not copy anything.
-	 */
-	if (len <= BUF_PAGE_HDR_SIZE)
-		goto out;
-
-	len -= BUF_PAGE_HDR_SIZE;
-
-	if (!data_page)
-		goto out;
-
-	bpage = *data_page;
-	if (!bpage)
-		goto out;
-
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
 	reader = rb_get_reader_page(cpu_buffer);
@@ -4008,8 +4065,14 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 		/* we copied everything to the beginning */
 		read = 0;
 	} else {
-		/* update the entry counter */
-		cpu_buffer->read += rb_page_entries(reader);
+		/*
+		 * update the entry counter, unless the entries are only
+		 * moving to the compressed pool
+		 */
+		if (entries)
+			*entries = rb_page_entries(reader);
+		else
+			cpu_buffer->read += rb_page_entries(reader);
 		cpu_buffer->read_bytes += BUF_PAGE_SIZE;
 
 		/* swap the pages */
@@ -4059,6 +4122,384 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
  out_unlock:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
+	return ret;
+}
+
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+/*
+ * Compressed history.
+ *
+ * When enabled with ring_buffer_set_compress(), a work item takes the
+ * full pages out of each per cpu buffer every RB_COMPRESS_INTERVAL, the
+ * way a reader of whole pages would, and keeps them LZO compressed in a
+ * pool of a given size per cpu.  Trace pages compress 3-5 times, so the
+ * same memory holds that much more history; the ring itself only needs
+ * to hold what is written between two passes.  In overwrite mode the
+ * oldest packed pages are dropped when the pool is full, otherwise the
+ * pages are left in the ring, which then fills up as it would have.
+ * When a pass finds nothing to pack and nothing written, the work stops
+ * until a writer fills a page again.
+ *
+ * ring_buffer_read_page() hands out the packed pages, unpacked, before
+ * any page still in the ring.  Event iterators and ring_buffer_consume()
+ * only see the ring.
+ */
+#define RB_COMPRESS_INTERVAL	(HZ / 10)
+
+#define RB_MISSED_FLAGS		(RB_MISSED_EVENTS | RB_MISSED_STORED)
+
+/* Called with zmutex held */
+static bool rb_pack_page(struct ring_buffer *buffer,
+			 struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct buffer_data_page *bpage;
+	struct rb_zpage *zpage, *tmp;
+	unsigned long entries = 0;
+	unsigned long flags;
+	unsigned int commit;
+	size_t size, len;
+	LIST_HEAD(dropped);
+	void *src;
+
+	if (!(buffer->flags & RB_FL_OVERWRITE) &&
+	    cpu_buffer->zbytes >= buffer->zsize)
+		return false;
+
+	if (rb_read_page(cpu_buffer, &buffer->zspare, BUF_PAGE_SIZE, 1,
+			 &entries) < 0)
+		return false;
+
+	bpage = buffer->zspare;
+	commit = local_read(&bpage->commit);
+	size = BUF_PAGE_HDR_SIZE + (commit & ~RB_MISSED_FLAGS);
+	if (commit & RB_MISSED_STORED)
+		size += sizeof(unsigned long);
+
+	src = buffer->zdst;
+	if (lzo1x_1_compress((void *)bpage, size, src, &len,
+			     buffer->zwrkmem) != LZO_E_OK || len >= size) {
+		src = bpage;
+		len = size;
+	}
+
+	zpage = kmalloc(sizeof(*zpage) + len, GFP_KERNEL | __GFP_NOWARN);
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!zpage) {
+		cpu_buffer->zoverrun += entries;
+		cpu_buffer->zmissed = true;
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return true;
+	}
+	zpage->entries = entries;
+	zpage->size = size;
+	zpage->len = len;
+	memcpy(zpage->data, src, len);
+	list_add_tail(&zpage->list, &cpu_buffer->zpages);
+	cpu_buffer->zbytes += len;
+	cpu_buffer->znr++;
+
+	while (cpu_buffer->zbytes > buffer->zsize &&
+	       (buffer->flags & RB_FL_OVERWRITE)) {
+		tmp = list_first_entry(&cpu_buffer->zpages,
+				       struct rb_zpage, list);
+		list_move_tail(&tmp->list, &dropped);
+		cpu_buffer->zbytes -= tmp->len;
+		cpu_buffer->znr--;
+		cpu_buffer->zoverrun += tmp->entries;
+		cpu_buffer->zmissed = true;
+	}
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	list_for_each_entry_safe(zpage, tmp, &dropped, list)
+		kfree(zpage);
+	return true;
+}
+
+/*
+ * Hand out the oldest packed page, in @bpage.  Packed pages are always
+ * whole, so they satisfy a reader that wants full pages, but they are
+ * not split: if the page data does not fit in @size bytes, nothing is
+ * returned (-ENOSPC), as rb_read_page() does when the first event does
+ * not fit.  Returns -ENODATA if there are no packed pages.
+ *
+ * Called with zmutex held.
+ */
+static int rb_unpack_page(struct ring_buffer_per_cpu *cpu_buffer,
+			  struct buffer_data_page *bpage, size_t size)
+{
+	struct rb_zpage *zpage;
+	unsigned long flags;
+	int err = LZO_E_OK;
+	bool missed;
+	size_t len;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (list_empty(&cpu_buffer->zpages)) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return -ENODATA;
+	}
+	zpage = list_first_entry(&cpu_buffer->zpages, struct rb_zpage, list);
+	if (zpage->size - BUF_PAGE_HDR_SIZE > size) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return -ENOSPC;
+	}
+	list_del(&zpage->list);
+	cpu_buffer->zbytes -= zpage->len;
+	cpu_buffer->znr--;
+	cpu_buffer->read += zpage->entries;
+	missed = cpu_buffer->zmissed;
+	cpu_buffer->zmissed = false;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	len = zpage->size;
+	if (zpage->len == zpage->size)
+		memcpy(bpage, zpage->data, len);
+	else
+		err = lzo1x_decompress_safe(zpage->data, zpage->len,
+					    (void *)bpage, &len);
+	if (WARN_ON_ONCE(err != LZO_E_OK || len != zpage->size)) {
+		/* hand out an empty page that says events were lost */
+		rb_init_page(bpage);
+		bpage->time_stamp = 0;
+		len = BUF_PAGE_HDR_SIZE;
+		missed = true;
+	}
+	kfree(zpage);
+
+	/* This page may be off to user land. Zero it out here. */
+	memset((void *)bpage + len, 0, PAGE_SIZE - len);
+
+	if (missed && !(local_read(&bpage->commit) & RB_MISSED_EVENTS))
+		local_add(RB_MISSED_EVENTS, &bpage->commit);
+	return 0;
+}
+
+static void rb_compress_work(struct work_struct *work)
+{
+	struct ring_buffer *buffer =
+		container_of(to_delayed_work(work), struct ring_buffer, zwork);
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long entries;
+	bool busy = false;
+	unsigned int i;
+	int cpu;
+
+	if (!buffer->zsize)
+		return;
+
+	for_each_buffer_cpu(buffer, cpu) {
+		cpu_buffer = buffer->buffers[cpu];
+
+		/* no more than a ring's worth, if the writer keeps up */
+		mutex_lock(&cpu_buffer->zmutex);
+		for (i = 0; i < buffer->pages; i++) {
+			if (!rb_pack_page(buffer, cpu_buffer))
+				break;
+			busy = true;
+			cond_resched();
+		}
+		mutex_unlock(&cpu_buffer->zmutex);
+
+		/* a writer part way through a page fills it soon */
+		entries = local_read(&cpu_buffer->entries);
+		if (entries != cpu_buffer->zentries) {
+			cpu_buffer->zentries = entries;
+			busy = true;
+		}
+	}
+
+	/*
+	 * Nothing packed and nothing written: stop polling until a writer
+	 * fills a page again, see rb_compress_kick().
+	 */
+	if (busy)
+		schedule_delayed_work(&buffer->zwork, RB_COMPRESS_INTERVAL);
+	else
+		buffer->zidle = true;
+}
+
+static void rb_compress_kick_func(struct irq_work *work)
+{
+	struct ring_buffer *buffer =
+		container_of(work, struct ring_buffer, zkick);
+
+	schedule_delayed_work(&buffer->zwork, RB_COMPRESS_INTERVAL);
+}
+
+/**
+ * ring_buffer_set_compress - set the size of the compressed pool
+ * @buffer: The ring buffer
+ * @size: the size in bytes per cpu, 0 to stop compressing
+ *
+ * Pages already compressed stay readable when compression is stopped.
+ */
+int ring_buffer_set_compress(struct ring_buffer *buffer, unsigned long size)
+{
+	int ret = 0;
+
+	mutex_lock(&buffer->mutex);
+	if (size && !buffer->zsize) {
+		ret = -ENOMEM;
+		buffer->zwrkmem = kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+		buffer->zdst = kmalloc(lzo1x_worst_compress(PAGE_SIZE),
+				       GFP_KERNEL);
+		buffer->zspare = ring_buffer_alloc_read_page(buffer,
+							raw_smp_processor_id());
+		if (!buffer->zwrkmem || !buffer->zdst || !buffer->zspare)
+			goto out_free;
+
+		buffer->zsize = size;
+		buffer->zidle = false;
+		schedule_delayed_work(&buffer->zwork, RB_COMPRESS_INTERVAL);
+		ret = 0;
+	} else if (!size && buffer->zsize) {
+		/*
+		 * The work returns at once from now on.  Once it is not
+		 * running, clear zidle, so that writers stop kicking it,
+		 * and flush out any kick that got in before that.
+		 */
+		buffer->zsize = 0;
+		cancel_delayed_work_sync(&buffer->zwork);
+		buffer->zidle = false;
+		irq_work_sync(&buffer->zkick);
+		cancel_delayed_work_sync(&buffer->zwork);
+		goto out_free;
+	} else {
+		buffer->zsize = size;
+	}
+	mutex_unlock(&buffer->mutex);
+	return ret;
+
+ out_free:
+	kfree(buffer->zwrkmem);
+	kfree(buffer->zdst);
+	if (buffer->zspare)
+		ring_buffer_free_read_page(buffer, buffer->zspare);
+	buffer->zwrkmem = NULL;
+	buffer->zdst = NULL;
+	buffer->zspare = NULL;
+	mutex_unlock(&buffer->mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_set_compress);
+
+/**
+ * ring_buffer_compress_size - get the size of the compressed pool
+ * @buffer: The ring buffer
+ */
+unsigned long ring_buffer_compress_size(struct ring_buffer *buffer)
+{
+	return buffer->zsize;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_compress_size);
+
+/**
+ * ring_buffer_compressed_pages_cpu - get the number of compressed pages
+ * @buffer: The ring buffer
+ * @cpu: The per CPU buffer to get the number from
+ */
+unsigned long
+ring_buffer_compressed_pages_cpu(struct ring_buffer *buffer, int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return 0;
+
+	return buffer->buffers[cpu]->znr;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_compressed_pages_cpu);
+
+/**
+ * ring_buffer_compressed_bytes_cpu - get the size of the compressed pages
+ * @buffer: The ring buffer
+ * @cpu: The per CPU buffer to get the size from
+ */
+unsigned long
+ring_buffer_compressed_bytes_cpu(struct ring_buffer *buffer, int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return 0;
+
+	return buffer->buffers[cpu]->zbytes;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_compressed_bytes_cpu);
+#endif /* CONFIG_RING_BUFFER_COMPRESS */
+
+/**
+ * ring_buffer_read_page - extract a page from the ring buffer
+ * @buffer: buffer to extract from
+ * @data_page: the page to use allocated from ring_buffer_alloc_read_page
+ * @len: amount to extract
+ * @cpu: the cpu of the buffer to extract
+ * @full: should the extraction only happen when the page is full.
+ *
+ * This function will pull out a page from the ring buffer and consume it.
+ * @data_page must be the address of the variable that was returned
+ * from ring_buffer_alloc_read_page. This is because the page might be used
+ * to swap with a page in the ring buffer.
+ *
+ * for example:
+ *	rpage = ring_buffer_alloc_read_page(buffer);
+ *	if (!rpage)
+ *		return error;
+ *	ret = ring_buffer_read_page(buffer, &rpage, len, cpu, 0);
+ *	if (ret >= 0)
+ *		process_page(rpage, ret);
+ *
+ * When @full is set, the function will not return true unless
+ * the writer is off the reader page.
+ *
+ * With CONFIG_RING_BUFFER_COMPRESS, pages that were compressed are
+ * returned first, always whole, and the caller must be able to sleep.
+ * Nothing is returned while the oldest of them does not fit in @len.
+ *
+ * Note: it is up to the calling functions to handle sleeps and wakeups.
+ *  The ring buffer can be used anywhere in the kernel and can not
+ *  blindly call wake_up. The layer that uses the ring buffer must be
+ *  responsible for that.
+ *
+ * Returns:
+ *  >=0 if data has been transferred, returns the offset of consumed data.
+ *  <0 if no data has been transferred.
+ */
+int ring_buffer_read_page(struct ring_buffer *buffer,
+			  void **data_page, size_t len, int cpu, int full)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+	struct buffer_data_page *bpage;
+	int ret = -1;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		goto out;
+
+	/*
+	 * If len is not big enough to hold the page header, then
+	 * we can not copy anything.
+	 */
+	if (len <= BUF_PAGE_HDR_SIZE)
+		goto out;
+
+	len -= BUF_PAGE_HDR_SIZE;
+
+	if (!data_page)
+		goto out;
+
+	bpage = *data_page;
+	if (!bpage)
+		goto out;
+
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	/* the packed pages are older than anything left in the ring */
+	mutex_lock(&cpu_buffer->zmutex);
+	ret = rb_unpack_page(cpu_buffer, bpage, len);
+	if (ret == -ENODATA)
+		ret = rb_read_page(cpu_buffer, data_page, len, full, NULL);
+	else if (ret < 0)
+		ret = -1;
+	mutex_unlock(&cpu_buffer->zmutex);
+#else
+	ret = rb_read_page(cpu_buffer, data_page, len, full, NULL);
+#endif
+
  out:
 	return ret;
 }
@@ -40,6 +40,10 @@ static int write_iteration = 50;
 module_param(write_iteration, uint, 0644);
 MODULE_PARM_DESC(write_iteration, "# of writes between timestamp readings");
 
+static int compress_kb;
+module_param(compress_kb, uint, 0444);
+MODULE_PARM_DESC(compress_kb, "size of the compressed pool per cpu, in KB");
+
 static int producer_nice = 19;
 static int consumer_nice = 19;
 
@@ -320,6 +324,19 @@ static void ring_buffer_producer(void)
 			read_events ? "events" : "pages");
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	if (compress_kb) {
+		unsigned long pages = 0, bytes = 0;
+		int cpu;
+
+		for_each_online_cpu(cpu) {
+			pages += ring_buffer_compressed_pages_cpu(buffer, cpu);
+			bytes += ring_buffer_compressed_bytes_cpu(buffer, cpu);
+		}
+		trace_printk("Compressed: %lu pages in %lu bytes\n",
+			     pages, bytes);
+	}
+#endif
 	trace_printk("Missed:   %ld\n", missed);
 	trace_printk("Hit:      %ld\n", hit);
 
@@ -425,6 +442,10 @@ static int __init ring_buffer_benchmark_init(void)
 	if (!buffer)
 		return -ENOMEM;
 
+	ret = ring_buffer_set_compress(buffer, (unsigned long)compress_kb << 10);
+	if (ret < 0)
+		goto out_fail;
+
 	if (!disable_reader) {
 		consumer = kthread_create(ring_buffer_consumer_thread,
 					  NULL, "rb_consumer");
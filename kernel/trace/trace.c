@@ -3713,6 +3713,43 @@ tracing_total_entries_read(struct file *filp, char __user *ubuf,
 	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
 }
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+static ssize_t
+tracing_compress_read(struct file *filp, char __user *ubuf,
+		      size_t cnt, loff_t *ppos)
+{
+	struct trace_array *tr = filp->private_data;
+	char buf[64];
+	int r;
+
+	r = sprintf(buf, "%lu\n", ring_buffer_compress_size(tr->buffer) >> 10);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+}
+
+static ssize_t
+tracing_compress_write(struct file *filp, const char __user *ubuf,
+		       size_t cnt, loff_t *ppos)
+{
+	struct trace_array *tr = filp->private_data;
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul_from_user(ubuf, cnt, 10, &val);
+	if (ret)
+		return ret;
+
+	/* value is in KB per cpu, 0 stops compressing */
+	ret = ring_buffer_set_compress(tr->buffer, val << 10);
+	if (ret < 0)
+		return ret;
+
+	*ppos += cnt;
+
+	return cnt;
+}
+#endif
+
 static ssize_t
 tracing_free_buffer_write(struct file *filp, const char __user *ubuf,
 			  size_t cnt, loff_t *ppos)
@@ -3945,6 +3982,15 @@ static const struct file_operations tracing_total_entries_fops = {
 	.llseek		= generic_file_llseek,
 };
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+static const struct file_operations tracing_compress_fops = {
+	.open		= tracing_open_generic,
+	.read		= tracing_compress_read,
+	.write		= tracing_compress_write,
+	.llseek		= generic_file_llseek,
+};
+#endif
+
 static const struct file_operations tracing_free_buffer_fops = {
 	.write		= tracing_free_buffer_write,
 	.release	= tracing_free_buffer_release,
@@ -4253,6 +4299,14 @@ tracing_stats_read(struct file *filp, char __user *ubuf,
 	cnt = ring_buffer_bytes_cpu(tr->buffer, cpu);
 	trace_seq_printf(s, "bytes: %ld\n", cnt);
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	cnt = ring_buffer_compressed_pages_cpu(tr->buffer, cpu);
+	trace_seq_printf(s, "compressed pages: %ld\n", cnt);
+
+	cnt = ring_buffer_compressed_bytes_cpu(tr->buffer, cpu);
+	trace_seq_printf(s, "compressed bytes: %ld\n", cnt);
+#endif
+
 	t = ns2usecs(ring_buffer_oldest_event_ts(tr->buffer, cpu));
 	usec_rem = do_div(t, USEC_PER_SEC);
 	trace_seq_printf(s, "oldest event ts: %5llu.%06lu\n", t, usec_rem);
@@ -4723,6 +4777,11 @@ static __init int tracer_init_debugfs(void)
 	trace_create_file("buffer_total_size_kb", 0444, d_tracer,
 			&global_trace, &tracing_total_entries_fops);
 
+#ifdef CONFIG_RING_BUFFER_COMPRESS
+	trace_create_file("buffer_compressed_kb", 0644, d_tracer,
+			&global_trace, &tracing_compress_fops);
+#endif
+
 	trace_create_file("free_buffer", 0644, d_tracer,
 			&global_trace, &tracing_free_buffer_fops);
 
@@ -801,14 +801,47 @@ extern void print_subsystem_event_filter(struct event_subsystem *system,
 					 struct trace_seq *s);
 extern int filter_assign_type(const char *type);
 
+extern int create_event_filter(struct ftrace_event_call *call,
+			       char *filter_str, bool set_str,
+			       struct event_filter **filterp);
+extern void free_event_filter(struct event_filter *filter);
+extern struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name);
+
 struct list_head *
 trace_get_fields(struct ftrace_event_call *event_call);
 
+#ifdef CONFIG_EVENT_HIST
+extern const struct file_operations event_hist_fops;
+extern int trace_event_hist_reg(struct ftrace_event_call *call, int enable);
+extern bool event_hist_update(struct ftrace_event_call *call, void *rec);
+extern void event_hist_destroy(struct ftrace_event_call *call);
+#else
+static inline bool
+event_hist_update(struct ftrace_event_call *call, void *rec)
+{
+	return false;
+}
+static inline void event_hist_destroy(struct ftrace_event_call *call) { }
+#endif
+
 static inline int
 filter_check_discard(struct ftrace_event_call *call, void *rec,
 		     struct ring_buffer *buffer,
 		     struct ring_buffer_event *event)
 {
+	/*
+	 * Events only enabled for their histogram are not kept.  TRACE_EVENT()
+	 * probes count them before reserving anything, with
+	 * trace_event_hist_commit(); this is for the other event types, and
+	 * for a probe that interrupted another one on the same cpu.
+	 */
+	if (unlikely(call->flags & TRACE_EVENT_FL_HIST) &&
+	    event_hist_update(call, rec)) {
+		ring_buffer_discard_commit(buffer, event);
+		return 1;
+	}
+
 	if (unlikely(call->flags & TRACE_EVENT_FL_FILTERED) &&
 	    !filter_match_preds(call->filter, rec)) {
 		ring_buffer_discard_commit(buffer, event);
@@ -215,7 +215,10 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_stop_cmdline_record();
 				call->flags &= ~TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			call->class->reg(call, TRACE_REG_UNREGISTER, NULL);
+			/* a histogram keeps the probe */
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				call->class->reg(call, TRACE_REG_UNREGISTER,
+						 NULL);
 		}
 		break;
 	case 1:
@@ -224,7 +227,9 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_start_cmdline_record();
 				call->flags |= TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			ret = call->class->reg(call, TRACE_REG_REGISTER, NULL);
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				ret = call->class->reg(call, TRACE_REG_REGISTER,
+						       NULL);
 			if (ret) {
 				tracing_stop_cmdline_record();
 				pr_info("event trace: Could not enable event "
@@ -239,6 +244,36 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 	return ret;
 }
 
+#ifdef CONFIG_EVENT_HIST
+/*
+ * Register the probe of @call for its histogram, if it is not already
+ * registered for tracing the event.  Called with event_mutex held.
+ */
+int trace_event_hist_reg(struct ftrace_event_call *call, int enable)
+{
+	int ret = 0;
+
+	if (enable) {
+		if (call->flags & TRACE_EVENT_FL_HIST)
+			return 0;
+		if (!(call->flags & TRACE_EVENT_FL_ENABLED))
+			ret = call->class->reg(call, TRACE_REG_REGISTER, NULL);
+		if (!ret)
+			call->flags |= TRACE_EVENT_FL_HIST;
+	} else if (call->flags & TRACE_EVENT_FL_HIST) {
+		call->flags &= ~TRACE_EVENT_FL_HIST;
+		if (!(call->flags & TRACE_EVENT_FL_ENABLED))
+			call->class->reg(call, TRACE_REG_UNREGISTER, NULL);
+	}
+
+	return ret;
+}
+
+#define EVENT_HIST_FOPS		(&event_hist_fops)
+#else
+#define EVENT_HIST_FOPS		NULL
+#endif
+
 static void ftrace_clear_events(void)
 {
 	struct ftrace_event_call *call;
@@ -1148,7 +1183,8 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 		 const struct file_operations *id,
 		 const struct file_operations *enable,
 		 const struct file_operations *filter,
-		 const struct file_operations *format)
+		 const struct file_operations *format,
+		 const struct file_operations *hist)
 {
 	struct list_head *head;
 	int ret;
@@ -1196,6 +1232,11 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 	trace_create_file("format", 0444, call->dir, call,
 			  format);
 
+	if (hist && call->class->reg &&
+	    !(call->flags & TRACE_EVENT_FL_IGNORE_ENABLE))
+		trace_create_file("hist", 0644, call->dir, call,
+				  hist);
+
 	return 0;
 }
 
@@ -1204,7 +1245,8 @@ __trace_add_event_call(struct ftrace_event_call *call, struct module *mod,
 		       const struct file_operations *id,
 		       const struct file_operations *enable,
 		       const struct file_operations *filter,
-		       const struct file_operations *format)
+		       const struct file_operations *format,
+		       const struct file_operations *hist)
 {
 	struct dentry *d_events;
 	int ret;
@@ -1227,7 +1269,8 @@ __trace_add_event_call(struct ftrace_event_call *call, struct module *mod,
 	if (!d_events)
 		return -ENOENT;
 
-	ret = event_create_dir(call, d_events, id, enable, filter, format);
+	ret = event_create_dir(call, d_events, id, enable, filter, format,
+			       hist);
 	if (!ret)
 		list_add(&call->list, &ftrace_events);
 	call->mod = mod;
@@ -1243,7 +1286,8 @@ int trace_add_event_call(struct ftrace_event_call *call)
 	ret = __trace_add_event_call(call, NULL, &ftrace_event_id_fops,
 				     &ftrace_enable_fops,
 				     &ftrace_event_filter_fops,
-				     &ftrace_event_format_fops);
+				     &ftrace_event_format_fops,
+				     EVENT_HIST_FOPS);
 	mutex_unlock(&event_mutex);
 	return ret;
 }
@@ -1272,6 +1316,7 @@ static void remove_subsystem_dir(const char *name)
  */
 static void __trace_remove_event_call(struct ftrace_event_call *call)
 {
+	event_hist_destroy(call);
 	ftrace_event_enable_disable(call, 0);
 	if (call->event.funcs)
 		__unregister_ftrace_event(&call->event);
@@ -1312,6 +1357,7 @@ struct ftrace_module_file_ops {
 	struct file_operations		enable;
 	struct file_operations		format;
 	struct file_operations		filter;
+	struct file_operations		hist;
 };
 
 static struct ftrace_module_file_ops *
@@ -1344,6 +1390,11 @@ trace_create_file_ops(struct module *mod)
 	file_ops->format = ftrace_event_format_fops;
 	file_ops->format.owner = mod;
 
+#ifdef CONFIG_EVENT_HIST
+	file_ops->hist = event_hist_fops;
+	file_ops->hist.owner = mod;
+#endif
+
 	list_add(&file_ops->list, &ftrace_module_file_list);
 
 	return file_ops;
@@ -1367,7 +1418,8 @@ static void trace_module_add_events(struct module *mod)
 	for_each_event(call, start, end) {
 		__trace_add_event_call(*call, mod,
 				       &file_ops->id, &file_ops->enable,
-				       &file_ops->filter, &file_ops->format);
+				       &file_ops->filter, &file_ops->format,
+				       EVENT_HIST_FOPS ? &file_ops->hist : NULL);
 	}
 }
 
@@ -1501,7 +1553,8 @@ static __init int event_trace_init(void)
 		__trace_add_event_call(*call, NULL, &ftrace_event_id_fops,
 				       &ftrace_enable_fops,
 				       &ftrace_event_filter_fops,
-				       &ftrace_event_format_fops);
+				       &ftrace_event_format_fops,
+				       EVENT_HIST_FOPS);
 	}
 
 	while (true) {
@@ -1858,6 +1858,31 @@ static int create_system_filter(struct event_subsystem *system,
 	return err;
 }
 
+/**
+ * create_event_filter - create a filter for @call not attached to it
+ *
+ * For users of the predicates other than the event filter itself, such
+ * as event histograms.  Same as create_filter(); free the filter with
+ * free_event_filter().
+ */
+int create_event_filter(struct ftrace_event_call *call,
+			char *filter_str, bool set_str,
+			struct event_filter **filterp)
+{
+	return create_filter(call, filter_str, set_str, filterp);
+}
+
+void free_event_filter(struct event_filter *filter)
+{
+	__free_filter(filter);
+}
+
+struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name)
+{
+	return find_event_field(call, name);
+}
+
 int apply_event_filter(struct ftrace_event_call *call, char *filter_string)
 {
 	struct event_filter *filter;
@@ -0,0 +1,845 @@
+/*
+ * trace_events_hist - in-kernel histograms of trace event fields
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Writing
+ *
+ *	keys=<field>[.log2][,<field>...][:vals=<field>[,<field>...]]
+ *		[:size=<entries>][:sort=hitcount|key] [if <filter>]
+ *
+ * to the "hist" file of an event counts the events that pass the filter
+ * in a table keyed by the given fields, and adds up the given values
+ * for each key.  A key with .log2 is bucketed by its power of two, which
+ * turns a latency field into a latency distribution.  The filter is an
+ * event filter of its own, in the syntax of the "filter" file.  Writing
+ * "clear" empties the table, writing "0" removes the histogram.
+ *
+ * The event does not need to be enabled: the histogram registers the
+ * probe itself.  TRACE_EVENT() probes of an event with a histogram build
+ * the entry in a per cpu buffer instead of the ring buffer, count it, and
+ * only then copy it to the ring buffer if the event is enabled and passes
+ * its filter, so events that are only counted never take ring buffer
+ * space.  A probe that interrupts another one on the same cpu, and the
+ * other event types, reserve as before and discard in
+ * filter_check_discard().
+ *
+ * Updates run in the probe, so the table is allocated up front and is
+ * lock-free: a key claims a free slot with cmpxchg, and its counts are
+ * atomic64_t.  Two cpus inserting the same key at the same time may
+ * each claim a slot; such duplicates are merged when the table is read.
+ */
+
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/seq_file.h>
+#include <linux/jhash.h>
+#include <linux/sort.h>
+#include <linux/log2.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		3
+#define HIST_SIZE_DEFAULT	2048
+#define HIST_SIZE_MAX		(1 << 17)
+
+#define HIST_FIELD_LOG2		1
+
+struct hist_field {
+	struct ftrace_event_field	*field;
+	unsigned long			flags;
+};
+
+/* state of a slot: free, being claimed, or a tag from the key's hash */
+#define HIST_SLOT_FREE		0UL
+#define HIST_SLOT_BUSY		1UL
+#define HIST_SLOT_TAG(hash)	((unsigned long)(hash) | 2UL)
+
+struct hist_entry {
+	unsigned long		state;
+	u64			key[HIST_KEYS_MAX];
+	atomic64_t		hitcount;
+	atomic64_t		sum[HIST_VALS_MAX];
+};
+
+struct hist_table {
+	struct hist_entry	*entries;
+	unsigned int		nr_slots;	/* twice the entries */
+	atomic_t		nr_entries;
+	atomic64_t		hits;
+	atomic_long_t		drops;
+};
+
+struct event_hist {
+	struct hist_field	keys[HIST_KEYS_MAX];
+	struct hist_field	vals[HIST_VALS_MAX];
+	unsigned int		n_keys;
+	unsigned int		n_vals;
+	unsigned int		size;		/* max entries */
+	bool			sort_by_key;
+	struct event_filter	*filter;
+	char			*config;
+	struct hist_table __rcu	*table;
+};
+
+static u64 hist_field_value(struct hist_field *hf, void *rec)
+{
+	struct ftrace_event_field *field = hf->field;
+	void *addr = rec + field->offset;
+	u64 val;
+
+	switch (field->size) {
+	case 1:
+		val = field->is_signed ? (s64)*(s8 *)addr : *(u8 *)addr;
+		break;
+	case 2:
+		val = field->is_signed ? (s64)*(s16 *)addr : *(u16 *)addr;
+		break;
+	case 4:
+		val = field->is_signed ? (s64)*(s32 *)addr : *(u32 *)addr;
+		break;
+	default:
+		val = *(u64 *)addr;
+		break;
+	}
+
+	/* bucket b holds [2^(b-1), 2^b), bucket 0 holds 0 */
+	if (hf->flags & HIST_FIELD_LOG2)
+		val = fls64(val);
+
+	return val;
+}
+
+static struct hist_entry *
+hist_find_entry(struct event_hist *hist, struct hist_table *table, u64 *key)
+{
+	size_t len = hist->n_keys * sizeof(u64);
+	unsigned int mask = table->nr_slots - 1;
+	struct hist_entry *entry;
+	unsigned long state, tag;
+	unsigned int i, idx;
+	u32 hash;
+
+	hash = jhash2((u32 *)key, len / sizeof(u32), 0);
+	tag = HIST_SLOT_TAG(hash);
+
+	/*
+	 * No more than half the slots are ever used, so the probe stops
+	 * at a free slot well before it has gone round.
+	 */
+	for (i = 0, idx = hash & mask; i <= mask; i++, idx = (idx + 1) & mask) {
+		entry = &table->entries[idx];
+
+		state = ACCESS_ONCE(entry->state);
+		if (state == HIST_SLOT_FREE) {
+			/* not in the table: claim the slot, if there is room */
+			if (atomic_inc_return(&table->nr_entries) > hist->size) {
+				atomic_dec(&table->nr_entries);
+				return NULL;
+			}
+			if (cmpxchg(&entry->state, HIST_SLOT_FREE,
+				    HIST_SLOT_BUSY) == HIST_SLOT_FREE) {
+				memcpy(entry->key, key, len);
+				smp_wmb();
+				entry->state = tag;
+				return entry;
+			}
+			atomic_dec(&table->nr_entries);
+			state = ACCESS_ONCE(entry->state);
+		}
+		if (state == tag) {
+			smp_rmb();
+			if (!memcmp(entry->key, key, len))
+				return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Called from trace_event_hist_commit() or filter_check_discard() for
+ * events with a histogram, with preemption disabled.  Returns true if the event is to be discarded,
+ * because it is only enabled for the histogram.
+ */
+bool event_hist_update(struct ftrace_event_call *call, void *rec)
+{
+	struct event_hist *hist = rcu_dereference_sched(call->hist);
+	u64 key[HIST_KEYS_MAX] = { 0 };
+	struct hist_entry *entry;
+	struct hist_table *table;
+	unsigned int i;
+
+	if (!hist || !filter_match_preds(hist->filter, rec))
+		goto out;
+
+	for (i = 0; i < hist->n_keys; i++)
+		key[i] = hist_field_value(&hist->keys[i], rec);
+
+	table = rcu_dereference_sched(hist->table);
+	atomic64_inc(&table->hits);
+
+	entry = hist_find_entry(hist, table, key);
+	if (!entry) {
+		atomic_long_inc(&table->drops);
+		goto out;
+	}
+
+	atomic64_inc(&entry->hitcount);
+	for (i = 0; i < hist->n_vals; i++)
+		atomic64_add(hist_field_value(&hist->vals[i], rec),
+			     &entry->sum[i]);
+out:
+	return !(call->flags & TRACE_EVENT_FL_ENABLED);
+}
+
+/*
+ * One page per cpu for TRACE_EVENT() probes to build their entry in
+ * before it is counted, allocated with the first histogram and kept.
+ * hist_buf_cnt catches a probe interrupting another one on the same cpu,
+ * which then falls back to the ring buffer.
+ */
+static DEFINE_PER_CPU(void *, hist_buf);
+static DEFINE_PER_CPU(int, hist_buf_cnt);
+static bool hist_buf_allocated;
+
+static void hist_alloc_buffers(void)
+{
+	struct page *page;
+	int cpu;
+
+	if (hist_buf_allocated)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
+		/* a cpu without one just uses the ring buffer */
+		if (page)
+			per_cpu(hist_buf, cpu) = page_address(page);
+	}
+	hist_buf_allocated = true;
+}
+
+/*
+ * Returns the buffer for an entry of len bytes, or NULL if the probe is
+ * to reserve it in the ring buffer.  Called with preemption disabled; a
+ * non-NULL return must be followed by trace_event_hist_commit().
+ */
+void *trace_event_hist_buffer(unsigned long len)
+{
+	void *buf = __this_cpu_read(hist_buf);
+
+	if (!buf || len > PAGE_SIZE)
+		return NULL;
+
+	if (__this_cpu_inc_return(hist_buf_cnt) != 1) {
+		__this_cpu_dec(hist_buf_cnt);
+		return NULL;
+	}
+
+	return buf;
+}
+EXPORT_SYMBOL_GPL(trace_event_hist_buffer);
+
+/*
+ * Counts the entry built in trace_event_hist_buffer(), and copies it to
+ * the ring buffer if the event is enabled and passes its filter.
+ */
+void trace_event_hist_commit(struct ftrace_event_call *call, void *rec,
+			     unsigned long len, unsigned long flags, int pc)
+{
+	struct ring_buffer_event *event;
+	struct ring_buffer *buffer;
+
+	tracing_generic_entry_update(rec, flags, pc);
+	((struct trace_entry *)rec)->type = call->event.type;
+
+	if (event_hist_update(call, rec))
+		goto out;
+
+	if (unlikely(call->flags & TRACE_EVENT_FL_FILTERED) &&
+	    !filter_match_preds(call->filter, rec))
+		goto out;
+
+	event = trace_current_buffer_lock_reserve(&buffer, call->event.type,
+						  len, flags, pc);
+	if (!event)
+		goto out;
+
+	memcpy(ring_buffer_event_data(event), rec, len);
+	trace_nowake_buffer_unlock_commit(buffer, event, flags, pc);
+ out:
+	__this_cpu_dec(hist_buf_cnt);
+}
+EXPORT_SYMBOL_GPL(trace_event_hist_commit);
+
+static struct hist_table *hist_alloc_table(unsigned int size)
+{
+	struct hist_table *table;
+
+	table = kzalloc(sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	table->nr_slots = roundup_pow_of_two(size) * 2;
+	table->entries = vzalloc(table->nr_slots * sizeof(*table->entries));
+	if (!table->entries) {
+		kfree(table);
+		return NULL;
+	}
+
+	return table;
+}
+
+static void hist_free_table(struct hist_table *table)
+{
+	if (!table)
+		return;
+
+	vfree(table->entries);
+	kfree(table);
+}
+
+static void hist_free(struct event_hist *hist)
+{
+	if (!hist)
+		return;
+
+	hist_free_table(rcu_dereference_raw(hist->table));
+	free_event_filter(hist->filter);
+	kfree(hist->config);
+	kfree(hist);
+}
+
+static int hist_parse_fields(struct ftrace_event_call *call,
+			     struct hist_field *fields, unsigned int *n,
+			     unsigned int max, char *str, bool allow_log2)
+{
+	struct ftrace_event_field *field;
+	unsigned long flags;
+	char *name, *mod;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (!*name)
+			continue;
+		if (*n == max)
+			return -EINVAL;
+
+		flags = 0;
+		mod = strchr(name, '.');
+		if (mod) {
+			*mod++ = '\0';
+			if (!allow_log2 || strcmp(mod, "log2"))
+				return -EINVAL;
+			flags |= HIST_FIELD_LOG2;
+		}
+
+		/* numbers only */
+		field = trace_find_event_field(call, name);
+		if (!field || field->filter_type != FILTER_OTHER ||
+		    field->size > sizeof(u64) || !is_power_of_2(field->size))
+			return -EINVAL;
+
+		fields[*n].field = field;
+		fields[*n].flags = flags;
+		(*n)++;
+	}
+
+	return 0;
+}
+
+static struct event_hist *
+hist_create(struct ftrace_event_call *call, char *buf)
+{
+	struct event_hist *hist;
+	char *filter_str, *opt, *val;
+	unsigned long size;
+	int err = -ENOMEM;
+
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return ERR_PTR(-ENOMEM);
+
+	hist->config = kstrdup(buf, GFP_KERNEL);
+	if (!hist->config)
+		goto fail;
+
+	hist->size = HIST_SIZE_DEFAULT;
+
+	filter_str = strstr(buf, " if ");
+	if (filter_str) {
+		*filter_str = '\0';
+		filter_str += 4;
+	}
+
+	err = -EINVAL;
+	while ((opt = strsep(&buf, ":")) != NULL) {
+		opt = strstrip(opt);
+		if (!*opt)
+			continue;
+
+		val = strchr(opt, '=');
+		if (!val)
+			goto fail;
+		*val++ = '\0';
+
+		if (!strcmp(opt, "keys")) {
+			err = hist_parse_fields(call, hist->keys, &hist->n_keys,
+						HIST_KEYS_MAX, val, true);
+		} else if (!strcmp(opt, "vals")) {
+			err = hist_parse_fields(call, hist->vals, &hist->n_vals,
+						HIST_VALS_MAX, val, false);
+		} else if (!strcmp(opt, "size")) {
+			err = kstrtoul(val, 0, &size);
+			if (!err && (!size || size > HIST_SIZE_MAX))
+				err = -EINVAL;
+			hist->size = size;
+		} else if (!strcmp(opt, "sort")) {
+			err = 0;
+			if (!strcmp(val, "key"))
+				hist->sort_by_key = true;
+			else if (strcmp(val, "hitcount"))
+				err = -EINVAL;
+		} else {
+			err = -EINVAL;
+		}
+		if (err)
+			goto fail;
+	}
+
+	err = -EINVAL;
+	if (!hist->n_keys)
+		goto fail;
+
+	if (filter_str) {
+		err = create_event_filter(call, filter_str, false,
+					  &hist->filter);
+		if (err)
+			goto fail;
+	}
+
+	err = -ENOMEM;
+	RCU_INIT_POINTER(hist->table, hist_alloc_table(hist->size));
+	if (!rcu_dereference_raw(hist->table))
+		goto fail;
+
+	return hist;
+
+ fail:
+	hist_free(hist);
+	return ERR_PTR(err);
+}
+
+/* Called with event_mutex held */
+static void hist_remove(struct ftrace_event_call *call)
+{
+	struct event_hist *hist;
+
+	hist = rcu_dereference_protected(call->hist,
+					 lockdep_is_held(&event_mutex));
+	if (!hist)
+		return;
+
+	trace_event_hist_reg(call, 0);
+	RCU_INIT_POINTER(call->hist, NULL);
+	/* Make sure the probes are done with it */
+	synchronize_sched();
+	hist_free(hist);
+}
+
+/* Called with event_mutex held, when the event goes away */
+void event_hist_destroy(struct ftrace_event_call *call)
+{
+	hist_remove(call);
+}
+
+static int hist_set(struct ftrace_event_call *call, char *buf)
+{
+	struct hist_table *table, *tmp;
+	struct event_hist *hist, *old;
+	int ret = 0;
+
+	buf = strstrip(buf);
+
+	mutex_lock(&event_mutex);
+	old = rcu_dereference_protected(call->hist,
+					lockdep_is_held(&event_mutex));
+
+	if (!strcmp(buf, "0")) {
+		hist_remove(call);
+		goto out_unlock;
+	}
+
+	if (!strcmp(buf, "clear")) {
+		if (!old)
+			goto out_unlock;
+		table = hist_alloc_table(old->size);
+		if (!table) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		tmp = rcu_dereference_protected(old->table,
+						lockdep_is_held(&event_mutex));
+		rcu_assign_pointer(old->table, table);
+		/* Make sure the probes are done with the old table */
+		synchronize_sched();
+		hist_free_table(tmp);
+		goto out_unlock;
+	}
+
+	hist_alloc_buffers();
+
+	hist = hist_create(call, buf);
+	if (IS_ERR(hist)) {
+		ret = PTR_ERR(hist);
+		goto out_unlock;
+	}
+
+	rcu_assign_pointer(call->hist, hist);
+	if (old) {
+		synchronize_sched();
+		hist_free(old);
+		goto out_unlock;
+	}
+
+	ret = trace_event_hist_reg(call, 1);
+	if (ret) {
+		RCU_INIT_POINTER(call->hist, NULL);
+		hist_free(hist);
+	}
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+/*
+ * Reading: a copy of the table, sorted and with duplicates merged, taken
+ * when the file is opened.  It keeps its own copy of the field names, as
+ * a dynamic event can go away while the file is open.
+ */
+struct hist_snap_entry {
+	u64			key[HIST_KEYS_MAX];
+	u64			hitcount;
+	u64			sum[HIST_VALS_MAX];
+};
+
+struct hist_snapshot {
+	char			*config;
+	unsigned int		n_keys;
+	unsigned int		n_vals;
+	char			*key_names[HIST_KEYS_MAX];
+	unsigned long		key_flags[HIST_KEYS_MAX];
+	int			key_signed[HIST_KEYS_MAX];
+	char			*val_names[HIST_VALS_MAX];
+	u64			hits;
+	unsigned long		drops;
+	unsigned int		nr;
+	struct hist_snap_entry	*entries;
+};
+
+static int hist_cmp_key(const void *a, const void *b)
+{
+	const struct hist_snap_entry *ea = a, *eb = b;
+	int i;
+
+	/* unused keys are all 0 */
+	for (i = 0; i < HIST_KEYS_MAX; i++) {
+		if (ea->key[i] != eb->key[i])
+			return ea->key[i] < eb->key[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static int hist_cmp_hitcount(const void *a, const void *b)
+{
+	const struct hist_snap_entry *ea = a, *eb = b;
+
+	if (ea->hitcount != eb->hitcount)
+		return ea->hitcount > eb->hitcount ? -1 : 1;
+	return hist_cmp_key(a, b);
+}
+
+static void hist_free_snapshot(struct hist_snapshot *snap)
+{
+	int i;
+
+	for (i = 0; i < HIST_KEYS_MAX; i++)
+		kfree(snap->key_names[i]);
+	for (i = 0; i < HIST_VALS_MAX; i++)
+		kfree(snap->val_names[i]);
+	kfree(snap->config);
+	vfree(snap->entries);
+	kfree(snap);
+}
+
+static void hist_copy_table(struct event_hist *hist,
+			    struct hist_snapshot *snap)
+{
+	struct hist_table *table = rcu_dereference_protected(hist->table,
+					lockdep_is_held(&event_mutex));
+	struct hist_snap_entry *s;
+	struct hist_entry *entry;
+	unsigned int i, j, k, n = 0;
+
+	snap->hits = atomic64_read(&table->hits);
+	snap->drops = atomic_long_read(&table->drops);
+
+	for (i = 0; i < table->nr_slots && n < hist->size; i++) {
+		entry = &table->entries[i];
+		if (ACCESS_ONCE(entry->state) <= HIST_SLOT_BUSY)
+			continue;
+		smp_rmb();
+
+		s = &snap->entries[n++];
+		memcpy(s->key, entry->key, sizeof(s->key));
+		s->hitcount = atomic64_read(&entry->hitcount);
+		for (j = 0; j < HIST_VALS_MAX; j++)
+			s->sum[j] = atomic64_read(&entry->sum[j]);
+	}
+	if (!n)
+		return;
+
+	/* merge the entries that two cpus added for the same key */
+	sort(snap->entries, n, sizeof(*s), hist_cmp_key, NULL);
+	for (i = 1, j = 0; i < n; i++) {
+		s = &snap->entries[i];
+		if (!hist_cmp_key(&snap->entries[j], s)) {
+			snap->entries[j].hitcount += s->hitcount;
+			for (k = 0; k < HIST_VALS_MAX; k++)
+				snap->entries[j].sum[k] += s->sum[k];
+			continue;
+		}
+		snap->entries[++j] = *s;
+	}
+	snap->nr = j + 1;
+
+	if (!hist->sort_by_key)
+		sort(snap->entries, snap->nr, sizeof(*s),
+		     hist_cmp_hitcount, NULL);
+}
+
+static struct hist_snapshot *hist_snapshot(struct ftrace_event_call *call)
+{
+	struct hist_snapshot *snap;
+	struct event_hist *hist;
+	unsigned int i;
+
+	snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return NULL;
+
+	mutex_lock(&event_mutex);
+	hist = rcu_dereference_protected(call->hist,
+					 lockdep_is_held(&event_mutex));
+	if (!hist)
+		goto out;
+
+	snap->config = kstrdup(hist->config, GFP_KERNEL);
+	snap->n_keys = hist->n_keys;
+	snap->n_vals = hist->n_vals;
+	for (i = 0; i < hist->n_keys; i++) {
+		snap->key_names[i] = kstrdup(hist->keys[i].field->name,
+					     GFP_KERNEL);
+		snap->key_flags[i] = hist->keys[i].flags;
+		snap->key_signed[i] = hist->keys[i].field->is_signed;
+		if (!snap->key_names[i])
+			goto fail;
+	}
+	for (i = 0; i < hist->n_vals; i++) {
+		snap->val_names[i] = kstrdup(hist->vals[i].field->name,
+					     GFP_KERNEL);
+		if (!snap->val_names[i])
+			goto fail;
+	}
+
+	snap->entries = vmalloc(hist->size * sizeof(*snap->entries));
+	if (!snap->config || !snap->entries)
+		goto fail;
+
+	hist_copy_table(hist, snap);
+ out:
+	mutex_unlock(&event_mutex);
+	return snap;
+
+ fail:
+	mutex_unlock(&event_mutex);
+	hist_free_snapshot(snap);
+	return NULL;
+}
+
+/* position 0 is the header, 1..nr the entries, nr + 1 the totals */
+static void *hist_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct hist_snapshot *snap = m->private;
+
+	if (*pos > snap->nr + 1)
+		return NULL;
+	return (void *)(unsigned long)(*pos + 1);
+}
+
+static void *hist_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return hist_seq_start(m, pos);
+}
+
+static void hist_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static void hist_show_key(struct seq_file *m, struct hist_snapshot *snap,
+			  unsigned int i, u64 key)
+{
+	u64 lo;
+
+	if (i)
+		seq_puts(m, ", ");
+
+	if (snap->key_flags[i] & HIST_FIELD_LOG2) {
+		seq_printf(m, "%s.log2: ", snap->key_names[i]);
+		if (!key) {
+			seq_printf(m, "%21s", "0");
+			return;
+		}
+		lo = 1ULL << (key - 1);
+		seq_printf(m, "%10llu-%-10llu", lo, lo + (lo - 1));
+	} else if (snap->key_signed[i]) {
+		seq_printf(m, "%s: %10lld", snap->key_names[i], key);
+	} else {
+		seq_printf(m, "%s: %10llu", snap->key_names[i], key);
+	}
+}
+
+static int hist_seq_show(struct seq_file *m, void *v)
+{
+	struct hist_snapshot *snap = m->private;
+	unsigned long idx = (unsigned long)v - 1;
+	struct hist_snap_entry *entry;
+	unsigned int i;
+
+	if (!snap->config) {
+		if (!idx)
+			seq_puts(m, "# no histogram, write one of\n"
+				 "#   keys=<field>[.log2][,...][:vals=<field>[,...]]"
+				 "[:size=<n>][:sort=hitcount|key] [if <filter>]\n");
+		return 0;
+	}
+
+	if (!idx) {
+		seq_printf(m, "# %s\n\n", snap->config);
+		return 0;
+	}
+
+	if (idx > snap->nr) {
+		seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n"
+			   "    Dropped: %lu\n", snap->hits, snap->nr,
+			   snap->drops);
+		return 0;
+	}
+
+	entry = &snap->entries[idx - 1];
+	seq_puts(m, "{ ");
+	for (i = 0; i < snap->n_keys; i++)
+		hist_show_key(m, snap, i, entry->key[i]);
+	seq_printf(m, " } hitcount: %10llu", entry->hitcount);
+	for (i = 0; i < snap->n_vals; i++)
+		seq_printf(m, "  %s: %10llu", snap->val_names[i],
+			   entry->sum[i]);
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static const struct seq_operations hist_seq_ops = {
+	.start = hist_seq_start,
+	.next = hist_seq_next,
+	.stop = hist_seq_stop,
+	.show = hist_seq_show,
+};
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	struct ftrace_event_call *call = inode->i_private;
+	struct hist_snapshot *snap;
+	int ret;
+
+	file->private_data = call;
+	if (!(file->f_mode & FMODE_READ))
+		return 0;
+
+	snap = hist_snapshot(call);
+	if (!snap)
+		return -ENOMEM;
+
+	ret = seq_open(file, &hist_seq_ops);
+	if (ret) {
+		hist_free_snapshot(snap);
+		return ret;
+	}
+	((struct seq_file *)file->private_data)->private = snap;
+
+	return 0;
+}
+
+static int event_hist_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m;
+
+	if (!(file->f_mode & FMODE_READ))
+		return 0;
+
+	m = file->private_data;
+	hist_free_snapshot(m->private);
+	return seq_release(inode, file);
+}
+
+static ssize_t
+event_hist_write(struct file *file, const char __user *ubuf, size_t cnt,
+		 loff_t *ppos)
+{
+	struct ftrace_event_call *call = file->f_path.dentry->d_inode->i_private;
+	char *buf;
+	int err;
+
+	if (cnt >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = (char *)__get_free_page(GFP_TEMPORARY);
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, cnt)) {
+		free_page((unsigned long) buf);
+		return -EFAULT;
+	}
+	buf[cnt] = '\0';
+
+	err = hist_set(call, buf);
+	free_page((unsigned long) buf);
+	if (err < 0)
+		return err;
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+const struct file_operations event_hist_fops = {
+	.open		= event_hist_open,
+	.read		= seq_read,
+	.write		= event_hist_write,
+	.llseek		= seq_lseek,
+	.release	= event_hist_release,
+};
@@ -1887,6 +1887,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	 * handled by the anon_vma lock + PG_lock.
 	 */
 	down_write(&mm->mmap_sem);
+	/* the pmd is about to be replaced under a speculative walker */
+	mm_spf_disable(mm);
 	if (unlikely(khugepaged_test_exit(mm)))
 		goto out;
 
@@ -1989,6 +1991,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 #endif
 	khugepaged_pages_collapsed++;
 out_up_write:
+	mm_spf_enable(mm);
 	up_write(&mm->mmap_sem);
 	return;
 
@@ -0,0 +1,176 @@
+/*
+ *  linux/mm/list_lru.c
+ *
+ *  LRU lists of reclaimable objects, split per memory node or per cpu.
+ *
+ *  The dentry and inode caches each kept one LRU per superblock under
+ *  one lock (for dentries, one lock for all superblocks).  Every dput()
+ *  or iput() that puts an object on the LRU, every lookup that takes it
+ *  off and every shrinker pass contended on it.  A list_lru spreads the
+ *  objects over several lists with a lock each, and the walk shares its
+ *  budget out over them, so reclaim walking one list does not hold up
+ *  additions to the others.
+ */
+#include <linux/list_lru.h>
+#include <linux/export.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+
+/* more lists than this buy nothing but cache footprint */
+#define LIST_LRU_MAX_LISTS	32
+
+static struct list_lru_one *list_lru_of(struct list_lru *lru,
+					struct list_head *item)
+{
+#ifdef CONFIG_NUMA
+	return &lru->lists[page_to_nid(virt_to_page(item))];
+#else
+	if (!lru->shift)
+		return &lru->lists[0];
+	return &lru->lists[hash_ptr(item, lru->shift)];
+#endif
+}
+
+bool list_lru_add(struct list_lru *lru, struct list_head *item)
+{
+	struct list_lru_one *l = list_lru_of(lru, item);
+
+	spin_lock(&l->lock);
+	if (list_empty(item)) {
+		list_add_tail(item, &l->list);
+		l->nr_items++;
+		spin_unlock(&l->lock);
+		return true;
+	}
+	spin_unlock(&l->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+bool list_lru_del(struct list_lru *lru, struct list_head *item)
+{
+	struct list_lru_one *l = list_lru_of(lru, item);
+
+	spin_lock(&l->lock);
+	if (!list_empty(item)) {
+		list_del_init(item);
+		l->nr_items--;
+		spin_unlock(&l->lock);
+		return true;
+	}
+	spin_unlock(&l->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+unsigned long list_lru_count(struct list_lru *lru)
+{
+	long count = 0;
+	unsigned int i;
+
+	for (i = 0; i < lru->nr_lists; i++)
+		count += ACCESS_ONCE(lru->lists[i].nr_items);
+	return count > 0 ? count : 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_count);
+
+static unsigned long list_lru_walk_one(struct list_lru_one *l,
+				       list_lru_walk_cb isolate, void *cb_arg,
+				       unsigned long *nr_to_walk)
+{
+	struct list_head *item, *n;
+	unsigned long isolated = 0;
+
+	spin_lock(&l->lock);
+restart:
+	list_for_each_safe(item, n, &l->list) {
+		if (!*nr_to_walk)
+			break;
+		--*nr_to_walk;
+
+		switch (isolate(item, &l->lock, cb_arg)) {
+		case LRU_REMOVED:
+			l->nr_items--;
+			isolated++;
+			break;
+		case LRU_ROTATE:
+			list_move_tail(item, &l->list);
+			break;
+		case LRU_SKIP:
+			break;
+		case LRU_RETRY:
+			/* the list may have changed under us: start over */
+			goto restart;
+		default:
+			BUG();
+		}
+	}
+	spin_unlock(&l->lock);
+	return isolated;
+}
+
+unsigned long list_lru_walk(struct list_lru *lru, list_lru_walk_cb isolate,
+			    void *cb_arg, unsigned long nr_to_walk)
+{
+	unsigned long share, budget, isolated = 0;
+	unsigned int i, start;
+
+	/*
+	 * Each list gets an equal share, and what a list leaves unused goes
+	 * to the next.  Start each walk on a different list, so the ones
+	 * walked last do not always get only what is left.
+	 */
+	share = max(nr_to_walk / lru->nr_lists, 1UL);
+	start = lru->cursor++;
+	for (i = 0; i < lru->nr_lists && nr_to_walk; i++) {
+		struct list_lru_one *l;
+
+		l = &lru->lists[(start + i) % lru->nr_lists];
+		if (!ACCESS_ONCE(l->nr_items))
+			continue;
+
+		budget = min(share, nr_to_walk);
+		nr_to_walk -= budget;
+		isolated += list_lru_walk_one(l, isolate, cb_arg, &budget);
+		nr_to_walk += budget;
+	}
+	return isolated;
+}
+EXPORT_SYMBOL_GPL(list_lru_walk);
+
+int list_lru_init(struct list_lru *lru)
+{
+	unsigned int i, nr;
+
+#ifdef CONFIG_NUMA
+	nr = nr_node_ids;
+	lru->shift = 0;
+#else
+	nr = roundup_pow_of_two(min_t(unsigned int, num_possible_cpus(),
+				      LIST_LRU_MAX_LISTS));
+	lru->shift = ilog2(nr);
+#endif
+	lru->lists = kcalloc(nr, sizeof(*lru->lists), GFP_KERNEL);
+	if (!lru->lists)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		spin_lock_init(&lru->lists[i].lock);
+		INIT_LIST_HEAD(&lru->lists[i].list);
+	}
+	lru->nr_lists = nr;
+	lru->cursor = 0;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_init);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	kfree(lru->lists);
+	lru->lists = NULL;
+	lru->nr_lists = 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
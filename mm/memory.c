@@ -57,6 +57,8 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
+#include <linux/log2.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1106,6 +1108,7 @@ again:
 	init_rss_vec(rss);
 	start_pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	pte = start_pte;
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -3160,6 +3163,136 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ *
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ *
+ * Target users are page handler itself and implementations of
+ * vm_ops->map_pages.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * Number of bytes around a read fault in which already cached pages of
+ * a file mapping are mapped in one go.  Must be a power of two number
+ * of pages, no larger than one page table.
+ */
+static unsigned long fault_around_bytes = rounddown_pow_of_two(65536);
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE; /* disables fault-around */
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			&fault_around_bytes_fops);
+	if (!ret)
+		pr_warn("Failed to create fault_around_bytes in debugfs");
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
+/*
+ * do_fault_around() tries to map a few pages around the fault address,
+ * hoping they will be touched soon.  Only pages that are already
+ * uptodate in the page cache are mapped: ->map_pages() never sleeps and
+ * never starts I/O, so a cold file costs nothing extra here.
+ *
+ * The window is fault_around_bytes wide, aligned down to its size and
+ * clipped to the vma and to the page table that holds @pte.  Called
+ * with the page table lock held.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr, nr_pages, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	nr_pages = ACCESS_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either end of page table or end of vma
+	 * or nr_pages from pgoff, depending what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			pgoff + nr_pages - 1);
+
+	/* Check if it makes any sense to call ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3181,7 +3314,6 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	struct page *page;
 	struct page *cow_page;
-	pte_t entry;
 	int anon = 0;
 	struct page *dirty_page = NULL;
 	struct vm_fault vmf;
@@ -3290,25 +3422,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter_fast(mm, MM_FILEPAGES);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, page_table);
 	} else {
 		if (cow_page)
 			mem_cgroup_uncharge_page(cow_page);
@@ -3364,8 +3483,25 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	spinlock_t *ptl;
 
 	pte_unmap(page_table);
+
+	/*
+	 * Let map_pages() have a chance to map the page and its cached
+	 * neighbours before we go through the full ->fault path.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    fault_around_bytes >> PAGE_SHIFT > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
@@ -3534,6 +3670,294 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults
+ *
+ * The common faults of a multi-threaded process - first touch of
+ * anonymous memory, read faults on cached file pages, and young/dirty
+ * bit updates - only change one pte under its page table lock.  Taking
+ * mmap_sem for them means they queue behind any mmap/munmap/mprotect in
+ * the process.  handle_speculative_fault() tries to resolve such faults
+ * without mmap_sem:
+ *
+ *  - the vma is looked up under mm->mm_rb_lock and validated through
+ *    vma->vm_sequence, which writers bump (vm_write_begin/end) before
+ *    they change the vma or any of its ptes;
+ *  - the page tables are walked without allocating anything, and the
+ *    sequence is checked again once the pte lock is held: a writer that
+ *    starts after that point serializes on the same pte lock and will
+ *    see (and fix up or zap) whatever pte we install;
+ *  - vmas and page tables stay allocated while a fault is in progress:
+ *    the speculative section runs with preemption disabled and never
+ *    sleeps, and both are freed after an RCU-sched grace period (vmas
+ *    through call_rcu_sched(), page tables through tlb_remove_table()).
+ *    The page tables are walked with interrupts disabled, as gup_fast
+ *    does, which also holds off tlb_remove_table()'s IPI fallback;
+ *    interrupts come back on once the pte lock is held, since the ptes
+ *    under it can't be zapped, nor their table freed, until we drop it.
+ *
+ * Nothing ever waits for a speculative fault to leave, so a process that
+ * keeps faulting can't hold up munmap().  Only the rare operations that
+ * turn speculation off wait for a grace period, see mm_spf_disable().
+ *
+ * Anything else returns VM_FAULT_RETRY and the caller falls back to the
+ * classic path under mmap_sem.
+ */
+static inline bool spf_enter(struct mm_struct *mm)
+{
+	rcu_read_lock_sched();
+	if (unlikely(ACCESS_ONCE(mm->spf_disabled))) {
+		rcu_read_unlock_sched();
+		return false;
+	}
+	return true;
+}
+
+static inline void spf_exit(struct mm_struct *mm)
+{
+	rcu_read_unlock_sched();
+}
+
+/**
+ * mm_spf_disable - keep speculative faults off an mm
+ * @mm: the mm, with mmap_sem held for writing
+ *
+ * For the rare operations that move or replace page tables under a vma
+ * (mremap, huge page collapse) and which are not worth fine-grained
+ * handling.  Faults fall back to the classic path until mm_spf_enable().
+ * Waits for a grace period, so that faults which started before are done;
+ * faults that start later see spf_disabled and don't hold it up.
+ */
+void mm_spf_disable(struct mm_struct *mm)
+{
+	mm->spf_disabled++;
+	synchronize_sched();
+}
+
+void mm_spf_enable(struct mm_struct *mm)
+{
+	smp_mb();
+	mm->spf_disabled--;
+}
+
+/*
+ * Find the pmd for @address without allocating anything.  Called with
+ * interrupts disabled; returns NULL if there is no pte table there.
+ */
+static pmd_t *spf_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		return NULL;
+	return pmd;
+}
+
+static struct vm_area_struct *spf_find_vma(struct mm_struct *mm,
+					   unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	read_lock(&mm->mm_rb_lock);
+	rb_node = mm->mm_rb.rb_node;
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (tmp->vm_end > addr) {
+			if (tmp->vm_start <= addr) {
+				vma = tmp;
+				break;
+			}
+			rb_node = rb_node->rb_left;
+		} else
+			rb_node = rb_node->rb_right;
+	}
+	read_unlock(&mm->mm_rb_lock);
+
+	return vma;
+}
+
+/**
+ * handle_speculative_fault - try to handle a user fault without mmap_sem
+ * @mm: faulting mm, current->mm
+ * @address: faulting address
+ * @flags: FAULT_FLAG_xxx, only FAULT_FLAG_WRITE is looked at
+ *
+ * Returns 0 if the fault was handled, or VM_FAULT_RETRY if the caller
+ * must go through handle_mm_fault() with mmap_sem held.  Only for faults
+ * from user mode: a kernel fault on a user address must be checked
+ * against the exception tables first.  Instruction fetch faults must not
+ * be passed here either: the vma is only checked for VM_READ/VM_WRITE.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned long vm_flags;
+	unsigned int seq;
+	pmd_t *pmd;
+	pte_t *pte, entry;
+	spinlock_t *ptl;
+	int write = flags & FAULT_FLAG_WRITE;
+	int ret = VM_FAULT_RETRY;
+
+	if (!spf_enter(mm))
+		return VM_FAULT_RETRY;
+
+	vma = spf_find_vma(mm, address);
+	if (!vma)
+		goto out;
+
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out;
+	if (address < vma->vm_start || address >= vma->vm_end)
+		goto out;
+
+	vm_flags = vma->vm_flags;
+	if (vm_flags & (VM_LOCKED | VM_GROWSDOWN | VM_GROWSUP | VM_HUGETLB |
+			VM_PFNMAP | VM_MIXEDMAP | VM_IO | VM_NONLINEAR))
+		goto out;
+	if (!(vm_flags & (write ? VM_WRITE : VM_READ | VM_WRITE)))
+		goto out;
+
+	/*
+	 * Private anonymous memory that already has its anon_vma, or file
+	 * read faults that ->map_pages() can satisfy from the page cache.
+	 */
+	if (!vma->vm_ops) {
+		if (!vma->anon_vma)
+			goto out;
+	} else if (write || !vma->vm_ops->map_pages)
+		goto out;
+
+	/* Prepare a new anonymous page before taking the pte lock */
+	if (!vma->vm_ops && write) {
+		local_irq_disable();
+		pmd = spf_find_pmd(mm, address);
+		if (!pmd) {
+			local_irq_enable();
+			goto out;
+		}
+		pte = pte_offset_map(pmd, address);
+		entry = *pte;
+		pte_unmap(pte);
+		local_irq_enable();
+		if (pte_none(entry)) {
+			page = alloc_page_vma((GFP_HIGHUSER_MOVABLE &
+					       ~__GFP_WAIT) | __GFP_NOWARN,
+					      vma, address);
+			if (!page)
+				goto out;
+			clear_user_highpage(page, address);
+			__SetPageUptodate(page);
+			if (mem_cgroup_newpage_charge(page, mm, GFP_NOWAIT)) {
+				page_cache_release(page);
+				page = NULL;
+				goto out;
+			}
+		}
+	}
+
+	/*
+	 * With interrupts off, a pte table found here is not freed under
+	 * us (see above), and huge page collapse disables speculation.
+	 * Only trylock the pte lock: its holder may be waiting for this
+	 * cpu to take a TLB flush IPI.
+	 */
+	local_irq_disable();
+	pmd = spf_find_pmd(mm, address);
+	if (!pmd) {
+		local_irq_enable();
+		goto out;
+	}
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		local_irq_enable();
+		goto out;
+	}
+	local_irq_enable();
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto unlock;
+
+	entry = *pte;
+	if (pte_present(entry)) {
+		/* Only access and dirty bit updates, no COW */
+		if (write) {
+			if (!pte_write(entry))
+				goto unlock;
+			entry = pte_mkdirty(entry);
+		}
+		entry = pte_mkyoung(entry);
+		if (ptep_set_access_flags(vma, address, pte, entry, write))
+			update_mmu_cache(vma, address, pte);
+		else if (write)
+			flush_tlb_fix_spurious_fault(vma, address);
+		ret = 0;
+	} else if (!pte_none(entry)) {
+		/* swap, migration or nonlinear entries */
+		goto unlock;
+	} else if (!vma->vm_ops) {
+		if (page) {
+			entry = mk_pte(page, vma->vm_page_prot);
+			entry = pte_mkwrite(pte_mkdirty(entry));
+			inc_mm_counter_fast(mm, MM_ANONPAGES);
+			page_add_new_anon_rmap(page, vma, address);
+			page = NULL;
+		} else if (!write) {
+			entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						      vma->vm_page_prot));
+		} else
+			goto unlock;
+		set_pte_at(mm, address, pte, entry);
+		update_mmu_cache(vma, address, pte);
+		ret = 0;
+	} else {
+		pgoff_t pgoff = linear_page_index(vma, address);
+
+		do_fault_around(vma, address, pte, pgoff, flags);
+		if (!pte_none(*pte))
+			ret = 0;
+	}
+unlock:
+	pte_unmap_unlock(pte, ptl);
+out:
+	spf_exit(mm);
+
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+
+	if (!ret) {
+		count_vm_event(PGFAULT);
+		count_vm_event(PGFAULT_SPECULATIVE);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+		check_sync_rss_stat(current);
+	}
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
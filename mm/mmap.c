@@ -220,6 +220,32 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static void __free_vma(struct rcu_head *head)
+{
+	kmem_cache_free(vm_area_cachep,
+			container_of(head, struct vm_area_struct, vm_rcu));
+}
+
+/*
+ * Free a vma that has been in the mm's rbtree.  A speculative fault may
+ * still be looking at it, so wait a grace period unless no other thread
+ * can be faulting.
+ */
+static void free_vma(struct vm_area_struct *vma)
+{
+	if (atomic_read(&vma->vm_mm->mm_users) > 1)
+		call_rcu_sched(&vma->vm_rcu, __free_vma);
+	else
+		kmem_cache_free(vm_area_cachep, vma);
+}
+#else
+static inline void free_vma(struct vm_area_struct *vma)
+{
+	kmem_cache_free(vm_area_cachep, vma);
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -236,7 +262,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 			removed_exe_file_vma(vma->vm_mm);
 	}
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	free_vma(vma);
 	return next;
 }
 
@@ -392,11 +418,32 @@ find_vma_prepare(struct mm_struct *mm, unsigned long addr,
 	return vma;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative faults look vmas up without mmap_sem, so the rbtree
+ * itself needs a lock of its own against rebalancing.
+ */
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_unlock(&mm->mm_rb_lock);
+}
+#else
+static inline void mm_rb_write_lock(struct mm_struct *mm) {}
+static inline void mm_rb_write_unlock(struct mm_struct *mm) {}
+#endif
+
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -476,7 +523,9 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_lock(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -560,6 +609,10 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	vm_write_begin(vma);
+	if (adjust_next || remove_next)
+		vm_write_begin(next);
+
 	vma_adjust_trans_huge(vma, start, end, adjust_next);
 
 	/*
@@ -617,6 +670,11 @@ again:			remove_next = 1 + (end > next->vm_end);
 	if (mapping)
 		mutex_unlock(&mapping->i_mmap_mutex);
 
+	/* a removed next stays odd: nothing may fault on it again */
+	if (adjust_next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	if (remove_next) {
 		if (file) {
 			fput(file);
@@ -627,7 +685,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		free_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -1939,7 +1997,10 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vm_write_begin(vma);
+		mm_rb_write_lock(mm);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
+		mm_rb_write_unlock(mm);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
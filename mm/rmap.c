@@ -1224,6 +1224,98 @@ out:
 		mem_cgroup_end_update_page_stat(page, &locked, &flags);
 }
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * With TTU_BATCH_FLUSH, try_to_unmap_one clears ptes that other cpus may
+ * have cached without flushing them, and notes the cpus involved in
+ * current->tlb_ubc.  The caller then flushes once for the whole batch:
+ * before starting writeback on a page that was mapped dirty, so that no
+ * write can slip in behind the I/O, and in any case before the pages are
+ * freed.
+ */
+void try_to_unmap_flush(void)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+
+	if (!tlb_ubc->flush_required)
+		return;
+
+	arch_tlbbatch_flush(&tlb_ubc->cpumask);
+	count_vm_events(TLB_FLUSH_AVOIDED, tlb_ubc->nr_pending - 1);
+	cpumask_clear(&tlb_ubc->cpumask);
+	tlb_ubc->nr_pending = 0;
+	tlb_ubc->flush_required = false;
+	tlb_ubc->writable = false;
+}
+
+/* Flush if some deferred entry could still let a write through */
+void try_to_unmap_flush_dirty(void)
+{
+	if (current->tlb_ubc.writable)
+		try_to_unmap_flush();
+}
+
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+
+	cpumask_or(&tlb_ubc->cpumask, &tlb_ubc->cpumask, mm_cpumask(mm));
+	tlb_ubc->nr_pending++;
+	tlb_ubc->flush_required = true;
+	if (writable)
+		tlb_ubc->writable = true;
+
+	/* the pte must read clear before the mm is marked, see below */
+	barrier();
+	mm->tlb_flush_batched = true;
+}
+
+/*
+ * Only worth deferring when other cpus may hold the entry: flushing
+ * just the local TLB is cheap.
+ */
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	bool should_defer = false;
+
+	if (!(flags & TTU_BATCH_FLUSH))
+		return false;
+
+	if (cpumask_any_but(mm_cpumask(mm), get_cpu()) < nr_cpu_ids)
+		should_defer = true;
+	put_cpu();
+
+	return should_defer;
+}
+
+/*
+ * munmap, mprotect, mremap or MADV_FREE may find a pte that reclaim
+ * cleared but did not flush yet, skip it as already empty, and return
+ * to userspace while another cpu can still reach the page through a
+ * stale TLB entry.  They call this under the ptl before looking at the
+ * ptes, to flush whatever reclaim still owes for the mm.
+ */
+void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+	if (mm->tlb_flush_batched) {
+		flush_tlb_mm(mm);
+
+		/* flush before clearing, a racing reclaim will set it again */
+		barrier();
+		mm->tlb_flush_batched = false;
+	}
+}
+#else
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+}
+
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	return false;
+}
+#endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
+
 /*
  * Subfunctions of try_to_unmap: try_to_unmap_one called
  * repeatedly from try_to_unmap_ksm, try_to_unmap_anon or try_to_unmap_file.
@@ -1262,7 +1354,16 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
-	pteval = ptep_clear_flush_notify(vma, address, pte);
+	if (should_defer_flush(mm, flags)) {
+		/*
+		 * Leave the TLB flush to try_to_unmap_flush(), which the
+		 * caller issues once for a batch of pages.
+		 */
+		pteval = ptep_get_and_clear(mm, address, pte);
+		set_tlb_ubc_flush_pending(mm, pte_dirty(pteval));
+		mmu_notifier_invalidate_page(mm, address);
+	} else
+		pteval = ptep_clear_flush_notify(vma, address, pte);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
@@ -1281,6 +1382,16 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
+		if (!PageDirty(page) && (flags & TTU_LAZYFREE)) {
+			/*
+			 * Clean page handed back with MADV_FREE and not
+			 * written since: drop it, the next touch gets a
+			 * fresh zero page.
+			 */
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
+		}
+
 		if (PageSwapCache(page)) {
 			/*
 			 * Store the swap location in the pte.
@@ -1319,6 +1430,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -39,6 +39,7 @@ int page_cluster;
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -491,6 +492,34 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	update_page_reclaim_stat(zone, page, file, 0);
 }
 
+/*
+ * Pages handed to MADV_FREE are clean, old and unlikely to be touched
+ * again soon, so move them to the tail of the inactive anon list where
+ * reclaim will find them first and can discard them without swap I/O.
+ */
+static void lru_lazyfree_fn(struct page *page, void *arg)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+	int lru = LRU_INACTIVE_ANON;
+
+	if (!PageLRU(page) || !PageAnon(page) || PageUnevictable(page))
+		return;
+
+	if (PageActive(page)) {
+		del_page_from_lru_list(zone, page, LRU_ACTIVE_ANON);
+		ClearPageActive(page);
+		add_page_to_lru_list(zone, page, lru);
+		__count_vm_event(PGDEACTIVATE);
+	}
+	ClearPageReferenced(page);
+
+	lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+	list_move_tail(&page->lru, &lruvec->lists[lru]);
+	__count_vm_event(PGLAZYFREE);
+	update_page_reclaim_stat(zone, page, 0, 0);
+}
+
 /*
  * Drain pages out of the cpu's pagevecs.
  * Either "cpu" is the current CPU, and preemption has already been
@@ -522,6 +551,10 @@ void lru_add_drain_cpu(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -551,6 +584,28 @@ void deactivate_page(struct page *page)
 	}
 }
 
+/**
+ * mark_page_lazyfree - make an anon page lazily freeable
+ * @page: page to mark
+ *
+ * mark_page_lazyfree() moves @page to the tail of the inactive anon list
+ * so that reclaim picks it up ahead of other anonymous memory.  Used by
+ * MADV_FREE once the page's dirty state has been cleared.
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (PageUnevictable(page))
+		return;
+
+	if (likely(get_page_unless_zero(page))) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	lru_add_drain_cpu(get_cpu());
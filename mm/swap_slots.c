@@ -0,0 +1,279 @@
+/*
+ *  linux/mm/swap_slots.c
+ *
+ *  Per-cpu caches of swap slots.
+ *
+ *  Every swap slot allocated for swap-out and every slot freed when its
+ *  last swapped page is dropped takes swap_lock, which all cpus doing
+ *  reclaim or tearing down swapped memory contend on.  Instead, each cpu
+ *  takes SWAP_SLOTS_CACHE_SIZE slots at a time for get_swap_page(), and
+ *  collects as many freed slots before returning them all under a
+ *  single swap_lock.
+ *
+ *  Slots in an allocation cache count as used, and slots in a free cache
+ *  still read SWAP_HAS_CACHE in swap_map.  So that a nearly full swap
+ *  device is not starved by slots parked in the caches, caching is
+ *  turned off while free swap is low and back on once it recovers.
+ *  swapoff disables and drains the caches while it runs.
+ */
+#include <linux/swap.h>
+#include <linux/percpu.h>
+#include <linux/cpu.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/init.h>
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* protects slots, nr, cur */
+	swp_entry_t	*slots;
+	int		nr;
+	int		cur;
+	spinlock_t	free_lock;	/* protects slots_ret, n_ret */
+	swp_entry_t	*slots_ret;
+	int		n_ret;
+};
+
+/* in free swap pages per online cpu */
+#define THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE	(5 * SWAP_SLOTS_CACHE_SIZE)
+#define THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE	(2 * SWAP_SLOTS_CACHE_SIZE)
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool swap_slot_cache_active;
+bool swap_slot_cache_enabled;
+static bool swap_slot_cache_initialized;
+/* serializes activation changes with draining */
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+/* held by swapoff for as long as the caches must stay off */
+static DEFINE_MUTEX(swap_slots_cache_enable_mutex);
+
+#define use_swap_slot_cache (swap_slot_cache_active && swap_slot_cache_enabled)
+
+static void drain_slots_cache_cpu(unsigned int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	if (!cache->slots)
+		return;
+
+	mutex_lock(&cache->alloc_lock);
+	swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+	cache->cur = 0;
+	cache->nr = 0;
+	mutex_unlock(&cache->alloc_lock);
+
+	spin_lock(&cache->free_lock);
+	swapcache_free_entries(cache->slots_ret, cache->n_ret);
+	cache->n_ret = 0;
+	spin_unlock(&cache->free_lock);
+}
+
+/* caller holds swap_slots_cache_mutex */
+static void drain_swap_slots_caches(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		drain_slots_cache_cpu(cpu);
+}
+
+static void deactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = false;
+	drain_swap_slots_caches();
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static void reactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = true;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static bool check_cache_active(void)
+{
+	long pages;
+
+	if (!swap_slot_cache_enabled)
+		return false;
+
+	pages = nr_swap_pages;
+	if (!swap_slot_cache_active) {
+		if (pages > num_online_cpus() *
+			    THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE)
+			reactivate_swap_slots_cache();
+	} else if (pages < num_online_cpus() *
+			   THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE)
+		deactivate_swap_slots_cache();
+
+	return swap_slot_cache_active;
+}
+
+static int alloc_swap_slot_cache(unsigned int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+	swp_entry_t *slots, *slots_ret;
+
+	if (cache->slots)
+		return 0;
+
+	slots = kcalloc(SWAP_SLOTS_CACHE_SIZE, sizeof(swp_entry_t),
+			GFP_KERNEL);
+	if (!slots)
+		return -ENOMEM;
+	slots_ret = kcalloc(SWAP_SLOTS_CACHE_SIZE, sizeof(swp_entry_t),
+			    GFP_KERNEL);
+	if (!slots_ret) {
+		kfree(slots);
+		return -ENOMEM;
+	}
+
+	mutex_init(&cache->alloc_lock);
+	spin_lock_init(&cache->free_lock);
+	cache->nr = 0;
+	cache->cur = 0;
+	cache->n_ret = 0;
+	cache->slots_ret = slots_ret;
+	cache->slots = slots;
+	return 0;
+}
+
+/*
+ * Called at swapon.  The caches are allocated for every possible cpu
+ * on first use and kept from then on: they are small, and that spares
+ * allocating in the cpu hotplug path.
+ */
+void enable_swap_slots_cache(void)
+{
+	unsigned int cpu;
+
+	mutex_lock(&swap_slots_cache_enable_mutex);
+	if (!swap_slot_cache_initialized) {
+		for_each_possible_cpu(cpu) {
+			if (alloc_swap_slot_cache(cpu)) {
+				printk(KERN_WARNING "swap: no memory for "
+				       "per-cpu slot caches\n");
+				goto out;
+			}
+		}
+		swap_slot_cache_initialized = true;
+	}
+	swap_slot_cache_enabled = true;
+out:
+	mutex_unlock(&swap_slots_cache_enable_mutex);
+}
+
+/*
+ * swapoff disables the caches, and empties them, for as long as it
+ * runs: try_to_unuse() cannot wait for slots sitting in them.
+ */
+void disable_swap_slots_cache_lock(void)
+{
+	mutex_lock(&swap_slots_cache_enable_mutex);
+	swap_slot_cache_enabled = false;
+	if (swap_slot_cache_initialized) {
+		mutex_lock(&swap_slots_cache_mutex);
+		drain_swap_slots_caches();
+		mutex_unlock(&swap_slots_cache_mutex);
+	}
+}
+
+void reenable_swap_slots_cache_unlock(void)
+{
+	if (swap_slot_cache_initialized && total_swap_pages)
+		swap_slot_cache_enabled = true;
+	mutex_unlock(&swap_slots_cache_enable_mutex);
+}
+
+/* called with cache->alloc_lock held */
+static int refill_swap_slots_cache(struct swap_slots_cache *cache)
+{
+	if (!use_swap_slot_cache || cache->nr)
+		return 0;
+
+	cache->cur = 0;
+	cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+	return cache->nr;
+}
+
+/**
+ * get_swap_page - allocate a swap entry for the swap cache
+ *
+ * Returns the entry, or one with a zero val if swap is full.
+ */
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry;
+
+	entry.val = 0;
+	if (check_cache_active()) {
+		/*
+		 * The mutex, not preemption, protects the cache: a refill
+		 * can sleep, and we may be on another cpu by then.
+		 */
+		cache = __this_cpu_ptr(&swp_slots);
+		if (cache->slots) {
+			mutex_lock(&cache->alloc_lock);
+			if (cache->nr || refill_swap_slots_cache(cache)) {
+				entry = cache->slots[cache->cur];
+				cache->slots[cache->cur++].val = 0;
+				cache->nr--;
+			}
+			mutex_unlock(&cache->alloc_lock);
+			if (entry.val)
+				return entry;
+		}
+	}
+
+	get_swap_pages(1, &entry);
+	return entry;
+}
+
+/**
+ * free_swap_slot - free a swap entry only the swap cache referenced
+ * @entry: the entry, still marked SWAP_HAS_CACHE in its swap_map
+ */
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+
+	cache = __this_cpu_ptr(&swp_slots);
+	if (use_swap_slot_cache && cache->slots_ret) {
+		spin_lock(&cache->free_lock);
+		/* recheck: the cache may have been drained meanwhile */
+		if (!use_swap_slot_cache) {
+			spin_unlock(&cache->free_lock);
+			goto direct_free;
+		}
+		if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+			swapcache_free_entries(cache->slots_ret,
+					       cache->n_ret);
+			cache->n_ret = 0;
+		}
+		cache->slots_ret[cache->n_ret++] = entry;
+		spin_unlock(&cache->free_lock);
+		return;
+	}
+direct_free:
+	swapcache_free_entries(&entry, 1);
+}
+
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nfb,
+					     unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_slots_cache_cpu(cpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	return 0;
+}
+__initcall(swap_slots_init);
@@ -167,13 +167,15 @@ int add_to_swap(struct page *page)
 	 * deadlock in the swap out path.
 	 */
 	/*
-	 * Add it to the swap cache and mark it dirty
+	 * Add it to the swap cache.  The page is not marked dirty here:
+	 * try_to_unmap() moves the pte dirty bits over, and a page that
+	 * stays clean after that was freed with MADV_FREE and can be
+	 * dropped without being written to swap.
 	 */
 	err = add_to_swap_cache(page, entry,
 			__GFP_HIGH|__GFP_NOMEMALLOC|__GFP_NOWARN);
 
 	if (!err) {	/* Success */
-		SetPageDirty(page);
 		return 1;
 	} else {	/* -ENOMEM radix-tree allocation failure */
 		/*
@@ -293,6 +295,15 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		if (found_page)
 			break;
 
+		/*
+		 * A slot with no references left may sit in a per-cpu
+		 * slot cache still marked SWAP_HAS_CACHE: swapcache_prepare
+		 * would report -EEXIST until it is freed, so give up here.
+		 * swapoff disables the caches and relies on the retry.
+		 */
+		if (swap_slot_cache_enabled && !__swp_swapcount(entry))
+			break;
+
 		/*
 		 * Get a new page to read into from swap.
 		 */
@@ -179,6 +179,157 @@ static int wait_for_discard(void *word)
 #define SWAPFILE_CLUSTER	256
 #define LATENCY_LIMIT		256
 
+/*
+ * Cluster states, on solid state swap without discard.  An owned
+ * cluster is some cpu's current allocation cluster: it sits on no list
+ * and is refiled by its count when that cpu moves on.
+ */
+enum {
+	CLUSTER_FREE,
+	CLUSTER_NONFULL,
+	CLUSTER_FULL,
+	CLUSTER_OWNED,
+};
+
+static inline struct swap_cluster_info *
+offset_to_cluster(struct swap_info_struct *si, unsigned long offset)
+{
+	return &si->cluster_info[offset / SWAPFILE_CLUSTER];
+}
+
+/* Move an unowned cluster to the list its count calls for */
+static void cluster_refile(struct swap_info_struct *si,
+			   struct swap_cluster_info *ci)
+{
+	unsigned int state;
+
+	if (!ci->count)
+		state = CLUSTER_FREE;
+	else if (ci->count < SWAPFILE_CLUSTER)
+		state = CLUSTER_NONFULL;
+	else
+		state = CLUSTER_FULL;
+	if (state == ci->state)
+		return;
+
+	ci->state = state;
+	if (state == CLUSTER_FREE)
+		list_move_tail(&ci->list, &si->free_clusters);
+	else if (state == CLUSTER_NONFULL)
+		list_move_tail(&ci->list, &si->nonfull_clusters);
+	else
+		list_del_init(&ci->list);
+}
+
+static void inc_cluster_info(struct swap_info_struct *si, unsigned long offset)
+{
+	struct swap_cluster_info *ci = offset_to_cluster(si, offset);
+
+	VM_BUG_ON(ci->count >= SWAPFILE_CLUSTER);
+	ci->count++;
+	if (ci->state != CLUSTER_OWNED)
+		cluster_refile(si, ci);
+}
+
+static void dec_cluster_info(struct swap_info_struct *si, unsigned long offset)
+{
+	struct swap_cluster_info *ci = offset_to_cluster(si, offset);
+
+	VM_BUG_ON(!ci->count);
+	ci->count--;
+	if (ci->state != CLUSTER_OWNED)
+		cluster_refile(si, ci);
+}
+
+/*
+ * Find a free slot in this cpu's cluster, taking a new cluster when it
+ * is used up: an empty one if there is any, so that allocation stays
+ * sequential, else one with holes.  Never scans more than a cluster, so
+ * a nearly full device costs no more than an empty one.  Returns 0 if
+ * no slot is free.  Called with swap_lock held.
+ */
+static unsigned long scan_swap_map_cluster(struct swap_info_struct *si)
+{
+	struct percpu_cluster *pc = this_cpu_ptr(si->percpu_cluster);
+	struct swap_cluster_info *ci;
+	unsigned long offset, end;
+
+	for (;;) {
+		ci = pc->cluster;
+		if (!ci) {
+			if (!list_empty(&si->free_clusters))
+				ci = list_first_entry(&si->free_clusters,
+					struct swap_cluster_info, list);
+			else if (!list_empty(&si->nonfull_clusters))
+				ci = list_first_entry(&si->nonfull_clusters,
+					struct swap_cluster_info, list);
+			else
+				return 0;
+			list_del_init(&ci->list);
+			ci->state = CLUSTER_OWNED;
+			pc->cluster = ci;
+			pc->next = (ci - si->cluster_info) * SWAPFILE_CLUSTER;
+		}
+
+		end = (ci - si->cluster_info + 1) * SWAPFILE_CLUSTER;
+		if (end > si->max)
+			end = si->max;
+		if (ci->count < SWAPFILE_CLUSTER) {
+			for (offset = pc->next; offset < end; offset++) {
+				if (!si->swap_map[offset]) {
+					pc->next = offset + 1;
+					return offset;
+				}
+			}
+		}
+
+		/* nothing free past pc->next: hand the cluster back */
+		pc->cluster = NULL;
+		cluster_refile(si, ci);
+	}
+}
+
+static int setup_swap_clusters(struct swap_info_struct *p,
+			       unsigned char *swap_map)
+{
+	unsigned long nr_clusters = DIV_ROUND_UP(p->max, SWAPFILE_CLUSTER);
+	struct swap_cluster_info *cluster_info;
+	unsigned long i;
+
+	cluster_info = vzalloc(nr_clusters * sizeof(*cluster_info));
+	if (!cluster_info)
+		return -ENOMEM;
+	p->percpu_cluster = alloc_percpu(struct percpu_cluster);
+	if (!p->percpu_cluster) {
+		vfree(cluster_info);
+		return -ENOMEM;
+	}
+
+	/* bad slots and the tail beyond p->max are never free */
+	for (i = 0; i < p->max; i++)
+		if (swap_map[i])
+			cluster_info[i / SWAPFILE_CLUSTER].count++;
+	cluster_info[nr_clusters - 1].count +=
+				nr_clusters * SWAPFILE_CLUSTER - p->max;
+
+	p->cluster_info = cluster_info;
+	INIT_LIST_HEAD(&p->free_clusters);
+	INIT_LIST_HEAD(&p->nonfull_clusters);
+	for (i = 0; i < nr_clusters; i++) {
+		INIT_LIST_HEAD(&cluster_info[i].list);
+		cluster_info[i].state = CLUSTER_FULL;	/* i.e. on no list */
+		cluster_refile(p, &cluster_info[i]);
+	}
+	return 0;
+}
+
+static void free_swap_clusters(struct swap_cluster_info *cluster_info,
+			       struct percpu_cluster __percpu *percpu_cluster)
+{
+	vfree(cluster_info);
+	free_percpu(percpu_cluster);
+}
+
 static unsigned long scan_swap_map(struct swap_info_struct *si,
 				   unsigned char usage)
 {
@@ -200,6 +351,14 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 	 */
 
 	si->flags += SWP_SCANNING;
+
+	if (si->cluster_info) {
+		scan_base = offset = scan_swap_map_cluster(si);
+		if (!offset)
+			goto no_page;
+		goto checks;
+	}
+
 	scan_base = offset = si->cluster_next;
 
 	if (unlikely(!si->cluster_nr--)) {
@@ -312,6 +471,8 @@ checks:
 		si->highest_bit = 0;
 	}
 	si->swap_map[offset] = usage;
+	if (si->cluster_info)
+		inc_cluster_info(si, offset);
 	si->cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
 
@@ -408,17 +569,25 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap entries for the swap cache, in one go under
+ * swap_lock.  Returns how many were allocated.  Most callers want
+ * get_swap_page(), which feeds from the per-cpu slot caches.
+ */
+int get_swap_pages(int n, swp_entry_t swp_entries[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int n_ret = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	if (n > nr_swap_pages)
+		n = nr_swap_pages;
+	nr_swap_pages -= n;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info[type];
@@ -435,19 +604,22 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
-		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		/* This is called for allocating swap entries for cache */
+		while (n_ret < n) {
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			swp_entries[n_ret++] = swp_entry(type, offset);
 		}
+		if (n_ret == n)
+			break;
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
+	nr_swap_pages += n - n_ret;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return n_ret;
 }
 
 /* The only caller of this function is now susupend routine */
@@ -472,7 +644,7 @@ swp_entry_t get_swap_page_of_type(int type)
 	return (swp_entry_t) {0};
 }
 
-static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+static struct swap_info_struct *__swap_info_get(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 	unsigned long offset, type;
@@ -490,7 +662,6 @@ static struct swap_info_struct *swap_info_get(swp_entry_t entry)
 		goto bad_offset;
 	if (!p->swap_map[offset])
 		goto bad_free;
-	spin_lock(&swap_lock);
 	return p;
 
 bad_free:
@@ -508,6 +679,16 @@ out:
 	return NULL;
 }
 
+static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+
+	p = __swap_info_get(entry);
+	if (p)
+		spin_lock(&swap_lock);
+	return p;
+}
+
 static unsigned char swap_entry_free(struct swap_info_struct *p,
 				     swp_entry_t entry, unsigned char usage)
 {
@@ -556,6 +737,8 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 			swap_list.next = p->type;
 		nr_swap_pages++;
 		p->inuse_pages--;
+		if (p->cluster_info)
+			dec_cluster_info(p, offset);
 		if ((p->flags & SWP_BLKDEV) &&
 				disk->fops->swap_slot_free_notify)
 			disk->fops->swap_slot_free_notify(p->bdev, offset);
@@ -586,14 +769,64 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 {
 	struct swap_info_struct *p;
 	unsigned char count;
+	bool last = false;
 
 	p = swap_info_get(entry);
 	if (p) {
-		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
+		if (p->swap_map[swp_offset(entry)] == SWAP_HAS_CACHE) {
+			/*
+			 * Last reference: leave the slot reserved, the
+			 * per-cpu slot cache frees it with others later.
+			 */
+			mem_cgroup_uncharge_swap(entry);
+			count = 0;
+			last = true;
+		} else
+			count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
 		if (page)
 			mem_cgroup_uncharge_swapcache(page, entry, count != 0);
 		spin_unlock(&swap_lock);
+		if (last)
+			free_swap_slot(entry);
+	}
+}
+
+/*
+ * Free a batch of entries whose only reference was the swap cache,
+ * from the slot caches: one swap_lock round trip for all of them.
+ */
+void swapcache_free_entries(swp_entry_t *entries, int n)
+{
+	struct swap_info_struct *p;
+	int i;
+
+	if (n <= 0)
+		return;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; i++) {
+		p = __swap_info_get(entries[i]);
+		if (p)
+			swap_entry_free(p, entries[i], SWAP_HAS_CACHE);
 	}
+	spin_unlock(&swap_lock);
+}
+
+/*
+ * Swap count of an entry, not counting the swap cache, read without
+ * swap_lock: only a hint.
+ */
+int __swp_swapcount(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+	unsigned long offset = swp_offset(entry);
+
+	if (swp_type(entry) >= nr_swapfiles)
+		return 0;
+	p = swap_info[swp_type(entry)];
+	if (!(p->flags & SWP_USED) || offset >= p->max)
+		return 0;
+	return swap_count(ACCESS_ONCE(p->swap_map[offset]));
 }
 
 /*
@@ -1550,6 +1783,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	struct swap_cluster_info *cluster_info;
+	struct percpu_cluster __percpu *percpu_cluster;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1615,10 +1850,15 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* slots parked in the per-cpu caches would keep try_to_unuse busy */
+	disable_swap_slots_cache_lock();
+
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 	err = try_to_unuse(type);
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
 
+	reenable_swap_slots_cache_unlock();
+
 	if (err) {
 		/*
 		 * reading p->prio and p->swap_map outside the lock is
@@ -1652,10 +1892,15 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	cluster_info = p->cluster_info;
+	p->cluster_info = NULL;
+	percpu_cluster = p->percpu_cluster;
+	p->percpu_cluster = NULL;
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	free_swap_clusters(cluster_info, percpu_cluster);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -2112,6 +2357,16 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 			p->flags |= SWP_DISCARDABLE;
 	}
 
+	/*
+	 * Discard wants the free-cluster search of scan_swap_map(), which
+	 * knows how to discard a cluster before reusing it.
+	 */
+	if ((p->flags & SWP_SOLIDSTATE) && !(p->flags & SWP_DISCARDABLE)) {
+		error = setup_swap_clusters(p, swap_map);
+		if (error)
+			goto bad_swap;
+	}
+
 	mutex_lock(&swapon_mutex);
 	prio = -1;
 	if (swap_flags & SWAP_FLAG_PREFER)
@@ -2130,6 +2385,8 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	atomic_inc(&proc_poll_event);
 	wake_up_interruptible(&proc_poll_wait);
 
+	enable_swap_slots_cache();
+
 	if (S_ISREG(inode->i_mode))
 		inode->i_flags |= S_SWAPFILE;
 	error = 0;
@@ -2146,6 +2403,9 @@ bad_swap:
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	vfree(swap_map);
+	free_swap_clusters(p->cluster_info, p->percpu_cluster);
+	p->cluster_info = NULL;
+	p->percpu_cluster = NULL;
 	if (swap_file) {
 		if (inode && S_ISREG(inode->i_mode)) {
 			mutex_unlock(&inode->i_mutex);
@@ -42,6 +42,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/ksm.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -784,6 +785,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		bool lazyfree = false;
 
 		cond_resched();
 
@@ -848,6 +850,11 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				goto keep_locked;
 			if (!add_to_swap(page))
 				goto activate_locked;
+			/* KSM maps its pages clean; they are never lazyfree */
+			if (PageKsm(page))
+				SetPageDirty(page);
+			else
+				lazyfree = true;
 			may_enter_fs = 1;
 		}
 
@@ -856,9 +863,24 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		/*
 		 * The page is mapped into the page tables of one or more
 		 * processes. Try to unmap it here.
+		 *
+		 * A page freshly added to swap cache is still clean unless
+		 * one of its ptes is dirty; clean ptes can only belong to
+		 * MADV_FREE pages, which try_to_unmap() simply discards.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+			int ret = try_to_unmap(page, TTU_BATCH_FLUSH | (lazyfree ?
+					TTU_UNMAP | TTU_LAZYFREE : TTU_UNMAP));
+
+			/*
+			 * The swap slot was never written: if the page stays
+			 * mapped, make sure it gets written before any pte
+			 * can be pointed at that slot.
+			 */
+			if (ret != SWAP_SUCCESS && lazyfree && !PageDirty(page))
+				SetPageDirty(page);
+
+			switch (ret) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -872,6 +894,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 		if (PageDirty(page)) {
 			nr_dirty++;
+			lazyfree = false;
 
 			/*
 			 * Only kswapd can writeback filesystem pages to
@@ -899,7 +922,11 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
+			/*
+			 * Page is dirty, try to write it out here.  No cpu
+			 * may keep a writable TLB entry for it past this.
+			 */
+			try_to_unmap_flush_dirty();
 			switch (pageout(page, mapping, sc)) {
 			case PAGE_KEEP:
 				nr_congested++;
@@ -971,6 +998,9 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		if (!mapping || !__remove_mapping(mapping, page))
 			goto keep_locked;
 
+		if (lazyfree)
+			count_vm_event(PGLAZYFREED);
+
 		/*
 		 * At this point, we have no other references and there is
 		 * no way to pick any more up (removed from LRU, removed
@@ -1022,6 +1052,8 @@ keep_lumpy:
 	if (nr_dirty && nr_dirty == nr_congested && global_reclaim(sc))
 		zone_set_flag(mz->zone, ZONE_CONGESTED);
 
+	/* the unmapped pages must be unreachable before they are freed */
+	try_to_unmap_flush();
 	free_hot_cold_page_list(&free_pages, 1);
 
 	list_splice(&ret_pages, page_list);
@@ -2436,7 +2468,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 {
 	unsigned long nr_reclaimed;
 	struct scan_control sc = {
-		.gfp_mask = gfp_mask,
+		.gfp_mask = (gfp_mask = memalloc_noio_flags(gfp_mask)),
 		.may_writepage = !laptop_mode,
 		.nr_to_reclaim = SWAP_CLUSTER_MAX,
 		.may_unmap = 1,
@@ -3393,7 +3425,7 @@ static int __zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 		.may_swap = 1,
 		.nr_to_reclaim = max_t(unsigned long, nr_pages,
 				       SWAP_CLUSTER_MAX),
-		.gfp_mask = gfp_mask,
+		.gfp_mask = (gfp_mask = memalloc_noio_flags(gfp_mask)),
 		.order = order,
 	};
 	struct shrink_control shrink = {
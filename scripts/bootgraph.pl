@@ -33,6 +33,9 @@
 # CONFIG_PRINTK_TIME configuration option enabled, and with
 # "initcall_debug" passed on the kernel command line.
 #
+# Driver probes are shown too, in the row of the thread running them, so
+# probes done asynchronously show up side by side.
+#
 # usage:
 # 	dmesg | perl scripts/bootgraph.pl > output.svg
 #
@@ -66,6 +69,19 @@ while (<>) {
 		$count = $count + 1;
 	}
 
+	if ($line =~ /([0-9\.]+)\] probe of ([^ ]+) @ ([0-9]+)/) {
+		my $func = "probe:" . $2;
+		if ($done == 0) {
+			$start{$func} = $1;
+			$type{$func} = 0;
+			if ($1 < $firsttime) {
+				$firsttime = $1;
+			}
+		}
+		$pids{$func} = $3;
+		$count = $count + 1;
+	}
+
 	if ($line =~ /([0-9\.]+)\] async_waiting @ ([0-9]+)/) {
 		my $pid = $2;
 		my $func;
@@ -94,6 +110,13 @@ while (<>) {
 		}
 	}
 
+	if ($line =~ /([0-9\.]+)\] probe of ([^ ]+) returned/) {
+		if ($done == 0) {
+			$end{"probe:" . $2} = $1;
+			$maxtime = $1;
+		}
+	}
+
 	if ($line =~ /([0-9\.]+)\] async_continuing @ ([0-9]+)/) {
 		my $pid = $2;
 		my $func =  "wait_" . $pid . "_" . $pidctr{$pid};
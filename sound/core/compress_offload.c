@@ -336,11 +336,14 @@ static unsigned int snd_compr_poll(struct file *f, poll_table *wait)
 	/* check if we have at least one fragment to fill */
 	switch (stream->runtime->state) {
 	case SNDRV_PCM_STATE_DRAINING:
-		/* stream has been woken up after drain is complete
-		 * draining done so set stream state to stopped
+		/* draining is done once the DSP has consumed everything
+		 * written, then the stream is stopped
 		 */
-		retval = snd_compr_get_poll(stream);
-		stream->runtime->state = SNDRV_PCM_STATE_SETUP;
+		if (stream->runtime->total_bytes_available ==
+				stream->runtime->total_bytes_transferred) {
+			retval = snd_compr_get_poll(stream);
+			stream->runtime->state = SNDRV_PCM_STATE_SETUP;
+		}
 		break;
 	case SNDRV_PCM_STATE_RUNNING:
 	case SNDRV_PCM_STATE_PREPARED:
@@ -658,7 +661,8 @@ static int snd_compress_dev_disconnect(struct snd_device *device)
 	struct snd_compr *compr;
 
 	compr = device->device_data;
-	snd_unregister_device(compr->direction, compr->card, compr->device);
+	snd_unregister_device(SNDRV_DEVICE_TYPE_COMPRESS, compr->card,
+			compr->device);
 	return 0;
 }
 
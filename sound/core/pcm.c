@@ -1023,6 +1023,8 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 
 	runtime->status->state = SNDRV_PCM_STATE_OPEN;
 
+	snd_pcm_position_timer_init(substream);
+
 	substream->runtime = runtime;
 	substream->private_data = pcm->private_data;
 	substream->ref_count = 1;
@@ -1039,6 +1041,7 @@ void snd_pcm_detach_substream(struct snd_pcm_substream *substream)
 
 	if (PCM_RUNTIME_CHECK(substream))
 		return;
+	hrtimer_cancel(&substream->position_timer);
 	runtime = substream->runtime;
 	if (runtime->private_free != NULL)
 		runtime->private_free(runtime);
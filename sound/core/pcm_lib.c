@@ -23,6 +23,8 @@
 #include <linux/time.h>
 #include <linux/math64.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
 #include <sound/core.h>
 #include <sound/control.h>
 #include <sound/info.h>
@@ -1772,6 +1774,128 @@ void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
 
 EXPORT_SYMBOL(snd_pcm_period_elapsed);
 
+/*
+ * Streams opened with SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP get no
+ * period interrupts, so nothing moves hw_ptr (and the status page that
+ * may be mmapped to the application) until the application asks for it.
+ * Refresh it from an hrtimer instead, armed for the next point where
+ * something has to happen: the wakeup threshold being reached, an xrun,
+ * or the end of a drain, as far as the rate and the current pointers
+ * tell.  The application moving appl_ptr only pushes those later, so
+ * the timer is re-armed earlier only when somebody is about to sleep.
+ * position_refresh_us is the shortest interval, so that a pointer that
+ * moves in coarse steps does not make the timer spin.
+ */
+static unsigned int position_refresh_us = 1000;
+module_param(position_refresh_us, uint, 0644);
+MODULE_PARM_DESC(position_refresh_us, "Shortest position refresh interval in us for streams without period wakeups (0 = off).");
+
+/* called with the stream lock held */
+static u64 snd_pcm_position_deadline(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t avail, wake, frames;
+	u64 ns;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		avail = snd_pcm_playback_avail(runtime);
+	else
+		avail = snd_pcm_capture_avail(runtime);
+
+	/* look again within a buffer time, whatever the thresholds */
+	frames = runtime->buffer_size;
+	wake = runtime->twake ? : runtime->control->avail_min;
+	if (avail < wake)
+		frames = min(frames, wake - avail);
+	if (runtime->status->state == SNDRV_PCM_STATE_DRAINING) {
+		if (avail < runtime->buffer_size)
+			frames = min(frames, runtime->buffer_size - avail);
+	} else if (avail < runtime->stop_threshold) {
+		frames = min(frames, runtime->stop_threshold - avail);
+	}
+
+	ns = div_u64((u64)frames * NSEC_PER_SEC, runtime->rate);
+	return max_t(u64, ns, position_refresh_us * 1000ULL);
+}
+
+static enum hrtimer_restart snd_pcm_position_refresh(struct hrtimer *timer)
+{
+	struct snd_pcm_substream *substream =
+		container_of(timer, struct snd_pcm_substream, position_timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	/*
+	 * A stop and start while we waited for the lock has queued the
+	 * timer again: leave it to that expiry, it must not be forwarded.
+	 */
+	if (hrtimer_is_queued(timer))
+		goto _end;
+	if (!substream->runtime || !snd_pcm_running(substream))
+		goto _end;
+	/* an xrun stops the stream, and the timer with it */
+	if (snd_pcm_update_hw_ptr(substream) < 0 || !position_refresh_us)
+		goto _end;
+	if (snd_pcm_running(substream)) {
+		hrtimer_forward_now(timer,
+			ns_to_ktime(snd_pcm_position_deadline(substream)));
+		ret = HRTIMER_RESTART;
+	}
+ _end:
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+	return ret;
+}
+
+void snd_pcm_position_timer_init(struct snd_pcm_substream *substream)
+{
+	hrtimer_init(&substream->position_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	substream->position_timer.function = snd_pcm_position_refresh;
+}
+
+/* called with the stream lock held */
+void snd_pcm_position_timer_start(struct snd_pcm_substream *substream)
+{
+	if (!substream->runtime->no_period_wakeup || !position_refresh_us ||
+	    !snd_pcm_running(substream))
+		return;
+	hrtimer_start(&substream->position_timer,
+		      ns_to_ktime(snd_pcm_position_deadline(substream)),
+		      HRTIMER_MODE_REL);
+}
+
+/*
+ * Called with the stream lock held by somebody about to wait for the
+ * stream: the application may have moved appl_ptr since the timer was
+ * armed, so the wakeup threshold can now come before it expires.
+ */
+void snd_pcm_position_timer_update(struct snd_pcm_substream *substream)
+{
+	struct hrtimer *timer = &substream->position_timer;
+	u64 ns;
+
+	if (!substream->runtime->no_period_wakeup || !position_refresh_us ||
+	    !snd_pcm_running(substream))
+		return;
+	ns = snd_pcm_position_deadline(substream);
+	if (hrtimer_is_queued(timer) &&
+	    ktime_to_ns(hrtimer_get_remaining(timer)) <= ns)
+		return;
+	hrtimer_start(timer, ns_to_ktime(ns), HRTIMER_MODE_REL);
+}
+
+/*
+ * Called with the stream lock held, so the timer callback may be
+ * spinning on it: don't wait for it, it won't restart once it sees the
+ * stream stopped, or the timer queued again by a restart.
+ * snd_pcm_detach_substream() does the final cancel.
+ */
+void snd_pcm_position_timer_stop(struct snd_pcm_substream *substream)
+{
+	hrtimer_try_to_cancel(&substream->position_timer);
+}
+
 /*
  * Wait until avail_min data becomes available
  * Returns a negative error code if any error occurs during operation.
@@ -1822,6 +1946,7 @@ static int wait_for_avail(struct snd_pcm_substream *substream,
 			avail = snd_pcm_capture_avail(runtime);
 		if (avail >= runtime->twake)
 			break;
+		snd_pcm_position_timer_update(substream);
 		snd_pcm_stream_unlock_irq(substream);
 
 		tout = schedule_timeout(wait_time);
@@ -35,6 +35,9 @@
 #include <sound/timer.h>
 #include <sound/minors.h>
 #include <asm/io.h>
+#ifdef CONFIG_ARM
+#include <asm/cachetype.h>
+#endif
 #if defined(CONFIG_MIPS) && defined(CONFIG_DMA_NONCOHERENT)
 #include <dma-coherence.h>
 #endif
@@ -877,6 +880,7 @@ static void snd_pcm_post_start(struct snd_pcm_substream *substream, int state)
 	if (substream->timer)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MSTART,
 				 &runtime->trigger_tstamp);
+	snd_pcm_position_timer_start(substream);
 }
 
 static struct action_ops snd_pcm_action_start = {
@@ -919,6 +923,7 @@ static int snd_pcm_do_stop(struct snd_pcm_substream *substream, int state)
 static void snd_pcm_post_stop(struct snd_pcm_substream *substream, int state)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_position_timer_stop(substream);
 	if (runtime->status->state != state) {
 		snd_pcm_trigger_tstamp(substream);
 		if (substream->timer)
@@ -1011,6 +1016,7 @@ static void snd_pcm_post_pause(struct snd_pcm_substream *substream, int push)
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	snd_pcm_trigger_tstamp(substream);
 	if (push) {
+		snd_pcm_position_timer_stop(substream);
 		runtime->status->state = SNDRV_PCM_STATE_PAUSED;
 		if (substream->timer)
 			snd_timer_notify(substream->timer,
@@ -1024,6 +1030,7 @@ static void snd_pcm_post_pause(struct snd_pcm_substream *substream, int push)
 			snd_timer_notify(substream->timer,
 					 SNDRV_TIMER_EVENT_MCONTINUE,
 					 &runtime->trigger_tstamp);
+		snd_pcm_position_timer_start(substream);
 	}
 }
 
@@ -1072,6 +1079,7 @@ static void snd_pcm_post_suspend(struct snd_pcm_substream *substream, int state)
 	if (substream->timer)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MSUSPEND,
 				 &runtime->trigger_tstamp);
+	snd_pcm_position_timer_stop(substream);
 	runtime->status->suspended_state = runtime->status->state;
 	runtime->status->state = SNDRV_PCM_STATE_SUSPENDED;
 	wake_up(&runtime->sleep);
@@ -1175,6 +1183,7 @@ static void snd_pcm_post_resume(struct snd_pcm_substream *substream, int state)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MRESUME,
 				 &runtime->trigger_tstamp);
 	runtime->status->state = runtime->status->suspended_state;
+	snd_pcm_position_timer_start(substream);
 }
 
 static struct action_ops snd_pcm_action_resume = {
@@ -2959,6 +2968,7 @@ static unsigned int snd_pcm_playback_poll(struct file *file, poll_table * wait)
 		}
 		/* Fall through */
 	case SNDRV_PCM_STATE_DRAINING:
+		snd_pcm_position_timer_update(substream);
 		mask = 0;
 		break;
 	default:
@@ -2996,6 +3006,7 @@ static unsigned int snd_pcm_capture_poll(struct file *file, poll_table * wait)
 			mask = POLLIN | POLLRDNORM;
 			break;
 		}
+		snd_pcm_position_timer_update(substream);
 		mask = 0;
 		break;
 	case SNDRV_PCM_STATE_DRAINING:
@@ -3019,8 +3030,18 @@ static unsigned int snd_pcm_capture_poll(struct file *file, poll_table * wait)
 /*
  * Only on coherent architectures, we can mmap the status and the control records
  * for effcient data transfer.  On others, we have to use HWSYNC ioctl...
+ *
+ * ARM is coherent enough when its data cache cannot alias: the user mapping
+ * of the status and control pages then hits the same cache lines as the
+ * kernel's linear mapping of them.
  */
 #if defined(CONFIG_X86) || defined(CONFIG_PPC) || defined(CONFIG_ALPHA)
+#define pcm_mmap_status_allowed()	1
+#elif defined(CONFIG_ARM)
+#define pcm_mmap_status_allowed()	(!cache_is_vivt() && !cache_is_vipt_aliasing())
+#endif
+
+#ifdef pcm_mmap_status_allowed
 /*
  * mmap status record
  */
@@ -3047,6 +3068,8 @@ static int snd_pcm_mmap_status(struct snd_pcm_substream *substream, struct file
 			       struct vm_area_struct *area)
 {
 	long size;
+	if (!pcm_mmap_status_allowed())
+		return -ENXIO;
 	if (!(area->vm_flags & VM_READ))
 		return -EINVAL;
 	size = area->vm_end - area->vm_start;
@@ -3084,6 +3107,8 @@ static int snd_pcm_mmap_control(struct snd_pcm_substream *substream, struct file
 				struct vm_area_struct *area)
 {
 	long size;
+	if (!pcm_mmap_status_allowed())
+		return -ENXIO;
 	if (!(area->vm_flags & VM_READ))
 		return -EINVAL;
 	size = area->vm_end - area->vm_start;
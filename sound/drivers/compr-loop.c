@@ -0,0 +1,594 @@
+/*
+ *  Compressed stream loopback soundcard
+ *
+ *  A software stand-in for a compress offload DSP: the stream written to
+ *  the compress playback device is "rendered" in real time at its sample
+ *  rate, and what is rendered comes out of the card's PCM capture device,
+ *  the way snd-aloop returns played samples.  Only PCM passthrough is
+ *  implemented - the point is to exercise the compress offload API, its
+ *  buffering, timestamps and wakeups, without the hardware.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include <sound/initval.h>
+#include <sound/compress_params.h>
+#include <sound/compress_offload.h>
+#include <sound/compress_driver.h>
+
+MODULE_DESCRIPTION("A compressed stream loopback soundcard");
+MODULE_LICENSE("GPL");
+MODULE_SUPPORTED_DEVICE("{{ALSA,Compressed loopback soundcard}}");
+
+#define MIN_FRAGMENT_SIZE	64
+#define MAX_FRAGMENT_SIZE	(64 * 1024)
+#define MIN_FRAGMENTS		2
+#define MAX_FRAGMENTS		64
+
+static int index = SNDRV_DEFAULT_IDX1;	/* Index 0-MAX */
+static char *id = SNDRV_DEFAULT_STR1;	/* ID for this card */
+
+module_param(index, int, 0444);
+MODULE_PARM_DESC(index, "Index value for compressed loopback soundcard.");
+module_param(id, charp, 0444);
+MODULE_PARM_DESC(id, "ID string for compressed loopback soundcard.");
+
+struct compr_loop {
+	struct snd_card *card;
+	struct snd_compr compr;
+	struct snd_pcm *pcm;
+	spinlock_t lock;		/* protects everything below */
+
+	/* compressed (playback) side */
+	struct snd_compr_stream *cstream;
+	struct hrtimer timer;
+	unsigned int rate;
+	unsigned int frame_bytes;
+	unsigned int no_wake;
+	ktime_t tick;			/* one fragment worth of time */
+	ktime_t base_time;		/* rendered up to here ... */
+	u64 written;			/* bytes made available by the app */
+	u64 consumed;			/* ... bytes rendered so far */
+	u64 woken;			/* fragment the app was last woken for */
+	snd_pcm_uframes_t io_frames;	/* frames that went to the output */
+	u64 tstamp;			/* ns, time consumed was updated at */
+	unsigned int running: 1;
+	unsigned int draining: 1;
+
+	/* PCM capture side, fed with what is rendered */
+	struct snd_pcm_substream *capture;
+	unsigned int cap_pos;		/* bytes, in the capture buffer */
+	unsigned int cap_period_pos;
+};
+
+static struct platform_device *device;
+
+/*
+ * Render the compressed stream up to @now: as much of it as its sample
+ * rate allows since the last update, limited by what has been written.
+ * Called with loop->lock held.  Returns true when a capture period is
+ * complete.
+ */
+static bool compr_loop_update(struct compr_loop *loop, ktime_t now)
+{
+	struct snd_compr_runtime *crt = loop->cstream->runtime;
+	struct snd_pcm_runtime *prt;
+	u64 frames, bytes, from;
+	unsigned int chunk, cap_bytes;
+	u32 off;
+	bool period = false;
+
+	if (!loop->running)
+		return false;
+
+	frames = div_u64(ktime_to_ns(ktime_sub(now, loop->base_time)) *
+			 loop->rate, NSEC_PER_SEC);
+	/* keep the remainder for the next update */
+	loop->base_time = ktime_add_ns(loop->base_time,
+				div_u64(frames * NSEC_PER_SEC, loop->rate));
+	bytes = frames * loop->frame_bytes;
+	if (bytes > loop->written - loop->consumed) {
+		/* underrun, or the end of a drain: nothing to play */
+		bytes = loop->written - loop->consumed;
+		loop->base_time = now;
+	}
+	if (!bytes)
+		goto out;
+
+	from = loop->consumed;
+	loop->consumed += bytes;
+	loop->io_frames += bytes / loop->frame_bytes;
+
+	if (!loop->capture)
+		goto out;
+	prt = loop->capture->runtime;
+	cap_bytes = frames_to_bytes(prt, prt->buffer_size);
+	while (bytes) {
+		div_u64_rem(from, crt->buffer_size, &off);
+		chunk = min_t(u64, bytes, crt->buffer_size - off);
+		chunk = min(chunk, cap_bytes - loop->cap_pos);
+		memcpy(prt->dma_area + loop->cap_pos, crt->buffer + off, chunk);
+		from += chunk;
+		bytes -= chunk;
+		loop->cap_pos += chunk;
+		if (loop->cap_pos == cap_bytes)
+			loop->cap_pos = 0;
+		loop->cap_period_pos += chunk;
+	}
+	if (loop->cap_period_pos >= frames_to_bytes(prt, prt->period_size)) {
+		loop->cap_period_pos %= frames_to_bytes(prt, prt->period_size);
+		period = true;
+	}
+ out:
+	loop->tstamp = ktime_to_ns(now);
+	return period;
+}
+
+static enum hrtimer_restart compr_loop_timer(struct hrtimer *timer)
+{
+	struct compr_loop *loop = container_of(timer, struct compr_loop, timer);
+	struct snd_pcm_substream *capture = NULL;
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	bool wake = false;
+	u64 fragment;
+
+	spin_lock(&loop->lock);
+	if (compr_loop_update(loop, hrtimer_cb_get_time(timer)))
+		capture = loop->capture;
+	fragment = div_u64(loop->consumed,
+			   loop->cstream->runtime->fragment_size);
+	if (fragment != loop->woken) {
+		loop->woken = fragment;
+		wake = !loop->no_wake;
+	}
+	if (loop->draining && loop->consumed == loop->written) {
+		loop->running = 0;
+		loop->draining = 0;
+		wake = true;
+		ret = HRTIMER_NORESTART;
+	} else {
+		hrtimer_forward_now(timer, loop->tick);
+	}
+	spin_unlock(&loop->lock);
+
+	if (wake)
+		snd_compr_fragment_elapsed(loop->cstream);
+	if (capture)
+		snd_pcm_period_elapsed(capture);
+	return ret;
+}
+
+/*
+ * compress offload callbacks
+ */
+static int compr_loop_open(struct snd_compr_stream *stream)
+{
+	struct compr_loop *loop = stream->private_data;
+	int err = 0;
+
+	spin_lock_irq(&loop->lock);
+	if (loop->cstream)
+		err = -EBUSY;
+	else
+		loop->cstream = stream;
+	spin_unlock_irq(&loop->lock);
+	return err;
+}
+
+static int compr_loop_free(struct snd_compr_stream *stream)
+{
+	struct compr_loop *loop = stream->private_data;
+
+	hrtimer_cancel(&loop->timer);
+	spin_lock_irq(&loop->lock);
+	loop->running = 0;
+	loop->cstream = NULL;
+	spin_unlock_irq(&loop->lock);
+	return 0;
+}
+
+static int compr_loop_set_params(struct snd_compr_stream *stream,
+				 struct snd_compr_params *params)
+{
+	struct compr_loop *loop = stream->private_data;
+	struct snd_codec *codec = &params->codec;
+	u32 frag = params->buffer.fragment_size;
+
+	if (codec->id != SND_AUDIOCODEC_PCM ||
+	    codec->ch_in < 1 || codec->ch_in > 2 ||
+	    codec->sample_rate < 8000 || codec->sample_rate > 192000 ||
+	    (codec->format &&
+	     codec->format != (__force u32)SNDRV_PCM_FORMAT_S16_LE))
+		return -EINVAL;
+	if (frag < MIN_FRAGMENT_SIZE || frag > MAX_FRAGMENT_SIZE ||
+	    params->buffer.fragments < MIN_FRAGMENTS ||
+	    params->buffer.fragments > MAX_FRAGMENTS)
+		return -EINVAL;
+
+	spin_lock_irq(&loop->lock);
+	loop->rate = codec->sample_rate;
+	loop->frame_bytes = codec->ch_in * 2;
+	loop->no_wake = params->no_wake_mode;
+	loop->tick = ns_to_ktime(div_u64((u64)frag * NSEC_PER_SEC,
+					 loop->rate * loop->frame_bytes));
+	loop->written = loop->consumed = loop->woken = 0;
+	loop->io_frames = 0;
+	spin_unlock_irq(&loop->lock);
+	return 0;
+}
+
+static int compr_loop_get_params(struct snd_compr_stream *stream,
+				 struct snd_codec *params)
+{
+	struct compr_loop *loop = stream->private_data;
+
+	memset(params, 0, sizeof(*params));
+	params->id = SND_AUDIOCODEC_PCM;
+	params->ch_in = params->ch_out = loop->frame_bytes / 2;
+	params->sample_rate = loop->rate;
+	params->format = (__force u32)SNDRV_PCM_FORMAT_S16_LE;
+	params->align = loop->frame_bytes;
+	return 0;
+}
+
+static int compr_loop_trigger(struct snd_compr_stream *stream, int cmd)
+{
+	struct compr_loop *loop = stream->private_data;
+	bool start = false;
+
+	if (cmd == SNDRV_PCM_TRIGGER_STOP ||
+	    cmd == SNDRV_PCM_TRIGGER_PAUSE_PUSH)
+		hrtimer_cancel(&loop->timer);
+
+	spin_lock_irq(&loop->lock);
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		loop->running = 1;
+		loop->draining = 0;
+		loop->base_time = ktime_get();
+		start = true;
+		break;
+	case SND_COMPR_TRIGGER_DRAIN:
+		if (!loop->running) {
+			spin_unlock_irq(&loop->lock);
+			return -EBADFD;
+		}
+		loop->draining = 1;
+		break;
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		compr_loop_update(loop, ktime_get());
+		loop->running = 0;
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+		/* whatever is left in the buffer is dropped */
+		loop->running = 0;
+		loop->draining = 0;
+		loop->consumed = loop->written;
+		break;
+	default:
+		spin_unlock_irq(&loop->lock);
+		return -EINVAL;
+	}
+	spin_unlock_irq(&loop->lock);
+
+	if (start)
+		hrtimer_start(&loop->timer, loop->tick, HRTIMER_MODE_REL);
+	return 0;
+}
+
+static int compr_loop_pointer(struct snd_compr_stream *stream,
+			      struct snd_compr_tstamp *tstamp)
+{
+	struct compr_loop *loop = stream->private_data;
+	struct snd_pcm_substream *capture = NULL;
+	u32 offset;
+
+	/* no parameters yet, nothing to report */
+	if (!stream->runtime->buffer_size) {
+		memset(tstamp, 0, sizeof(*tstamp));
+		return 0;
+	}
+
+	spin_lock_irq(&loop->lock);
+	if (compr_loop_update(loop, ktime_get()))
+		capture = loop->capture;
+	div_u64_rem(loop->consumed, stream->runtime->buffer_size, &offset);
+	tstamp->byte_offset = offset;
+	tstamp->copied_total = loop->consumed;
+	tstamp->pcm_frames = div_u64(loop->consumed, loop->frame_bytes);
+	tstamp->pcm_io_frames = loop->io_frames;
+	tstamp->sampling_rate = loop->rate;
+	tstamp->timestamp = loop->tstamp;
+	spin_unlock_irq(&loop->lock);
+
+	if (capture)
+		snd_pcm_period_elapsed(capture);
+	return 0;
+}
+
+static int compr_loop_ack(struct snd_compr_stream *stream, size_t bytes)
+{
+	struct compr_loop *loop = stream->private_data;
+
+	spin_lock_irq(&loop->lock);
+	loop->written += bytes;
+	spin_unlock_irq(&loop->lock);
+	return 0;
+}
+
+static int compr_loop_get_caps(struct snd_compr_stream *stream,
+			       struct snd_compr_caps *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	caps->num_codecs = 1;
+	caps->direction = SND_COMPRESS_PLAYBACK;
+	caps->min_fragment_size = MIN_FRAGMENT_SIZE;
+	caps->max_fragment_size = MAX_FRAGMENT_SIZE;
+	caps->min_fragments = MIN_FRAGMENTS;
+	caps->max_fragments = MAX_FRAGMENTS;
+	caps->codecs[0] = SND_AUDIOCODEC_PCM;
+	return 0;
+}
+
+static int compr_loop_get_codec_caps(struct snd_compr_stream *stream,
+				     struct snd_compr_codec_caps *codec)
+{
+	if (codec->codec != SND_AUDIOCODEC_PCM)
+		return -EINVAL;
+	memset(codec->descriptor, 0, sizeof(codec->descriptor));
+	codec->num_descriptors = 1;
+	codec->descriptor[0].max_ch = 2;
+	codec->descriptor[0].sample_rates = SNDRV_PCM_RATE_8000_192000;
+	codec->descriptor[0].min_buffer = MIN_FRAGMENT_SIZE * MIN_FRAGMENTS;
+	return 0;
+}
+
+static struct snd_compr_ops compr_loop_compr_ops = {
+	.open =			compr_loop_open,
+	.free =			compr_loop_free,
+	.set_params =		compr_loop_set_params,
+	.get_params =		compr_loop_get_params,
+	.trigger =		compr_loop_trigger,
+	.pointer =		compr_loop_pointer,
+	.ack =			compr_loop_ack,
+	.get_caps =		compr_loop_get_caps,
+	.get_codec_caps =	compr_loop_get_codec_caps,
+};
+
+/*
+ * PCM capture callbacks
+ */
+static struct snd_pcm_hardware compr_loop_pcm_hardware = {
+	.info =		(SNDRV_PCM_INFO_INTERLEAVED | SNDRV_PCM_INFO_MMAP |
+			 SNDRV_PCM_INFO_MMAP_VALID),
+	.formats =	SNDRV_PCM_FMTBIT_S16_LE,
+	.rates =	SNDRV_PCM_RATE_CONTINUOUS | SNDRV_PCM_RATE_8000_192000,
+	.rate_min =	8000,
+	.rate_max =	192000,
+	.channels_min =	1,
+	.channels_max =	2,
+	.buffer_bytes_max =	2 * 1024 * 1024,
+	.period_bytes_min =	64,
+	.period_bytes_max =	1024 * 1024,
+	.periods_min =	1,
+	.periods_max =	1024,
+	.fifo_size =	0,
+};
+
+static int compr_loop_pcm_open(struct snd_pcm_substream *substream)
+{
+	struct compr_loop *loop = snd_pcm_substream_chip(substream);
+
+	substream->runtime->hw = compr_loop_pcm_hardware;
+	/* the capture gets the compressed stream's bytes as they are */
+	spin_lock_irq(&loop->lock);
+	if (loop->rate) {
+		substream->runtime->hw.rate_min = loop->rate;
+		substream->runtime->hw.rate_max = loop->rate;
+		substream->runtime->hw.channels_min = loop->frame_bytes / 2;
+		substream->runtime->hw.channels_max = loop->frame_bytes / 2;
+	}
+	spin_unlock_irq(&loop->lock);
+	return 0;
+}
+
+static int compr_loop_pcm_close(struct snd_pcm_substream *substream)
+{
+	return 0;
+}
+
+static int compr_loop_pcm_hw_params(struct snd_pcm_substream *substream,
+				    struct snd_pcm_hw_params *params)
+{
+	return snd_pcm_lib_alloc_vmalloc_buffer(substream,
+						params_buffer_bytes(params));
+}
+
+static int compr_loop_pcm_hw_free(struct snd_pcm_substream *substream)
+{
+	return snd_pcm_lib_free_vmalloc_buffer(substream);
+}
+
+static int compr_loop_pcm_prepare(struct snd_pcm_substream *substream)
+{
+	struct compr_loop *loop = snd_pcm_substream_chip(substream);
+
+	spin_lock_irq(&loop->lock);
+	loop->cap_pos = 0;
+	loop->cap_period_pos = 0;
+	spin_unlock_irq(&loop->lock);
+	return 0;
+}
+
+static int compr_loop_pcm_trigger(struct snd_pcm_substream *substream,
+				  int cmd)
+{
+	struct compr_loop *loop = snd_pcm_substream_chip(substream);
+
+	spin_lock(&loop->lock);
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+		loop->capture = substream;
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		loop->capture = NULL;
+		break;
+	default:
+		spin_unlock(&loop->lock);
+		return -EINVAL;
+	}
+	spin_unlock(&loop->lock);
+	return 0;
+}
+
+static snd_pcm_uframes_t
+compr_loop_pcm_pointer(struct snd_pcm_substream *substream)
+{
+	struct compr_loop *loop = snd_pcm_substream_chip(substream);
+	unsigned int pos;
+
+	spin_lock(&loop->lock);
+	if (loop->cstream)
+		compr_loop_update(loop, ktime_get());
+	pos = loop->cap_pos;
+	spin_unlock(&loop->lock);
+	return bytes_to_frames(substream->runtime, pos);
+}
+
+static struct snd_pcm_ops compr_loop_pcm_ops = {
+	.open =		compr_loop_pcm_open,
+	.close =	compr_loop_pcm_close,
+	.ioctl =	snd_pcm_lib_ioctl,
+	.hw_params =	compr_loop_pcm_hw_params,
+	.hw_free =	compr_loop_pcm_hw_free,
+	.prepare =	compr_loop_pcm_prepare,
+	.trigger =	compr_loop_pcm_trigger,
+	.pointer =	compr_loop_pcm_pointer,
+	.page =		snd_pcm_lib_get_vmalloc_page,
+	.mmap =		snd_pcm_lib_mmap_vmalloc,
+};
+
+static int __devinit compr_loop_probe(struct platform_device *devptr)
+{
+	struct snd_card *card;
+	struct compr_loop *loop;
+	struct snd_pcm *pcm;
+	int err;
+
+	err = snd_card_create(index, id, THIS_MODULE,
+			      sizeof(struct compr_loop), &card);
+	if (err < 0)
+		return err;
+	loop = card->private_data;
+	loop->card = card;
+	spin_lock_init(&loop->lock);
+	hrtimer_init(&loop->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	loop->timer.function = compr_loop_timer;
+
+	err = snd_pcm_new(card, "Compress Loopback PCM", 0, 0, 1, &pcm);
+	if (err < 0)
+		goto __nodev;
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &compr_loop_pcm_ops);
+	pcm->private_data = loop;
+	pcm->info_flags = 0;
+	strcpy(pcm->name, "Compress Loopback PCM");
+	loop->pcm = pcm;
+
+	loop->compr.name = "Compress Loopback";
+	loop->compr.dev = &devptr->dev;
+	loop->compr.ops = &compr_loop_compr_ops;
+	loop->compr.private_data = loop;
+	err = snd_compress_new(card, 0, SND_COMPRESS_PLAYBACK, &loop->compr);
+	if (err < 0)
+		goto __nodev;
+
+	strcpy(card->driver, "ComprLoop");
+	strcpy(card->shortname, "Compress Loopback");
+	strcpy(card->longname, "Compress Loopback 1");
+	snd_card_set_dev(card, &devptr->dev);
+	/* registers the card, with the PCM and the compressed device */
+	err = snd_compress_register(&loop->compr);
+	if (!err) {
+		platform_set_drvdata(devptr, card);
+		return 0;
+	}
+      __nodev:
+	snd_card_free(card);
+	return err;
+}
+
+static int __devexit compr_loop_remove(struct platform_device *devptr)
+{
+	struct snd_card *card = platform_get_drvdata(devptr);
+	struct compr_loop *loop = card->private_data;
+
+	/* frees the card */
+	snd_compress_deregister(&loop->compr);
+	platform_set_drvdata(devptr, NULL);
+	return 0;
+}
+
+#define SND_COMPR_LOOP_DRIVER	"snd_compr_loop"
+
+static struct platform_driver compr_loop_driver = {
+	.probe		= compr_loop_probe,
+	.remove		= __devexit_p(compr_loop_remove),
+	.driver		= {
+		.name	= SND_COMPR_LOOP_DRIVER
+	},
+};
+
+static int __init alsa_card_compr_loop_init(void)
+{
+	int err;
+
+	err = platform_driver_register(&compr_loop_driver);
+	if (err < 0)
+		return err;
+
+	device = platform_device_register_simple(SND_COMPR_LOOP_DRIVER, 0,
+						 NULL, 0);
+	if (IS_ERR(device)) {
+		platform_driver_unregister(&compr_loop_driver);
+		return PTR_ERR(device);
+	}
+	if (!platform_get_drvdata(device)) {
+		platform_device_unregister(device);
+		platform_driver_unregister(&compr_loop_driver);
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static void __exit alsa_card_compr_loop_exit(void)
+{
+	platform_device_unregister(device);
+	platform_driver_unregister(&compr_loop_driver);
+}
+
+module_init(alsa_card_compr_loop_init)
+module_exit(alsa_card_compr_loop_exit)
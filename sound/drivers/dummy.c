@@ -397,7 +397,10 @@ static int dummy_hrtimer_start(struct snd_pcm_substream *substream)
 	struct dummy_hrtimer_pcm *dpcm = substream->runtime->private_data;
 
 	dpcm->base_time = hrtimer_cb_get_time(&dpcm->timer);
-	hrtimer_start(&dpcm->timer, dpcm->period_time, HRTIMER_MODE_REL);
+	/* the position is computed from the clock: no ticks needed for it */
+	if (!substream->runtime->no_period_wakeup)
+		hrtimer_start(&dpcm->timer, dpcm->period_time,
+			      HRTIMER_MODE_REL);
 	atomic_set(&dpcm->running, 1);
 	return 0;
 }
@@ -574,6 +577,10 @@ static int dummy_pcm_open(struct snd_pcm_substream *substream)
 		return err;
 
 	runtime->hw = dummy->pcm_hw;
+#ifdef CONFIG_HIGH_RES_TIMERS
+	if (hrtimer)
+		runtime->hw.info |= SNDRV_PCM_INFO_NO_PERIOD_WAKEUP;
+#endif
 	if (substream->pcm->device & 1) {
 		runtime->hw.info &= ~SNDRV_PCM_INFO_INTERLEAVED;
 		runtime->hw.info |= SNDRV_PCM_INFO_NONINTERLEAVED;
@@ -0,0 +1,319 @@
+/*
+ *
+ * profile-callchain.c
+ *
+ * callchain: cost of sampling callchains on a running task
+ *
+ * Runs a workload of deep call paths for a fixed time while it is
+ * being sampled, once per sampling mode, and reports how much of the
+ * workload's throughput each mode costs and how much it writes into
+ * the ring buffer per sample:
+ *
+ *   off          - no sampling, the baseline
+ *   ip           - PERF_SAMPLE_IP only
+ *   callchain    - full kernel + user callchains
+ *   callchain-id - the same callchains, written once and referred
+ *                  to by id (attr.callchain_id)
+ *   user-stack   - kernel callchains plus a copy of the top of the
+ *                  user stack and registers, for unwinding offline
+ *                  (PERF_SAMPLE_STACK_USER, exclude_callchain_user)
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static int freq = 1000;
+static int seconds = 2;
+static int depth = 32;
+static int paths = 64;
+static int stack_size = 4096;
+static unsigned int page_size;
+
+static const struct option options[] = {
+	OPT_INTEGER('F', "freq", &freq,
+		    "Sampling frequency in Hz"),
+	OPT_INTEGER('s', "seconds", &seconds,
+		    "Seconds to run each mode"),
+	OPT_INTEGER('d', "depth", &depth,
+		    "Depth of the call paths"),
+	OPT_INTEGER('p', "paths", &paths,
+		    "Number of distinct call paths"),
+	OPT_INTEGER('S', "stack-size", &stack_size,
+		    "Bytes of user stack to copy in user-stack mode"),
+	OPT_END()
+};
+
+static const char * const bench_profile_callchain_usage[] = {
+	"perf bench profile callchain <options>",
+	NULL
+};
+
+#define DATA_PAGES	64
+
+#ifdef __arm__
+/* fp, sp, lr, pc: enough to start unwinding from */
+#define USER_REGS	((1ULL << 11) | (1ULL << 13) | (1ULL << 14) | (1ULL << 15))
+#else
+#define USER_REGS	0ULL
+#endif
+
+enum {
+	MODE_OFF,
+	MODE_IP,
+	MODE_CALLCHAIN,
+	MODE_CALLCHAIN_ID,
+	MODE_USER_STACK,
+	NR_MODES,
+};
+
+static const char * const mode_names[NR_MODES] = {
+	"off", "ip", "callchain", "callchain-id", "user-stack",
+};
+
+struct result {
+	unsigned long long	loops;
+	unsigned long long	samples;
+	unsigned long long	chains;		/* PERF_RECORD_CALLCHAIN */
+	unsigned long long	lost;
+	unsigned long long	bytes;
+	int			unsupported;
+};
+
+static volatile unsigned long sink;
+
+static unsigned long walk(int d, unsigned long path);
+
+/* two functions so that every path has its own return addresses */
+static unsigned long __attribute__((noinline)) walk_a(int d, unsigned long path)
+{
+	return walk(d - 1, path) + 1;
+}
+
+static unsigned long __attribute__((noinline)) walk_b(int d, unsigned long path)
+{
+	return walk(d - 1, path) + 2;
+}
+
+static unsigned long __attribute__((noinline)) walk(int d, unsigned long path)
+{
+	unsigned long v = 0;
+	int i;
+
+	if (!d) {
+		for (i = 0; i < 64; i++)
+			v += i * path;
+		return v;
+	}
+	if ((path >> ((d - 1) % (sizeof(path) * 8))) & 1)
+		return walk_a(d, path);
+	return walk_b(d, path);
+}
+
+static void setup_attr(struct perf_event_attr *attr, int mode)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = PERF_TYPE_SOFTWARE;
+	attr->config = PERF_COUNT_SW_CPU_CLOCK;
+	attr->freq = 1;
+	attr->sample_freq = freq;
+	attr->sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+	attr->disabled = 1;
+
+	switch (mode) {
+	case MODE_CALLCHAIN_ID:
+		attr->callchain_id = 1;
+		/* fall through */
+	case MODE_CALLCHAIN:
+		attr->sample_type |= PERF_SAMPLE_CALLCHAIN;
+		break;
+	case MODE_USER_STACK:
+		attr->sample_type |= PERF_SAMPLE_CALLCHAIN |
+				     PERF_SAMPLE_REGS_USER |
+				     PERF_SAMPLE_STACK_USER;
+		attr->exclude_callchain_user = 1;
+		attr->sample_regs_user = USER_REGS;
+		attr->sample_stack_user = stack_size;
+		break;
+	default:
+		break;
+	}
+}
+
+/* consume everything in the buffer, counting records and bytes */
+static void drain(struct perf_event_mmap_page *pc, struct result *res)
+{
+	unsigned char *data = (unsigned char *)pc + page_size;
+	unsigned long mask = DATA_PAGES * page_size - 1;
+	u64 head, tail = pc->data_tail;
+	struct perf_event_header *hdr;
+	unsigned char copy[sizeof(*hdr)];
+	unsigned long off;
+	unsigned int i;
+
+	head = pc->data_head;
+	rmb();
+
+	while (tail < head) {
+		off = tail & mask;
+		hdr = (struct perf_event_header *)(data + off);
+		if (off + sizeof(*hdr) > mask + 1) {
+			for (i = 0; i < sizeof(*hdr); i++)
+				copy[i] = data[(off + i) & mask];
+			hdr = (struct perf_event_header *)copy;
+		}
+
+		switch (hdr->type) {
+		case PERF_RECORD_SAMPLE:
+			res->samples++;
+			break;
+		case PERF_RECORD_CALLCHAIN:
+			res->chains++;
+			break;
+		case PERF_RECORD_LOST:
+			res->lost++;
+			break;
+		default:
+			break;
+		}
+		res->bytes += hdr->size;
+		tail += hdr->size;
+	}
+
+	pc->data_tail = tail;
+}
+
+static int run(int mode, struct result *res)
+{
+	struct perf_event_attr attr;
+	struct perf_event_mmap_page *pc = NULL;
+	size_t len = (DATA_PAGES + 1) * page_size;
+	unsigned long long end;
+	unsigned long path = 0;
+	int fd = -1;
+
+	memset(res, 0, sizeof(*res));
+
+	if (mode != MODE_OFF) {
+		setup_attr(&attr, mode);
+		fd = sys_perf_event_open(&attr, 0, -1, -1, 0);
+		if (fd < 0) {
+			if (errno != EINVAL && errno != ENOSYS &&
+			    errno != E2BIG && errno != EOPNOTSUPP) {
+				fprintf(stderr, "perf_event_open: %s\n",
+					strerror(errno));
+				return -1;
+			}
+			res->unsupported = 1;
+			return 0;
+		}
+
+		pc = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  fd, 0);
+		if (pc == MAP_FAILED) {
+			fprintf(stderr, "mmap: %s\n", strerror(errno));
+			close(fd);
+			return -1;
+		}
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	end = rdclock() + seconds * 1000000000ULL;
+	while (rdclock() < end) {
+		int i;
+
+		for (i = 0; i < 100; i++) {
+			sink += walk(depth, path);
+			if (++path >= (unsigned long)paths)
+				path = 0;
+		}
+		res->loops += i;
+		if (pc)
+			drain(pc, res);
+	}
+
+	if (pc) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		drain(pc, res);
+		munmap(pc, len);
+		close(fd);
+	}
+
+	return 0;
+}
+
+int bench_profile_callchain(int argc, const char **argv,
+			    const char *prefix __used)
+{
+	struct result res[NR_MODES];
+	double overhead;
+	int mode;
+
+	argc = parse_options(argc, argv, options,
+			     bench_profile_callchain_usage, 0);
+
+	if (freq < 1 || seconds < 1 || depth < 1 || paths < 1) {
+		usage_with_options(bench_profile_callchain_usage, options);
+		return 1;
+	}
+	stack_size &= ~7;
+	page_size = sysconf(_SC_PAGE_SIZE);
+
+	for (mode = 0; mode < NR_MODES; mode++)
+		if (run(mode, &res[mode]))
+			return 1;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d Hz for %d sec, call depth %d, %d distinct paths\n\n"
+		       " %14s %10s %10s %10s %14s %10s\n",
+		       freq, seconds, depth, paths,
+		       "mode", "samples", "callchains", "lost",
+		       "bytes/sample", "overhead");
+
+	for (mode = 0; mode < NR_MODES; mode++) {
+		struct result *r = &res[mode];
+
+		overhead = 100.0 * (1.0 - (double)r->loops / res[MODE_OFF].loops);
+
+		switch (bench_format) {
+		case BENCH_FORMAT_DEFAULT:
+			if (r->unsupported) {
+				printf(" %14s %s\n", mode_names[mode],
+				       "not supported by this kernel");
+				break;
+			}
+			printf(" %14s %10llu %10llu %10llu %14.1f %9.2f%%\n",
+			       mode_names[mode], r->samples, r->chains,
+			       r->lost,
+			       r->samples ? (double)r->bytes / r->samples : 0.0,
+			       overhead);
+			break;
+
+		case BENCH_FORMAT_SIMPLE:
+			printf("%s %.2f\n", mode_names[mode],
+			       r->unsupported ? 0.0 : overhead);
+			break;
+
+		default:
+			/* reaching here is something disaster */
+			fprintf(stderr, "Unknown format:%d\n", bench_format);
+			exit(1);
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  profile ... cost of sampling callchains
  *
  */
 
@@ -61,6 +62,16 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite profile_suites[] = {
+	{ "callchain",
+	  "Cost of sampling callchains, by callchain mode",
+	  bench_profile_callchain },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                    }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +85,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "profile",
+	  "sampling overhead",
+	  profile_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
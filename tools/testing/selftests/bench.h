@@ -0,0 +1,89 @@
+/*
+ * Clocks and a thread runner for the selftests that time something.
+ *
+ * Include it after the system headers (and after _GNU_SOURCE, where a
+ * test defines that).  run_threads() needs -lpthread.
+ */
+#ifndef __SELFTESTS_BENCH_H
+#define __SELFTESTS_BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+static inline double clock_now(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Wall clock seconds, for intervals */
+static inline double now(void)
+{
+	return clock_now(CLOCK_MONOTONIC);
+}
+
+/* Seconds of cpu time used by all threads of the process */
+static inline double cpu_now(void)
+{
+	return clock_now(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/* Context switches of the calling thread, voluntary or not */
+static inline long wakeups(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+/*
+ * Run fn in nr threads, the i-th one on arg + i * size, and return how
+ * many seconds they took.  With seconds > 0, *stop is cleared first and
+ * set after that long, and the threads are expected to return once they
+ * see it; otherwise they run until they are done and stop may be NULL.
+ */
+static inline double run_threads(int nr, void *(*fn)(void *), void *arg,
+				 size_t size, int seconds, volatile int *stop)
+{
+	pthread_t *threads;
+	double t;
+	int i, err;
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		exit(1);
+	}
+
+	if (seconds > 0)
+		*stop = 0;
+	t = now();
+	for (i = 0; i < nr; i++) {
+		err = pthread_create(&threads[i], NULL, fn,
+				     (char *)arg + i * size);
+		if (err) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(err));
+			exit(1);
+		}
+	}
+	if (seconds > 0) {
+		sleep(seconds);
+		*stop = 1;
+	}
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+	t = now() - t;
+
+	free(threads);
+	return t;
+}
+
+#endif /* __SELFTESTS_BENCH_H */
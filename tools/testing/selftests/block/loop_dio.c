@@ -0,0 +1,197 @@
+/*
+ * A loop device on an image file, buffered and then in direct I/O mode
+ * (LOOP_SET_DIRECT_IO), like fio with numjobs=N, rw=randrw, direct=1 on
+ * /dev/loopN: how many 4k random reads and writes per second each mode
+ * does, and how much the page cache grew while doing them.
+ *
+ * In buffered mode loop_thread does one bio at a time, and every block
+ * read or written through the loop device is cached twice: once for
+ * /dev/loopN and once for the image file.  In direct I/O mode the image
+ * file's copy goes away and several bios are in flight at once.
+ *
+ *	./loop_dio /data/loop_dio.img 512 16
+ *
+ * Needs root, and a filesystem under the image that supports O_DIRECT.
+ *
+ * Usage: loop_dio <image> [size in MB] [threads] [seconds]  (default: 256 8 10)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/loop.h>
+
+#include "../bench.h"
+
+#ifndef LOOP_SET_DIRECT_IO
+#define LOOP_SET_DIRECT_IO	0x4C08
+#endif
+
+#define BS	4096
+
+static char dev[64];
+static unsigned long long nr_blocks;
+static volatile int stop;
+
+struct worker {
+	unsigned int seed;
+	unsigned long count;
+};
+
+/* "Cached:" from /proc/meminfo, in kB */
+static long cached_kb(void)
+{
+	char line[256];
+	long kb = -1;
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "Cached: %ld kB", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+static void drop_caches(void)
+{
+	int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+
+	sync();
+	if (fd >= 0) {
+		if (write(fd, "3", 1) != 1)
+			perror("drop_caches");
+		close(fd);
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long block;
+	void *buf;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_DIRECT);
+	if (fd < 0 || posix_memalign(&buf, BS, BS)) {
+		perror(dev);
+		exit(1);
+	}
+	memset(buf, 0x5a, BS);
+
+	while (!stop) {
+		block = ((unsigned long long)rand_r(&w->seed) << 31 |
+			 rand_r(&w->seed)) % nr_blocks;
+		if (rand_r(&w->seed) & 1) {
+			if (pwrite(fd, buf, BS, block * BS) != BS) {
+				perror("pwrite");
+				exit(1);
+			}
+		} else {
+			if (pread(fd, buf, BS, block * BS) != BS) {
+				perror("pread");
+				exit(1);
+			}
+		}
+		w->count++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void run(const char *mode, int nr_threads, int seconds)
+{
+	struct worker *workers;
+	unsigned long total = 0;
+	long cached;
+	double t;
+	int i;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		exit(1);
+	}
+
+	drop_caches();
+	cached = cached_kb();
+	for (i = 0; i < nr_threads; i++)
+		workers[i].seed = i + 1;
+	t = run_threads(nr_threads, worker, workers, sizeof(*workers),
+			seconds, &stop);
+	for (i = 0; i < nr_threads; i++)
+		total += workers[i].count;
+
+	printf("%-8s: %10.0f IOPS, page cache +%ld kB\n",
+	       mode, total / t, cached_kb() - cached);
+	free(workers);
+}
+
+int main(int argc, char **argv)
+{
+	int ctl, lo, img, nr, nr_threads, seconds;
+	long size_mb;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: loop_dio <image> [size in MB] [threads] [seconds]\n");
+		exit(1);
+	}
+	size_mb = argc > 2 ? strtol(argv[2], NULL, 0) : 256;
+	nr_threads = argc > 3 ? atoi(argv[3]) : 8;
+	seconds = argc > 4 ? atoi(argv[4]) : 10;
+	nr_blocks = size_mb * 1024 * 1024 / BS;
+	if (!nr_blocks || nr_threads < 1) {
+		fprintf(stderr, "nothing to do\n");
+		exit(1);
+	}
+
+	img = open(argv[1], O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (img < 0 || ftruncate(img, size_mb * 1024 * 1024)) {
+		perror(argv[1]);
+		exit(1);
+	}
+
+	ctl = open("/dev/loop-control", O_RDWR);
+	if (ctl < 0) {
+		perror("/dev/loop-control");
+		goto out_unlink;
+	}
+	nr = ioctl(ctl, LOOP_CTL_GET_FREE);
+	close(ctl);
+	if (nr < 0) {
+		perror("LOOP_CTL_GET_FREE");
+		goto out_unlink;
+	}
+	snprintf(dev, sizeof(dev), "/dev/loop%d", nr);
+	lo = open(dev, O_RDWR);
+	if (lo < 0 || ioctl(lo, LOOP_SET_FD, img)) {
+		perror(dev);
+		goto out_unlink;
+	}
+
+	run("buffered", nr_threads, seconds);
+
+	if (ioctl(lo, LOOP_SET_DIRECT_IO, 1)) {
+		if (errno == EINVAL || errno == ENOTTY)
+			printf("direct  : not supported [SKIP]\n");
+		else
+			perror("LOOP_SET_DIRECT_IO");
+	} else {
+		run("direct", nr_threads, seconds);
+	}
+
+	ioctl(lo, LOOP_CLR_FD, 0);
+	close(lo);
+out_unlink:
+	close(img);
+	unlink(argv[1]);
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Random read IOPS against a block device (or a file) with O_DIRECT, at
+ * 1, 2, 4, ... up to one thread per cpu, each thread with one read in
+ * flight and pinned to its own cpu, like fio's psync engine does with
+ * numjobs=1..N.
+ *
+ * Run in a guest on a virtio disk backed by something fast (tmpfs, a
+ * ramdisk, NVMe):
+ *
+ *	./rand_read /dev/vdb
+ *
+ * With a single virtqueue every submission and completion takes the same
+ * lock and every interrupt lands on one cpu, so IOPS stop scaling after
+ * a couple of threads; with a virtqueue per cpu they should keep going up
+ * until the host runs out of iothreads.
+ *
+ * Usage: rand_read <dev or file> [block size] [seconds per step]  (default: 4096 5)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "../bench.h"
+
+static const char *path;
+static long bs;
+static unsigned long long nr_blocks;
+static volatile int stop;
+
+struct worker {
+	int cpu;
+	unsigned long count;
+};
+
+static void *reader(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->cpu + 1;
+	unsigned long long block;
+	cpu_set_t set;
+	void *buf;
+	int fd;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || posix_memalign(&buf, 4096, bs)) {
+		perror(path);
+		exit(1);
+	}
+
+	while (!stop) {
+		block = ((unsigned long long)rand_r(&seed) << 31 |
+			 rand_r(&seed)) % nr_blocks;
+		if (pread(fd, buf, bs, block * bs) != bs) {
+			perror("pread");
+			exit(1);
+		}
+		w->count++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static double run(int nr_threads, int seconds)
+{
+	struct worker *workers;
+	unsigned long total = 0;
+	double t;
+	int i;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		workers[i].cpu = i;
+	t = run_threads(nr_threads, reader, workers, sizeof(*workers),
+			seconds, &stop);
+	for (i = 0; i < nr_threads; i++)
+		total += workers[i].count;
+
+	free(workers);
+	return total / t;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size;
+	int seconds, nr_cpus, n, fd;
+	struct stat st;
+	double iops, one = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: rand_read <dev or file> [block size] [seconds per step]\n");
+		exit(1);
+	}
+	path = argv[1];
+	bs = argc > 2 ? strtol(argv[2], NULL, 0) : 4096;
+	seconds = argc > 3 ? atoi(argv[3]) : 5;
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		exit(1);
+	}
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size)) {
+			perror("BLKGETSIZE64");
+			exit(1);
+		}
+	} else {
+		size = st.st_size;
+	}
+	close(fd);
+
+	if (bs < 512 || bs % 512 || size < (unsigned long long)bs) {
+		fprintf(stderr, "%s: too small for %ld byte blocks\n", path, bs);
+		exit(1);
+	}
+	nr_blocks = size / bs;
+
+	for (n = 1; ; n *= 2) {
+		if (n > nr_cpus)
+			n = nr_cpus;
+		iops = run(n, seconds);
+		if (n == 1)
+			one = iops;
+		printf("%3d threads: %10.0f IOPS (x%.2f)\n", n, iops, iops / one);
+		if (n == nr_cpus)
+			break;
+	}
+	return 0;
+}
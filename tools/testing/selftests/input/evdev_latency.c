@@ -0,0 +1,243 @@
+/*
+ * Feed multitouch frames into a uinput device and read them back from its
+ * evdev node, measuring how long a frame takes from the moment the input
+ * core timestamps it to the moment the reader has it, and how many frames
+ * per second make it through.
+ *
+ * Every frame moves each of the given number of fingers, so it carries
+ * four events per finger (slot, tracking id, x, y) plus SYN_REPORT.  With
+ * evdev passing whole frames, the reader is woken once per frame and gets
+ * the frame in one read(); the "reads/frame" column shows it.
+ *
+ *	./evdev_latency 10 10000 1000
+ *
+ * sends 10000 frames of 10 fingers, one every millisecond; an interval of
+ * 0 sends them as fast as uinput takes them.  The latency is measured
+ * against the clock selected with EVIOCSCLOCKID (monotonic by default;
+ * -b for boottime, -r for realtime).  Needs write access to /dev/uinput.
+ *
+ * Usage: evdev_latency [-b|-r] [fingers] [frames] [interval us]
+ *        (default: 2 1000 1000)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "../bench.h"
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME		7
+#endif
+
+#define DEV_NAME	"evdev_latency"
+#define MAX_FINGERS	10
+#define READ_EVENTS	256
+
+static int fingers = 2;
+static long frames = 1000;
+static long interval = 1000;
+static int clkid = CLOCK_MONOTONIC;
+
+static void set_bit_ioctl(int fd, unsigned long req, int bit, const char *what)
+{
+	if (ioctl(fd, req, bit)) {
+		perror(what);
+		exit(1);
+	}
+}
+
+static int create_device(void)
+{
+	struct uinput_user_dev ud;
+	int fd;
+
+	fd = open("/dev/uinput", O_WRONLY);
+	if (fd < 0) {
+		printf("/dev/uinput: %s [SKIP]\n", strerror(errno));
+		exit(0);
+	}
+
+	memset(&ud, 0, sizeof(ud));
+	snprintf(ud.name, UINPUT_MAX_NAME_SIZE, DEV_NAME);
+	ud.id.bustype = BUS_VIRTUAL;
+	ud.absmax[ABS_MT_SLOT] = MAX_FINGERS - 1;
+	ud.absmax[ABS_MT_TRACKING_ID] = 65535;
+	ud.absmax[ABS_MT_POSITION_X] = 4095;
+	ud.absmax[ABS_MT_POSITION_Y] = 4095;
+
+	set_bit_ioctl(fd, UI_SET_EVBIT, EV_ABS, "UI_SET_EVBIT");
+	set_bit_ioctl(fd, UI_SET_ABSBIT, ABS_MT_SLOT, "UI_SET_ABSBIT");
+	set_bit_ioctl(fd, UI_SET_ABSBIT, ABS_MT_TRACKING_ID, "UI_SET_ABSBIT");
+	set_bit_ioctl(fd, UI_SET_ABSBIT, ABS_MT_POSITION_X, "UI_SET_ABSBIT");
+	set_bit_ioctl(fd, UI_SET_ABSBIT, ABS_MT_POSITION_Y, "UI_SET_ABSBIT");
+
+	if (write(fd, &ud, sizeof(ud)) != sizeof(ud) ||
+	    ioctl(fd, UI_DEV_CREATE)) {
+		perror("uinput");
+		exit(1);
+	}
+	return fd;
+}
+
+/* the new device is the event node that answers to our name */
+static int open_event_node(void)
+{
+	char path[64], name[64];
+	int i, tries, fd;
+
+	for (tries = 0; tries < 50; tries++) {
+		for (i = 0; i < 32; i++) {
+			snprintf(path, sizeof(path), "/dev/input/event%d", i);
+			fd = open(path, O_RDONLY | O_NONBLOCK);
+			if (fd < 0)
+				continue;
+			memset(name, 0, sizeof(name));
+			if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) > 0 &&
+			    !strcmp(name, DEV_NAME))
+				return fd;
+			close(fd);
+		}
+		/* give udev a moment to create the node */
+		usleep(100000);
+	}
+	printf("no event node for " DEV_NAME "\n");
+	exit(1);
+}
+
+static void *writer(void *arg)
+{
+	struct input_event ev[MAX_FINGERS * 4 + 1];
+	int fd = *(int *)arg;
+	int f, n, len;
+	long i;
+
+	memset(ev, 0, sizeof(ev));
+	for (i = 0; i < frames; i++) {
+		n = 0;
+		for (f = 0; f < fingers; f++) {
+			ev[n].type = EV_ABS;
+			ev[n].code = ABS_MT_SLOT;
+			ev[n++].value = f;
+			ev[n].type = EV_ABS;
+			ev[n].code = ABS_MT_TRACKING_ID;
+			ev[n++].value = f;
+			ev[n].type = EV_ABS;
+			ev[n].code = ABS_MT_POSITION_X;
+			ev[n++].value = (i + f * 100) & 4095;
+			ev[n].type = EV_ABS;
+			ev[n].code = ABS_MT_POSITION_Y;
+			ev[n++].value = (i * 3 + f * 100) & 4095;
+		}
+		ev[n].type = EV_SYN;
+		ev[n].code = SYN_REPORT;
+		ev[n++].value = 0;
+
+		len = n * sizeof(ev[0]);
+		if (write(fd, ev, len) != len) {
+			perror("uinput write");
+			exit(1);
+		}
+		if (interval)
+			usleep(interval);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct input_event ev[READ_EVENTS];
+	double lat, lat_sum = 0, lat_max = 0, start, t;
+	long got = 0, reads = 0, dropped = 0;
+	struct pollfd pfd;
+	pthread_t thread;
+	int ufd, efd, i, n;
+
+	if (argc > 1 && (!strcmp(argv[1], "-b") || !strcmp(argv[1], "-r"))) {
+		clkid = argv[1][1] == 'b' ? CLOCK_BOOTTIME : CLOCK_REALTIME;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		fingers = atoi(argv[1]);
+	if (argc > 2)
+		frames = strtol(argv[2], NULL, 0);
+	if (argc > 3)
+		interval = strtol(argv[3], NULL, 0);
+	if (fingers < 1)
+		fingers = 1;
+	if (fingers > MAX_FINGERS)
+		fingers = MAX_FINGERS;
+
+	ufd = create_device();
+	efd = open_event_node();
+
+	if (ioctl(efd, EVIOCSCLOCKID, &clkid)) {
+		if (clkid == CLOCK_BOOTTIME && errno == EINVAL) {
+			printf("EVIOCSCLOCKID: no CLOCK_BOOTTIME [SKIP]\n");
+			exit(0);
+		}
+		perror("EVIOCSCLOCKID");
+		exit(1);
+	}
+
+	start = now();
+	pthread_create(&thread, NULL, writer, &ufd);
+
+	pfd.fd = efd;
+	pfd.events = POLLIN;
+	while (got < frames) {
+		/* a second without events: the rest got dropped */
+		if (poll(&pfd, 1, 1000) <= 0)
+			break;
+		n = read(efd, ev, sizeof(ev));
+		if (n < 0) {
+			if (errno == EAGAIN)
+				continue;
+			perror("read");
+			exit(1);
+		}
+		t = clock_now(clkid);
+		reads++;
+		for (i = 0; i < n / (int)sizeof(ev[0]); i++) {
+			if (ev[i].type != EV_SYN)
+				continue;
+			if (ev[i].code == SYN_DROPPED) {
+				dropped++;
+				continue;
+			}
+			if (ev[i].code != SYN_REPORT)
+				continue;
+			lat = t - (ev[i].time.tv_sec + ev[i].time.tv_usec / 1e6);
+			lat_sum += lat;
+			if (lat > lat_max)
+				lat_max = lat;
+			got++;
+		}
+	}
+	t = now() - start;
+	pthread_join(thread, NULL);
+
+	printf("%d fingers: %ld/%ld frames in %.3fs (%.0f frames/s), "
+	       "%.2f reads/frame, %ld drops\n",
+	       fingers, got, frames, t, got / t,
+	       got ? (double)reads / got : 0.0, dropped);
+	printf("latency: avg %.1fus, max %.1fus (%s)\n",
+	       got ? lat_sum * 1e6 / got : 0.0, lat_max * 1e6,
+	       clkid == CLOCK_BOOTTIME ? "boottime" :
+	       clkid == CLOCK_REALTIME ? "realtime" : "monotonic");
+
+	ioctl(ufd, UI_DEV_DESTROY);
+	close(efd);
+	close(ufd);
+	return got == frames ? 0 : 1;
+}
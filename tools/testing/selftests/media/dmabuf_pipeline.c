@@ -0,0 +1,300 @@
+/*
+ * Pass frames from vivi to the mem2mem test device, first the usual way,
+ * by copying each captured MMAP buffer into an MMAP buffer of the m2m
+ * OUTPUT queue, then without a copy: every vivi buffer is exported with
+ * VIDIOC_EXPBUF and queued on the OUTPUT queue as V4L2_MEMORY_DMABUF.
+ *
+ *	modprobe vivi; modprobe mem2mem_testdev
+ *	./dmabuf_pipeline /dev/video0 /dev/video1 300
+ *
+ * vivi paces the frames, so both runs take about as long; what differs
+ * is the cpu time spent per frame, which for the copy is dominated by
+ * the memcpy of a 640x480 YUYV frame.  The m2m transaction time is set
+ * to its 1ms minimum so it does not limit the rate.
+ *
+ * Usage: dmabuf_pipeline [vivi dev] [m2m dev] [frames]
+ *        (default: /dev/video0 /dev/video1 100)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include "../bench.h"
+
+#ifndef VIDIOC_EXPBUF
+/* as in <linux/videodev2.h> */
+#define V4L2_MEMORY_DMABUF	4
+
+struct v4l2_exportbuffer {
+	__u32		type;
+	__u32		index;
+	__u32		plane;
+	__u32		flags;
+	__s32		fd;
+	__u32		reserved[11];
+};
+
+#define VIDIOC_EXPBUF		_IOWR('V', 16, struct v4l2_exportbuffer)
+#endif
+
+/* V4L2_CID_TRANS_TIME_MSEC of mem2mem_testdev */
+#define M2M_CID_TRANS_TIME	V4L2_CID_PRIVATE_BASE
+
+#define WIDTH		640
+#define HEIGHT		480
+#define NR_BUFS		4
+
+#define CAP		V4L2_BUF_TYPE_VIDEO_CAPTURE
+#define OUT		V4L2_BUF_TYPE_VIDEO_OUTPUT
+
+static const char *vivi_path = "/dev/video0";
+static const char *m2m_path = "/dev/video1";
+
+struct pipeline {
+	int vivi, m2m;
+	void *vivi_map[NR_BUFS];
+	void *out_map[NR_BUFS];
+	int fds[NR_BUFS];
+	size_t size;
+};
+
+static void xioctl(int fd, unsigned long req, void *arg, const char *what)
+{
+	if (ioctl(fd, req, arg)) {
+		if (req == VIDIOC_EXPBUF && (errno == EINVAL || errno == ENOTTY)) {
+			printf("%s: not supported [SKIP]\n", what);
+			exit(0);
+		}
+		perror(what);
+		exit(1);
+	}
+}
+
+static void set_fmt(int fd, int type, const char *what)
+{
+	struct v4l2_format fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+	fmt.fmt.pix.width = WIDTH;
+	fmt.fmt.pix.height = HEIGHT;
+	fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	xioctl(fd, VIDIOC_S_FMT, &fmt, what);
+	if (fmt.fmt.pix.width != WIDTH || fmt.fmt.pix.height != HEIGHT ||
+	    fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+		printf("%s: %dx%d YUYV not accepted\n", what, WIDTH, HEIGHT);
+		exit(1);
+	}
+}
+
+static void reqbufs(int fd, int type, int memory, const char *what)
+{
+	struct v4l2_requestbuffers req;
+
+	memset(&req, 0, sizeof(req));
+	req.count = NR_BUFS;
+	req.type = type;
+	req.memory = memory;
+	xioctl(fd, VIDIOC_REQBUFS, &req, what);
+	if (req.count != NR_BUFS) {
+		printf("%s: got %u buffers, wanted %d\n", what, req.count,
+		       NR_BUFS);
+		exit(1);
+	}
+}
+
+static void *map_buf(int fd, int type, int index, size_t *size,
+		     const char *what)
+{
+	struct v4l2_buffer buf;
+	void *p;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = type;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+	xioctl(fd, VIDIOC_QUERYBUF, &buf, what);
+	p = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		 buf.m.offset);
+	if (p == MAP_FAILED) {
+		perror(what);
+		exit(1);
+	}
+	*size = buf.length;
+	return p;
+}
+
+static void qbuf(int fd, int type, int memory, int index, int dmabuf_fd,
+		 size_t bytesused, size_t length, const char *what)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = type;
+	buf.memory = memory;
+	buf.index = index;
+	buf.bytesused = bytesused;
+	if (memory == V4L2_MEMORY_DMABUF) {
+		buf.m.fd = dmabuf_fd;
+		buf.length = length;
+	}
+	xioctl(fd, VIDIOC_QBUF, &buf, what);
+}
+
+static struct v4l2_buffer dqbuf(int fd, int type, int memory, const char *what)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = type;
+	buf.memory = memory;
+	xioctl(fd, VIDIOC_DQBUF, &buf, what);
+	return buf;
+}
+
+static void setup(struct pipeline *p, int out_memory)
+{
+	struct v4l2_control ctrl;
+	size_t size;
+	int i, type;
+
+	p->vivi = open(vivi_path, O_RDWR);
+	if (p->vivi < 0) {
+		perror(vivi_path);
+		exit(1);
+	}
+	p->m2m = open(m2m_path, O_RDWR);
+	if (p->m2m < 0) {
+		perror(m2m_path);
+		exit(1);
+	}
+
+	set_fmt(p->vivi, CAP, "vivi S_FMT");
+	set_fmt(p->m2m, OUT, "m2m OUTPUT S_FMT");
+	set_fmt(p->m2m, CAP, "m2m CAPTURE S_FMT");
+
+	ctrl.id = M2M_CID_TRANS_TIME;
+	ctrl.value = 1;
+	xioctl(p->m2m, VIDIOC_S_CTRL, &ctrl, "m2m S_CTRL");
+
+	reqbufs(p->vivi, CAP, V4L2_MEMORY_MMAP, "vivi REQBUFS");
+	reqbufs(p->m2m, OUT, out_memory, "m2m OUTPUT REQBUFS");
+	reqbufs(p->m2m, CAP, V4L2_MEMORY_MMAP, "m2m CAPTURE REQBUFS");
+
+	for (i = 0; i < NR_BUFS; i++) {
+		p->vivi_map[i] = map_buf(p->vivi, CAP, i, &p->size,
+					 "vivi QUERYBUF");
+		if (out_memory == V4L2_MEMORY_MMAP) {
+			p->out_map[i] = map_buf(p->m2m, OUT, i, &size,
+						"m2m OUTPUT QUERYBUF");
+			if (size < p->size) {
+				printf("m2m OUTPUT buffers too small\n");
+				exit(1);
+			}
+		} else {
+			struct v4l2_exportbuffer eb;
+
+			memset(&eb, 0, sizeof(eb));
+			eb.type = CAP;
+			eb.index = i;
+			eb.flags = O_CLOEXEC;
+			xioctl(p->vivi, VIDIOC_EXPBUF, &eb, "vivi EXPBUF");
+			p->fds[i] = eb.fd;
+		}
+		qbuf(p->vivi, CAP, V4L2_MEMORY_MMAP, i, -1, 0, 0,
+		     "vivi QBUF");
+		qbuf(p->m2m, CAP, V4L2_MEMORY_MMAP, i, -1, 0, 0,
+		     "m2m CAPTURE QBUF");
+	}
+
+	type = CAP;
+	xioctl(p->vivi, VIDIOC_STREAMON, &type, "vivi STREAMON");
+	xioctl(p->m2m, VIDIOC_STREAMON, &type, "m2m CAPTURE STREAMON");
+	type = OUT;
+	xioctl(p->m2m, VIDIOC_STREAMON, &type, "m2m OUTPUT STREAMON");
+}
+
+static void teardown(struct pipeline *p, int out_memory)
+{
+	int i;
+
+	for (i = 0; i < NR_BUFS; i++) {
+		munmap(p->vivi_map[i], p->size);
+		if (out_memory == V4L2_MEMORY_MMAP)
+			munmap(p->out_map[i], p->size);
+		else
+			close(p->fds[i]);
+	}
+	/* closing the devices stops streaming and frees the buffers */
+	close(p->m2m);
+	close(p->vivi);
+}
+
+static void run(int out_memory, long frames)
+{
+	struct v4l2_buffer cap, out;
+	struct pipeline p;
+	double t, cpu;
+	long n;
+
+	setup(&p, out_memory);
+
+	t = now();
+	cpu = cpu_now();
+	for (n = 0; n < frames; n++) {
+		cap = dqbuf(p.vivi, CAP, V4L2_MEMORY_MMAP, "vivi DQBUF");
+
+		if (out_memory == V4L2_MEMORY_MMAP) {
+			memcpy(p.out_map[cap.index], p.vivi_map[cap.index],
+			       cap.bytesused);
+			qbuf(p.m2m, OUT, out_memory, cap.index, -1,
+			     cap.bytesused, 0, "m2m OUTPUT QBUF");
+		} else {
+			qbuf(p.m2m, OUT, out_memory, cap.index,
+			     p.fds[cap.index], cap.bytesused, p.size,
+			     "m2m OUTPUT QBUF");
+		}
+
+		out = dqbuf(p.m2m, CAP, V4L2_MEMORY_MMAP, "m2m CAPTURE DQBUF");
+		qbuf(p.m2m, CAP, V4L2_MEMORY_MMAP, out.index, -1, 0, 0,
+		     "m2m CAPTURE QBUF");
+
+		/* the source buffer is free again once the m2m is done with it */
+		out = dqbuf(p.m2m, OUT, out_memory, "m2m OUTPUT DQBUF");
+		qbuf(p.vivi, CAP, V4L2_MEMORY_MMAP, out.index, -1, 0, 0,
+		     "vivi QBUF");
+	}
+	cpu = cpu_now() - cpu;
+	t = now() - t;
+
+	printf("%-8s %ld frames in %.3fs (%.1f fps), %.1fus cpu/frame\n",
+	       out_memory == V4L2_MEMORY_MMAP ? "copy:" : "dmabuf:",
+	       frames, t, frames / t, cpu * 1e6 / frames);
+
+	teardown(&p, out_memory);
+}
+
+int main(int argc, char **argv)
+{
+	long frames;
+
+	if (argc > 1)
+		vivi_path = argv[1];
+	if (argc > 2)
+		m2m_path = argv[2];
+	frames = argc > 3 ? strtol(argv[3], NULL, 0) : 100;
+	if (frames < 1)
+		frames = 1;
+
+	run(V4L2_MEMORY_MMAP, frames);
+	run(V4L2_MEMORY_DMABUF, frames);
+	return 0;
+}
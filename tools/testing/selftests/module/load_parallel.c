@@ -0,0 +1,170 @@
+/*
+ * Time loading a set of modules one after the other and then all at
+ * once, one thread per module, the way udev loads drivers at boot:
+ *
+ *	./load_parallel dummy.ko ifb.ko veth.ko tun.ko
+ *
+ * The modules must not be loaded yet, and must not depend on each other
+ * or on modules that are not loaded; each is unloaded again after each
+ * round.  Resolving symbols against the kernel used to take module_mutex
+ * once per symbol, so that concurrent loads mostly queued behind each
+ * other, and against other modules cost a search of every module; now
+ * they should overlap.  Every round also checks that all modules loaded
+ * and unloaded, so a run doubles as a stress test of concurrent loads.
+ *
+ * Boot with initcall_debug to have the kernel log how long linking each
+ * module took.
+ *
+ * Usage: load_parallel [-r rounds] <module.ko>...  (default: 5 rounds)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "../bench.h"
+
+struct module {
+	const char *path;
+	char name[64];
+	void *image;
+	unsigned long len;
+	int err;
+};
+
+static struct module *mods;
+static int nr_mods;
+
+static void read_module(struct module *m)
+{
+	const char *base = strrchr(m->path, '/');
+	struct stat st;
+	char *p;
+	int fd;
+
+	fd = open(m->path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(m->path);
+		exit(1);
+	}
+	m->len = st.st_size;
+	m->image = malloc(m->len);
+	if (!m->image || read(fd, m->image, m->len) != (ssize_t)m->len) {
+		perror(m->path);
+		exit(1);
+	}
+	close(fd);
+
+	/* the name the kernel will know it by */
+	snprintf(m->name, sizeof(m->name), "%s", base ? base + 1 : m->path);
+	p = strstr(m->name, ".ko");
+	if (p)
+		*p = '\0';
+	for (p = m->name; *p; p++)
+		if (*p == '-')
+			*p = '_';
+}
+
+static void *load(void *arg)
+{
+	struct module *m = arg;
+
+	m->err = 0;
+	if (syscall(__NR_init_module, m->image, m->len, ""))
+		m->err = errno;
+	return NULL;
+}
+
+static void unload_all(void)
+{
+	int i;
+
+	for (i = 0; i < nr_mods; i++) {
+		if (syscall(__NR_delete_module, mods[i].name, O_NONBLOCK)) {
+			printf("%s: unload failed: %s\n", mods[i].name,
+			       strerror(errno));
+			exit(1);
+		}
+	}
+}
+
+static void check_loaded(void)
+{
+	int i;
+
+	for (i = 0; i < nr_mods; i++) {
+		if (mods[i].err) {
+			printf("%s: load failed: %s\n", mods[i].name,
+			       strerror(mods[i].err));
+			exit(1);
+		}
+	}
+}
+
+static double serial(void)
+{
+	double start = now();
+	int i;
+
+	for (i = 0; i < nr_mods; i++)
+		load(&mods[i]);
+	start = now() - start;
+	check_loaded();
+	unload_all();
+	return start;
+}
+
+static double parallel(void)
+{
+	double t = run_threads(nr_mods, load, mods, sizeof(*mods), 0, NULL);
+
+	check_loaded();
+	unload_all();
+	return t;
+}
+
+int main(int argc, char **argv)
+{
+	double one = 0, all = 0;
+	int rounds = 5, i, opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		if (opt != 'r') {
+			fprintf(stderr, "usage: %s [-r rounds] <module.ko>...\n",
+				argv[0]);
+			exit(1);
+		}
+		rounds = atoi(optarg);
+	}
+	nr_mods = argc - optind;
+	if (nr_mods < 1 || rounds < 1) {
+		fprintf(stderr, "usage: %s [-r rounds] <module.ko>...\n",
+			argv[0]);
+		exit(1);
+	}
+
+	mods = calloc(nr_mods, sizeof(*mods));
+	if (!mods) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_mods; i++) {
+		mods[i].path = argv[optind + i];
+		read_module(&mods[i]);
+	}
+
+	for (i = 0; i < rounds; i++) {
+		one += serial();
+		all += parallel();
+	}
+
+	printf("%d modules, %d rounds: %.1f ms one by one, "
+	       "%.1f ms in parallel\n", nr_mods, rounds,
+	       one * 1000 / rounds, all * 1000 / rounds);
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Read a large directory and stat every entry, the way a media scanner
+ * does, first with getdents64() and one fstatat() per entry, then with
+ * getdents_stat(), which returns the attributes along with the entries
+ * where the filesystem supports it (ext4, fuse), and checks that the two
+ * agree.
+ *
+ *	./getdents_stat /data/media 100000
+ *
+ * creates a directory of that many files under the given directory,
+ * times both ways of reading it, and removes it again.  For cold cache
+ * numbers, drop caches before the run and pass -r to read only.
+ *
+ * Usage: getdents_stat [-r] [dir] [nr files]  (default: . 100000)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "../bench.h"
+
+#ifndef __NR_getdents_stat
+#ifdef __arm__
+#define __NR_getdents_stat	(__NR_SYSCALL_BASE + 500)
+#else
+#define __NR_getdents_stat	-1
+#endif
+#endif
+
+/* as in <linux/dirent_stat.h> */
+struct linux_dirent_stat {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	uint16_t	d_reclen;
+	uint8_t		d_type;
+	uint8_t		d_stat_valid;
+	uint32_t	st_mode;
+	uint32_t	st_nlink;
+	uint32_t	st_uid;
+	uint32_t	st_gid;
+	uint32_t	st_blksize;
+	uint64_t	st_dev;
+	uint64_t	st_rdev;
+	int64_t		st_size;
+	uint64_t	st_blocks;
+	int64_t		st_atime_sec;
+	int64_t		st_mtime_sec;
+	int64_t		st_ctime_sec;
+	uint32_t	st_atime_nsec;
+	uint32_t	st_mtime_nsec;
+	uint32_t	st_ctime_nsec;
+	uint32_t	__pad;
+	char		d_name[0];
+};
+
+struct linux_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[0];
+};
+
+#define BUF_SIZE	(64 * 1024)
+
+static char buf[BUF_SIZE] __attribute__((aligned(8)));
+
+static int is_dot(const char *name)
+{
+	return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+static long getdents_then_stat(int dfd)
+{
+	long n, pos, count = 0;
+	struct stat st;
+
+	lseek(dfd, 0, SEEK_SET);
+	while ((n = syscall(__NR_getdents64, dfd, buf, BUF_SIZE)) > 0) {
+		for (pos = 0; pos < n; ) {
+			struct linux_dirent64 *d = (void *)(buf + pos);
+
+			pos += d->d_reclen;
+			if (is_dot(d->d_name))
+				continue;
+			if (fstatat(dfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+				perror(d->d_name);
+				exit(1);
+			}
+			count++;
+		}
+	}
+	if (n < 0) {
+		perror("getdents64");
+		exit(1);
+	}
+	return count;
+}
+
+/* returns the number of entries, *valid those that came with attributes */
+static long getdents_stat(int dfd, long *valid, int check)
+{
+	long n, pos, count = 0;
+	struct stat st;
+
+	*valid = 0;
+	lseek(dfd, 0, SEEK_SET);
+	while ((n = syscall(__NR_getdents_stat, dfd, buf, BUF_SIZE, 0)) > 0) {
+		for (pos = 0; pos < n; ) {
+			struct linux_dirent_stat *d = (void *)(buf + pos);
+
+			pos += d->d_reclen;
+			if (is_dot(d->d_name))
+				continue;
+			count++;
+			if (d->d_stat_valid) {
+				(*valid)++;
+				if (!check)
+					continue;
+			}
+			if (fstatat(dfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+				perror(d->d_name);
+				exit(1);
+			}
+			if (d->d_stat_valid &&
+			    (d->d_ino != st.st_ino ||
+			     d->st_mode != st.st_mode ||
+			     d->st_size != st.st_size ||
+			     d->st_nlink != st.st_nlink ||
+			     d->st_mtime_sec != st.st_mtime)) {
+				printf("%s: attributes differ from fstatat()\n",
+				       d->d_name);
+				exit(1);
+			}
+		}
+	}
+	if (n < 0) {
+		if (errno == ENOSYS) {
+			printf("getdents_stat: not supported [SKIP]\n");
+			exit(0);
+		}
+		perror("getdents_stat");
+		exit(1);
+	}
+	return count;
+}
+
+static void make_files(const char *dir, long nr, int create)
+{
+	char path[4096];
+	long i;
+	int fd;
+
+	for (i = 0; i < nr; i++) {
+		snprintf(path, sizeof(path), "%s/IMG_%06ld.jpg", dir, i);
+		if (!create) {
+			unlink(path);
+			continue;
+		}
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0 || ftruncate(fd, i)) {
+			perror(path);
+			exit(1);
+		}
+		close(fd);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long nr, count, valid;
+	int read_only = 0, dfd;
+	char dir[4096];
+	double t;
+
+	if (argc > 1 && !strcmp(argv[1], "-r")) {
+		read_only = 1;
+		argc--;
+		argv++;
+	}
+	snprintf(dir, sizeof(dir), "%s/getdents_stat.d",
+		 argc > 1 ? argv[1] : ".");
+	nr = argc > 2 ? strtol(argv[2], NULL, 0) : 100000;
+
+	if (!read_only) {
+		if (mkdir(dir, 0755)) {
+			perror(dir);
+			exit(1);
+		}
+		make_files(dir, nr, 1);
+	}
+
+	dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror(dir);
+		exit(1);
+	}
+
+	/* check first: this also makes sure the syscall is there */
+	count = getdents_stat(dfd, &valid, 1);
+	printf("%ld entries, %ld with attributes\n", count, valid);
+
+	t = now();
+	count = getdents_then_stat(dfd);
+	t = now() - t;
+	printf("getdents64 + fstatat: %ld entries in %.3fs (%.0f/s)\n",
+	       count, t, count / t);
+
+	t = now();
+	count = getdents_stat(dfd, &valid, 0);
+	t = now() - t;
+	printf("getdents_stat:        %ld entries in %.3fs (%.0f/s)\n",
+	       count, t, count / t);
+
+	close(dfd);
+	if (!read_only) {
+		make_files(dir, nr, 0);
+		rmdir(dir);
+	}
+	return 0;
+}
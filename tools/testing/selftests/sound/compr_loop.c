@@ -0,0 +1,324 @@
+/*
+ * Stream through snd-compr-loop: PCM passthrough written to its compress
+ * offload device comes back on its capture PCM.  Checks that everything
+ * written is captured in order, and measures what a compress offload
+ * user sees of it: wakeups and cpu time for the chosen fragment size,
+ * how far the rendered position (pcm_io_frames) drifts from the clock,
+ * how low the buffer runs, and how long a drain takes compared to what
+ * was left in the buffer.
+ *
+ *	modprobe snd-compr-loop
+ *	./compr_loop 1 4096 4 10
+ *	./compr_loop -n 1 4096 4 10
+ *
+ * streams for 10s through card 1 with 4 fragments of 4096 bytes.  With
+ * -n the stream is set up with no_wake_mode and the program sleeps for
+ * half a buffer between writes instead of polling.
+ *
+ * Usage: compr_loop [-n] [card] [fragment bytes] [fragments] [seconds]
+ *        (default: 1 4096 4 10)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+
+#include "../bench.h"
+
+#define RATE		48000
+#define CHANNELS	2
+#define FRAME_BYTES	(CHANNELS * 2)
+
+/* as in <sound/compress_offload.h> and <sound/compress_params.h> */
+#define SND_AUDIOCODEC_PCM	1
+#define SND_COMPRESS_PLAYBACK	0
+
+struct snd_codec {
+	uint32_t id, ch_in, ch_out, sample_rate, bit_rate, rate_control;
+	uint32_t profile, level, ch_mode, format, align;
+	uint32_t options[16];
+	uint32_t reserved[3];
+};
+
+struct snd_compr_params {
+	uint32_t fragment_size;
+	uint32_t fragments;
+	struct snd_codec codec;
+	uint8_t no_wake_mode;
+};
+
+struct snd_compr_tstamp {
+	uint32_t byte_offset;
+	uint32_t copied_total;
+	unsigned long pcm_frames;
+	unsigned long pcm_io_frames;
+	uint32_t sampling_rate;
+	uint64_t timestamp;
+};
+
+struct snd_compr_avail {
+	uint64_t avail;
+	struct snd_compr_tstamp tstamp;
+};
+
+struct snd_compr_caps {
+	uint32_t num_codecs, direction;
+	uint32_t min_fragment_size, max_fragment_size;
+	uint32_t min_fragments, max_fragments;
+	uint32_t codecs[32];
+	uint32_t reserved[11];
+};
+
+#define SNDRV_COMPRESS_GET_CAPS	_IOWR('C', 0x10, struct snd_compr_caps)
+#define SNDRV_COMPRESS_SET_PARAMS _IOW('C', 0x12, struct snd_compr_params)
+#define SNDRV_COMPRESS_TSTAMP	_IOR('C', 0x20, struct snd_compr_tstamp)
+#define SNDRV_COMPRESS_AVAIL	_IOR('C', 0x21, struct snd_compr_avail)
+#define SNDRV_COMPRESS_START	_IO('C', 0x32)
+#define SNDRV_COMPRESS_DRAIN	_IO('C', 0x34)
+
+static int no_wake;
+static unsigned int fragment = 4096, fragments = 4;
+static unsigned int counter;		/* next frame value to write */
+static unsigned int expect;		/* next frame value to capture */
+static long captured, bad_frames;
+
+static void xioctl(int fd, unsigned long req, void *arg, const char *what)
+{
+	if (ioctl(fd, req, arg)) {
+		perror(what);
+		exit(1);
+	}
+}
+
+static void set_mask(struct snd_pcm_hw_params *p, int n, unsigned int bit)
+{
+	struct snd_mask *m = &p->masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+
+	memset(m, 0, sizeof(*m));
+	m->bits[bit / 32] = 1U << (bit % 32);
+}
+
+static void set_interval(struct snd_pcm_hw_params *p, int n, unsigned int val)
+{
+	struct snd_interval *i =
+		&p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+
+	memset(i, 0, sizeof(*i));
+	i->min = i->max = val;
+	i->integer = 1;
+}
+
+static int open_capture(const char *path)
+{
+	struct snd_pcm_hw_params hw;
+	int fd, i;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	memset(&hw, 0, sizeof(hw));
+	for (i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_MASK -
+			 SNDRV_PCM_HW_PARAM_FIRST_MASK; i++)
+		memset(&hw.masks[i], 0xff, sizeof(hw.masks[i]));
+	for (i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+			 SNDRV_PCM_HW_PARAM_FIRST_INTERVAL; i++)
+		hw.intervals[i].max = UINT_MAX;
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_ACCESS,
+		 SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_FORMAT, SNDRV_PCM_FORMAT_S16_LE);
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_SUBFORMAT, SNDRV_PCM_SUBFORMAT_STD);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_CHANNELS, CHANNELS);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_RATE, RATE);
+	/* room for the whole compressed buffer, and then some */
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+		     fragment / FRAME_BYTES);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_PERIODS, fragments * 2);
+	hw.rmask = ~0U;
+	xioctl(fd, SNDRV_PCM_IOCTL_HW_PARAMS, &hw, "capture HW_PARAMS");
+	xioctl(fd, SNDRV_PCM_IOCTL_PREPARE, NULL, "capture PREPARE");
+	xioctl(fd, SNDRV_PCM_IOCTL_START, NULL, "capture START");
+	return fd;
+}
+
+static void fill(int16_t *buf, unsigned int bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes / FRAME_BYTES; i++, counter++)
+		buf[i * 2] = buf[i * 2 + 1] = counter & 0x7fff;
+}
+
+/* write what the stream takes; unaccepted frames are written again */
+static void write_stream(int fd, int16_t *buf, unsigned int bytes)
+{
+	ssize_t n;
+
+	fill(buf, bytes);
+	n = write(fd, buf, bytes);
+	if (n < 0) {
+		perror("compress write");
+		exit(1);
+	}
+	counter -= (bytes - n) / FRAME_BYTES;
+}
+
+static void read_capture(int fd, int16_t *buf, unsigned int bytes)
+{
+	struct snd_xferi x;
+	unsigned long i;
+
+	for (;;) {
+		x.buf = buf;
+		x.frames = bytes / FRAME_BYTES;
+		if (ioctl(fd, SNDRV_PCM_IOCTL_READI_FRAMES, &x)) {
+			if (errno == EAGAIN)
+				return;
+			perror("capture read");
+			exit(1);
+		}
+		for (i = 0; i < (unsigned long)x.result; i++, expect++)
+			if (buf[i * 2] != (int16_t)(expect & 0x7fff))
+				bad_frames++;
+		captured += x.result;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double start, t, cpu, drift, max_drift = 0, drain, expected;
+	struct snd_compr_params params;
+	struct snd_compr_caps caps;
+	struct snd_compr_avail avail;
+	struct timespec nap;
+	struct pollfd pfd;
+	unsigned int buffer, i, min_fill, fill_now;
+	int cfd, pfd_cap, card = 1, seconds = 10;
+	char path[64];
+	long woken;
+	int16_t *buf;
+
+	if (argc > 1 && !strcmp(argv[1], "-n")) {
+		no_wake = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		card = atoi(argv[1]);
+	if (argc > 2)
+		fragment = strtoul(argv[2], NULL, 0) & ~(FRAME_BYTES - 1);
+	if (argc > 3)
+		fragments = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		seconds = atoi(argv[4]);
+	buffer = fragment * fragments;
+	min_fill = buffer;
+
+	buf = malloc(buffer);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+
+	snprintf(path, sizeof(path), "/dev/snd/comprC%dD0", card);
+	cfd = open(path, O_WRONLY);
+	if (cfd < 0) {
+		printf("%s: %s [SKIP]\n", path, strerror(errno));
+		exit(0);
+	}
+	xioctl(cfd, SNDRV_COMPRESS_GET_CAPS, &caps, "GET_CAPS");
+	for (i = 0; i < caps.num_codecs; i++)
+		if (caps.codecs[i] == SND_AUDIOCODEC_PCM)
+			break;
+	if (i == caps.num_codecs || caps.direction != SND_COMPRESS_PLAYBACK) {
+		printf("%s: no PCM playback [SKIP]\n", path);
+		exit(0);
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.fragment_size = fragment;
+	params.fragments = fragments;
+	params.codec.id = SND_AUDIOCODEC_PCM;
+	params.codec.ch_in = params.codec.ch_out = CHANNELS;
+	params.codec.sample_rate = RATE;
+	params.codec.format = SNDRV_PCM_FORMAT_S16_LE;
+	params.codec.align = FRAME_BYTES;
+	params.no_wake_mode = no_wake;
+	xioctl(cfd, SNDRV_COMPRESS_SET_PARAMS, &params, "SET_PARAMS");
+
+	snprintf(path, sizeof(path), "/dev/snd/pcmC%dD0c", card);
+	pfd_cap = open_capture(path);
+
+	/* the whole buffer goes in with the first write, before START */
+	write_stream(cfd, buf, buffer);
+	xioctl(cfd, SNDRV_COMPRESS_START, NULL, "START");
+
+	pfd.fd = cfd;
+	pfd.events = POLLOUT;
+	nap.tv_sec = 0;
+	nap.tv_nsec = (long)buffer * 500000000LL / (RATE * FRAME_BYTES);
+
+	woken = wakeups();
+	cpu = cpu_now();
+	start = now();
+	while ((t = now() - start) < seconds) {
+		if (no_wake)
+			nanosleep(&nap, NULL);
+		else
+			poll(&pfd, 1, 1000);
+
+		xioctl(cfd, SNDRV_COMPRESS_AVAIL, &avail, "AVAIL");
+		t = now() - start;
+		fill_now = buffer - avail.avail;
+		if (fill_now < min_fill && t > 0.5)
+			min_fill = fill_now;
+		/* the rendered position against the clock, once settled */
+		drift = avail.tstamp.pcm_io_frames / (double)RATE - t;
+		if (t > 0.5 && (drift > max_drift || -drift > max_drift))
+			max_drift = drift < 0 ? -drift : drift;
+
+		if (avail.avail >= fragment)
+			write_stream(cfd, buf,
+				     avail.avail - avail.avail % fragment);
+		read_capture(pfd_cap, buf, buffer);
+	}
+	t = now() - start;
+	cpu = cpu_now() - cpu;
+	woken = wakeups() - woken;
+
+	xioctl(cfd, SNDRV_COMPRESS_AVAIL, &avail, "AVAIL");
+	expected = (buffer - avail.avail) / (double)(RATE * FRAME_BYTES);
+	drain = now();
+	xioctl(cfd, SNDRV_COMPRESS_DRAIN, NULL, "DRAIN");
+	pfd.events = POLLOUT;
+	if (poll(&pfd, 1, (int)(expected * 1000) + 1000) <= 0) {
+		printf("drain did not complete\n");
+		exit(1);
+	}
+	drain = now() - drain;
+	/* what was left comes out of the capture too */
+	usleep(10000);
+	read_capture(pfd_cap, buf, buffer);
+
+	printf("%s, %u x %u bytes: %.0f wakeups/s, cpu %.2f%%, "
+	       "position drift max %.2fms, buffer low %u bytes\n",
+	       no_wake ? "no wake" : "fragment wakeups", fragments, fragment,
+	       woken / t, cpu * 100 / t, max_drift * 1e3, min_fill);
+	printf("drain %.1fms for %.1fms buffered; %u frames written, "
+	       "%ld captured, %ld out of order\n",
+	       drain * 1e3, expected * 1e3, counter, captured, bad_frames);
+
+	close(pfd_cap);
+	close(cfd);
+	return bad_frames || captured != counter;
+}
@@ -0,0 +1,313 @@
+/*
+ * Round-trip latency and cpu cost of a small-period PCM stream through
+ * snd-aloop, with and without period wakeups.
+ *
+ * Silence is played into the loopback with a click every 100ms, and the
+ * capture side is read back until the click shows up; the time between
+ * writing and reading it is the round trip.  Both sides are serviced by
+ * one thread, which finds out how much room or data there is from the
+ * mmapped status and control records when the kernel lets it map them,
+ * without a syscall, or with SNDRV_PCM_IOCTL_SYNC_PTR otherwise.
+ *
+ * By default the thread sleeps in poll() and is woken at every period.
+ * With -n the streams are opened with SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP
+ * and the thread sleeps for a period at a time on its own, relying on the
+ * PCM core to keep hw_ptr up to date; compare the wakeups/s and cpu
+ * columns of the two runs.
+ *
+ *	modprobe snd-aloop
+ *	./pcm_latency /dev/snd/pcmC1D0p /dev/snd/pcmC1D1c 96 10
+ *	./pcm_latency -n /dev/snd/pcmC1D0p /dev/snd/pcmC1D1c 96 10
+ *
+ * Usage: pcm_latency [-n] [playback dev] [capture dev] [period frames]
+ *        [seconds]  (default: /dev/snd/pcmC1D0p /dev/snd/pcmC1D1c 96 10)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sound/asound.h>
+
+#include "../bench.h"
+
+#define RATE		48000
+#define CHANNELS	2
+#define PERIODS		4
+#define CLICK		0x4000
+
+struct stream {
+	const char *path;
+	int fd;
+	int capture;
+	unsigned long buffer_size;
+	unsigned long boundary;
+	volatile struct snd_pcm_mmap_status *status;
+	volatile struct snd_pcm_mmap_control *control;
+	struct snd_pcm_sync_ptr sync;	/* when the records can't be mapped */
+	int mapped;
+};
+
+static int no_wakeup;
+static unsigned long period = 96;
+static short *frames_buf;
+
+static void xioctl(struct stream *s, unsigned long req, void *arg,
+		   const char *what)
+{
+	if (ioctl(s->fd, req, arg)) {
+		fprintf(stderr, "%s: %s: %s\n", s->path, what, strerror(errno));
+		exit(1);
+	}
+}
+
+static void set_mask(struct snd_pcm_hw_params *p, int n, unsigned int bit)
+{
+	struct snd_mask *m = &p->masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+
+	memset(m, 0, sizeof(*m));
+	m->bits[bit / 32] = 1U << (bit % 32);
+}
+
+static void set_interval(struct snd_pcm_hw_params *p, int n, unsigned int val)
+{
+	struct snd_interval *i =
+		&p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+
+	memset(i, 0, sizeof(*i));
+	i->min = i->max = val;
+	i->integer = 1;
+}
+
+static void setup(struct stream *s)
+{
+	struct snd_pcm_hw_params hw;
+	struct snd_pcm_sw_params sw;
+	long page = sysconf(_SC_PAGESIZE);
+	int i;
+
+	s->fd = open(s->path, O_RDWR | O_NONBLOCK);
+	if (s->fd < 0) {
+		printf("%s: %s [SKIP]\n", s->path, strerror(errno));
+		exit(0);
+	}
+
+	memset(&hw, 0, sizeof(hw));
+	for (i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_MASK -
+			 SNDRV_PCM_HW_PARAM_FIRST_MASK; i++)
+		memset(&hw.masks[i], 0xff, sizeof(hw.masks[i]));
+	for (i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+			 SNDRV_PCM_HW_PARAM_FIRST_INTERVAL; i++)
+		hw.intervals[i].max = UINT_MAX;
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_ACCESS,
+		 SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_FORMAT, SNDRV_PCM_FORMAT_S16_LE);
+	set_mask(&hw, SNDRV_PCM_HW_PARAM_SUBFORMAT, SNDRV_PCM_SUBFORMAT_STD);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_CHANNELS, CHANNELS);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_RATE, RATE);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, period);
+	set_interval(&hw, SNDRV_PCM_HW_PARAM_PERIODS, PERIODS);
+	hw.rmask = ~0U;
+	if (no_wakeup)
+		hw.flags |= SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP;
+	xioctl(s, SNDRV_PCM_IOCTL_HW_PARAMS, &hw, "HW_PARAMS");
+	if (no_wakeup && !(hw.info & SNDRV_PCM_INFO_NO_PERIOD_WAKEUP)) {
+		printf("%s: no period wakeup not supported [SKIP]\n", s->path);
+		exit(0);
+	}
+	s->buffer_size = hw.intervals[SNDRV_PCM_HW_PARAM_BUFFER_SIZE -
+				      SNDRV_PCM_HW_PARAM_FIRST_INTERVAL].min;
+
+	/* the same boundary the kernel computes in hw_params */
+	s->boundary = s->buffer_size;
+	while (s->boundary * 2 <= LONG_MAX - s->buffer_size)
+		s->boundary *= 2;
+
+	memset(&sw, 0, sizeof(sw));
+	sw.tstamp_mode = SNDRV_PCM_TSTAMP_ENABLE;
+	sw.period_step = 1;
+	sw.avail_min = period;
+	/* started explicitly, together, once playback is primed */
+	sw.start_threshold = s->boundary;
+	sw.stop_threshold = s->buffer_size;
+	sw.boundary = s->boundary;
+	xioctl(s, SNDRV_PCM_IOCTL_SW_PARAMS, &sw, "SW_PARAMS");
+
+	s->status = mmap(NULL, page, PROT_READ, MAP_SHARED, s->fd,
+			 SNDRV_PCM_MMAP_OFFSET_STATUS);
+	s->control = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  s->fd, SNDRV_PCM_MMAP_OFFSET_CONTROL);
+	s->mapped = s->status != MAP_FAILED && s->control != MAP_FAILED;
+	if (!s->mapped) {
+		s->status = &s->sync.s.status;
+		s->control = &s->sync.c.control;
+	}
+
+	xioctl(s, SNDRV_PCM_IOCTL_PREPARE, NULL, "PREPARE");
+}
+
+/* frames the stream can take (playback) or has (capture) */
+static unsigned long avail(struct stream *s)
+{
+	long a;
+
+	if (!s->mapped) {
+		s->sync.flags = SNDRV_PCM_SYNC_PTR_HWSYNC |
+				SNDRV_PCM_SYNC_PTR_APPL |
+				SNDRV_PCM_SYNC_PTR_AVAIL_MIN;
+		xioctl(s, SNDRV_PCM_IOCTL_SYNC_PTR, &s->sync, "SYNC_PTR");
+	}
+
+	a = s->status->hw_ptr - s->control->appl_ptr;
+	if (!s->capture)
+		a += s->buffer_size;
+	if (a < 0)
+		a += s->boundary;
+	else if ((unsigned long)a >= s->boundary)
+		a -= s->boundary;
+	return a;
+}
+
+/* on an xrun, start over; a click in flight is lost */
+static int transfer(struct stream *s)
+{
+	struct snd_xferi x;
+
+	x.buf = frames_buf;
+	x.frames = period;
+	if (!ioctl(s->fd, s->capture ? SNDRV_PCM_IOCTL_READI_FRAMES :
+				       SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
+		return 0;
+	if (errno != EPIPE && errno != EAGAIN) {
+		fprintf(stderr, "%s: transfer: %s\n", s->path, strerror(errno));
+		exit(1);
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct stream pb = { .path = "/dev/snd/pcmC1D0p" };
+	struct stream cap = { .path = "/dev/snd/pcmC1D1c", .capture = 1 };
+	double start, cpu, t, click_time = 0, lat, lat_sum = 0, lat_max = 0;
+	unsigned long click_every, since_click = 0;
+	long clicks = 0, xruns = 0, woken;
+	struct timespec nap;
+	struct pollfd pfd[2];
+	int seconds = 10;
+	unsigned long i;
+
+	if (argc > 1 && !strcmp(argv[1], "-n")) {
+		no_wakeup = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		pb.path = argv[1];
+	if (argc > 2)
+		cap.path = argv[2];
+	if (argc > 3)
+		period = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		seconds = atoi(argv[4]);
+
+	frames_buf = calloc(period, CHANNELS * sizeof(short));
+	if (!frames_buf) {
+		perror("calloc");
+		exit(1);
+	}
+	click_every = RATE / 10 / period;
+	if (!click_every)
+		click_every = 1;
+
+	setup(&pb);
+	setup(&cap);
+
+	/* prime the playback buffer, then start both at once */
+	while (avail(&pb) >= period)
+		if (transfer(&pb))
+			break;
+	xioctl(&pb, SNDRV_PCM_IOCTL_LINK, (void *)(long)cap.fd, "LINK");
+	xioctl(&pb, SNDRV_PCM_IOCTL_START, NULL, "START");
+
+	pfd[0].fd = pb.fd;
+	pfd[0].events = POLLOUT;
+	pfd[1].fd = cap.fd;
+	pfd[1].events = POLLIN;
+	nap.tv_sec = 0;
+	nap.tv_nsec = period * 1000000000ULL / RATE;
+
+	woken = wakeups();
+	cpu = cpu_now();
+	start = now();
+	while (now() - start < seconds) {
+		if (no_wakeup)
+			nanosleep(&nap, NULL);
+		else
+			poll(pfd, 2, 1000);
+
+		while (avail(&pb) >= period) {
+			memset(frames_buf, 0, period * CHANNELS * sizeof(short));
+			if (!click_time && ++since_click >= click_every) {
+				frames_buf[0] = frames_buf[1] = CLICK;
+				since_click = 0;
+			}
+			if (transfer(&pb)) {
+				xruns++;
+				click_time = 0;
+				xioctl(&pb, SNDRV_PCM_IOCTL_PREPARE, NULL,
+				       "PREPARE");
+				xioctl(&pb, SNDRV_PCM_IOCTL_START, NULL,
+				       "START");
+				break;
+			}
+			if (frames_buf[0] == CLICK)
+				click_time = now();
+		}
+
+		while (avail(&cap) >= period) {
+			if (transfer(&cap)) {
+				xruns++;
+				xioctl(&cap, SNDRV_PCM_IOCTL_PREPARE, NULL,
+				       "PREPARE");
+				xioctl(&cap, SNDRV_PCM_IOCTL_START, NULL,
+				       "START");
+				break;
+			}
+			if (!click_time)
+				continue;
+			for (i = 0; i < period * CHANNELS; i++)
+				if (frames_buf[i] > CLICK / 2)
+					break;
+			if (i == period * CHANNELS)
+				continue;
+			lat = now() - click_time;
+			lat_sum += lat;
+			if (lat > lat_max)
+				lat_max = lat;
+			clicks++;
+			click_time = 0;
+		}
+	}
+	t = now() - start;
+	cpu = cpu_now() - cpu;
+	woken = wakeups() - woken;
+
+	printf("%s, period %lu, status %s: %ld clicks, latency avg %.2fms "
+	       "max %.2fms, %.0f wakeups/s, cpu %.2f%%, %ld xruns\n",
+	       no_wakeup ? "no period wakeup" : "period wakeup", period,
+	       pb.mapped ? "mmapped" : "via SYNC_PTR", clicks,
+	       clicks ? lat_sum * 1e3 / clicks : 0.0, lat_max * 1e3,
+	       woken / t, cpu * 100 / t, xruns);
+
+	close(cap.fd);
+	close(pb.fd);
+	return clicks ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/*
+ * Malloc-style churn over an anonymous mapping, comparing the cost of
+ * handing memory back with MADV_DONTNEED and with MADV_FREE.
+ *
+ * Each round dirties every page of the buffer, "frees" it with the
+ * advice under test and starts over, the way an allocator recycles a
+ * large arena.  With MADV_DONTNEED every round refaults and zeroes all
+ * pages; with MADV_FREE they stay mapped unless reclaim took them.
+ *
+ * The test also checks MADV_FREE semantics: a page written after the
+ * advice must keep its new contents, and any page must read back either
+ * its old contents or zeroes.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../bench.h"
+
+#ifndef MADV_FREE
+#define MADV_FREE 8
+#endif
+
+#define LENGTH (64UL*1024*1024)
+#define ROUNDS 50
+
+static unsigned long pagesize;
+
+static void touch(char *addr, char val)
+{
+	unsigned long i;
+
+	for (i = 0; i < LENGTH; i += pagesize)
+		addr[i] = val;
+}
+
+static double churn(char *addr, int advice)
+{
+	double start = now();
+	int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		touch(addr, round + 1);
+		if (madvise(addr, LENGTH, advice)) {
+			perror("madvise");
+			exit(1);
+		}
+	}
+	return now() - start;
+}
+
+static int check(char *addr)
+{
+	unsigned long i;
+
+	touch(addr, 1);
+	if (madvise(addr, LENGTH, MADV_FREE)) {
+		perror("madvise");
+		return 1;
+	}
+
+	for (i = 0; i < LENGTH; i += pagesize) {
+		if (addr[i] != 1 && addr[i] != 0) {
+			printf("page %lu: stale value %d\n", i / pagesize, addr[i]);
+			return 1;
+		}
+	}
+
+	/* writes after MADV_FREE cancel it for that page */
+	touch(addr, 2);
+	for (i = 0; i < LENGTH; i += pagesize) {
+		if (addr[i] != 2) {
+			printf("page %lu: lost write, got %d\n",
+			       i / pagesize, addr[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	double dontneed, free;
+	char *addr;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	addr = mmap(NULL, LENGTH, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	if (madvise(addr, LENGTH, MADV_FREE)) {
+		perror("MADV_FREE not supported");
+		exit(1);
+	}
+
+	if (check(addr)) {
+		munmap(addr, LENGTH);
+		exit(1);
+	}
+
+	dontneed = churn(addr, MADV_DONTNEED);
+	free = churn(addr, MADV_FREE);
+	printf("%d rounds over %lu MB: MADV_DONTNEED %.3fs, MADV_FREE %.3fs\n",
+	       ROUNDS, LENGTH >> 20, dontneed, free);
+
+	munmap(addr, LENGTH);
+	return 0;
+}
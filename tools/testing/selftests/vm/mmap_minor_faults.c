@@ -0,0 +1,81 @@
+/*
+ * Count minor faults taken while touching every page of a large,
+ * fully cached file mapping, the way a loader walks a big .so or .odex.
+ *
+ * Without fault-around each page costs one minor fault.  With it, one
+ * fault maps up to fault_around_bytes worth of cached neighbours, which
+ * can be tuned through debugfs:
+ *
+ *	echo 4096 > /sys/kernel/debug/fault_around_bytes	(off)
+ *	echo 65536 > /sys/kernel/debug/fault_around_bytes	(default)
+ *
+ * Usage: mmap_minor_faults [file]  (default: ./mmap_minor_faults.data)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "../bench.h"
+
+#define LENGTH (128UL*1024*1024)
+
+static long minflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "./mmap_minor_faults.data";
+	unsigned long pagesize = sysconf(_SC_PAGESIZE);
+	unsigned long i, sum = 0;
+	static char buf[1 << 16];
+	long faults;
+	double start;
+	char *addr;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror("open");
+		exit(1);
+	}
+	unlink(path);
+
+	/* write the file out so that every page is cached and uptodate */
+	memset(buf, 0x5a, sizeof(buf));
+	for (i = 0; i < LENGTH; i += sizeof(buf)) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			exit(1);
+		}
+	}
+
+	addr = mmap(NULL, LENGTH, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	faults = minflt();
+	start = now();
+	for (i = 0; i < LENGTH; i += pagesize)
+		sum += addr[i];
+	start = now() - start;
+	faults = minflt() - faults;
+
+	printf("%lu pages: %ld minor faults (%.1f pages/fault), %.3fs\n",
+	       LENGTH / pagesize, faults,
+	       faults ? (double)(LENGTH / pagesize) / faults : 0.0, start);
+
+	munmap(addr, LENGTH);
+	close(fd);
+	return sum != 0x5a * (LENGTH / pagesize);
+}
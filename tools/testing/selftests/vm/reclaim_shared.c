@@ -0,0 +1,135 @@
+/*
+ * Reclaim throughput on a process whose threads run on every cpu,
+ * so that unmapping any of its pages means flushing remote TLBs.
+ *
+ * The threads keep reading a MAP_SHARED file mapping that is larger
+ * than the memory they may use, so reclaim has to unmap pages from
+ * under them all the time.  Run it under a memory limit:
+ *
+ *	mkdir /sys/fs/cgroup/memory/reclaim
+ *	echo 64M > /sys/fs/cgroup/memory/reclaim/memory.limit_in_bytes
+ *	echo $$ > /sys/fs/cgroup/memory/reclaim/tasks
+ *	./reclaim_shared 256
+ *
+ * It prints the pages reclaimed per second and, where reclaim batches
+ * its TLB flushes, how many per-page flushes that saved
+ * ("tlb_flush_avoided" in /proc/vmstat).
+ *
+ * run_vmtests runs it under a 64M memory cgroup limit.
+ *
+ * Usage: reclaim_shared [file MB] [file]  (default: 256 ./reclaim_shared.data)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "../bench.h"
+
+#define PASSES 3
+
+static unsigned long pagesize;
+static unsigned long length;
+static char *addr;
+
+static long vmstat(const char *prefix)
+{
+	char key[64];
+	long val, sum = 0;
+	int found = 0;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%63s %ld", key, &val) == 2) {
+		if (!strncmp(key, prefix, strlen(prefix))) {
+			sum += val;
+			found = 1;
+		}
+	}
+	fclose(f);
+	return found ? sum : -1;
+}
+
+static void *reader(void *arg)
+{
+	long cpu = *(long *)arg;
+	unsigned long i, nr = length / pagesize, sum = 0;
+	cpu_set_t set;
+	int pass;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	/* each thread walks the file with its own stride */
+	for (pass = 0; pass < PASSES; pass++)
+		for (i = 0; i < nr; i++)
+			sum += addr[((i * (2 * cpu + 1)) % nr) * pagesize];
+
+	return (void *)sum;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+	const char *path = argc > 2 ? argv[2] : "./reclaim_shared.data";
+	long steal, avoided, nr_cpus, i, *cpus;
+	static char buf[1 << 16];
+	double start;
+	int fd;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	length = mb << 20;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror("open");
+		exit(1);
+	}
+	unlink(path);
+	memset(buf, 0x5a, sizeof(buf));
+	for (i = 0; i < (long)length; i += sizeof(buf)) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			exit(1);
+		}
+	}
+
+	addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	cpus = calloc(nr_cpus, sizeof(*cpus));
+	if (!cpus) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_cpus; i++)
+		cpus[i] = i;
+
+	steal = vmstat("pgsteal");
+	avoided = vmstat("tlb_flush_avoided");
+	start = run_threads(nr_cpus, reader, cpus, sizeof(*cpus), 0, NULL);
+	steal = vmstat("pgsteal") - steal;
+
+	printf("%ld threads over %lu MB: %.3fs, %ld pages reclaimed "
+	       "(%.0f/s)", nr_cpus, mb, start, steal, steal / start);
+	if (avoided >= 0)
+		printf(", %ld TLB flushes avoided",
+		       vmstat("tlb_flush_avoided") - avoided);
+	printf("\n");
+
+	munmap(addr, length);
+	close(fd);
+	free(cpus);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Page fault throughput of a multithreaded process while one of its
+ * threads keeps mapping and unmapping memory, the way an app with a
+ * busy allocator or a JIT behaves.
+ *
+ * Each worker repeatedly faults in a private anonymous buffer and drops
+ * it with MADV_DONTNEED; a separate thread loops over mmap/munmap and
+ * holds mmap_sem for writing most of the time.  Without speculative
+ * page faults the workers queue behind it; with them, the first-touch
+ * faults are handled without mmap_sem.  Compare "pgfault_speculative"
+ * in /proc/vmstat before and after a run.
+ *
+ * Usage: spf_threads [nr_workers]  (default: 4)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "../bench.h"
+
+#define LENGTH (16UL*1024*1024)
+#define ROUNDS 40
+
+static unsigned long pagesize;
+static volatile int stop;
+
+static void *mapper(void *arg)
+{
+	(void)arg;
+	while (!stop) {
+		char *p = mmap(NULL, pagesize, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			continue;
+		munmap(p, pagesize);
+	}
+	return NULL;
+}
+
+static void *worker(void *arg)
+{
+	unsigned long i, *faults = arg;
+	int round;
+	char *addr;
+
+	addr = mmap(NULL, LENGTH, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < LENGTH; i += pagesize)
+			addr[i] = round + 1;
+		for (i = 0; i < LENGTH; i += pagesize) {
+			if (addr[i] != round + 1) {
+				printf("page %lu: got %d, expected %d\n",
+				       i / pagesize, addr[i], round + 1);
+				exit(1);
+			}
+		}
+		*faults += LENGTH / pagesize;
+		if (madvise(addr, LENGTH, MADV_DONTNEED)) {
+			perror("madvise");
+			exit(1);
+		}
+	}
+
+	munmap(addr, LENGTH);
+	return NULL;
+}
+
+static double run(int nr, int with_mapper, unsigned long *faults)
+{
+	pthread_t mapper_thread;
+	unsigned long *counts;
+	double t;
+	int i;
+
+	counts = calloc(nr, sizeof(*counts));
+	if (!counts) {
+		perror("calloc");
+		exit(1);
+	}
+
+	stop = 0;
+	if (with_mapper)
+		pthread_create(&mapper_thread, NULL, mapper, NULL);
+
+	/* the workers do a fixed amount of faulting, so no time limit */
+	t = run_threads(nr, worker, counts, sizeof(*counts), 0, NULL);
+	*faults = 0;
+	for (i = 0; i < nr; i++)
+		*faults += counts[i];
+
+	stop = 1;
+	if (with_mapper)
+		pthread_join(mapper_thread, NULL);
+
+	free(counts);
+	return t;
+}
+
+int main(int argc, char **argv)
+{
+	int nr = argc > 1 ? atoi(argv[1]) : 4;
+	unsigned long faults;
+	double quiet, busy;
+
+	if (nr < 1)
+		nr = 1;
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	quiet = run(nr, 0, &faults);
+	printf("%d workers, idle mm:     %lu faults in %.3fs (%.0f/s)\n",
+	       nr, faults, quiet, faults / quiet);
+	busy = run(nr, 1, &faults);
+	printf("%d workers, mmap/munmap: %lu faults in %.3fs (%.0f/s)\n",
+	       nr, faults, busy, faults / busy);
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * stat() throughput on many cpus while the dentry and inode caches are
+ * being shrunk, the way a busy file server looks under memory pressure.
+ *
+ * One thread per cpu stats every file of a tree, each starting in a
+ * different directory, over and over.  Meanwhile, if run as root, a
+ * separate thread writes 2 to /proc/sys/vm/drop_caches every 100ms, so
+ * that the dcache and icache shrinkers keep walking the LRUs that the
+ * stat()ing threads keep putting dentries and inodes back on.
+ *
+ * With one LRU and one lock per superblock (one lock for all dentry
+ * LRUs, even), the shrinkers and every dput()/iput() contend on it;
+ * with the LRUs split into per-cpu lists, much less.
+ *
+ *	./stat_storm /mnt/scratch 20000
+ *
+ * run_vmtests runs it with 2000 files per thread for 5 seconds, in a
+ * scratch directory of its own.
+ *
+ * Usage: stat_storm [dir] [files per thread] [seconds]  (default: . 10000 10)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../bench.h"
+
+static const char *base;
+static long nr_files, nr_threads;
+static volatile int stop;
+
+struct worker {
+	long first;		/* directory to start in */
+	unsigned long count;
+};
+
+static void *stater(void *arg)
+{
+	struct worker *w = arg;
+	char path[4096];
+	struct stat st;
+	long d, i;
+
+	for (d = w->first; !stop; d = (d + 1) % nr_threads) {
+		for (i = 0; i < nr_files && !stop; i++) {
+			snprintf(path, sizeof(path), "%s/stat_storm.%ld/%ld",
+				 base, d, i);
+			if (stat(path, &st)) {
+				perror(path);
+				exit(1);
+			}
+		}
+		w->count += i;
+	}
+	return NULL;
+}
+
+static void *dropper(void *arg)
+{
+	int fd = *(int *)arg;
+
+	while (!stop) {
+		if (pwrite(fd, "2", 1, 0) != 1) {
+			perror("drop_caches");
+			exit(1);
+		}
+		usleep(100000);
+	}
+	return NULL;
+}
+
+static void make_tree(int create)
+{
+	char path[4096];
+	long d, i;
+	int fd;
+
+	for (d = 0; d < nr_threads; d++) {
+		snprintf(path, sizeof(path), "%s/stat_storm.%ld", base, d);
+		if (create && mkdir(path, 0700)) {
+			perror(path);
+			exit(1);
+		}
+		for (i = 0; i < nr_files; i++) {
+			snprintf(path, sizeof(path), "%s/stat_storm.%ld/%ld",
+				 base, d, i);
+			if (!create) {
+				unlink(path);
+				continue;
+			}
+			fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+			if (fd < 0) {
+				perror(path);
+				exit(1);
+			}
+			close(fd);
+		}
+		if (!create) {
+			snprintf(path, sizeof(path), "%s/stat_storm.%ld",
+				 base, d);
+			rmdir(path);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int seconds, drop_fd;
+	unsigned long total = 0;
+	struct worker *workers;
+	pthread_t drop_thread;
+	double start;
+	long i;
+
+	base = argc > 1 ? argv[1] : ".";
+	nr_files = argc > 2 ? strtol(argv[2], NULL, 0) : 10000;
+	seconds = argc > 3 ? atoi(argv[3]) : 10;
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_files < 1)
+		nr_files = 1;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		exit(1);
+	}
+
+	make_tree(1);
+
+	drop_fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (drop_fd < 0)
+		printf("not dropping caches: %m\n");
+	else
+		pthread_create(&drop_thread, NULL, dropper, &drop_fd);
+
+	for (i = 0; i < nr_threads; i++)
+		workers[i].first = i;
+	start = run_threads(nr_threads, stater, workers, sizeof(*workers),
+			    seconds, &stop);
+	for (i = 0; i < nr_threads; i++)
+		total += workers[i].count;
+	/* stop is set now, so the dropper returns too */
+	if (drop_fd >= 0) {
+		pthread_join(drop_thread, NULL);
+		close(drop_fd);
+	}
+
+	printf("%ld threads x %ld files: %lu stats in %.3fs (%.0f/s)%s\n",
+	       nr_threads, nr_files, total, start, total / start,
+	       drop_fd >= 0 ? ", dropping caches" : "");
+
+	make_tree(0);
+	free(workers);
+	return 0;
+}
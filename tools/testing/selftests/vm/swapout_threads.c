@@ -0,0 +1,120 @@
+/*
+ * Multi-threaded swap-out throughput, meant to be run against zram:
+ *
+ *	echo $((512 << 20)) > /sys/block/zram0/disksize
+ *	mkswap /dev/zram0 && swapon /dev/zram0
+ *	mkdir /sys/fs/cgroup/memory/swapout
+ *	echo 64M > /sys/fs/cgroup/memory/swapout/memory.limit_in_bytes
+ *	echo $$ > /sys/fs/cgroup/memory/swapout/tasks
+ *	./swapout_threads 4 96
+ *
+ * Each thread dirties its own anonymous buffer and then keeps walking
+ * it, so that with memory limited the threads push pages out to swap
+ * and fault them back in concurrently.  Every slot allocation and free
+ * used to take swap_lock; with per-cpu slot caches and cluster
+ * allocation they mostly don't, which shows as more pages per second
+ * here, and keeps showing once the swap device is nearly full.
+ *
+ * run_vmtests runs it under a 64M memory cgroup limit, when swap is on.
+ *
+ * Usage: swapout_threads [nr_threads] [MB per thread]  (default: 4 64)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../bench.h"
+
+#define PASSES 4
+
+static unsigned long pagesize;
+static unsigned long length;
+
+static long vmstat(const char *name)
+{
+	char key[64];
+	long val, ret = -1;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%63s %ld", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void *worker(void *arg)
+{
+	unsigned long i, seed = *(unsigned long *)arg;
+	int pass;
+	char *addr;
+
+	addr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	for (pass = 0; pass < PASSES; pass++) {
+		for (i = 0; i < length; i += pagesize) {
+			char val = (char)(seed + i / pagesize + pass);
+
+			if (pass && addr[i] != (char)(val - 1)) {
+				printf("page %lu: got %d, expected %d\n",
+				       i / pagesize, addr[i], val - 1);
+				exit(1);
+			}
+			addr[i] = val;
+		}
+	}
+
+	munmap(addr, length);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int nr = argc > 1 ? atoi(argv[1]) : 4;
+	unsigned long mb = argc > 2 ? strtoul(argv[2], NULL, 0) : 64;
+	long pswpout, pswpin;
+	unsigned long *seeds;
+	double start;
+	int i;
+
+	if (nr < 1)
+		nr = 1;
+	pagesize = sysconf(_SC_PAGESIZE);
+	length = mb << 20;
+
+	seeds = calloc(nr, sizeof(*seeds));
+	if (!seeds) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr; i++)
+		seeds[i] = i * 131;
+
+	pswpout = vmstat("pswpout");
+	pswpin = vmstat("pswpin");
+	start = run_threads(nr, worker, seeds, sizeof(*seeds), 0, NULL);
+	pswpout = vmstat("pswpout") - pswpout;
+	pswpin = vmstat("pswpin") - pswpin;
+
+	printf("%d threads x %lu MB: %.3fs, %ld pages out, %ld in "
+	       "(%.0f swapped pages/s)\n", nr, mb, start, pswpout, pswpin,
+	       (pswpout + pswpin) / start);
+	if (!pswpout)
+		printf("no swap-out happened: is swap on and memory limited?\n");
+
+	free(seeds);
+	return 0;
+}
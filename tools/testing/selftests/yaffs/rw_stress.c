@@ -0,0 +1,243 @@
+/*
+ * Readers against writers on one yaffs2 file system, e.g. on nandsim
+ * (see write_latency.c for the setup):
+ *
+ *	./rw_stress /mnt 4 4 30
+ *
+ * Reader threads look up, stat and read back files that were written
+ * once at the start, and check their contents, while writer threads
+ * keep rewriting and fsync()ing files of their own, so that garbage
+ * collection keeps moving the chunks the readers are reading.  The
+ * readers drop the page cache for each file first, so that every read
+ * goes through yaffs.
+ *
+ * Any read that returns the wrong data fails the test.  The read
+ * latency percentiles show how long readers wait behind writers and
+ * gc; they are the number to compare across locking changes.
+ *
+ * Usage: rw_stress <dir> [readers] [writers] [seconds]  (default: 4 4 30)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../bench.h"
+
+#define CHUNK_SIZE	4096
+#define FILE_SIZE	(64 * 1024)
+#define RO_FILES	16
+#define MAX_SAMPLES	(1 << 18)
+
+struct worker {
+	const char *dir;
+	int id;
+	unsigned int seed;
+	long errors;
+	int n;
+	double *lat;
+};
+
+static volatile int stop;
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Every word of a read-only file holds its file number and offset */
+static void fill(unsigned int *buf, int file, int off)
+{
+	int i;
+
+	for (i = 0; i < CHUNK_SIZE / 4; i++)
+		buf[i] = (file << 20) ^ (off + i * 4);
+}
+
+static void *reader(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int buf[CHUNK_SIZE / 4], want[CHUNK_SIZE / 4];
+	char path[4096];
+	struct stat st;
+
+	while (!stop) {
+		int file = rand_r(&w->seed) % RO_FILES;
+		int fd, off;
+		double t;
+
+		snprintf(path, sizeof(path), "%s/rws.ro.%d", w->dir, file);
+		t = now();
+		fd = open(path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) || st.st_size != FILE_SIZE) {
+			fprintf(stderr, "%s: missing or short\n", path);
+			w->errors++;
+			if (fd >= 0)
+				close(fd);
+			continue;
+		}
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		for (off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+			if (pread(fd, buf, CHUNK_SIZE, off) != CHUNK_SIZE) {
+				perror("pread");
+				w->errors++;
+				break;
+			}
+			fill(want, file, off);
+			if (memcmp(buf, want, CHUNK_SIZE)) {
+				fprintf(stderr, "%s: bad data at %d\n",
+					path, off);
+				w->errors++;
+			}
+		}
+		close(fd);
+		if (w->n < MAX_SAMPLES)
+			w->lat[w->n++] = (now() - t) * 1e3;
+	}
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct worker *w = arg;
+	char buf[CHUNK_SIZE], path[4096], tmp[4096];
+
+	snprintf(path, sizeof(path), "%s/rws.rw.%d", w->dir, w->id);
+	snprintf(tmp, sizeof(tmp), "%s/rws.rw.%d.tmp", w->dir, w->id);
+	while (!stop) {
+		int fd, off;
+
+		/* Rewrite in place, then replace the file as a whole */
+		fd = open(path, O_RDWR | O_CREAT, 0600);
+		if (fd < 0) {
+			perror("open");
+			w->errors++;
+			return NULL;
+		}
+		for (off = 0; off < FILE_SIZE && !stop; off += CHUNK_SIZE) {
+			memset(buf, rand_r(&w->seed), sizeof(buf));
+			if (pwrite(fd, buf, CHUNK_SIZE, off) != CHUNK_SIZE ||
+			    fsync(fd)) {
+				perror("pwrite");
+				w->errors++;
+				break;
+			}
+			w->n++;
+		}
+		close(fd);
+
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0 || write(fd, buf, CHUNK_SIZE) != CHUNK_SIZE ||
+		    fsync(fd) || rename(tmp, path)) {
+			perror(tmp);
+			w->errors++;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+	return NULL;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+
+	return w->lat ? reader(w) : writer(w);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = argc > 1 ? argv[1] : NULL;
+	int readers = argc > 2 ? atoi(argv[2]) : 4;
+	int writers = argc > 3 ? atoi(argv[3]) : 4;
+	int seconds = argc > 4 ? atoi(argv[4]) : 30;
+	unsigned int buf[CHUNK_SIZE / 4];
+	char path[4096];
+	struct worker *w;
+	double *lat;
+	long errors = 0, writes = 0;
+	int i, off, n = 0;
+
+	if (!dir || readers < 1 || writers < 0 || seconds < 1) {
+		fprintf(stderr,
+			"usage: %s <dir> [readers] [writers] [seconds]\n",
+			argv[0]);
+		exit(1);
+	}
+
+	for (i = 0; i < RO_FILES; i++) {
+		int fd;
+
+		snprintf(path, sizeof(path), "%s/rws.ro.%d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			perror("open");
+			exit(1);
+		}
+		for (off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+			fill(buf, i, off);
+			if (write(fd, buf, CHUNK_SIZE) != CHUNK_SIZE) {
+				perror("write");
+				exit(1);
+			}
+		}
+		fsync(fd);
+		close(fd);
+	}
+
+	w = calloc(readers + writers, sizeof(*w));
+	lat = calloc((size_t)readers * MAX_SAMPLES, sizeof(*lat));
+	if (!w || !lat) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < readers + writers; i++) {
+		w[i].dir = dir;
+		w[i].id = i;
+		w[i].seed = i + 1;
+		if (i < readers)
+			w[i].lat = lat + (size_t)i * MAX_SAMPLES;
+	}
+
+	run_threads(readers + writers, worker, w, sizeof(*w), seconds, &stop);
+
+	for (i = 0; i < readers + writers; i++) {
+		errors += w[i].errors;
+		if (i < readers) {
+			memmove(lat + n, w[i].lat, w[i].n * sizeof(*lat));
+			n += w[i].n;
+		} else {
+			writes += w[i].n;
+		}
+	}
+
+	printf("%d readers, %d writers, %ds: %d file reads, %ld chunk writes\n",
+	       readers, writers, seconds, n, writes);
+	if (n) {
+		qsort(lat, n, sizeof(lat[0]), cmp_double);
+		printf("read ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+		       lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100],
+		       lat[n - 1]);
+	}
+
+	for (i = 0; i < RO_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/rws.ro.%d", dir, i);
+		unlink(path);
+	}
+	for (i = readers; i < readers + writers; i++) {
+		snprintf(path, sizeof(path), "%s/rws.rw.%d", dir, i);
+		unlink(path);
+	}
+
+	if (errors || !n) {
+		printf("rw_stress: %ld errors [FAIL]\n", errors);
+		return 1;
+	}
+	printf("rw_stress: [PASS]\n");
+	return 0;
+}
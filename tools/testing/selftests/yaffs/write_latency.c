@@ -0,0 +1,143 @@
+/*
+ * Write latency percentiles on a yaffs2 file system that is kept busy
+ * with garbage collection, e.g. on nandsim:
+ *
+ *	modprobe nandsim first_id_byte=0x20 second_id_byte=0xaa \
+ *		third_id_byte=0x00 fourth_id_byte=0x15
+ *	mount -t yaffs2 /dev/mtdblock0 /mnt
+ *	./write_latency /mnt 70
+ *
+ * The file system is first filled to the given percentage with files,
+ * which are then rewritten chunk by chunk in random order, so that the
+ * flash is soon full of partly dirty blocks and every allocation has to
+ * wait for some to be collected.  Each write is fsync()ed, so that it
+ * reaches yaffs rather than sitting in the page cache, and timed.
+ *
+ * Writes that collect garbage inline show up as the long tail; with a
+ * background thread doing the collecting, the tail shrinks.  The gc
+ * counters from /proc/yaffs are printed at the end.
+ *
+ * Usage: write_latency <dir> [fill %] [seconds]  (default: 70 20)
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/statvfs.h>
+
+#include "../bench.h"
+
+#define WRITE_SIZE	4096
+#define FILE_SIZE	(256 * 1024)
+#define MAX_FILES	4096
+#define MAX_SAMPLES	(1 << 20)
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_gc_stats(void)
+{
+	char line[128];
+	FILE *f;
+
+	f = fopen("/proc/yaffs", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "Device", 6) || strstr(line, "gc"))
+			fputs(line, stdout);
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = argc > 1 ? argv[1] : NULL;
+	int fill = argc > 2 ? atoi(argv[2]) : 70;
+	double seconds = argc > 3 ? atof(argv[3]) : 20;
+	static char buf[WRITE_SIZE];
+	static double lat[MAX_SAMPLES];
+	char path[4096];
+	struct statvfs st;
+	int fds[MAX_FILES];
+	int nr_files, i, n = 0;
+	double end, t;
+
+	if (!dir) {
+		fprintf(stderr, "usage: %s <dir> [fill %%] [seconds]\n",
+			argv[0]);
+		exit(1);
+	}
+	if (statvfs(dir, &st)) {
+		perror("statvfs");
+		exit(1);
+	}
+
+	nr_files = (double)st.f_bavail * st.f_frsize * fill / 100 / FILE_SIZE;
+	if (nr_files > MAX_FILES)
+		nr_files = MAX_FILES;
+	if (nr_files < 1) {
+		fprintf(stderr, "%s: not enough space\n", dir);
+		exit(1);
+	}
+
+	memset(buf, 0x5a, sizeof(buf));
+	for (i = 0; i < nr_files; i++) {
+		int off;
+
+		snprintf(path, sizeof(path), "%s/wlat.%d", dir, i);
+		fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fds[i] < 0) {
+			perror("open");
+			exit(1);
+		}
+		for (off = 0; off < FILE_SIZE; off += WRITE_SIZE) {
+			if (write(fds[i], buf, WRITE_SIZE) != WRITE_SIZE) {
+				perror("write");
+				exit(1);
+			}
+		}
+		fsync(fds[i]);
+	}
+
+	srand(1);
+	end = now() + seconds;
+	while (n < MAX_SAMPLES && (t = now()) < end) {
+		int fd = fds[rand() % nr_files];
+		off_t off = (off_t)(rand() % (FILE_SIZE / WRITE_SIZE)) *
+			    WRITE_SIZE;
+
+		buf[0]++;
+		if (pwrite(fd, buf, WRITE_SIZE, off) != WRITE_SIZE ||
+		    fsync(fd)) {
+			perror("pwrite");
+			exit(1);
+		}
+		lat[n++] = (now() - t) * 1e3;
+	}
+
+	if (!n) {
+		fprintf(stderr, "no writes timed\n");
+		exit(1);
+	}
+	qsort(lat, n, sizeof(lat[0]), cmp_double);
+	printf("%d files, %d writes of %d bytes in %.0fs\n",
+	       nr_files, n, WRITE_SIZE, seconds);
+	printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+	       lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100],
+	       lat[n * 999 / 1000], lat[n - 1]);
+	print_gc_stats();
+
+	for (i = 0; i < nr_files; i++) {
+		close(fds[i]);
+		snprintf(path, sizeof(path), "%s/wlat.%d", dir, i);
+		unlink(path);
+	}
+	return 0;
+}
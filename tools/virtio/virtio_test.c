@@ -10,6 +10,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <time.h>
 #include <linux/vhost.h>
 #include <linux/virtio.h>
 #include <linux/virtio_ring.h>
@@ -151,9 +152,12 @@ static void run_test(struct vdev_info *dev, struct vq_info *vq, int bufs)
 	long completed_before;
 	int r, test = 1;
 	unsigned len;
-	long long spurious = 0;
+	long long spurious = 0, interrupts = 0;
+	struct timespec start, end;
+	double t;
 	r = ioctl(dev->control, VHOST_TEST_RUN, &test);
 	assert(r >= 0);
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	for (;;) {
 		virtqueue_disable_cb(vq->vq);
 		completed_before = completed;
@@ -185,12 +189,17 @@ static void run_test(struct vdev_info *dev, struct vq_info *vq, int bufs)
 			break;
 		if (virtqueue_enable_cb(vq->vq)) {
 			wait_for_interrupt(dev);
+			++interrupts;
 		}
 	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
 	test = 0;
 	r = ioctl(dev->control, VHOST_TEST_RUN, &test);
 	assert(r >= 0);
+	t = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
 	fprintf(stderr, "spurious wakeus: 0x%llx\n", spurious);
+	fprintf(stderr, "%d bufs in %.3fs (%.0f/s), %lld interrupts\n",
+		bufs, t, bufs / t, interrupts);
 }
 
 const char optstring[] = "h";